@@ -1,16 +1,118 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <stdint.h>
 #include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
 #include "../../lib/include/net.h"
 #include "../../lib/include/util.h"
+#include "../../lib/include/rga.h"
 
 static void print_client_usage(const char *prog) {
     printf("Usage: %s --nm-ip IP --nm-port PORT [--username NAME] [--client-port PORT] [--bind-ip IP] [--verbose]\n", prog);
     printf("Defaults: nm-ip=127.0.0.1, nm-port=8000\n");
 }
 
+// READ payload chunks go straight to stdout; ctx remembers the last byte
+static int stdout_sink(void *ctx, const char *data, int len) {
+    if (len <= 0) return 0;
+    fwrite(data, 1, len, stdout);
+    *(char*)ctx = data[len - 1];
+    return 0;
+}
+
+// An "OP <file> <op>" line from a live session goes into the replica.
+// Returns 1 if line was one.
+static int live_apply(Rga *doc, const char *line) {
+    if (strncmp(line, "OP ", 3) != 0) return 0;
+    const char *op = strchr(line + 3, ' ');
+    if (!op || rga_apply(doc, op + 1) != 0) printf("ERR live copy out of sync\n");
+    return 1;
+}
+
+static void live_print(Rga *doc, const char *prefix) {
+    int len = 0;
+    char *text = rga_text(doc, &len);
+    printf("%s%s\n", prefix, text ? text : "");
+    free(text);
+}
+
+// LIVE <file>: edit alongside everyone else in the file's live session.
+// The SS sends every edit (ours included) as operations, which keep a
+// local replica current; it is printed after each batch.
+static void live_session(const char *ip, uint16_t port, const char *fname) {
+    int sfd = net_connect(ip, port);
+    if (sfd < 0) { printf("ERR connect SS\n"); return; }
+    NetConn *sc = net_conn_open(sfd);
+    if (!sc) { net_close(sfd); printf("ERR out of memory\n"); return; }
+    Rga *doc = rga_create(NULL, 0);
+    char *line;
+    char cmd[1200];
+    int live = 0;
+    if (doc && net_conn_next_line(sc, &line) > 0) {
+        snprintf(cmd, sizeof(cmd), "COLLAB_JOIN %s", fname);
+        net_send_line(sfd, cmd);
+        // The document so far arrives as operations, then the reply
+        while (net_conn_next_line(sc, &line) > 0) {
+            if (live_apply(doc, line)) continue;
+            if (strncmp(line, "OK", 2) == 0) live = 1;
+            else printf("%s\n", line);
+            break;
+        }
+    } else if (!doc) printf("ERR out of memory\n");
+    else printf("ERR no response\n");
+    if (!live) { rga_free(doc); net_conn_close(sc); return; }
+    live_print(doc, "");
+    printf("Enter '<sentence_index> <word_index> <content>' lines, SHOW, SAVE, end with 'EVIL'\n");
+    int changed = 0, lost = 0;
+    while (1) {
+        struct pollfd pfd[2] = { { 0, POLLIN, 0 }, { sfd, POLLIN, 0 } };
+        if (net_conn_pending(sc) == 0 && poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (net_conn_pending(sc) > 0 || pfd[1].revents) {
+            if (net_conn_next_line(sc, &line) <= 0) { printf("ERR connection to SS lost\n"); lost = 1; break; }
+            if (live_apply(doc, line)) changed = 1;
+            else printf("%s\n", line);
+            if (changed && net_conn_pending(sc) == 0) { live_print(doc, "[live] "); changed = 0; }
+            continue;
+        }
+        if (!pfd[0].revents) continue;
+        char ln[1024];
+        if (!fgets(ln, sizeof(ln), stdin)) break;
+        ln[strcspn(ln, "\r\n")] = 0;
+        if (ln[0] == '\0') continue;
+        if (strcasecmp(ln, "EVIL") == 0) break;
+        if (strcasecmp(ln, "SHOW") == 0) { live_print(doc, ""); continue; }
+        if (strcasecmp(ln, "SAVE") == 0) {
+            snprintf(cmd, sizeof(cmd), "COLLAB_SAVE %s", fname);
+            net_send_line(sfd, cmd);
+            continue;
+        }
+        int sidx, widx; char content[900];
+        if (sscanf(ln, "%d %d %899[\x20-\x7E]", &sidx, &widx, content) < 3) { printf("ERR format: <sentence_index> <word_index> <content>\n"); continue; }
+        snprintf(cmd, sizeof(cmd), "COLLAB_UPDATE %s %d %d %s", fname, sidx, widx, content);
+        net_send_line(sfd, cmd);
+    }
+    if (!lost) {
+        snprintf(cmd, sizeof(cmd), "COLLAB_LEAVE %s", fname);
+        net_send_line(sfd, cmd);
+        while (net_conn_next_line(sc, &line) > 0) {
+            if (live_apply(doc, line)) continue;
+            printf("%s\n", line);
+            if (strncmp(line, "OK", 2) == 0 || strncmp(line, "ERR", 3) == 0) break;
+        }
+        net_send_line(sfd, "QUIT");
+        net_conn_next_line(sc, &line);
+    }
+    rga_free(doc);
+    net_conn_close(sc);
+}
+
 int main(int argc, char **argv) {
     char nm_ip[64] = "127.0.0.1";
     uint16_t nm_port = 8000;
@@ -56,6 +158,8 @@ int main(int argc, char **argv) {
     }
 
     net_set_verbose(verbose);
+    // LIVE polls stdin alongside the SS, so nothing may sit in a stdio buffer
+    setvbuf(stdin, NULL, _IONBF, 0);
     if (username[0]) {
         printf("Client will connect to NM at %s:%u as '%s'\n", nm_ip, nm_port, username);
     } else {
@@ -69,13 +173,15 @@ int main(int argc, char **argv) {
     }
     int fd = net_connect_ex(nm_ip, nm_port, bind_ptr, client_port);
     if (fd < 0) { fprintf(stderr, "Cannot connect to NM\n"); return 1; }
+    NetConn *nmc = net_conn_open(fd);
+    if (!nmc) { fprintf(stderr, "Out of memory\n"); net_close(fd); return 1; }
     char local_ip[64] = "";
     uint16_t local_port = 0;
     if (net_get_local_addr(fd, local_ip, sizeof(local_ip), &local_port) == 0 && local_port != 0) {
         printf("Client local endpoint %s:%u\n", local_ip[0] ? local_ip : "0.0.0.0", local_port);
     }
     char buf[1024];
-    if (net_recv_line(fd, buf, sizeof(buf)) > 0) printf("%s\n", buf);
+    if (net_conn_recv_line(nmc, buf, sizeof(buf)) > 0) printf("%s\n", buf);
     // Prompt username
     if (username[0] == '\0') {
         printf("username> "); fflush(stdout);
@@ -84,7 +190,7 @@ int main(int argc, char **argv) {
     }
     char login[256]; snprintf(login, sizeof(login), "LOGIN %s %u", username, (unsigned)(local_port ? local_port : client_port));
     net_send_line(fd, login);
-    if (net_recv_line(fd, buf, sizeof(buf)) > 0) printf("%s\n", buf);
+    if (net_conn_recv_line(nmc, buf, sizeof(buf)) > 0) printf("%s\n", buf);
     while (1) {
         printf("> "); fflush(stdout);
         if (!fgets(buf, sizeof(buf), stdin)) break;
@@ -93,7 +199,7 @@ int main(int argc, char **argv) {
         net_send_line(fd, buf);
         if (strncmp(buf, "READ ", 5)==0 || strncmp(buf, "STREAM ", 7)==0) {
     char resp[256]; 
-    if (net_recv_line(fd, resp, sizeof(resp)) <= 0) { 
+    if (net_conn_recv_line(nmc, resp, sizeof(resp)) <= 0) { 
         printf("<no response>\n"); 
         continue; 
     }
@@ -114,29 +220,45 @@ int main(int argc, char **argv) {
             printf("ERR: cannot connect to SS\n"); 
             continue; 
         }
+        NetConn *sc = net_conn_open(sfd);
+        if (!sc) { net_close(sfd); printf("ERR: out of memory\n"); continue; }
         
         // Receive welcome message from SS
         char welcome[256]; 
-        net_recv_line(sfd, welcome, sizeof(welcome));
+        net_conn_recv_line(sc, welcome, sizeof(welcome));
+        // READ payloads come back as one binary frame when the SS supports it
+        // (an SS without HELLO just answers ERR and stays in line mode)
+        int frames = 0;
+        if (strncmp(buf, "READ ", 5) == 0) frames = net_hello(sc, 1) == 1;
         
         // Send READ or STREAM command to SS
         net_send_line(sfd, buf);
         
         // Receive response from SS
         char ss_resp[1024];
-        if (net_recv_line(sfd, ss_resp, sizeof(ss_resp)) <= 0) {
+        if (net_conn_recv_line(sc, ss_resp, sizeof(ss_resp)) <= 0) {
             printf("ERR: no response from SS\n");
-            net_close(sfd);
+            net_conn_close(sc);
             continue;
         }
         
         // Check SS response
         if (strncmp(ss_resp, "OK", 2) == 0) {
             // For READ: receive all content until END or empty line
-            if (strncmp(buf, "READ ", 5) == 0) {
+            if (strncmp(buf, "READ ", 5) == 0 && frames) {
+                // Written out as it arrives; large files are never held in memory
+                char last = '\n';
+                long long total = 0;
+                if (net_conn_recv_payload_stream(sc, stdout_sink, &last, &total) != 0) {
+                    printf("\nERR: transfer from SS interrupted\n");
+                } else if (total > 0 && last != '\n') {
+                    printf("\n");
+                }
+            }
+            else if (strncmp(buf, "READ ", 5) == 0) {
                 while (1) {
-                    char content[4096];
-                    int n = net_recv_line(sfd, content, sizeof(content));
+                    char *content;
+                    int n = net_conn_next_line(sc, &content);
                     if (n <= 0) break;  // Connection closed
                     if (strcmp(content, "END") == 0) break;  // End marker
                     printf("%s\n", content);
@@ -146,7 +268,7 @@ int main(int argc, char **argv) {
             else {
                 while (1) {
                     char word[1024];
-                    int n = net_recv_line(sfd, word, sizeof(word));
+                    int n = net_conn_recv_line(sc, word, sizeof(word));
                     if (n <= 0) break;
                     if (strcmp(word, "STOP") == 0 || strcmp(word, "END") == 0) break;
                     printf("%s ", word);
@@ -161,8 +283,8 @@ int main(int argc, char **argv) {
         
         // Close SS connection
         net_send_line(sfd, "QUIT");
-        net_recv_line(sfd, welcome, sizeof(welcome));
-        net_close(sfd);
+        net_conn_recv_line(sc, welcome, sizeof(welcome));
+        net_conn_close(sc);
     } else {
         // Unexpected response from NM
         printf("%s\n", resp);
@@ -170,7 +292,7 @@ int main(int argc, char **argv) {
 
         } else if (strncmp(buf, "WRITE ", 6)==0) {
             // Step 1: ask NM for SS address
-            char nmresp[256]; if (net_recv_line(fd, nmresp, sizeof(nmresp)) <= 0) { printf("<no response>\n"); continue; }
+            char nmresp[256]; if (net_conn_recv_line(nmc, nmresp, sizeof(nmresp)) <= 0) { printf("<no response>\n"); continue; }
             // Check for error response from NM
             if (strncmp(nmresp, "ERR", 3)==0) { printf("%s\n", nmresp); continue; }
             // printf("%s\n", nmresp);
@@ -178,13 +300,18 @@ int main(int argc, char **argv) {
             char ip[64]; unsigned port; sscanf(nmresp+3, "%63s %u", ip, &port);
             int sfd = net_connect(ip, (uint16_t)port);
             if (sfd<0){ printf("ERR connect SS\n"); continue; }
-            char welcome[256]; if (net_recv_line(sfd, welcome, sizeof(welcome))>0) {}
+            NetConn *sc = net_conn_open(sfd);
+            if (!sc) { net_close(sfd); printf("ERR out of memory\n"); continue; }
+            char welcome[256]; if (net_conn_recv_line(sc, welcome, sizeof(welcome))>0) {}
             // parse filename and sentence index to send WRITE_BEGIN
-            char fname[256]; int sidx=-1; if (sscanf(buf+6, "%255s %d", fname, &sidx) < 2) { printf("ERR bad args\n"); net_close(sfd); continue; }
-            char cmd[512]; snprintf(cmd, sizeof(cmd), "WRITE_BEGIN %s %d", fname, sidx);
+            // WRITE <file> <sentence> [WAIT <ms>] queues for a locked sentence
+            char fname[256]; int sidx=-1, wait_ms=0; if (sscanf(buf+6, "%255s %d WAIT %d", fname, &sidx, &wait_ms) < 2) { printf("ERR bad args\n"); net_conn_close(sc); continue; }
+            char cmd[512];
+            if (wait_ms > 0) snprintf(cmd, sizeof(cmd), "WRITE_BEGIN %s %d WAIT %d", fname, sidx, wait_ms);
+            else snprintf(cmd, sizeof(cmd), "WRITE_BEGIN %s %d", fname, sidx);
             net_send_line(sfd, cmd);
-            char sresp[256]; if (net_recv_line(sfd, sresp, sizeof(sresp))<=0) { printf("ERR no response\n"); net_close(sfd); continue; }
-            if (strncmp(sresp, "OK", 2)!=0) { printf("%s\n", sresp); net_close(sfd); continue; }
+            char sresp[256]; if (net_conn_recv_line(sc, sresp, sizeof(sresp))<=0) { printf("ERR no response\n"); net_conn_close(sc); continue; }
+            if (strncmp(sresp, "OK", 2)!=0) { printf("%s\n", sresp); net_conn_close(sc); continue; }
             // Parse lock response: "OK lock <filename> <sentence_index>"
             char lock_fname[256]; int lock_sidx=-1;
             if (sscanf(sresp, "OK lock %255s %d", lock_fname, &lock_sidx) >= 2) {
@@ -210,10 +337,10 @@ int main(int argc, char **argv) {
                     // Break out and send the command to NM instead
                     char end_cmd[512]; snprintf(end_cmd, sizeof(end_cmd), "WRITE_END %s %d", fname, sidx);
                     net_send_line(sfd, end_cmd);
-                    net_recv_line(sfd, sresp, sizeof(sresp));
+                    net_conn_recv_line(sc, sresp, sizeof(sresp));
                     net_send_line(sfd, "QUIT");
-                    net_recv_line(sfd, welcome, sizeof(welcome));
-                    net_close(sfd);
+                    net_conn_recv_line(sc, welcome, sizeof(welcome));
+                    net_conn_close(sc);
                     // Now send to NM
                     net_send_line(fd, ln);
                     goto handle_normal;
@@ -223,11 +350,18 @@ int main(int argc, char **argv) {
                 // Include filename and sentence index in WRITE_UPDATE
                 char ucmd[1024]; snprintf(ucmd, sizeof(ucmd), "WRITE_UPDATE %s %d %d %s", fname, sidx, widx, content);
                 net_send_line(sfd, ucmd);
-                if (net_recv_line(sfd, sresp, sizeof(sresp))>0) printf("%s\n", sresp);
+                if (net_conn_recv_line(sc, sresp, sizeof(sresp))>0) printf("%s\n", sresp);
             }
             char end_cmd[512]; snprintf(end_cmd, sizeof(end_cmd), "WRITE_END %s %d", fname, sidx);
-            net_send_line(sfd, end_cmd); if (net_recv_line(sfd, sresp, sizeof(sresp))>0) printf("%s\n", sresp);
-            net_send_line(sfd, "QUIT"); net_recv_line(sfd, welcome, sizeof(welcome)); net_close(sfd);
+            net_send_line(sfd, end_cmd); if (net_conn_recv_line(sc, sresp, sizeof(sresp))>0) printf("%s\n", sresp);
+            net_send_line(sfd, "QUIT"); net_conn_recv_line(sc, welcome, sizeof(welcome)); net_conn_close(sc);
+            continue;
+        } else if (strncmp(buf, "LIVE ", 5)==0) {
+            char nmresp[256]; if (net_conn_recv_line(nmc, nmresp, sizeof(nmresp)) <= 0) { printf("<no response>\n"); continue; }
+            if (strncmp(nmresp, "SS ", 3)!=0) { printf("%s\n", nmresp); continue; }
+            char ip[64]; unsigned port; char fname[256];
+            if (sscanf(nmresp+3, "%63s %u", ip, &port) < 2 || sscanf(buf+5, "%255s", fname) < 1) { printf("ERR bad args\n"); continue; }
+            live_session(ip, (uint16_t)port, fname);
             continue;
         } else {
             handle_normal:
@@ -235,10 +369,10 @@ int main(int argc, char **argv) {
             char resp[512];
             if (strncmp(buf, "EXEC ", 5)==0) {
                 // EXEC protocol: NM sends OK then streams output lines and END
-                if (net_recv_line(fd, resp, sizeof(resp)) <=0) { printf("<no response>\n"); }
+                if (net_conn_recv_line(nmc, resp, sizeof(resp)) <=0) { printf("<no response>\n"); }
                 else if (strncmp(resp, "OK", 2)==0) {
                     while (1) {
-                        if (net_recv_line(fd, resp, sizeof(resp)) <=0) { printf("<no response>\n"); break; }
+                        if (net_conn_recv_line(nmc, resp, sizeof(resp)) <=0) { printf("<no response>\n"); break; }
                         if (strcmp(resp, "END")==0) break;
                         printf("%s\n", resp);
                     }
@@ -247,7 +381,7 @@ int main(int argc, char **argv) {
                 }
             } else {
                 while (1) {
-                    if (net_recv_line(fd, resp, sizeof(resp)) <=0) { printf("<no response>\n"); break; }
+                    if (net_conn_recv_line(nmc, resp, sizeof(resp)) <=0) { printf("<no response>\n"); break; }
                     printf("%s\n", resp);
                     if (strcmp(resp, "END")==0 || strncmp(resp, "OK", 2)==0 || strncmp(resp, "ERR", 3)==0 || strcmp(resp, "BYE")==0) break;
                 }
@@ -255,7 +389,7 @@ int main(int argc, char **argv) {
             if (strcmp(buf, "QUIT")==0) break;
         }
     }
-    net_close(fd);
+    net_conn_close(nmc);
     return 0;
 }
 
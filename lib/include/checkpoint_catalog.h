@@ -0,0 +1,58 @@
+#ifndef CHECKPOINT_CATALOG_H
+#define CHECKPOINT_CATALOG_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "hashmap.h"
+
+// Per-file list of checkpoints: tag, creation time, size and content hash,
+// kept at <root>/<file>/.catalog and cached in memory after the first
+// lookup. LISTCHECKPOINTS, VIEWCHECKPOINT and REVERT go through it instead
+// of the directory tree.
+//
+// The file is append-only, one "<created> <size> <hash> <tag>" line per
+// CHECKPOINT; a later line for the same tag replaces the earlier one. A
+// file with no catalog yet (checkpoints older than the catalog) gets one
+// built from its checkpoint directories on first use.
+
+typedef struct {
+    char tag[64];
+    int64_t created;            // unix seconds
+    long long size;
+    uint64_t hash;              // hash_bytes() of the contents
+} CheckpointEntry;
+
+typedef enum {
+    CATALOG_SORT_TIME = 0,
+    CATALOG_SORT_TAG,
+    CATALOG_SORT_SIZE
+} CatalogSort;
+
+// Reads one checkpoint's contents (used to build a missing catalog)
+typedef int (*CatalogLoader)(const char *fname, const char *tag, char **buf, int *len);
+
+typedef struct CatalogFile CatalogFile;
+
+typedef struct {
+    char root[256];
+    CatalogLoader load;
+    CatalogFile **files;
+    int nfiles, cap_files;
+    HashMap *index;             // file name -> slot in files
+    pthread_mutex_t mutex;
+} CheckpointCatalog;
+
+CheckpointCatalog* catalog_open(const char *root, CatalogLoader load);
+// Record (or replace) tag with the contents it was saved with
+int catalog_add(CheckpointCatalog *cat, const char *fname, const char *tag, const char *buf, int len);
+// 0 and *out filled if fname has checkpoint tag, 1 if not
+int catalog_find(CheckpointCatalog *cat, const char *fname, const char *tag, CheckpointEntry *out);
+// One page of fname's checkpoints in the given order: *out (malloc'd) gets
+// up to limit entries starting at offset, *total the number there are.
+// limit <= 0 means all. Returns 0 or -1.
+int catalog_list(CheckpointCatalog *cat, const char *fname, CatalogSort sort, int desc,
+                 int offset, int limit, CheckpointEntry **out, int *count, int *total);
+// "time", "tag" or "size". Returns 0, or -1 for anything else.
+int catalog_parse_sort(const char *s, CatalogSort *sort);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef CHUNK_STORE_H
+#define CHUNK_STORE_H
+
+#include <pthread.h>
+#include "hashmap.h"
+
+// Content-addressed store for checkpoint contents. A document is cut into
+// chunks at content-defined boundaries (a rolling gear hash, so an edit
+// only moves the boundaries around it) and each chunk is kept once at
+// <root>/<xx>/<sha256>. A checkpoint is then a small manifest listing its
+// chunks, and a new checkpoint of a lightly edited file only writes the
+// chunks that changed.
+//
+// Manifest: "CKM1 <size> <nchunks>\n" then "<sha256> <len>\n" per chunk.
+//
+// Chunks are reference counted across all manifests (counted at open by
+// reading them); a chunk whose last manifest goes away is deleted.
+
+#define CHUNK_MIN (2 * 1024)
+#define CHUNK_AVG_BITS 13               // boundaries every ~8 KB
+#define CHUNK_MAX (64 * 1024)
+
+typedef struct {
+    char root[256];
+    HashMap *refs;              // chunk hash -> references from manifests
+    long long chunks;           // distinct chunks stored
+    long long stored_bytes;     // their total size
+    long long logical_bytes;    // total size of every manifest's document
+    int manifests;
+    pthread_mutex_t mutex;
+} ChunkStore;
+
+// Open the store at root, counting references from every file called
+// "manifest" under manifest_root and deleting chunks none of them use.
+ChunkStore* chunk_store_open(const char *root, const char *manifest_root);
+// Store buf and write its manifest to manifest_path (replacing one that
+// is there, whose chunks are released). Returns 0 or -1.
+int chunk_store_save(ChunkStore *cs, const char *manifest_path, const char *buf, int len);
+// Hand the document behind manifest_path to sink chunk by chunk (last is
+// 1 on the final call; an empty document is one call with len 0). Returns
+// 0, 1 if there is no such manifest, -1 on a read error or if sink failed.
+typedef int (*ChunkSink)(void *ctx, const char *data, int len, int last);
+int chunk_store_read(ChunkStore *cs, const char *manifest_path, ChunkSink sink, void *ctx);
+// The whole document as one malloc'd, NUL-terminated buffer
+int chunk_store_load(ChunkStore *cs, const char *manifest_path, char **buf, int *len);
+// Delete a manifest and release its chunks
+int chunk_store_remove(ChunkStore *cs, const char *manifest_path);
+// "chunks=<n> stored=<bytes> logical=<bytes> dedup=<logical/stored>"
+void chunk_store_stats_format(ChunkStore *cs, char *buf, int buflen);
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef COLLAB_H
+#define COLLAB_H
+
+#include <pthread.h>
+#include "rga.h"
+#include "doc.h"
+#include "fiber.h"
+
+// Live sessions: documents several clients edit at once, without sentence
+// locks. The SS holds each live document as an RGA replica (rga.h) and
+// turns every edit into operations that go to every subscriber as
+// "OP <file> <op>" lines, so each client keeps its own replica current
+// from small deltas instead of re-reading the file.
+//
+// A subscriber is one client connection (a CollabPeer). Everything sent
+// to it goes through its outbox, which a writer of its own (a fiber, or a
+// thread without a scheduler) drains onto the socket, so a session that
+// broadcasts never waits on a slow client. A client that falls
+// COLLAB_OUTBOX_MAX bytes behind is disconnected.
+//
+// Documents live in a hub keyed by file name and are reference counted;
+// the last reference removes one. The text goes back to the file in
+// saves: collab_save_begin() hands out the text to commit and
+// collab_save_end() takes the version that was written (which may have
+// merged in other writers' commits) as the new base, sending any changes
+// the merge brought in to the subscribers.
+
+#define COLLAB_BUCKETS 256
+#define COLLAB_OUTBOX_MAX (16 << 20)
+
+typedef struct CollabPeer {
+    int fd;
+    // A dup of fd for the writer to wait on: the session reading fd may
+    // run on the same scheduler thread, which takes one waiter per fd
+    int wfd;
+    uint32_t site;              // ids of this client's own characters
+    pthread_mutex_t mutex;
+    char *out;                  // outbox
+    int out_len, out_cap;
+    int wake_fd;                // eventfd: outbox filled or closing
+    int done_fd;                // eventfd: writer exited
+    int closing;
+    int failed;                 // send failed or outbox overflowed
+} CollabPeer;
+
+typedef struct CollabDoc {
+    char *name;
+    Rga *rga;
+    char *base;                 // the file as last saved (or loaded)
+    int base_len;
+    int dirty;                  // edited since the last save began
+    CollabPeer **peers;
+    int npeers, cap_peers;
+    long long ops;              // operations applied
+    int max_len;                // longest the text may grow (0: no limit)
+    // The visible text with the ids of its characters and its sentences,
+    // kept current by collab_insert_words() so an edit re-reads only the
+    // sentence it changes. Any other change marks it stale (view_ok 0)
+    // and the next edit rebuilds it from the RGA.
+    char *view;
+    RgaId *view_ids;
+    int view_len, view_cap;
+    DocIndexSent *view_sents;
+    int view_count, view_sents_cap;
+    int view_ok;
+    int refs;                   // under the hub lock
+    pthread_mutex_t mutex;      // everything above but refs
+    pthread_mutex_t save_mutex; // one save at a time
+    struct CollabDoc *next;
+} CollabDoc;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    CollabDoc *buckets[COLLAB_BUCKETS];
+    int docs;
+    long long ops;              // of documents already gone
+} CollabHub;
+
+// What a save writes: the text and the ids of its characters
+typedef struct {
+    char *text;
+    int len;
+    RgaId *ids;
+    int nids;
+} CollabSave;
+
+CollabHub* collab_hub_create(void);
+
+// Start a subscriber on fd with its writer (a fiber on sched, or a thread
+// if sched is NULL). NULL if out of memory.
+CollabPeer* collab_peer_open(int fd, uint32_t site, FiberSched *sched);
+// Queue line (newline added). Returns -1 if the peer has failed.
+int collab_peer_send(CollabPeer *p, const char *line);
+// Stop the writer (after it sent what is queued, unless the connection is
+// gone) and free the peer. fd stays open. The peer must have left every
+// document first.
+void collab_peer_close(CollabPeer *p, int flush);
+
+// name's document with a reference, or NULL if it isn't live
+CollabDoc* collab_get(CollabHub *h, const char *name);
+// name's document, or a new one holding text whose file holds base and
+// whose edits may not take it past max_len bytes (0: no limit); with a
+// reference. NULL if out of memory.
+CollabDoc* collab_open(CollabHub *h, const char *name, const char *base, int base_len, const char *text, int len, int max_len);
+void collab_release(CollabHub *h, CollabDoc *d);
+// Referenced documents with unsaved edits (*out malloc'd). Returns how many.
+int collab_dirty(CollabHub *h, CollabDoc ***out);
+
+// Subscribe p: the document's operations are queued to it (rebuilding it
+// from nothing), then everything applied from here on. Returns 0, 1 if p
+// is subscribed already, -2 if out of memory.
+int collab_join(CollabDoc *d, CollabPeer *p);
+// Returns the subscribers left, or -1 if p wasn't one
+int collab_leave(CollabDoc *d, CollabPeer *p);
+// WRITE_UPDATE on the live text: insert content before word widx of
+// sentence sidx, as doc_insert() does, and send the change to every
+// subscriber. Returns 0, -1 if sidx is out of range, -2 if widx is (the
+// largest accepted index in *max either way), -3 if out of memory, -4 if
+// the text would outgrow max_len.
+int collab_insert_words(CollabDoc *d, int sidx, int widx, const char *content, int *max);
+// A subscriber's own operation: apply it and pass it on to the others.
+// Its inserts must use the subscriber's site. Returns 0, -1 if it is
+// malformed or can't be applied, -2 if out of memory, -3 if an insert
+// could take the text past max_len.
+int collab_apply(CollabDoc *d, CollabPeer *from, const char *op);
+
+// Begin a save (off the fiber threads: waits for any other save). Returns
+// 0 with s filled in, 1 if nothing changed since the last one (no save
+// begun), -1 if out of memory.
+int collab_save_begin(CollabDoc *d, CollabSave *s);
+// committed: the text now in the file, or NULL if the save failed
+void collab_save_end(CollabDoc *d, CollabSave *s, const char *committed, int committed_len);
+
+// "live_docs=<n> live_peers=<n> live_ops=<n>"
+void collab_stats_format(CollabHub *h, char *buf, int buflen);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef CONN_POOL_H
+#define CONN_POOL_H
+
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include "net.h"
+
+// Pool of long-lived connections keyed by host:port. Used by the NM for
+// its admin links to storage servers: the address is resolved once per
+// host, idle connections are health-checked before reuse, and connections
+// idle for longer than the timeout are closed by conn_pool_reap().
+#define CONN_POOL_MAX_HOSTS 64
+
+typedef struct PooledConn {
+    NetConn *conn;
+    int frames;                 // peer accepted binary frames (HELLO FRAMES)
+    int reused;                 // came from the idle list, not a fresh connect
+    int host_idx;
+    time_t last_used;
+    struct PooledConn *next;    // idle list link
+} PooledConn;
+
+typedef struct {
+    char host[64];
+    uint16_t port;
+    NetAddr addr;
+    int addr_valid;
+    PooledConn *idle;           // most recently used first
+    int idle_count;
+} ConnPoolHost;
+
+typedef struct {
+    ConnPoolHost hosts[CONN_POOL_MAX_HOSTS];
+    int host_count;
+    int max_idle_per_host;
+    int idle_timeout_sec;
+    int negotiate_frames;
+    NetTimeouts timeouts;       // applied to every new connection
+    pthread_mutex_t mutex;
+    // Counters for diagnostics
+    unsigned long connects;
+    unsigned long reuses;
+    unsigned long stale;
+} ConnPool;
+
+// Create a pool; negotiate_frames sends HELLO FRAMES on every new connection
+ConnPool* conn_pool_create(int max_idle_per_host, int idle_timeout_sec, int negotiate_frames);
+// Bound connects and socket waits on connections opened from now on
+void conn_pool_set_timeouts(ConnPool *pool, const NetTimeouts *t);
+// Get a healthy connection (idle one if available, otherwise a new one)
+PooledConn* conn_pool_acquire(ConnPool *pool, const char *host, uint16_t port);
+// Hand a connection back. Pass reusable=0 if the exchange did not complete
+// cleanly; the connection is then closed instead of pooled.
+void conn_pool_release(ConnPool *pool, PooledConn *pc, int reusable);
+// Close connections idle for longer than the timeout. Returns how many.
+int conn_pool_reap(ConnPool *pool);
+// Close every idle connection to host:port and forget its cached address
+void conn_pool_drop_host(ConnPool *pool, const char *host, uint16_t port);
+// Free pool
+void conn_pool_free(ConnPool *pool);
+
+#endif
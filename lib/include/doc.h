@@ -0,0 +1,85 @@
+#ifndef DOC_H
+#define DOC_H
+
+#include <stdint.h>
+
+// In-memory document for a write session: the text split into sentences
+// (each keeps its '.', '!' or '?'). A WRITE_UPDATE only touches the
+// sentence it edits, and the whole text is rebuilt once, at WRITE_END.
+//
+// The split is the same one the SS has always used: whitespace after a
+// delimiter is dropped, the trailing unterminated sentence is trimmed, and
+// sentences are joined back with a single space. An edit that adds or
+// removes delimiters re-splits just the sentences around it, so each
+// edit sees the document exactly as if it had been written out and read
+// back.
+typedef struct {
+    char **sents;
+    int *lens;
+    int count;
+    int cap;
+    int unsplit;                // sentence edited last, re-split on the next edit (-1 = none)
+} Doc;
+
+// Parse text into a document (never empty: "" becomes one empty sentence)
+Doc* doc_parse(const char *text, int len);
+void doc_free(Doc *d);
+// Insert content before word widx of sentence sidx. Sentences up to sidx
+// are created if missing. Returns 0, or -1 if widx is out of range (the
+// largest accepted index is stored in *max_widx), -2 on allocation failure.
+int doc_insert(Doc *d, int sidx, int widx, const char *content, int *max_widx);
+// Rebuild the text (malloc'd, NUL-terminated). Returns 0 or -1.
+int doc_serialize(const Doc *d, char **out, int *out_len);
+// Three-way merge on sentence boundaries: the sentences ours changed
+// relative to base, replayed onto theirs (another edit of the same base).
+// A run of base sentences both sides changed, differently, is a conflict;
+// edits to neighbouring sentences are not. Returns 0 with the merged text
+// in *out (malloc'd), 1 on a conflict, -1 on allocation failure.
+int doc_merge(const char *base, int base_len, const char *ours, int ours_len,
+              const char *theirs, int theirs_len, char **out, int *out_len);
+// doc_merge, but with prefer_ours a conflict is settled for ours: each
+// run of clashing hunks keeps ours' version of that stretch of base, and
+// theirs' other changes are merged as usual. *conflicts (optional) gets
+// the number of runs settled that way. Returns 0 or -1.
+int doc_merge_ex(const char *base, int base_len, const char *ours, int ours_len,
+                 const char *theirs, int theirs_len, int prefer_ours, int *conflicts,
+                 char **out, int *out_len);
+// Where each sentence of from went in to (a later version of the same
+// text), by the sentence diff doc_merge() uses: (*map)[i] is its index in
+// to, or -1 if it was rewritten away; the last entry, for the position
+// after from's last sentence, is the one after to's. A rewritten sentence
+// keeps its place among what replaced it. Returns the entries in *map
+// (malloc'd; from's sentence count plus one), or -1.
+int doc_sentence_map(const char *from, int from_len, const char *to, int to_len, int **map);
+
+// Sentence index of a stored file, kept as a small sidecar next to it so
+// range checks, INFO and STREAM don't have to scan the file. Sentences
+// are split exactly as doc_parse() splits them; offsets are into the raw
+// file. size/mtime_ns record which version of the file was indexed.
+typedef struct {
+    uint32_t start;             // first non-space byte of the sentence
+    uint32_t len;               // up to and including its delimiter
+    uint32_t words;             // whitespace-separated words in it
+} DocIndexSent;
+
+typedef struct {
+    int64_t size;
+    int64_t mtime_ns;
+    uint32_t words;             // whitespace-separated words in the file
+    uint32_t chars;
+    int last_delim;             // last non-space byte is '.', '!' or '?'
+    int count;
+    DocIndexSent *sents;
+} DocIndex;
+
+DocIndex* doc_index_build(const char *text, int len);
+// Binary sidecar, replaced atomically. load returns NULL if the file is
+// missing or damaged.
+int doc_index_save(const DocIndex *ix, const char *path);
+DocIndex* doc_index_load(const char *path);
+void doc_index_free(DocIndex *ix);
+// doc_parse() taking the sentence boundaries from ix instead of scanning
+// for them; falls back to doc_parse() if ix doesn't describe text
+Doc* doc_parse_indexed(const char *text, int len, const DocIndex *ix);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef DOC_CACHE_H
+#define DOC_CACHE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "doc.h"
+#include "mapped_file.h"
+
+// Recently read documents: the file's contents (a MappedFile, so a large
+// one is a shared mapping rather than a heap copy) plus its sentence
+// index, so a hot file is served without reading or tokenizing it again.
+// Entries are keyed by file name and stamped with the size and mtime they
+// were read at (the index's size/mtime_ns); a lookup with a different
+// stamp is a miss, so a file changed behind the cache's back is never
+// served stale. Writers also drop or replace the entry directly.
+//
+// The cache is split into shards by name hash, each with its own lock,
+// LRU list and an equal share of the byte budget. Entries are reference
+// counted: one evicted or replaced while a reader holds it stays valid
+// until released. A mapped document counts only its index against the
+// budget; its pages belong to the page cache.
+
+#define DOC_CACHE_SHARDS 16
+#define DOC_CACHE_BUCKETS 256           // per shard
+#define DOC_CACHE_DEFAULT_MB 64
+
+typedef struct DocCacheEntry {
+    char *name;
+    MappedFile *file;
+    const char *data;           // file->data, not NUL-terminated
+    int len;
+    DocIndex *ix;
+    long long charge;           // bytes counted against the budget
+    int refs;
+    int cached;                 // still reachable from the shard
+    struct DocCacheEntry *hnext;
+    struct DocCacheEntry *prev, *next;  // LRU, most recent first
+} DocCacheEntry;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    DocCacheEntry *buckets[DOC_CACHE_BUCKETS];
+    DocCacheEntry *head, *tail;
+    long long bytes;
+    int entries;
+} DocCacheShard;
+
+typedef struct {
+    long long budget;           // total; each shard gets budget/DOC_CACHE_SHARDS
+    DocCacheShard shards[DOC_CACHE_SHARDS];
+    pthread_mutex_t stats_mutex;
+    long long hits, misses, evictions;
+} DocCache;
+
+// budget 0 makes every put pass straight through (nothing is kept)
+DocCache* doc_cache_create(long long budget);
+// Cached copy of name if it was read at this size/mtime (a reference the
+// caller releases), else NULL. A stale entry is dropped.
+DocCacheEntry* doc_cache_get(DocCache *c, const char *name, int64_t size, int64_t mtime_ns);
+// Add file/ix (the caller's reference to file and ix itself are taken
+// over; stamped by ix->size/mtime_ns) as name's entry, replacing any
+// other. Always returns a reference for the caller; one too big for its
+// shard is handed back without being kept. NULL only if out of memory,
+// in which case file and ix have been released.
+DocCacheEntry* doc_cache_put(DocCache *c, const char *name, MappedFile *file, DocIndex *ix);
+void doc_cache_release(DocCache *c, DocCacheEntry *e);
+void doc_cache_invalidate(DocCache *c, const char *name);
+// "cache_hits=<n> cache_misses=<n> cache_hit_ratio=<r> cache_bytes=<n> cache_entries=<n> cache_evictions=<n>"
+void doc_cache_stats_format(DocCache *c, char *buf, int buflen);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef DURABLE_H
+#define DURABLE_H
+
+// When data written to disk is considered safe. write_file_all(), the
+// edit log and the NM metadata all sync through here:
+//   none   - leave flushing to the OS (fast; a power cut can lose recent writes)
+//   fsync  - fsync each write before returning
+//   group  - callers queue their fsync and wait on a flusher thread. Callers
+//            that arrive while a batch is being synced form the next batch,
+//            and each file or directory is synced once per batch however
+//            many callers asked. A window_ms above 0 also lingers that long
+//            to grow a batch, once the previous one showed concurrent load.
+// Whole-file writes always go to a temp file that is renamed into place
+// (and the directory synced), so a crash leaves the old or the new file.
+typedef enum {
+    DURABLE_NONE = 0,
+    DURABLE_FSYNC,
+    DURABLE_GROUP
+} DurableMode;
+
+#define DURABLE_DEFAULT_WINDOW_MS 0
+
+// Set the policy; group mode starts the flusher. Returns 0 or -1.
+int durable_init(DurableMode mode, int window_ms);
+DurableMode durable_get_mode(void);
+// "none", "fsync" or "group". Returns 0, or -1 if s is none of those.
+int durable_parse_mode(const char *s, DurableMode *mode);
+const char* durable_mode_name(DurableMode mode);
+// Make what was written to fd durable per the policy
+int durable_sync(int fd);
+// Sync tmp_path, rename it over path and sync path's directory
+int durable_publish(const char *tmp_path, const char *path);
+// Replace path with buf via a temp file and durable_publish()
+int durable_write_file(const char *path, const char *buf, int len);
+// "durable=<mode> syncs=<requests> flushes=<fsync calls>"
+void durable_stats_format(char *buf, int buflen);
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef EDIT_LOG_H
+#define EDIT_LOG_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "hashmap.h"
+
+// Append-only log of write-session edits. Each WRITE_UPDATE appends one
+// small record and WRITE_END appends a commit marker; a background
+// applier then writes the committed document to the data file, off the
+// commit path. At startup the log is replayed, so a commit the applier
+// never reached is not lost.
+//
+// Records are text lines (a snapshot carries a payload after its line):
+//   B <sid> <base> <file>         session opened on version <base> of file
+//   U <sid> <sidx> <widx> <text>  one WRITE_UPDATE
+//   C <lsn> <sid> <hash>          commit: base + updates = version <lsn>
+//   S <lsn> <sid> <hash> <len>    commit carrying the whole document
+//   D <lsn> <file>                data file now holds version <lsn>
+//   R <lsn> <file>                data file rewritten outside the log
+//   E <sid>                       session over
+//
+// Version numbers (lsn) make replay exact: a plain commit is replayed on
+// top of the version it started from, and a session whose base was
+// overtaken by another commit logs its whole document instead (S). The
+// hash of each committed document lets replay recognise a version the
+// applier wrote just before a crash, before its D record went out.
+
+typedef void (*EditLogApplied)(const char *fname, const char *buf, int len, void *arg);
+
+typedef struct EditLogFile EditLogFile;
+
+typedef struct {
+    uint64_t sid;
+    uint64_t base;              // version the session's document started from
+    char fname[256];
+} EditLogSession;
+
+typedef struct {
+    int fd;
+    char path[512];
+    char data_root[256];
+    uint64_t next_lsn;
+    uint64_t next_sid;
+    int open_sessions;
+    int applying;               // files being written right now
+    EditLogFile *files;         // per-file version and pending write
+    int nfiles, cap_files;
+    HashMap *index;             // file name -> slot in files
+    int npending;
+    EditLogApplied on_applied;
+    void *arg;
+    pthread_t applier;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;        // applier wakeup
+    pthread_cond_t done;        // a pending write finished
+} EditLog;
+
+// Replay whatever path holds into data_root, start the applier and return
+// the log, or NULL if it can't be opened. on_applied runs after every data
+// file write (replay included).
+EditLog* edit_log_open(const char *path, const char *data_root, EditLogApplied on_applied, void *arg);
+// Open a session on fname. Call before reading the file the session edits.
+// Every call below accepts a NULL log or session and then does nothing.
+EditLogSession* edit_log_begin(EditLog *el, const char *fname);
+int edit_log_update(EditLog *el, EditLogSession *s, int sidx, int widx, const char *content);
+// Log the session's document as committed and queue the data file write.
+// The session stays open for further edits on top of this version.
+// Returns -1 if it was not logged (the caller writes the file itself).
+int edit_log_commit(EditLog *el, EditLogSession *s, const char *buf, int len);
+// Close the session and free it
+void edit_log_end(EditLog *el, EditLogSession *s);
+// Make sure fname's data file holds its latest commit (writing it now if
+// the applier hasn't yet). Call before reading or replacing the file.
+void edit_log_settle(EditLog *el, const char *fname);
+void edit_log_settle_all(EditLog *el);
+// fname was written, moved or deleted outside the log
+void edit_log_reset(EditLog *el, const char *fname);
+
+#endif
@@ -18,6 +18,7 @@
 #define ERR_ONLY_OWNER 13
 #define ERR_UNKNOWN_COMMAND 14
 #define ERR_SYSTEM_ERROR 15
+#define ERR_FILE_TOO_LARGE 16
 
 // Error code to string
 const char* errcode_to_string(int code);
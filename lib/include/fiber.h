@@ -0,0 +1,51 @@
+#ifndef FIBER_H
+#define FIBER_H
+
+#include <stddef.h>
+
+// Stackful fibers multiplexed over a few OS threads. Each scheduler thread
+// runs its own epoll loop; a fiber stays on the thread it was placed on and
+// runs until it waits on a socket, sleeps or hands blocking work (disk I/O)
+// to the helper pool, at which point the thread switches to the next ready
+// fiber. Only fibers may call fiber_wait_fd / fiber_sleep_ms /
+// fiber_call_blocking to yield; from a plain thread they simply block.
+//
+// A fiber must not yield while holding a pthread mutex: another fiber on
+// the same thread could then try to take it and deadlock the thread.
+//
+// Linux only (epoll + ucontext). Elsewhere fiber_sched_create() returns
+// NULL and callers fall back to threads.
+#define FIBER_DEFAULT_STACK (256 * 1024)
+
+typedef void (*FiberFn)(void *arg);
+typedef struct FiberSched FiberSched;
+
+// Start nthreads scheduler threads and a helper pool of blocking_threads
+// for fiber_call_blocking(). stack_size 0 means FIBER_DEFAULT_STACK.
+FiberSched* fiber_sched_create(int nthreads, int blocking_threads, size_t stack_size);
+// Run fn(arg) as a new fiber on one of the scheduler threads (round robin).
+// Callable from any thread. Returns 0, or -1 if the fiber could not be queued.
+int fiber_spawn(FiberSched *sched, FiberFn fn, void *arg);
+// Fibers currently alive across all scheduler threads
+int fiber_count(FiberSched *sched);
+
+// 1 when called from inside a fiber
+int fiber_current(void);
+// Wait until fd is readable (for_write=0) or writable (for_write=1).
+// timeout_ms < 0 waits forever. Returns 1 ready, 0 timeout, -1 error.
+// Each scheduler thread takes one waiter per fd at a time: a second fiber
+// on the same thread waiting on the same fd gets -1 (EEXIST). Two fibers
+// that wait on one socket, say a reader and a writer, need separate fds
+// (dup()) for it.
+int fiber_wait_fd(int fd, int for_write, int timeout_ms);
+// Sleep without holding the OS thread
+void fiber_sleep_ms(int ms);
+// Let other ready fibers run
+void fiber_yield(void);
+// Run fn(arg) on the helper pool and park until it returns
+void fiber_call_blocking(FiberFn fn, void *arg);
+
+// net.c wait hook: parks the fiber on EAGAIN (see net_set_wait_hook)
+int fiber_net_wait(int fd, int for_write);
+
+#endif
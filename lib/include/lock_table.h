@@ -0,0 +1,151 @@
+#ifndef LOCK_TABLE_H
+#define LOCK_TABLE_H
+
+#include <pthread.h>
+
+// Sentence locks for every file being edited. Files hash into shards,
+// each with its own lock, so WRITE traffic on different files doesn't
+// contend; a file's record is created with its first lock.
+// Each record keeps its locked sentences in a small open-addressed map
+// (sentence -> owner) that grows as needed, plus a count of them, so
+// there is no limit on files or sentence numbers and "is anything in
+// this file locked" is a single lookup.
+//
+// An owner is any id the caller uses for the holder; an owner never
+// holds a lock with the id -1.
+//
+// Locks can be leased: each one then lapses lease_ms after it was taken
+// or last renewed, and lock_table_expire() (run periodically) releases
+// lapsed ones, so a holder that hangs or vanishes doesn't block the
+// sentence forever. A lapsed lock no longer counts as held by its owner
+// even before it is reaped, and acquiring its sentence reaps it there
+// and then, as lock_table_expire() would, instead of waiting for the
+// next sweep.
+//
+// A caller may also queue for a locked sentence. Waiters on a sentence
+// are served first come, first served: releasing it hands it straight to
+// the oldest waiter (it never becomes free in between, so nobody can cut
+// in) and writes to that waiter's wake_fd, which it can poll or hand to
+// its event loop. A file's record goes away with its last lock unless it
+// has seen waiting or an expired lease; then it stays (without its
+// sentence map) to keep its contention counters.
+//
+// Locks are keyed by where their sentence is in the file now: a commit
+// that adds or removes sentences remaps them (lock_table_remap()), so a
+// lock keeps guarding its sentence and newcomers contend on the right
+// one. The holder keeps using the index it locked the sentence by, and
+// the lock remembers where that sentence is in the holder's own copy of
+// the file, which moves only when the holder takes in the current
+// version (lock_table_rebase()).
+
+#define LOCK_TABLE_SHARDS 16
+#define LOCK_TABLE_BUCKETS 256          // per shard
+
+typedef struct LockWaiter {
+    long owner;
+    int sidx;                   // where the sentence is now (remapped)
+    int as;                     // the index it was asked for by
+    int wake_fd;                // an eventfd or pipe, written once on handover
+    int granted;
+    long long since_ms;
+    struct LockWaiter *next;
+} LockWaiter;
+
+typedef struct {
+    int sidx;                   // where the sentence is now; -1 = empty slot
+    int as;                     // the index its holder locked it by
+    int at;                     // where it is in the holder's copy of the file
+    long owner;
+    long long expires_ms;       // lease end, 0 = none
+    LockWaiter *head, *tail;    // queued for this sentence, oldest first
+} SentenceLock;
+
+// Contention counters of one file (or, summed, of the table)
+typedef struct {
+    int held;                   // sentences locked now
+    int waiting;                // waiters queued now
+    long long waits;            // waiters ever queued
+    long long timeouts;         // of those, gave up before their turn
+    long long wait_ms;          // total time spent queued
+    long long wait_ms_max;
+    long long expired;          // locks whose lease ran out
+} LockStats;
+
+typedef struct FileLocks {
+    char *name;
+    SentenceLock *slots;
+    int cap;                    // power of two
+    LockStats stats;
+    struct FileLocks *next;
+} FileLocks;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    FileLocks *buckets[LOCK_TABLE_BUCKETS];
+    int files;                  // records in the shard
+} LockShard;
+
+// Called for each lock whose lease ran out as it is released, with its
+// shard lock held (it must not call back into the table)
+typedef void (*LockExpiredFn)(const char *name, int sidx, long owner, void *arg);
+
+typedef struct {
+    LockShard shards[LOCK_TABLE_SHARDS];
+    int lease_ms;               // 0 = locks last until released
+    LockExpiredFn on_expire;    // for leases reaped by an acquire
+    void *on_expire_arg;
+} LockTable;
+
+LockTable* lock_table_create(int lease_ms);
+// fn (may be NULL) is told of each lapsed lock an acquire reaps
+void lock_table_on_expire(LockTable *lt, LockExpiredFn fn, void *arg);
+// Lock sentence sidx of name for owner. Returns 0 if locked, 1 if it is
+// already locked (by anyone, owner included), -1 if out of memory. A lock
+// on it whose lease has run out is reaped first; if that hands it to a
+// waiter, it is locked.
+int lock_table_acquire(LockTable *lt, const char *name, int sidx, long owner);
+// lock_table_acquire(), queueing w (caller-owned, wake_fd set) if another
+// owner holds the sentence. Returns 0 if locked now, 1 if owner holds it
+// already, 2 if queued, -1 if out of memory. A queued caller waits for
+// wake_fd to become readable or its own timeout, then calls
+// lock_table_wait_end() either way.
+int lock_table_acquire_wait(LockTable *lt, const char *name, int sidx, long owner, LockWaiter *w);
+// Leave the queue: 0 if w was handed the lock, 1 if it wasn't (and is
+// now dequeued, counted as a timeout)
+int lock_table_wait_end(LockTable *lt, const char *name, LockWaiter *w);
+// Unlock sidx (as owner locked it) if owner holds it, handing it to the oldest waiter if there
+// is one. Returns 0, or 1 if owner didn't hold it.
+int lock_table_release(LockTable *lt, const char *name, int sidx, long owner);
+// Restart the lease on every sentence of name owner holds. Returns how
+// many it holds.
+int lock_table_renew(LockTable *lt, const char *name, long owner);
+// Release every sentence of name owner holds (handing each to its oldest
+// waiter). Returns how many were released.
+int lock_table_release_owner(LockTable *lt, const char *name, long owner);
+// Release every lock whose lease has run out, calling fn (if set) for
+// each. Returns how many were released.
+int lock_table_expire(LockTable *lt, LockExpiredFn fn, void *arg);
+// 1 if owner holds sidx of name
+int lock_table_holds(LockTable *lt, const char *name, int sidx, long owner);
+// Where the sentence owner holds as sidx is in its copy of name, or -1 if
+// it holds no such lock
+int lock_table_locate(LockTable *lt, const char *name, int sidx, long owner);
+// name's sentences moved: the lock on sentence i goes to map[i] (i < n),
+// one past the old last sentence or beyond shifts with map[n-1]. A lock
+// whose sentence is gone (-1) is dropped and its waiters turned away as
+// timed out. Returns how many were dropped, or -1 out of memory (nothing
+// moved).
+int lock_table_remap(LockTable *lt, const char *name, const int *map, int n);
+// owner's copy of name is the current version again: each sentence it
+// holds is where its lock now is. Returns how many it holds.
+int lock_table_rebase(LockTable *lt, const char *name, long owner);
+// Sentences of name locked by owner
+int lock_table_owned(LockTable *lt, const char *name, long owner);
+// Sentences of name locked by anyone
+int lock_table_held(LockTable *lt, const char *name);
+// Counters of name (all zero if it was never locked)
+void lock_table_file_stats(LockTable *lt, const char *name, LockStats *out);
+// "lock_files=<n> lock_held=<n> lock_waiting=<n> lock_waits=<n> lock_timeouts=<n> lock_wait_ms=<n> lock_wait_ms_max=<n> lock_expired=<n>"
+void lock_table_stats_format(LockTable *lt, char *buf, int buflen);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Read-only view of a file's contents, shared by reference count. Files
+// of MAPPED_FILE_MIN_MAP bytes or more are mmap()ed, so every reader of a
+// large document uses the same page-cache pages instead of a heap copy
+// each; smaller ones are simply read into memory, which is cheaper than
+// setting up a mapping.
+//
+// The SS replaces files by writing a temp file and renaming it over the
+// old one, so a mapping keeps showing the version it was opened on and
+// stays valid after a commit; it is the holder's job (the document cache)
+// to let go of it. The old inode's space is freed with the last release.
+// Truncating a mapped file in place would make reads past the new end
+// fault, which is why nothing on the SS writes data files that way.
+//
+// data is not NUL-terminated.
+
+#define MAPPED_FILE_MIN_MAP (64 * 1024)
+
+typedef struct {
+    const char *data;
+    int len;
+    int64_t size;               // stamp of the version opened
+    int64_t mtime_ns;
+    void *map;                  // NULL when held on the heap
+    size_t map_len;
+    int refs;
+} MappedFile;
+
+// NULL if path can't be opened or isn't a regular file
+MappedFile* mapped_file_open(const char *path);
+MappedFile* mapped_file_retain(MappedFile *mf);
+void mapped_file_release(MappedFile *mf);
+
+#endif
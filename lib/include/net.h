@@ -12,11 +12,172 @@ int net_accept(int server_fd, char *peer_ip_buf, int ip_buf_len, uint16_t *peer_
 int net_connect(const char *ip, uint16_t port);
 int net_connect_ex(const char *remote_host, uint16_t remote_port, const char *local_host, uint16_t local_port);
 
+// Resolved peer address, so hot paths can connect without a getaddrinfo()
+typedef struct {
+    int family;
+    int len;
+    unsigned char addr[28];   // large enough for sockaddr_in6
+} NetAddr;
+
+int net_resolve(const char *host, uint16_t port, NetAddr *out);
+int net_connect_addr(const NetAddr *addr);
+
+// Time limits, so a peer that stops answering costs a bounded wait instead
+// of a hung thread. The connect variants give up after timeout_ms (errno
+// ETIMEDOUT) rather than waiting out the kernel's SYN retries; 0 means no
+// limit. net_set_io_timeouts sets SO_RCVTIMEO/SO_SNDTIMEO on a blocking
+// socket: from then on every send/recv helper below, NetConn reads and
+// frames included, fails with errno ETIMEDOUT once a single wait runs past
+// the limit.
+typedef struct {
+    int connect_ms;
+    int recv_ms;
+    int send_ms;
+} NetTimeouts;
+
+int net_connect_timeout(const char *ip, uint16_t port, int timeout_ms);
+int net_connect_addr_timeout(const NetAddr *addr, int timeout_ms);
+void net_set_io_timeouts(int fd, int recv_ms, int send_ms);
+// Non-blocking sockets: every send/recv helper below retries on EAGAIN by
+// waiting for readiness. Without a hook that wait is a poll(); a fiber
+// scheduler installs one that parks the calling fiber instead.
+typedef int (*NetWaitHook)(int fd, int for_write);
+void net_set_nonblocking(int fd, int enabled);
+void net_set_wait_hook(NetWaitHook hook);
+// Disable Nagle on request/response links
+void net_set_nodelay(int fd);
+
 int net_get_local_addr(int fd, char *ip_buf, int ip_buf_len, uint16_t *port_out);
 
 int net_send_line(int fd, const char *line);
+// For event loops: one send that never waits. Returns 0 if the whole line
+// went out, -1 if not; any of it may have, so on -1 the stream is broken
+// and the connection must be closed.
+int net_send_line_nowait(int fd, const char *line);
 int net_recv_line(int fd, char *buf, int buflen);
 void net_close(int fd);
 
+// Batched sender for multi-line responses: lines accumulate in memory and
+// go out in as few send() calls as possible. It flushes on its own once
+// NET_SENDBUF_FLUSH bytes are pending (with MSG_MORE where available, so the
+// kernel keeps packing segments) and on net_sendbuf_flush(). With fd < 0 it
+// only accumulates and grows, for callers that want the bytes themselves.
+#define NET_SENDBUF_FLUSH 16384
+
+typedef struct {
+    int fd;
+    char *buf;
+    int len;
+    int cap;
+    int err;        // sticky: set once a send fails, later calls are no-ops
+} NetSendBuf;
+
+void net_sendbuf_init(NetSendBuf *b, int fd);
+int net_sendbuf_append(NetSendBuf *b, const void *data, int len);
+int net_sendbuf_line(NetSendBuf *b, const char *line);
+int net_sendbuf_linef(NetSendBuf *b, const char *fmt, ...);
+int net_sendbuf_flush(NetSendBuf *b);
+// Releases memory without flushing
+void net_sendbuf_free(NetSendBuf *b);
+
+// Buffered per-connection reader: pulls large chunks from the socket and
+// hands lines out of its buffer instead of doing one recv() per byte.
+// Every read on a wrapped fd must go through the NetConn from then on.
+#define NET_CONN_BUFSZ 16384
+#define NET_CONN_MAX_LINE (1 << 20)
+
+typedef struct {
+    int fd;
+    char *buf;
+    int cap;
+    int start;      // first unread byte
+    int end;        // one past the last buffered byte
+    int held_pos;   // byte clobbered by an over-long line's terminator (-1 if none)
+    char held;
+} NetConn;
+
+NetConn* net_conn_open(int fd);
+// Zero-copy: *line points into the connection buffer (NUL-terminated) and
+// stays valid until the next read on this connection. Returns length or -1.
+int net_conn_next_line(NetConn *c, char **line);
+// Copying variant with the same contract as net_recv_line.
+int net_conn_recv_line(NetConn *c, char *buf, int buflen);
+// Per-call deadline: as net_conn_recv_line, but returns -2 (errno
+// ETIMEDOUT) if no full line arrived within timeout_ms in total, however
+// slowly the peer trickles bytes. 0 means no limit.
+int net_conn_recv_line_timeout(NetConn *c, char *buf, int buflen, int timeout_ms);
+int net_conn_read_exact(NetConn *c, void *buf, int len);
+// Bytes already buffered and not yet handed out
+int net_conn_pending(NetConn *c);
+// For event loops: one recv() that never blocks. Returns bytes read, 0 on
+// EOF, -1 on error, -2 if nothing was ready.
+int net_conn_fill_nowait(NetConn *c);
+// 1 if a full line (or maxlen-1 bytes of an over-long one) is buffered, so
+// net_conn_recv_line(c, buf, maxlen) will return without touching the socket
+int net_conn_has_line(NetConn *c, int maxlen);
+// Free the reader but keep the socket open
+void net_conn_free(NetConn *c);
+// Close the socket and free the reader
+void net_conn_close(NetConn *c);
+
+// Length-prefixed binary frames. A connection starts in line mode; the
+// client offers "HELLO FRAMES" and, if the server answers "OK HELLO FRAMES",
+// bulk payloads on that connection travel as frames instead of text lines.
+// Header (network byte order): u32 payload length, u16 opcode, u16 flags,
+// u32 request id.
+#define NET_FRAME_HDR_LEN 12
+#define NET_FRAME_MAX (64 << 20)
+
+#define NET_OP_DATA 1           // raw payload bytes
+#define NET_OP_LINE 2           // one protocol line, no trailing newline
+#define NET_OP_ERR  3           // error text
+
+#define NET_FRAME_MORE 0x0001   // more DATA frames follow for this payload
+
+typedef struct {
+    uint32_t len;
+    uint16_t op;
+    uint16_t flags;
+    uint32_t req_id;
+} NetFrameHdr;
+
+int net_send_frame(int fd, uint16_t op, uint16_t flags, uint32_t req_id, const void *payload, uint32_t len);
+// net_send_frame that never waits, with net_send_line_nowait's result
+int net_send_frame_nowait(int fd, uint16_t op, uint16_t flags, uint32_t req_id, const void *payload, uint32_t len);
+// Reads one frame. *payload is malloc'd and NUL-terminated (caller frees).
+int net_conn_recv_frame(NetConn *c, NetFrameHdr *h, char **payload);
+// For event loops: 1 if a whole frame is buffered (net_conn_recv_frame will
+// not touch the socket), 0 if not yet, -1 if its header announces more
+// than a NetConn can buffer (NET_CONN_MAX_LINE).
+int net_conn_has_frame(NetConn *c);
+// Reads DATA frames until one without NET_FRAME_MORE and joins them, up
+// to NET_PAYLOAD_MAX bytes in all.
+#define NET_PAYLOAD_MAX 0x7ffffff0
+int net_conn_recv_payload(NetConn *c, char **out, int *out_len);
+// Sends len bytes of buf as DATA frames, split at NET_FRAME_MAX with
+// NET_FRAME_MORE like net_send_file. Returns 0 or -1.
+int net_send_payload(int fd, uint32_t req_id, const void *buf, long long len);
+
+// Bulk transfers that never hold the whole payload in memory.
+// Sends len bytes of file_fd starting at offset as DATA frames, straight
+// from the page cache (sendfile on Linux, pread/send elsewhere). Payloads
+// over NET_FRAME_MAX are split with NET_FRAME_MORE. Returns 0, or -1 if
+// the socket failed or the file came up short (the stream is then broken
+// and the connection must be closed).
+int net_send_file(int fd, uint32_t req_id, int file_fd, long long offset, long long len);
+// Receive a payload and hand it to sink chunk by chunk. sink returns 0 to
+// continue. *total (optional) gets the byte count. Returns 0 or -1.
+typedef int (*NetChunkSink)(void *ctx, const char *data, int len);
+int net_conn_recv_payload_stream(NetConn *c, NetChunkSink sink, void *ctx, long long *total);
+// Forward a payload from c to out_fd frame by frame without buffering it
+// (splice through a pipe on Linux). Returns 0 or -1.
+int net_conn_relay_payload(NetConn *c, int out_fd, long long *total);
+
+// Client side: offer frames. Returns 1 if accepted, 0 if the server stays in
+// line mode, -1 if the server did not understand HELLO or the link failed.
+int net_hello(NetConn *c, int want_frames);
+// Server side: answer a "HELLO ..." line. Returns 1 if frames were picked.
+int net_hello_reply(int fd, const char *line, int frames_enabled);
+
 #endif
 
@@ -0,0 +1,84 @@
+#ifndef RGA_H
+#define RGA_H
+
+#include <stdint.h>
+
+// Replicated growable array: a sequence CRDT holding a document's text
+// one character per element, so several replicas can edit the same text
+// at once and still end up identical. Every character gets an id
+// (Lamport clock, site) when it is inserted and keeps it for good;
+// deleting it only marks it, so later operations can still name it. An
+// insert names the character it goes after (its origin), and inserts
+// made concurrently after the same origin are ordered by id, largest
+// first. Replicas that have applied the same operations, in any order
+// that keeps each operation after the ones it names, hold the same text.
+//
+// Operations travel as text lines:
+//   I <clock>.<site> <origin clock>.<origin site> <text>
+//       text inserted after the origin (0.0 = the start of the document);
+//       its characters get clocks clock, clock+1, ... of site
+//   D <clock>.<site>[+<n>] ...
+//       characters deleted; an item names n (default 1) consecutive
+//       clocks of one site
+// In <text> a backslash, newline, carriage return and NUL are written
+// \\, \n, \r and \0, so an operation is always one line. Long inserts
+// are split into several I lines of at most RGA_OP_MAX_TEXT characters.
+//
+// Site 0 belongs to the replica a document was loaded into.
+
+#define RGA_OP_MAX_TEXT 4096
+
+typedef struct {
+    uint64_t clock;
+    uint32_t site;
+} RgaId;
+
+typedef struct {
+    RgaId id;
+    int next;                   // following element in document order, -1 = last
+    char ch;
+    char deleted;
+} RgaElem;
+
+typedef struct {
+    RgaElem *elems;             // elems[0] is the start, id 0.0
+    int count, cap;
+    int *slots;                 // open-addressed id -> element, -1 = empty
+    int nslots;                 // power of two
+    int visible;                // characters not deleted
+    uint64_t clock;             // largest clock seen
+} Rga;
+
+// Called with each operation line (no newline) a call below produces;
+// a non-zero return stops it and is passed back
+typedef int (*RgaEmit)(void *arg, const char *op);
+
+// A replica holding text as site 0's characters (text may be NULL)
+Rga* rga_create(const char *text, int len);
+void rga_free(Rga *r);
+// The visible text (malloc'd, NUL-terminated), or NULL
+char* rga_text(const Rga *r, int *len);
+// Ids of the visible characters in order (malloc'd; NULL if empty or out
+// of memory, *n says which)
+RgaId* rga_visible_ids(const Rga *r, int *n);
+// Id of visible character pos, or 0.0 for pos -1. Returns 0, -1 if out
+// of range.
+int rga_id_at(const Rga *r, int pos, RgaId *out);
+
+// Local edits, emitted as operations for the other replicas. Return 0,
+// -1 on a bad position or unknown id, -2 if out of memory, or what emit
+// returned.
+int rga_insert_after(Rga *r, uint32_t site, RgaId origin, const char *text, int len, RgaEmit emit, void *arg);
+int rga_insert(Rga *r, uint32_t site, int pos, const char *text, int len, RgaEmit emit, void *arg);
+int rga_delete_ids(Rga *r, const RgaId *ids, int n, RgaEmit emit, void *arg);
+int rga_delete(Rga *r, int pos, int n, RgaEmit emit, void *arg);
+
+// Apply another replica's operation. Returns 0 (also for one already
+// applied), -1 if it is malformed or names a character this replica
+// hasn't seen, -2 if out of memory.
+int rga_apply(Rga *r, const char *op);
+// Operations that rebuild this replica (deleted characters included)
+// from an empty one, in document order
+int rga_snapshot(const Rga *r, RgaEmit emit, void *arg);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef RPC_H
+#define RPC_H
+
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include "net.h"
+
+// Multiplexed request/reply channel to storage servers. One persistent
+// connection per host is opened with "HELLO FRAMES RPC"; every request is a
+// LINE frame carrying a fresh request id, any number can be in flight at
+// once, and a reader thread per connection matches reply frames to the
+// waiting calls by id, whatever order they come back in. A batch goes out
+// to all its hosts before the first reply is awaited, so fanning a command
+// out to N servers costs one round trip instead of N.
+//
+// Only commands whose whole reply is a few lines belong here; bulk
+// transfers (FETCH, SYNC, VIEWCHECKPOINT) stay on pooled connections.
+#define RPC_MAX_HOSTS 64
+#define RPC_RETRY_SEC 30        // re-offer RPC to a host that declined it
+
+#define RPC_OK 0
+#define RPC_UNREACHABLE (-1)
+#define RPC_NO_RESPONSE (-2)    // nothing came back before the deadline
+#define RPC_UNSUPPORTED (-3)    // peer does not speak RPC; use a plain connection
+
+typedef struct RpcCall RpcCall;
+typedef struct RpcConn RpcConn;
+
+typedef struct {
+    char host[64];
+    uint16_t port;
+    RpcConn *conn;              // NULL when not connected
+    time_t declined_at;         // last time the peer refused RPC (0 = never)
+    int connecting;
+} RpcHost;
+
+typedef struct {
+    RpcHost hosts[RPC_MAX_HOSTS];
+    int host_count;
+    NetTimeouts timeouts;
+    pthread_mutex_t mutex;      // hosts, connections and pending calls
+    pthread_cond_t cond;        // signalled whenever a call completes
+} RpcClient;
+
+typedef struct {
+    const char *host;
+    uint16_t port;
+    const char *cmd;
+    int status;                 // RPC_OK or one of the errors above
+    char *reply;                // malloc'd reply lines, '\n'-terminated
+    int reply_len;
+} RpcRequest;
+
+RpcClient* rpc_client_create(const NetTimeouts *t);
+// Send every request, then wait until all have replied or timeout_ms has
+// passed (0 waits for as long as the connections stay up). Each request gets its own status; free replies with
+// rpc_requests_free().
+void rpc_call_batch(RpcClient *rc, RpcRequest *reqs, int n, int timeout_ms);
+// One request with a one-line reply (copied into resp, no newline).
+// Returns RPC_OK or an error code.
+int rpc_call(RpcClient *rc, const char *host, uint16_t port, const char *cmd, char *resp, int resplen, int timeout_ms);
+void rpc_requests_free(RpcRequest *reqs, int n);
+// Forget the connection to host:port (e.g. the SS went away)
+void rpc_client_drop_host(RpcClient *rc, const char *host, uint16_t port);
+
+#endif
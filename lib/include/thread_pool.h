@@ -0,0 +1,41 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+
+// Fixed set of worker threads fed from a FIFO job queue. A max_queue of 0
+// leaves the queue unbounded; otherwise thread_pool_submit() refuses work
+// once that many jobs are waiting.
+typedef void (*ThreadPoolFn)(void *arg);
+
+typedef struct ThreadPoolJob {
+    ThreadPoolFn fn;
+    void *arg;
+    struct ThreadPoolJob *next;
+} ThreadPoolJob;
+
+typedef struct {
+    pthread_t *threads;
+    int nthreads;
+    ThreadPoolJob *head;
+    ThreadPoolJob *tail;
+    int depth;                  // jobs waiting, not counting running ones
+    int max_queue;
+    int busy;                   // workers currently running a job
+    int shutdown;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} ThreadPool;
+
+// Start nthreads workers. Returns NULL if no worker could be started.
+ThreadPool* thread_pool_create(int nthreads, int max_queue);
+// Queue fn(arg). Returns 0, or -1 if the queue is full or the pool stopping.
+int thread_pool_submit(ThreadPool *pool, ThreadPoolFn fn, void *arg);
+// Jobs waiting for a worker
+int thread_pool_depth(ThreadPool *pool);
+// Workers currently running a job
+int thread_pool_busy(ThreadPool *pool);
+// Run the queued jobs, stop the workers and free the pool
+void thread_pool_free(ThreadPool *pool);
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef UNDO_LOG_H
+#define UNDO_LOG_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "hashmap.h"
+
+// Per-file undo history as a journal of reverse deltas, one file per
+// document at <root>/<file>.undo. Each change appends the byte range it
+// replaced: applying a record to the newer text gives back the older one.
+// Sentence edits touch a small range, so a record is usually a few bytes
+// rather than a copy of the document.
+//
+// Record: "D <before> <after> <off> <del> <ins>\n" + ins bytes + "\n"
+//   after  - hash of the text the delta applies to (the newer version)
+//   before - hash of the text it produces (the older version)
+//   replace bytes [off, off+del) of the newer text with the ins bytes
+//
+// The newest `depth` records within `budget` bytes are live; older ones
+// are dropped when the journal is compacted. Hashes tie the history to
+// the file: if the file no longer matches the newest record (it was
+// written some other way), its history is discarded rather than applied.
+
+typedef struct {
+    long pos;                   // where the record starts in the journal
+    int hdr_len;
+    int off, del, ins;
+    uint64_t before, after;
+} UndoRecord;
+
+typedef struct {
+    char name[256];
+    int loaded;
+    UndoRecord *recs;
+    int nrecs, cap;
+    long bytes;                 // journal size
+    pthread_mutex_t mutex;      // held between undo_log_acquire/release
+} UndoFile;
+
+typedef struct {
+    char root[256];
+    int depth;
+    long budget;
+    UndoFile **files;
+    int nfiles, cap_files;
+    HashMap *index;             // file name -> slot in files
+    pthread_mutex_t mutex;
+} UndoLog;
+
+#define UNDO_DEFAULT_DEPTH 16
+#define UNDO_DEFAULT_BUDGET (1024L * 1024L)
+
+UndoLog* undo_log_open(const char *root, int depth, long budget);
+// Lock fname's history. Every change to the file that should be undoable
+// happens between acquire and release, so records stay in file order.
+UndoFile* undo_log_acquire(UndoLog *ul, const char *fname);
+void undo_log_release(UndoFile *uf);
+// The file went from prev to cur: append the delta that takes it back
+int undo_log_record(UndoLog *ul, UndoFile *uf, const char *prev, int prev_len, const char *cur, int cur_len);
+// Levels that can be undone right now
+int undo_log_depth(UndoLog *ul, UndoFile *uf);
+// Step cur back `steps` versions into a malloc'd *out. Returns 0, -1 if
+// fewer levels are kept, or -2 if cur isn't the version history ends at
+// (the history is then discarded). Nothing is dropped until undo_log_drop.
+int undo_log_undo(UndoLog *ul, UndoFile *uf, const char *cur, int cur_len, int steps, char **out, int *out_len);
+// Forget the newest `steps` records (after their undo was written)
+void undo_log_drop(UndoLog *ul, UndoFile *uf, int steps);
+// Discard the file's history
+void undo_log_clear(UndoLog *ul, UndoFile *uf);
+// Carry history over a rename; the caller holds neither file
+void undo_log_move(UndoLog *ul, const char *oldname, const char *newname);
+
+#endif
@@ -7,6 +7,8 @@
 int mkpath(const char *path);
 int read_file_all(const char *path, char **out_buf, int *out_len);
 int write_file_all(const char *path, const char *buf, int len);
+// 64-bit FNV-1a of buf, for telling file versions apart
+uint64_t hash_bytes(const char *buf, int len);
 
 int config_get_string(const char *key, char *out_buf, size_t out_len);
 int config_get_uint16(const char *key, uint16_t *out_value);
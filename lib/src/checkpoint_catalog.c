@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "../../lib/include/checkpoint_catalog.h"
+#include "../../lib/include/util.h"
+
+struct CatalogFile {
+    char name[256];
+    int loaded;
+    CheckpointEntry *entries;
+    int n, cap;
+    HashMap *tags;              // tag -> slot in entries
+    int lines;                  // records in the catalog file
+};
+
+static void catalog_path(CheckpointCatalog *cat, const char *fname, char *out, size_t outlen) {
+    snprintf(out, outlen, "%s/%s/.catalog", cat->root, fname);
+}
+
+static int format_entry(const CheckpointEntry *e, char *out, size_t outlen) {
+    return snprintf(out, outlen, "%" PRId64 " %lld %016" PRIx64 " %s\n", e->created, e->size, e->hash, e->tag);
+}
+
+// Add or replace in memory only
+static int put_entry(CatalogFile *cf, const CheckpointEntry *e) {
+    int slot = hashmap_get(cf->tags, e->tag);
+    if (slot >= 0) { cf->entries[slot] = *e; return 0; }
+    if (cf->n == cf->cap) {
+        int ncap = cf->cap ? cf->cap * 2 : 16;
+        CheckpointEntry *m = (CheckpointEntry*)realloc(cf->entries, ncap * sizeof(CheckpointEntry));
+        if (!m) return -1;
+        cf->entries = m;
+        cf->cap = ncap;
+    }
+    if (hashmap_put(cf->tags, e->tag, cf->n) != 0) return -1;
+    cf->entries[cf->n++] = *e;
+    return 0;
+}
+
+static int append_line(CheckpointCatalog *cat, CatalogFile *cf, const CheckpointEntry *e) {
+    char path[600]; catalog_path(cat, cf->name, path, sizeof(path));
+    char dir[600]; snprintf(dir, sizeof(dir), "%s/%s", cat->root, cf->name);
+    mkpath(dir);
+    char line[160];
+    int len = format_entry(e, line, sizeof(line));
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) return -1;
+    int rc = 0;
+    for (int off = 0; off < len; ) {
+        ssize_t n = write(fd, line + off, len - off);
+        if (n < 0) { if (errno == EINTR) continue; rc = -1; break; }
+        off += (int)n;
+    }
+    close(fd);
+    if (rc == 0) cf->lines++;
+    return rc;
+}
+
+// Write the catalog afresh: one line per live entry
+static int rewrite(CheckpointCatalog *cat, CatalogFile *cf) {
+    char *buf = (char*)malloc((size_t)cf->n * 160 + 1);
+    if (!buf) return -1;
+    int len = 0;
+    for (int i = 0; i < cf->n; i++) len += format_entry(&cf->entries[i], buf + len, 160);
+    char path[600]; catalog_path(cat, cf->name, path, sizeof(path));
+    int rc = write_file_all(path, buf, len);
+    free(buf);
+    if (rc == 0) cf->lines = cf->n;
+    return rc;
+}
+
+// Describe a checkpoint directory the catalog doesn't know about
+static int entry_from_disk(CheckpointCatalog *cat, const char *fname, const char *tag, CheckpointEntry *e) {
+    char dir[600]; snprintf(dir, sizeof(dir), "%s/%s/%s", cat->root, fname, tag);
+    struct stat st;
+    if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode)) return -1;
+    char *buf = NULL; int len = 0;
+    if (!cat->load || cat->load(fname, tag, &buf, &len) != 0) return -1;
+    memset(e, 0, sizeof(*e));
+    strncpy(e->tag, tag, sizeof(e->tag) - 1);
+    e->created = (int64_t)st.st_mtime;
+    e->size = len;
+    e->hash = hash_bytes(buf, len);
+    free(buf);
+    return 0;
+}
+
+static void load(CheckpointCatalog *cat, CatalogFile *cf) {
+    cf->loaded = 1;
+    char path[600]; catalog_path(cat, cf->name, path, sizeof(path));
+    char *buf = NULL; int len = 0;
+    if (read_file_all(path, &buf, &len) == 0) {
+        char *p = buf;
+        while (p < buf + len) {
+            char *nl = memchr(p, '\n', buf + len - p);
+            if (!nl) break;         // torn last line
+            *nl = '\0';
+            CheckpointEntry e;
+            memset(&e, 0, sizeof(e));
+            if (sscanf(p, "%" SCNd64 " %lld %" SCNx64 " %63s", &e.created, &e.size, &e.hash, e.tag) == 4) {
+                put_entry(cf, &e);
+                cf->lines++;
+            }
+            p = nl + 1;
+        }
+        free(buf);
+        // Mostly overwritten tags: worth squeezing out
+        if (cf->lines > 2 * cf->n + 16) rewrite(cat, cf);
+        return;
+    }
+    // No catalog yet: build it from the checkpoint directories
+    char dir[600]; snprintf(dir, sizeof(dir), "%s/%s", cat->root, cf->name);
+    DIR *d = opendir(dir);
+    if (!d) return;
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        if (de->d_name[0] == '.') continue;
+        CheckpointEntry e;
+        if (entry_from_disk(cat, cf->name, de->d_name, &e) == 0) put_entry(cf, &e);
+    }
+    closedir(d);
+    if (cf->n > 0) rewrite(cat, cf);
+}
+
+CheckpointCatalog* catalog_open(const char *root, CatalogLoader loader) {
+    CheckpointCatalog *cat = (CheckpointCatalog*)calloc(1, sizeof(CheckpointCatalog));
+    if (!cat) return NULL;
+    strncpy(cat->root, root, sizeof(cat->root) - 1);
+    cat->load = loader;
+    cat->index = hashmap_create();
+    if (!cat->index) { free(cat); return NULL; }
+    pthread_mutex_init(&cat->mutex, NULL);
+    return cat;
+}
+
+// Cached catalog of fname, loaded on first use. Call with cat->mutex held.
+static CatalogFile* file_get(CheckpointCatalog *cat, const char *fname) {
+    int slot = hashmap_get(cat->index, fname);
+    CatalogFile *cf = slot >= 0 ? cat->files[slot] : NULL;
+    if (!cf) {
+        if (cat->nfiles == cat->cap_files) {
+            int ncap = cat->cap_files ? cat->cap_files * 2 : 16;
+            CatalogFile **m = (CatalogFile**)realloc(cat->files, ncap * sizeof(CatalogFile*));
+            if (!m) return NULL;
+            cat->files = m;
+            cat->cap_files = ncap;
+        }
+        cf = (CatalogFile*)calloc(1, sizeof(CatalogFile));
+        if (!cf) return NULL;
+        cf->tags = hashmap_create();
+        if (!cf->tags || hashmap_put(cat->index, fname, cat->nfiles) != 0) {
+            if (cf->tags) hashmap_free(cf->tags);
+            free(cf);
+            return NULL;
+        }
+        strncpy(cf->name, fname, sizeof(cf->name) - 1);
+        cat->files[cat->nfiles++] = cf;
+    }
+    if (!cf->loaded) load(cat, cf);
+    return cf;
+}
+
+int catalog_add(CheckpointCatalog *cat, const char *fname, const char *tag, const char *buf, int len) {
+    if (!cat) return -1;
+    CheckpointEntry e;
+    memset(&e, 0, sizeof(e));
+    strncpy(e.tag, tag, sizeof(e.tag) - 1);
+    e.created = (int64_t)time(NULL);
+    e.size = len;
+    e.hash = hash_bytes(buf, len);
+    pthread_mutex_lock(&cat->mutex);
+    CatalogFile *cf = file_get(cat, fname);
+    int rc = cf ? put_entry(cf, &e) : -1;
+    if (rc == 0) rc = append_line(cat, cf, &e);
+    pthread_mutex_unlock(&cat->mutex);
+    return rc;
+}
+
+int catalog_find(CheckpointCatalog *cat, const char *fname, const char *tag, CheckpointEntry *out) {
+    if (!cat) return 1;
+    pthread_mutex_lock(&cat->mutex);
+    CatalogFile *cf = file_get(cat, fname);
+    int rc = 1;
+    if (cf) {
+        int slot = hashmap_get(cf->tags, tag);
+        if (slot >= 0) {
+            *out = cf->entries[slot];
+            rc = 0;
+        } else if (tag[0] != '.' && entry_from_disk(cat, fname, tag, out) == 0) {
+            // A checkpoint saved just before a crash cut off its catalog line
+            if (put_entry(cf, out) == 0) append_line(cat, cf, out);
+            rc = 0;
+        }
+    }
+    pthread_mutex_unlock(&cat->mutex);
+    return rc;
+}
+
+static int cmp_time(const void *a, const void *b) {
+    const CheckpointEntry *x = (const CheckpointEntry*)a, *y = (const CheckpointEntry*)b;
+    if (x->created != y->created) return x->created < y->created ? -1 : 1;
+    return strcmp(x->tag, y->tag);
+}
+
+static int cmp_tag(const void *a, const void *b) {
+    return strcmp(((const CheckpointEntry*)a)->tag, ((const CheckpointEntry*)b)->tag);
+}
+
+static int cmp_size(const void *a, const void *b) {
+    const CheckpointEntry *x = (const CheckpointEntry*)a, *y = (const CheckpointEntry*)b;
+    if (x->size != y->size) return x->size < y->size ? -1 : 1;
+    return cmp_time(a, b);
+}
+
+int catalog_list(CheckpointCatalog *cat, const char *fname, CatalogSort sort, int desc,
+                 int offset, int limit, CheckpointEntry **out, int *count, int *total) {
+    *out = NULL; *count = 0; *total = 0;
+    if (!cat) return -1;
+    pthread_mutex_lock(&cat->mutex);
+    CatalogFile *cf = file_get(cat, fname);
+    int n = cf ? cf->n : 0;
+    CheckpointEntry *all = (CheckpointEntry*)malloc((n ? n : 1) * sizeof(CheckpointEntry));
+    if (all && n) memcpy(all, cf->entries, n * sizeof(CheckpointEntry));
+    pthread_mutex_unlock(&cat->mutex);
+    if (!all) return -1;
+
+    qsort(all, n, sizeof(CheckpointEntry),
+          sort == CATALOG_SORT_TAG ? cmp_tag : sort == CATALOG_SORT_SIZE ? cmp_size : cmp_time);
+    if (desc) {
+        for (int i = 0, j = n - 1; i < j; i++, j--) {
+            CheckpointEntry t = all[i]; all[i] = all[j]; all[j] = t;
+        }
+    }
+    if (offset < 0) offset = 0;
+    if (offset > n) offset = n;
+    int cnt = n - offset;
+    if (limit > 0 && cnt > limit) cnt = limit;
+    memmove(all, all + offset, cnt * sizeof(CheckpointEntry));
+    *out = all;
+    *count = cnt;
+    *total = n;
+    return 0;
+}
+
+int catalog_parse_sort(const char *s, CatalogSort *sort) {
+    if (strcmp(s, "time") == 0) *sort = CATALOG_SORT_TIME;
+    else if (strcmp(s, "tag") == 0) *sort = CATALOG_SORT_TAG;
+    else if (strcmp(s, "size") == 0) *sort = CATALOG_SORT_SIZE;
+    else return -1;
+    return 0;
+}
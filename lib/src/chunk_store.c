@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "../../lib/include/chunk_store.h"
+#include "../../lib/include/util.h"
+
+// --- SHA-256 (chunk names) --------------------------------------------
+
+static const uint32_t sha_k[64] = {
+    0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
+    0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,
+    0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,
+    0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,0xc6e00bf3,0xd5a79147,0x06ca6351,0x14292967,
+    0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85,
+    0xa2bfe8a1,0xa81a664b,0xc24b8b70,0xc76c51a3,0xd192e819,0xd6990624,0xf40e3585,0x106aa070,
+    0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3,
+    0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha_block(uint32_t h[8], const unsigned char *p) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) w[i] = (uint32_t)p[4*i] << 24 | (uint32_t)p[4*i+1] << 16 | (uint32_t)p[4*i+2] << 8 | p[4*i+3];
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROR(w[i-15], 7) ^ ROR(w[i-15], 18) ^ (w[i-15] >> 3);
+        uint32_t s1 = ROR(w[i-2], 17) ^ ROR(w[i-2], 19) ^ (w[i-2] >> 10);
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = hh + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) + sha_k[i] + w[i];
+        uint32_t t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        hh = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+}
+
+static void sha256_hex(const char *data, int len, char out[65]) {
+    uint32_t h[8] = { 0x6a09e667,0xbb67ae85,0x3c6ef372,0xa54ff53a,0x510e527f,0x9b05688c,0x1f83d9ab,0x5be0cd19 };
+    const unsigned char *p = (const unsigned char*)data;
+    int i = 0;
+    for (; i + 64 <= len; i += 64) sha_block(h, p + i);
+    unsigned char tail[128] = {0};
+    int rest = len - i;
+    memcpy(tail, p + i, rest);
+    tail[rest] = 0x80;
+    int tlen = rest + 9 <= 64 ? 64 : 128;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int k = 0; k < 8; k++) tail[tlen - 1 - k] = (unsigned char)(bits >> (8 * k));
+    sha_block(h, tail);
+    if (tlen == 128) sha_block(h, tail + 64);
+    for (int k = 0; k < 8; k++) snprintf(out + 8 * k, 9, "%08x", h[k]);
+}
+
+// --- content-defined chunking -------------------------------------------
+
+static uint64_t gear[256];
+static pthread_once_t gear_once = PTHREAD_ONCE_INIT;
+
+// Fixed pseudo-random table (splitmix64), so boundaries are stable
+// across runs and machines
+static void gear_init(void) {
+    uint64_t x = 0x9e3779b97f4a7c15ULL;
+    for (int i = 0; i < 256; i++) {
+        uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        gear[i] = z ^ (z >> 31);
+    }
+}
+
+// Length of the chunk starting at buf. The gear hash shifts one bit per
+// byte, so its top bits depend on the last 64 bytes only: a boundary is
+// wherever those bytes hash to zero under the mask.
+static int next_chunk(const char *buf, int len) {
+    if (len <= CHUNK_MIN) return len;
+    const uint64_t mask = ~0ULL << (64 - CHUNK_AVG_BITS);
+    int limit = len < CHUNK_MAX ? len : CHUNK_MAX;
+    uint64_t h = 0;
+    for (int i = 0; i < limit; i++) {
+        h = (h << 1) + gear[(unsigned char)buf[i]];
+        if (i + 1 >= CHUNK_MIN && (h & mask) == 0) return i + 1;
+    }
+    return limit;
+}
+
+// --- manifests ----------------------------------------------------------
+
+typedef struct {
+    char hash[65];
+    int len;
+} ChunkRef;
+
+// Parse a manifest into a malloc'd array. Returns the chunk count, or -1
+// if the manifest is missing or damaged.
+static int manifest_read(const char *path, ChunkRef **out, long long *size) {
+    char *buf = NULL; int len = 0;
+    if (read_file_all(path, &buf, &len) != 0) return -1;
+    int n = 0;
+    long long total = 0;
+    char *p = buf;
+    if (sscanf(p, "CKM1 %lld %d", &total, &n) != 2 || n < 0) { free(buf); return -1; }
+    ChunkRef *refs = (ChunkRef*)malloc((n ? n : 1) * sizeof(ChunkRef));
+    if (!refs) { free(buf); return -1; }
+    long long sum = 0;
+    for (int i = 0; i < n; i++) {
+        p = strchr(p, '\n');
+        if (!p || sscanf(++p, "%64s %d", refs[i].hash, &refs[i].len) != 2 || strlen(refs[i].hash) != 64 || refs[i].len < 0) {
+            free(refs); free(buf); return -1;
+        }
+        sum += refs[i].len;
+    }
+    free(buf);
+    if (sum != total) { free(refs); return -1; }
+    *out = refs;
+    if (size) *size = total;
+    return n;
+}
+
+static void chunk_path(ChunkStore *cs, const char *hash, char *out, size_t outlen) {
+    snprintf(out, outlen, "%s/%.2s/%s", cs->root, hash, hash);
+}
+
+static int ref_count(ChunkStore *cs, const char *hash) {
+    int n = hashmap_get(cs->refs, hash);
+    return n > 0 ? n : 0;
+}
+
+// Drop one reference; the chunk goes when its last one does
+static void unref(ChunkStore *cs, const ChunkRef *r) {
+    int n = ref_count(cs, r->hash);
+    if (n > 1) { hashmap_put(cs->refs, r->hash, n - 1); return; }
+    hashmap_remove(cs->refs, r->hash);
+    if (n == 1) {
+        char path[512]; chunk_path(cs, r->hash, path, sizeof(path));
+        remove(path);
+        cs->chunks--;
+        cs->stored_bytes -= r->len;
+    }
+}
+
+static void add_ref(ChunkStore *cs, const ChunkRef *r) {
+    int n = ref_count(cs, r->hash);
+    if (n == 0) { cs->chunks++; cs->stored_bytes += r->len; }
+    hashmap_put(cs->refs, r->hash, n + 1);
+}
+
+static void scan_manifests(ChunkStore *cs, const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return;
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        if (e->d_name[0] == '.') continue;
+        char path[1024]; snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        struct stat st;
+        if (stat(path, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) { scan_manifests(cs, path); continue; }
+        if (strcmp(e->d_name, "manifest") != 0) continue;
+        ChunkRef *refs = NULL; long long size = 0;
+        int n = manifest_read(path, &refs, &size);
+        if (n < 0) continue;
+        for (int i = 0; i < n; i++) add_ref(cs, &refs[i]);
+        cs->logical_bytes += size;
+        cs->manifests++;
+        free(refs);
+    }
+    closedir(d);
+}
+
+// Delete chunks no manifest refers to (left by a crash mid-checkpoint)
+static void sweep_chunks(ChunkStore *cs) {
+    DIR *d = opendir(cs->root);
+    if (!d) return;
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        if (e->d_name[0] == '.') continue;
+        char sub[512]; snprintf(sub, sizeof(sub), "%s/%s", cs->root, e->d_name);
+        DIR *sd = opendir(sub);
+        if (!sd) continue;
+        struct dirent *c;
+        while ((c = readdir(sd))) {
+            if (c->d_name[0] == '.') continue;
+            if (ref_count(cs, c->d_name) == 0) {
+                char path[1024]; snprintf(path, sizeof(path), "%s/%s", sub, c->d_name);
+                remove(path);
+            }
+        }
+        closedir(sd);
+    }
+    closedir(d);
+}
+
+ChunkStore* chunk_store_open(const char *root, const char *manifest_root) {
+    pthread_once(&gear_once, gear_init);
+    ChunkStore *cs = (ChunkStore*)calloc(1, sizeof(ChunkStore));
+    if (!cs) return NULL;
+    strncpy(cs->root, root, sizeof(cs->root) - 1);
+    cs->refs = hashmap_create();
+    if (!cs->refs || mkpath(root) != 0) { if (cs->refs) hashmap_free(cs->refs); free(cs); return NULL; }
+    pthread_mutex_init(&cs->mutex, NULL);
+    scan_manifests(cs, manifest_root);
+    sweep_chunks(cs);
+    return cs;
+}
+
+int chunk_store_save(ChunkStore *cs, const char *manifest_path, const char *buf, int len) {
+    int cap = 16, n = 0;
+    ChunkRef *refs = (ChunkRef*)malloc(cap * sizeof(ChunkRef));
+    if (!refs) return -1;
+    for (int off = 0; off < len; ) {
+        int clen = next_chunk(buf + off, len - off);
+        if (n == cap) {
+            ChunkRef *m = (ChunkRef*)realloc(refs, (cap *= 2) * sizeof(ChunkRef));
+            if (!m) { free(refs); return -1; }
+            refs = m;
+        }
+        sha256_hex(buf + off, clen, refs[n].hash);
+        refs[n].len = clen;
+        n++;
+        off += clen;
+    }
+
+    // The manifest text: header plus one short line per chunk
+    char *mf = (char*)malloc(64 + (size_t)n * 80);
+    if (!mf) { free(refs); return -1; }
+    int mlen = sprintf(mf, "CKM1 %d %d\n", len, n);
+    for (int i = 0; i < n; i++) mlen += sprintf(mf + mlen, "%s %d\n", refs[i].hash, refs[i].len);
+
+    pthread_mutex_lock(&cs->mutex);
+    ChunkRef *old = NULL; long long old_size = 0;
+    int old_n = manifest_read(manifest_path, &old, &old_size);
+    int rc = 0, added = 0, off = 0;
+    for (; added < n; added++) {
+        ChunkRef *r = &refs[added];
+        if (ref_count(cs, r->hash) == 0) {
+            // Only chunks the store doesn't hold yet cost a write
+            char path[512]; chunk_path(cs, r->hash, path, sizeof(path));
+            if (write_file_all(path, buf + off, r->len) != 0) { rc = -1; break; }
+        }
+        add_ref(cs, r);
+        off += r->len;
+    }
+    if (rc == 0 && write_file_all(manifest_path, mf, mlen) != 0) rc = -1;
+    if (rc != 0) {
+        for (int i = 0; i < added; i++) unref(cs, &refs[i]);
+    } else {
+        if (old_n >= 0) {
+            for (int i = 0; i < old_n; i++) unref(cs, &old[i]);
+            cs->logical_bytes -= old_size;
+            cs->manifests--;
+        }
+        cs->logical_bytes += len;
+        cs->manifests++;
+    }
+    pthread_mutex_unlock(&cs->mutex);
+    free(old);
+    free(refs);
+    free(mf);
+    return rc;
+}
+
+int chunk_store_read(ChunkStore *cs, const char *manifest_path, ChunkSink sink, void *ctx) {
+    pthread_mutex_lock(&cs->mutex);
+    ChunkRef *refs = NULL;
+    int n = manifest_read(manifest_path, &refs, NULL);
+    if (n < 0) { pthread_mutex_unlock(&cs->mutex); return 1; }
+    int rc = n == 0 ? sink(ctx, "", 0, 1) : 0;
+    for (int i = 0; i < n && rc == 0; i++) {
+        char path[512]; chunk_path(cs, refs[i].hash, path, sizeof(path));
+        char *data = NULL; int dlen = 0;
+        if (read_file_all(path, &data, &dlen) != 0 || dlen != refs[i].len) { free(data); rc = -1; break; }
+        if (sink(ctx, data, dlen, i == n - 1) != 0) rc = -1;
+        free(data);
+    }
+    pthread_mutex_unlock(&cs->mutex);
+    free(refs);
+    return rc;
+}
+
+typedef struct {
+    char *buf;
+    int len, cap;
+} LoadCtx;
+
+static int load_sink(void *ctx, const char *data, int len, int last) {
+    (void)last;
+    LoadCtx *l = (LoadCtx*)ctx;
+    if (l->len + len + 1 > l->cap) {
+        int ncap = (l->len + len + 1) * 2;
+        char *n = (char*)realloc(l->buf, ncap);
+        if (!n) return -1;
+        l->buf = n;
+        l->cap = ncap;
+    }
+    memcpy(l->buf + l->len, data, len);
+    l->len += len;
+    l->buf[l->len] = '\0';
+    return 0;
+}
+
+int chunk_store_load(ChunkStore *cs, const char *manifest_path, char **buf, int *len) {
+    LoadCtx l = { NULL, 0, 0 };
+    int rc = chunk_store_read(cs, manifest_path, load_sink, &l);
+    if (rc != 0) { free(l.buf); return rc; }
+    *buf = l.buf;
+    *len = l.len;
+    return 0;
+}
+
+int chunk_store_remove(ChunkStore *cs, const char *manifest_path) {
+    pthread_mutex_lock(&cs->mutex);
+    ChunkRef *refs = NULL; long long size = 0;
+    int n = manifest_read(manifest_path, &refs, &size);
+    int rc = remove(manifest_path) == 0 ? 0 : -1;
+    if (rc == 0 && n >= 0) {
+        for (int i = 0; i < n; i++) unref(cs, &refs[i]);
+        cs->logical_bytes -= size;
+        cs->manifests--;
+    }
+    pthread_mutex_unlock(&cs->mutex);
+    free(refs);
+    return rc;
+}
+
+void chunk_store_stats_format(ChunkStore *cs, char *buf, int buflen) {
+    pthread_mutex_lock(&cs->mutex);
+    double ratio = cs->stored_bytes > 0 ? (double)cs->logical_bytes / (double)cs->stored_bytes : 1.0;
+    snprintf(buf, buflen, "chunks=%lld stored=%lld logical=%lld dedup=%.2f",
+             cs->chunks, cs->stored_bytes, cs->logical_bytes, ratio);
+    pthread_mutex_unlock(&cs->mutex);
+}
@@ -0,0 +1,590 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include "../../lib/include/collab.h"
+#include "../../lib/include/doc.h"
+#include "../../lib/include/hashmap.h"
+
+CollabHub* collab_hub_create(void) {
+    CollabHub *h = (CollabHub*)calloc(1, sizeof(CollabHub));
+    if (!h) return NULL;
+    pthread_mutex_init(&h->mutex, NULL);
+    return h;
+}
+
+// --- subscribers ------------------------------------------------------
+
+static void wake(int fd) {
+    uint64_t one = 1;
+    ssize_t n = write(fd, &one, sizeof(one));
+    (void)n;
+}
+
+// Returns -1 once the peer has failed (checked between waits, so a
+// client that stopped reading can't hold the writer forever) or waiting
+// for room fails
+static int send_all(CollabPeer *p, const char *buf, int len) {
+    for (int off = 0; off < len; ) {
+        ssize_t n = send(p->fd, buf + off, len - off, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0) { off += (int)n; continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (__sync_fetch_and_add(&p->failed, 0)) return -1;
+            if (fiber_wait_fd(p->wfd, 1, 1000) < 0) return -1;
+            continue;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+static void peer_writer(void *arg) {
+    CollabPeer *p = (CollabPeer*)arg;
+    char *spare = NULL;
+    int spare_cap = 0;
+    while (1) {
+        // Swap the outbox for an empty buffer and send it unlocked
+        pthread_mutex_lock(&p->mutex);
+        char *out = p->out;
+        int len = p->out_len, cap = p->out_cap, closing = p->closing;
+        p->out = spare;
+        p->out_cap = spare_cap;
+        p->out_len = 0;
+        pthread_mutex_unlock(&p->mutex);
+        spare = out;
+        spare_cap = cap;
+        if (len > 0) {
+            if (!__sync_fetch_and_add(&p->failed, 0) && send_all(p, out, len) != 0) {
+                __sync_lock_test_and_set(&p->failed, 1);
+            }
+            continue;
+        }
+        if (closing) break;
+        fiber_wait_fd(p->wake_fd, 0, -1);
+        uint64_t v;
+        ssize_t n = read(p->wake_fd, &v, sizeof(v));
+        (void)n;
+    }
+    free(spare);
+    wake(p->done_fd);
+}
+
+static void* peer_writer_thread(void *arg) {
+    peer_writer(arg);
+    return NULL;
+}
+
+CollabPeer* collab_peer_open(int fd, uint32_t site, FiberSched *sched) {
+    CollabPeer *p = (CollabPeer*)calloc(1, sizeof(CollabPeer));
+    if (!p) return NULL;
+    p->fd = fd;
+    p->wfd = dup(fd);
+    p->site = site;
+    pthread_mutex_init(&p->mutex, NULL);
+    p->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    p->done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int started = 0;
+    if (p->wfd >= 0 && p->wake_fd >= 0 && p->done_fd >= 0) {
+        if (sched) {
+            started = fiber_spawn(sched, peer_writer, p) == 0;
+        } else {
+            pthread_t t;
+            if (pthread_create(&t, NULL, peer_writer_thread, p) == 0) {
+                pthread_detach(t);
+                started = 1;
+            }
+        }
+    }
+    if (!started) {
+        if (p->wfd >= 0) close(p->wfd);
+        if (p->wake_fd >= 0) close(p->wake_fd);
+        if (p->done_fd >= 0) close(p->done_fd);
+        pthread_mutex_destroy(&p->mutex);
+        free(p);
+        return NULL;
+    }
+    return p;
+}
+
+int collab_peer_send(CollabPeer *p, const char *line) {
+    int len = (int)strlen(line);
+    int rc = 0;
+    pthread_mutex_lock(&p->mutex);
+    if (__sync_fetch_and_add(&p->failed, 0)) {
+        rc = -1;
+    } else if (p->out_len + len + 1 > COLLAB_OUTBOX_MAX) {
+        // Too far behind: drop the client rather than buffer without end
+        __sync_lock_test_and_set(&p->failed, 1);
+        shutdown(p->fd, SHUT_RDWR);
+        rc = -1;
+    } else {
+        if (p->out_len + len + 1 > p->out_cap) {
+            int cap = p->out_cap ? p->out_cap : 4096;
+            while (cap < p->out_len + len + 1) cap *= 2;
+            char *out = (char*)realloc(p->out, cap);
+            if (!out) rc = -1;
+            else { p->out = out; p->out_cap = cap; }
+        }
+        if (rc == 0) {
+            memcpy(p->out + p->out_len, line, len);
+            p->out[p->out_len + len] = '\n';
+            p->out_len += len + 1;
+        }
+    }
+    pthread_mutex_unlock(&p->mutex);
+    if (rc == 0) wake(p->wake_fd);
+    return rc;
+}
+
+void collab_peer_close(CollabPeer *p, int flush) {
+    if (!p) return;
+    pthread_mutex_lock(&p->mutex);
+    p->closing = 1;
+    pthread_mutex_unlock(&p->mutex);
+    if (!flush) __sync_lock_test_and_set(&p->failed, 1);
+    wake(p->wake_fd);
+    uint64_t v;
+    while (read(p->done_fd, &v, sizeof(v)) != sizeof(v)) fiber_wait_fd(p->done_fd, 0, -1);
+    close(p->wfd);
+    close(p->wake_fd);
+    close(p->done_fd);
+    pthread_mutex_destroy(&p->mutex);
+    free(p->out);
+    free(p);
+}
+
+// --- documents --------------------------------------------------------
+
+static void doc_free_live(CollabDoc *d) {
+    free(d->name);
+    rga_free(d->rga);
+    free(d->base);
+    free(d->peers);
+    free(d->view);
+    free(d->view_ids);
+    free(d->view_sents);
+    pthread_mutex_destroy(&d->mutex);
+    pthread_mutex_destroy(&d->save_mutex);
+    free(d);
+}
+
+CollabDoc* collab_get(CollabHub *h, const char *name) {
+    unsigned int b = hash_string(name) % COLLAB_BUCKETS;
+    pthread_mutex_lock(&h->mutex);
+    CollabDoc *d = h->buckets[b];
+    while (d && strcmp(d->name, name) != 0) d = d->next;
+    if (d) d->refs++;
+    pthread_mutex_unlock(&h->mutex);
+    return d;
+}
+
+CollabDoc* collab_open(CollabHub *h, const char *name, const char *base, int base_len, const char *text, int len, int max_len) {
+    CollabDoc *d = (CollabDoc*)calloc(1, sizeof(CollabDoc));
+    if (!d) return NULL;
+    d->name = strdup(name);
+    d->rga = rga_create(text, len);
+    d->base = (char*)malloc(base_len + 1);
+    pthread_mutex_init(&d->mutex, NULL);
+    pthread_mutex_init(&d->save_mutex, NULL);
+    if (!d->name || !d->rga || !d->base) { doc_free_live(d); return NULL; }
+    if (base_len > 0) memcpy(d->base, base, base_len);
+    d->base[base_len] = '\0';
+    d->base_len = base_len;
+    d->max_len = max_len;
+    d->refs = 1;
+
+    unsigned int b = hash_string(name) % COLLAB_BUCKETS;
+    pthread_mutex_lock(&h->mutex);
+    CollabDoc *cur = h->buckets[b];
+    while (cur && strcmp(cur->name, name) != 0) cur = cur->next;
+    if (cur) {
+        // Someone else opened it first
+        cur->refs++;
+    } else {
+        d->next = h->buckets[b];
+        h->buckets[b] = d;
+        h->docs++;
+    }
+    pthread_mutex_unlock(&h->mutex);
+    if (cur) { doc_free_live(d); return cur; }
+    return d;
+}
+
+void collab_release(CollabHub *h, CollabDoc *d) {
+    if (!d) return;
+    unsigned int b = hash_string(d->name) % COLLAB_BUCKETS;
+    pthread_mutex_lock(&h->mutex);
+    int last = --d->refs == 0;
+    if (last) {
+        CollabDoc **pp = &h->buckets[b];
+        while (*pp && *pp != d) pp = &(*pp)->next;
+        if (*pp) *pp = d->next;
+        h->docs--;
+        h->ops += d->ops;
+    }
+    pthread_mutex_unlock(&h->mutex);
+    if (last) doc_free_live(d);
+}
+
+int collab_dirty(CollabHub *h, CollabDoc ***out) {
+    *out = NULL;
+    int n = 0;
+    pthread_mutex_lock(&h->mutex);
+    CollabDoc **docs = h->docs > 0 ? (CollabDoc**)malloc(sizeof(CollabDoc*) * h->docs) : NULL;
+    for (int b = 0; docs && b < COLLAB_BUCKETS; b++) {
+        for (CollabDoc *d = h->buckets[b]; d; d = d->next) {
+            pthread_mutex_lock(&d->mutex);
+            int dirty = d->dirty;
+            pthread_mutex_unlock(&d->mutex);
+            if (dirty) { d->refs++; docs[n++] = d; }
+        }
+    }
+    pthread_mutex_unlock(&h->mutex);
+    if (n == 0) free(docs);
+    else *out = docs;
+    return n;
+}
+
+// --- edits ------------------------------------------------------------
+
+typedef struct {
+    CollabDoc *d;
+    CollabPeer *skip;           // the subscriber the operation came from
+    CollabPeer *only;           // send to this one alone (a snapshot)
+} Broadcast;
+
+// Document lock held
+static int broadcast(void *arg, const char *op) {
+    Broadcast *bc = (Broadcast*)arg;
+    CollabDoc *d = bc->d;
+    int len = (int)(strlen(d->name) + strlen(op)) + 8;
+    char *line = (char*)malloc(len);
+    if (!line) return -2;
+    snprintf(line, len, "OP %s %s", d->name, op);
+    if (bc->only) {
+        collab_peer_send(bc->only, line);
+    } else {
+        for (int i = 0; i < d->npeers; i++) {
+            if (d->peers[i] != bc->skip) collab_peer_send(d->peers[i], line);
+        }
+        d->ops++;
+    }
+    free(line);
+    return 0;
+}
+
+int collab_join(CollabDoc *d, CollabPeer *p) {
+    pthread_mutex_lock(&d->mutex);
+    int rc = 0;
+    for (int i = 0; i < d->npeers; i++) {
+        if (d->peers[i] == p) rc = 1;
+    }
+    if (rc == 0 && d->npeers == d->cap_peers) {
+        int cap = d->cap_peers ? d->cap_peers * 2 : 4;
+        CollabPeer **peers = (CollabPeer**)realloc(d->peers, sizeof(CollabPeer*) * cap);
+        if (!peers) rc = -2;
+        else { d->peers = peers; d->cap_peers = cap; }
+    }
+    if (rc == 0) {
+        // The snapshot goes out before anything broadcast after it
+        Broadcast bc = { d, NULL, p };
+        rc = rga_snapshot(d->rga, broadcast, &bc) == 0 ? 0 : -2;
+        if (rc == 0) d->peers[d->npeers++] = p;
+    }
+    pthread_mutex_unlock(&d->mutex);
+    return rc;
+}
+
+int collab_leave(CollabDoc *d, CollabPeer *p) {
+    pthread_mutex_lock(&d->mutex);
+    int rc = -1;
+    for (int i = 0; i < d->npeers; i++) {
+        if (d->peers[i] != p) continue;
+        d->peers[i] = d->peers[--d->npeers];
+        rc = d->npeers;
+        break;
+    }
+    pthread_mutex_unlock(&d->mutex);
+    return rc;
+}
+
+// Change the visible text from `from` to `to` (the ids of from's
+// characters given, and of the character before them as `before`, 0.0 at
+// the start) with site 0 operations sent to every subscriber: the span
+// between their common prefix and suffix is replaced, its length put in
+// *pre and *suf if wanted. Document lock held.
+static int replace_span(CollabDoc *d, RgaId before, const char *from, int from_len, const RgaId *ids,
+                        const char *to, int to_len, int *pre_out, int *suf_out) {
+    int pre = 0;
+    while (pre < from_len && pre < to_len && from[pre] == to[pre]) pre++;
+    int suf = 0;
+    while (suf < from_len - pre && suf < to_len - pre &&
+           from[from_len - 1 - suf] == to[to_len - 1 - suf]) suf++;
+    if (pre_out) *pre_out = pre;
+    if (suf_out) *suf_out = suf;
+    Broadcast bc = { d, NULL, NULL };
+    int rc = 0;
+    if (from_len - pre - suf > 0) rc = rga_delete_ids(d->rga, ids + pre, from_len - pre - suf, broadcast, &bc);
+    if (rc == 0 && to_len - pre - suf > 0) {
+        RgaId origin = before;
+        if (pre > 0) origin = ids[pre - 1];
+        rc = rga_insert_after(d->rga, 0, origin, to + pre, to_len - pre - suf, broadcast, &bc);
+    }
+    return rc;
+}
+
+// --- the cached view --------------------------------------------------
+
+static int view_is_delim(char ch) {
+    return ch == '.' || ch == '!' || ch == '?';
+}
+
+// Document lock held
+static int view_rebuild(CollabDoc *d) {
+    free(d->view);
+    free(d->view_ids);
+    free(d->view_sents);
+    d->view = NULL;
+    d->view_ids = NULL;
+    d->view_sents = NULL;
+    d->view_len = d->view_cap = d->view_count = d->view_sents_cap = 0;
+    d->view_ok = 0;
+
+    int len = 0, nids = 0;
+    char *text = rga_text(d->rga, &len);
+    RgaId *ids = rga_visible_ids(d->rga, &nids);
+    DocIndex *ix = text ? doc_index_build(text, len) : NULL;
+    if (!text || (!ids && nids > 0) || !ix) {
+        free(text);
+        free(ids);
+        doc_index_free(ix);
+        return -1;
+    }
+    d->view = text;
+    d->view_ids = ids;
+    d->view_len = d->view_cap = len;
+    d->view_sents = ix->sents;
+    d->view_count = d->view_sents_cap = ix->count;
+    ix->sents = NULL;
+    doc_index_free(ix);
+    d->view_ok = 1;
+    return 0;
+}
+
+// Replace view[ws, we) (sentence w, or the whole text when it has no
+// sentences) with `to`: the change goes to the RGA and every subscriber,
+// then the view is spliced and only sentence w and the one after it are
+// split again. Returns 0 or -3. A view that can't be kept up to date is
+// marked stale, which costs the next edit a rebuild and nothing else.
+// Document lock held.
+static int view_replace(CollabDoc *d, int w, int ws, int we, const char *to, int to_len) {
+    RgaId before = { 0, 0 };
+    if (ws > 0) before = d->view_ids[ws - 1];
+    // rga_insert_after() gives the new characters the next clocks in a row
+    uint64_t clock = d->rga->clock;
+    int pre = 0, suf = 0;
+    if (replace_span(d, before, d->view + ws, we - ws, d->view_ids + ws, to, to_len, &pre, &suf) != 0) {
+        d->view_ok = 0;
+        return -3;
+    }
+
+    int at = ws + pre, del = we - ws - pre - suf, ins = to_len - pre - suf;
+    int len = d->view_len - del + ins;
+    if (len > d->view_cap) {
+        int cap = d->view_cap > 0 ? d->view_cap : 256;
+        while (cap < len) cap *= 2;
+        char *view = (char*)realloc(d->view, cap + 1);
+        if (view) d->view = view;
+        RgaId *ids = view ? (RgaId*)realloc(d->view_ids, sizeof(RgaId) * cap) : NULL;
+        if (!ids) { d->view_ok = 0; return 0; }
+        d->view_ids = ids;
+        d->view_cap = cap;
+    }
+    int tail = d->view_len - at - del;
+    memmove(d->view + at + ins, d->view + at + del, tail);
+    memmove(d->view_ids + at + ins, d->view_ids + at + del, sizeof(RgaId) * tail);
+    memcpy(d->view + at, to + pre, ins);
+    for (int k = 0; k < ins; k++) d->view_ids[at + k] = (RgaId){ clock + 1 + (uint64_t)k, 0 };
+    d->view_len = len;
+    d->view[len] = '\0';
+
+    // Sentences before w still end where they did; the edited one may have
+    // gained or lost a delimiter, so it is split again together with the
+    // next (which ends in one, or the text does)
+    int delta = ins - del;
+    int n = d->view_count;
+    int first = n > 0 ? w : 0;
+    int last = n == 0 ? -1 : w + 1 < n ? w + 1 : w;
+    int re = last >= 0 ? (int)(d->view_sents[last].start + d->view_sents[last].len) + delta : len;
+    DocIndex *ix = doc_index_build(d->view + ws, re - ws);
+    if (!ix) { d->view_ok = 0; return 0; }
+    int count = n - (last - first + 1) + ix->count;
+    if (count > d->view_sents_cap) {
+        int cap = d->view_sents_cap > 0 ? d->view_sents_cap : 16;
+        while (cap < count) cap *= 2;
+        DocIndexSent *sents = (DocIndexSent*)realloc(d->view_sents, sizeof(DocIndexSent) * cap);
+        if (!sents) { doc_index_free(ix); d->view_ok = 0; return 0; }
+        d->view_sents = sents;
+        d->view_sents_cap = cap;
+    }
+    memmove(d->view_sents + first + ix->count, d->view_sents + last + 1, sizeof(DocIndexSent) * (n - last - 1));
+    for (int k = 0; k < ix->count; k++) {
+        d->view_sents[first + k] = ix->sents[k];
+        d->view_sents[first + k].start += (uint32_t)ws;
+    }
+    for (int k = first + ix->count; k < count; k++) d->view_sents[k].start += (uint32_t)delta;
+    d->view_count = count;
+    doc_index_free(ix);
+    return 0;
+}
+
+int collab_insert_words(CollabDoc *d, int sidx, int widx, const char *content, int *max) {
+    pthread_mutex_lock(&d->mutex);
+    int out_len = 0, rc = -3;
+    char *out = NULL;
+    Doc *doc = NULL;
+    if (d->view_ok || view_rebuild(d) == 0) {
+        // The same range rule as WRITE: a new sentence only after a
+        // finished one
+        int n = d->view_count;
+        const DocIndexSent *last = n > 0 ? &d->view_sents[n - 1] : NULL;
+        int max_sidx = !last ? 0 : view_is_delim(d->view[last->start + last->len - 1]) ? n : n - 1;
+        if (sidx < 0 || sidx > max_sidx) {
+            *max = max_sidx;
+            rc = -1;
+        } else {
+            // Only the sentence edited (the last one when a new sentence
+            // goes after it) is parsed and written back
+            int w = sidx < n ? sidx : n - 1;
+            int ws = n > 0 ? (int)d->view_sents[w].start : 0;
+            int we = n > 0 ? ws + (int)d->view_sents[w].len : d->view_len;
+            doc = doc_parse(d->view + ws, we - ws);
+            int irc = doc ? doc_insert(doc, n > 0 ? sidx - w : 0, widx, content, max) : -2;
+            if (irc == -1) {
+                rc = -2;
+            } else if (irc == 0 && doc_serialize(doc, &out, &out_len) == 0) {
+                // A space between it and a following sentence it touches,
+                // as doc_join() puts between neighbours
+                char next = we < d->view_len ? d->view[we] : ' ';
+                if (out_len > 0 && out[out_len - 1] != ' ' && next != ' ' && next != '\t' && next != '\n' && next != '\r') {
+                    char *spaced = (char*)realloc(out, out_len + 2);
+                    if (!spaced) goto done;
+                    out = spaced;
+                    out[out_len++] = ' ';
+                    out[out_len] = '\0';
+                }
+                if (d->max_len > 0 && out_len > we - ws && d->view_len - (we - ws) + out_len > d->max_len) rc = -4;
+                else rc = view_replace(d, w, ws, we, out, out_len);
+            }
+        }
+    }
+done:
+    if (rc == 0) d->dirty = 1;
+    pthread_mutex_unlock(&d->mutex);
+    doc_free(doc);
+    free(out);
+    return rc;
+}
+
+int collab_apply(CollabDoc *d, CollabPeer *from, const char *op) {
+    // A client only inserts characters of its own site, so ids stay unique
+    if (op[0] == 'I') {
+        const char *dot = strchr(op, '.');
+        if (!dot || strtoul(dot + 1, NULL, 10) != from->site) return -1;
+    }
+    pthread_mutex_lock(&d->mutex);
+    // An insert adds fewer characters than its line is long
+    int rc = op[0] == 'I' && d->max_len > 0 && d->rga->visible + (int)strlen(op) > d->max_len ? -3 : rga_apply(d->rga, op);
+    if (rc == 0) {
+        Broadcast bc = { d, from, NULL };
+        broadcast(&bc, op);
+        d->dirty = 1;
+        d->view_ok = 0;
+    }
+    pthread_mutex_unlock(&d->mutex);
+    return rc;
+}
+
+// --- saves ------------------------------------------------------------
+
+int collab_save_begin(CollabDoc *d, CollabSave *s) {
+    memset(s, 0, sizeof(*s));
+    pthread_mutex_lock(&d->save_mutex);
+    pthread_mutex_lock(&d->mutex);
+    int rc = 1;
+    if (d->dirty && d->view_ok) {
+        s->text = (char*)malloc(d->view_len + 1);
+        s->ids = d->view_len > 0 ? (RgaId*)malloc(sizeof(RgaId) * d->view_len) : NULL;
+        if (s->text) {
+            memcpy(s->text, d->view, d->view_len);
+            s->text[d->view_len] = '\0';
+            s->len = d->view_len;
+        }
+        if (s->ids) memcpy(s->ids, d->view_ids, sizeof(RgaId) * d->view_len);
+        s->nids = s->ids ? d->view_len : 0;
+        rc = s->text && (s->ids || d->view_len == 0) ? 0 : -1;
+        if (rc == 0) d->dirty = 0;
+    } else if (d->dirty) {
+        s->text = rga_text(d->rga, &s->len);
+        s->ids = rga_visible_ids(d->rga, &s->nids);
+        rc = s->text && (s->ids || s->nids == 0) ? 0 : -1;
+        if (rc == 0) d->dirty = 0;
+    }
+    pthread_mutex_unlock(&d->mutex);
+    if (rc != 0) {
+        free(s->text);
+        free(s->ids);
+        pthread_mutex_unlock(&d->save_mutex);
+    }
+    return rc;
+}
+
+void collab_save_end(CollabDoc *d, CollabSave *s, const char *committed, int committed_len) {
+    char *base = committed ? (char*)malloc(committed_len + 1) : NULL;
+    pthread_mutex_lock(&d->mutex);
+    if (!committed || !base) {
+        d->dirty = 1;
+    } else {
+        memcpy(base, committed, committed_len);
+        base[committed_len] = '\0';
+        free(d->base);
+        d->base = base;
+        d->base_len = committed_len;
+        // Other writers' changes merged in on the way: the subscribers get
+        // them too, positioned by the ids the saved text had (still valid
+        // whatever was edited since)
+        if (committed_len != s->len || memcmp(committed, s->text, s->len) != 0) {
+            RgaId start = { 0, 0 };
+            if (replace_span(d, start, s->text, s->len, s->ids, committed, committed_len, NULL, NULL) != 0) d->dirty = 1;
+            d->view_ok = 0;
+        }
+    }
+    pthread_mutex_unlock(&d->mutex);
+    pthread_mutex_unlock(&d->save_mutex);
+    free(s->text);
+    free(s->ids);
+    memset(s, 0, sizeof(*s));
+}
+
+void collab_stats_format(CollabHub *h, char *buf, int buflen) {
+    int docs = 0, peers = 0;
+    long long ops = 0;
+    pthread_mutex_lock(&h->mutex);
+    docs = h->docs;
+    ops = h->ops;
+    for (int b = 0; b < COLLAB_BUCKETS; b++) {
+        for (CollabDoc *d = h->buckets[b]; d; d = d->next) {
+            pthread_mutex_lock(&d->mutex);
+            peers += d->npeers;
+            ops += d->ops;
+            pthread_mutex_unlock(&d->mutex);
+        }
+    }
+    pthread_mutex_unlock(&h->mutex);
+    snprintf(buf, buflen, "live_docs=%d live_peers=%d live_ops=%lld", docs, peers, ops);
+}
@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <errno.h>
+#include "../../lib/include/conn_pool.h"
+
+ConnPool* conn_pool_create(int max_idle_per_host, int idle_timeout_sec, int negotiate_frames) {
+    ConnPool *pool = (ConnPool*)calloc(1, sizeof(ConnPool));
+    if (!pool) return NULL;
+    pool->max_idle_per_host = max_idle_per_host;
+    pool->idle_timeout_sec = idle_timeout_sec;
+    pool->negotiate_frames = negotiate_frames;
+    pthread_mutex_init(&pool->mutex, NULL);
+    return pool;
+}
+
+void conn_pool_set_timeouts(ConnPool *pool, const NetTimeouts *t) {
+    if (!pool || !t) return;
+    pthread_mutex_lock(&pool->mutex);
+    pool->timeouts = *t;
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+static void close_pooled(PooledConn *pc) {
+    net_conn_close(pc->conn);
+    free(pc);
+}
+
+// Caller holds pool->mutex. Returns -1 when the host table is full.
+static int find_host(ConnPool *pool, const char *host, uint16_t port, int create) {
+    for (int i = 0; i < pool->host_count; i++) {
+        if (pool->hosts[i].port == port && strcmp(pool->hosts[i].host, host) == 0) return i;
+    }
+    if (!create || pool->host_count >= CONN_POOL_MAX_HOSTS) return -1;
+    ConnPoolHost *h = &pool->hosts[pool->host_count];
+    memset(h, 0, sizeof(*h));
+    strncpy(h->host, host, sizeof(h->host)-1);
+    h->port = port;
+    return pool->host_count++;
+}
+
+// An idle request/response connection must have nothing to read: any
+// readability means the peer closed it (or sent something unexpected)
+static int idle_conn_healthy(PooledConn *pc) {
+    if (net_conn_pending(pc->conn) > 0) return 0;
+    struct pollfd pfd;
+    pfd.fd = pc->conn->fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int rc = poll(&pfd, 1, 0);
+    return rc == 0;
+}
+
+static int connect_host(ConnPool *pool, int idx, const char *host, uint16_t port) {
+    NetAddr addr;
+    int have_addr = 0;
+    pthread_mutex_lock(&pool->mutex);
+    NetTimeouts t = pool->timeouts;
+    if (idx >= 0 && pool->hosts[idx].addr_valid) { addr = pool->hosts[idx].addr; have_addr = 1; }
+    pthread_mutex_unlock(&pool->mutex);
+    if (have_addr) {
+        int fd = net_connect_addr_timeout(&addr, t.connect_ms);
+        if (fd >= 0) { net_set_io_timeouts(fd, t.recv_ms, t.send_ms); return fd; }
+        // A timeout is not a stale address; don't wait twice
+        if (errno == ETIMEDOUT) return -1;
+        // Cached address may be stale; resolve again below
+    }
+    if (net_resolve(host, port, &addr) != 0) return -1;
+    if (idx >= 0) {
+        pthread_mutex_lock(&pool->mutex);
+        pool->hosts[idx].addr = addr;
+        pool->hosts[idx].addr_valid = 1;
+        pthread_mutex_unlock(&pool->mutex);
+    }
+    int fd = net_connect_addr_timeout(&addr, t.connect_ms);
+    if (fd >= 0) net_set_io_timeouts(fd, t.recv_ms, t.send_ms);
+    return fd;
+}
+
+static PooledConn* open_conn(ConnPool *pool, int idx, const char *host, uint16_t port) {
+    int fd = connect_host(pool, idx, host, port);
+    NetConn *c = net_conn_open(fd);
+    if (!c) { if (fd >= 0) net_close(fd); return NULL; }
+    net_set_nodelay(fd);
+    int frames = 0;
+    if (pool->negotiate_frames) {
+        frames = net_hello(c, 1);
+        if (frames < 0 && errno == ETIMEDOUT) {
+            // Accepted by the kernel but the SS never answered
+            net_conn_close(c);
+            return NULL;
+        }
+        if (frames < 0) {
+            // Peer predates HELLO and hung up after its ERR; plain line mode
+            net_conn_close(c);
+            fd = connect_host(pool, idx, host, port);
+            c = net_conn_open(fd);
+            if (!c) { if (fd >= 0) net_close(fd); return NULL; }
+            net_set_nodelay(fd);
+            frames = 0;
+        }
+    }
+    PooledConn *pc = (PooledConn*)calloc(1, sizeof(PooledConn));
+    if (!pc) { net_conn_close(c); return NULL; }
+    pc->conn = c;
+    pc->frames = frames;
+    pc->host_idx = idx;
+    pthread_mutex_lock(&pool->mutex);
+    pool->connects++;
+    pthread_mutex_unlock(&pool->mutex);
+    return pc;
+}
+
+PooledConn* conn_pool_acquire(ConnPool *pool, const char *host, uint16_t port) {
+    if (!pool || !host) return NULL;
+    pthread_mutex_lock(&pool->mutex);
+    int idx = find_host(pool, host, port, 1);
+    if (idx >= 0) {
+        ConnPoolHost *h = &pool->hosts[idx];
+        while (h->idle) {
+            PooledConn *pc = h->idle;
+            h->idle = pc->next;
+            h->idle_count--;
+            pc->next = NULL;
+            if (idle_conn_healthy(pc)) {
+                pc->reused = 1;
+                pool->reuses++;
+                pthread_mutex_unlock(&pool->mutex);
+                return pc;
+            }
+            pool->stale++;
+            close_pooled(pc);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return open_conn(pool, idx, host, port);
+}
+
+void conn_pool_release(ConnPool *pool, PooledConn *pc, int reusable) {
+    if (!pc) return;
+    if (!pool || !reusable || pc->host_idx < 0) { close_pooled(pc); return; }
+    pthread_mutex_lock(&pool->mutex);
+    ConnPoolHost *h = &pool->hosts[pc->host_idx];
+    if (h->idle_count >= pool->max_idle_per_host) {
+        pthread_mutex_unlock(&pool->mutex);
+        close_pooled(pc);
+        return;
+    }
+    pc->last_used = time(NULL);
+    pc->reused = 0;
+    pc->next = h->idle;
+    h->idle = pc;
+    h->idle_count++;
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+int conn_pool_reap(ConnPool *pool) {
+    if (!pool) return 0;
+    time_t now = time(NULL);
+    PooledConn *dead = NULL;
+    int reaped = 0;
+    pthread_mutex_lock(&pool->mutex);
+    for (int i = 0; i < pool->host_count; i++) {
+        PooledConn **pp = &pool->hosts[i].idle;
+        while (*pp) {
+            PooledConn *pc = *pp;
+            if (now - pc->last_used > pool->idle_timeout_sec || !idle_conn_healthy(pc)) {
+                *pp = pc->next;
+                pool->hosts[i].idle_count--;
+                pc->next = dead;
+                dead = pc;
+                reaped++;
+            } else {
+                pp = &pc->next;
+            }
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    while (dead) {
+        PooledConn *next = dead->next;
+        close_pooled(dead);
+        dead = next;
+    }
+    return reaped;
+}
+
+void conn_pool_drop_host(ConnPool *pool, const char *host, uint16_t port) {
+    if (!pool || !host) return;
+    PooledConn *dead = NULL;
+    pthread_mutex_lock(&pool->mutex);
+    int idx = find_host(pool, host, port, 0);
+    if (idx >= 0) {
+        dead = pool->hosts[idx].idle;
+        pool->hosts[idx].idle = NULL;
+        pool->hosts[idx].idle_count = 0;
+        pool->hosts[idx].addr_valid = 0;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    while (dead) {
+        PooledConn *next = dead->next;
+        close_pooled(dead);
+        dead = next;
+    }
+}
+
+void conn_pool_free(ConnPool *pool) {
+    if (!pool) return;
+    for (int i = 0; i < pool->host_count; i++) {
+        PooledConn *pc = pool->hosts[i].idle;
+        while (pc) {
+            PooledConn *next = pc->next;
+            close_pooled(pc);
+            pc = next;
+        }
+    }
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool);
+}
@@ -0,0 +1,675 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include "../../lib/include/doc.h"
+#include "../../lib/include/util.h"
+
+static int is_space(char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+static int is_delim(char ch) {
+    return ch == '.' || ch == '!' || ch == '?';
+}
+
+static int doc_reserve(Doc *d, int need) {
+    if (need <= d->cap) return 0;
+    int cap = d->cap ? d->cap : 16;
+    while (cap < need) cap *= 2;
+    char **s = (char**)realloc(d->sents, sizeof(char*) * cap);
+    if (!s) return -1;
+    d->sents = s;
+    int *l = (int*)realloc(d->lens, sizeof(int) * cap);
+    if (!l) return -1;
+    d->lens = l;
+    d->cap = cap;
+    return 0;
+}
+
+static int doc_append(Doc *d, const char *s, int len) {
+    if (doc_reserve(d, d->count + 1) != 0) return -1;
+    char *copy = (char*)malloc(len + 1);
+    if (!copy) return -1;
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    d->sents[d->count] = copy;
+    d->lens[d->count] = len;
+    d->count++;
+    return 0;
+}
+
+// Walk the sentences of text: each delimiter ends one, whitespace after
+// it is skipped, and a trailing unterminated sentence is trimmed
+static int split_walk(const char *text, int len, int (*emit)(void*, const char*, int, int), void *arg) {
+    int start = 0;
+    while (start < len && is_space(text[start])) start++;
+    for (int i = start; i < len; i++) {
+        if (!is_delim(text[i])) continue;
+        if (emit(arg, text, start, i + 1 - start) != 0) return -1;
+        start = i + 1;
+        while (start < len && is_space(text[start])) start++;
+        i = start - 1;
+    }
+    int seglen = len - start;
+    while (seglen > 0 && is_space(text[start + seglen - 1])) seglen--;
+    if (seglen > 0 && emit(arg, text, start, seglen) != 0) return -1;
+    return 0;
+}
+
+static int split_emit_doc(void *arg, const char *text, int start, int len) {
+    return doc_append((Doc*)arg, text + start, len);
+}
+
+// Split text into sentences and append them to d
+static int doc_split(Doc *d, const char *text, int len) {
+    return split_walk(text, len, split_emit_doc, d);
+}
+
+Doc* doc_parse(const char *text, int len) {
+    Doc *d = (Doc*)calloc(1, sizeof(Doc));
+    if (!d) return NULL;
+    d->unsplit = -1;
+    if (doc_split(d, text ? text : "", text ? len : 0) != 0 ||
+        (d->count == 0 && doc_append(d, "", 0) != 0)) {
+        doc_free(d);
+        return NULL;
+    }
+    return d;
+}
+
+Doc* doc_parse_indexed(const char *text, int len, const DocIndex *ix) {
+    if (!ix || ix->size != len) return doc_parse(text, len);
+    for (int i = 0; i < ix->count; i++) {
+        if ((int64_t)ix->sents[i].start + ix->sents[i].len > len) return doc_parse(text, len);
+    }
+    Doc *d = (Doc*)calloc(1, sizeof(Doc));
+    if (!d) return NULL;
+    d->unsplit = -1;
+    if (doc_reserve(d, ix->count) != 0) { doc_free(d); return NULL; }
+    for (int i = 0; i < ix->count; i++) {
+        if (doc_append(d, text + ix->sents[i].start, (int)ix->sents[i].len) != 0) { doc_free(d); return NULL; }
+    }
+    if (d->count == 0 && doc_append(d, "", 0) != 0) { doc_free(d); return NULL; }
+    return d;
+}
+
+void doc_free(Doc *d) {
+    if (!d) return;
+    for (int i = 0; i < d->count; i++) free(d->sents[i]);
+    free(d->sents);
+    free(d->lens);
+    free(d);
+}
+
+// Join sentences [lo, hi], skipping empty ones and putting a space between
+// neighbours unless one of them already has it
+static char* doc_join(const Doc *d, int lo, int hi, int *out_len) {
+    size_t cap = 1;
+    for (int i = lo; i <= hi; i++) cap += d->lens[i] + 1;
+    char *buf = (char*)malloc(cap);
+    if (!buf) return NULL;
+    int n = 0;
+    for (int i = lo; i <= hi; i++) {
+        const char *s = d->sents[i];
+        if (d->lens[i] == 0) continue;
+        if (n > 0 && buf[n-1] != ' ' && buf[n-1] != '\t' && s[0] != ' ' && s[0] != '\t') buf[n++] = ' ';
+        memcpy(buf + n, s, d->lens[i]);
+        n += d->lens[i];
+    }
+    buf[n] = '\0';
+    *out_len = n;
+    return buf;
+}
+
+static int ends_sentence(const Doc *d, int i) {
+    return d->lens[i] > 0 && is_delim(d->sents[i][d->lens[i] - 1]);
+}
+
+// Re-split the sentences around i after an edit, as a write-out and
+// read-back of the whole document would. Done before the next edit rather
+// than right away, so the text written at the end keeps the last edit's
+// spacing exactly as it always has. Only the run of sentences that
+// lack a delimiter on either side of i can change.
+static int doc_resplit(Doc *d, int i) {
+    int lo = i, hi = i;
+    while (lo > 0 && !ends_sentence(d, lo - 1)) lo--;
+    while (hi < d->count - 1 && !ends_sentence(d, hi)) hi++;
+
+    int len = 0;
+    char *text = doc_join(d, lo, hi, &len);
+    if (!text) return -1;
+    Doc part = {0};
+    int rc = doc_split(&part, text, len);
+    free(text);
+    if (rc != 0) {
+        for (int k = 0; k < part.count; k++) free(part.sents[k]);
+        free(part.sents); free(part.lens);
+        return -1;
+    }
+
+    int old_n = hi - lo + 1;
+    int new_count = d->count - old_n + part.count;
+    if (doc_reserve(d, new_count) != 0) {
+        for (int k = 0; k < part.count; k++) free(part.sents[k]);
+        free(part.sents); free(part.lens);
+        return -1;
+    }
+    for (int k = lo; k <= hi; k++) free(d->sents[k]);
+    int tail = d->count - hi - 1;
+    if (part.count != old_n && tail > 0) {
+        memmove(d->sents + lo + part.count, d->sents + hi + 1, sizeof(char*) * tail);
+        memmove(d->lens + lo + part.count, d->lens + hi + 1, sizeof(int) * tail);
+    }
+    for (int k = 0; k < part.count; k++) {
+        d->sents[lo + k] = part.sents[k];
+        d->lens[lo + k] = part.lens[k];
+    }
+    d->count = new_count;
+    free(part.sents); free(part.lens);
+    if (d->count == 0) return doc_append(d, "", 0);
+    return 0;
+}
+
+int doc_insert(Doc *d, int sidx, int widx, const char *content, int *max_widx) {
+    if (d->unsplit >= 0) {
+        if (doc_resplit(d, d->unsplit) != 0) return -2;
+        d->unsplit = -1;
+    }
+    while (sidx >= d->count) {
+        if (doc_append(d, "", 0) != 0) return -2;
+    }
+    const char *s = d->sents[sidx];
+    int slen = d->lens[sidx];
+
+    // Words are split by spaces only, as they always have been
+    int wc = 0;
+    for (int i = 0; i < slen; i++) {
+        if (s[i] != ' ' && (i == 0 || s[i-1] == ' ')) wc++;
+    }
+    if (max_widx) *max_widx = wc + 1;
+    if (widx < 0 || widx > wc + 1) return -1;
+    int insert_pos = widx > wc ? wc : widx;
+
+    int clen = (int)strlen(content);
+    char *ns = (char*)malloc(slen + clen + 3);
+    if (!ns) return -2;
+    int n = 0, w = 0, i = 0;
+    while (1) {
+        while (i < slen && s[i] == ' ') i++;
+        if (w == insert_pos) {
+            if (n > 0) ns[n++] = ' ';
+            memcpy(ns + n, content, clen);
+            n += clen;
+            if (i < slen) ns[n++] = ' ';
+        }
+        if (i >= slen) break;
+        if (n > 0 && ns[n-1] != ' ') ns[n++] = ' ';
+        while (i < slen && s[i] != ' ') ns[n++] = s[i++];
+        w++;
+    }
+    ns[n] = '\0';
+
+    free(d->sents[sidx]);
+    d->sents[sidx] = ns;
+    d->lens[sidx] = n;
+    d->unsplit = sidx;
+    return 0;
+}
+
+int doc_serialize(const Doc *d, char **out, int *out_len) {
+    int len = 0;
+    char *buf = doc_join(d, 0, d->count - 1, &len);
+    if (!buf) return -1;
+    *out = buf;
+    if (out_len) *out_len = len;
+    return 0;
+}
+
+// Sentences of base [b0, b1) replaced by those of the other side [x0, x1)
+typedef struct {
+    int b0, b1, x0, x1;
+} Hunk;
+
+typedef struct {
+    Hunk *h;
+    int count, cap;
+} HunkList;
+
+// Past this many inserted plus deleted sentences the diff stops looking
+// for matches and reports what's left as one hunk (a superset of the real
+// changes, so at worst a merge reports a conflict it needn't)
+#define DIFF_MAX_EDITS 1024
+// Middles up to this many sentence pairs get align_hunks()
+#define DIFF_ALIGN_CELLS (1 << 22)
+
+static int hunk_add(HunkList *l, int b0, int b1, int x0, int x1) {
+    if (b0 == b1 && x0 == x1) return 0;
+    if (l->count == l->cap) {
+        int cap = l->cap ? l->cap * 2 : 8;
+        Hunk *h = (Hunk*)realloc(l->h, sizeof(Hunk) * cap);
+        if (!h) return -1;
+        l->h = h;
+        l->cap = cap;
+    }
+    l->h[l->count++] = (Hunk){ b0, b1, x0, x1 };
+    return 0;
+}
+
+static uint64_t* sent_hashes(const Doc *d) {
+    uint64_t *h = (uint64_t*)malloc(sizeof(uint64_t) * (d->count + 1));
+    for (int i = 0; h && i < d->count; i++) h[i] = hash_bytes(d->sents[i], d->lens[i]);
+    return h;
+}
+
+static int sent_eq(const Doc *a, const uint64_t *ah, int i, const Doc *b, const uint64_t *bh, int j) {
+    return ah[i] == bh[j] && a->lens[i] == b->lens[j] && memcmp(a->sents[i], b->sents[j], a->lens[i]) == 0;
+}
+
+// Myers picks any shortest script, and with repeated sentences that can
+// split an in-place rewrite into an insertion and a deletion some equal
+// sentences apart. Slide such one-sided hunks over the repeats until they
+// meet a neighbouring hunk and join it, so a rewrite lines up with where
+// the other side's changes are.
+static void hunks_compact(HunkList *l, const Doc *b, const uint64_t *bh, const Doc *x, const uint64_t *xh) {
+    int n = 0;
+    for (int i = 0; i < l->count; i++) {
+        Hunk h = l->h[i];
+        int del = h.x0 == h.x1;
+        if (h.b0 != h.b1 && !del) { l->h[n++] = h; continue; }
+        // Between two hunks every sentence is matched, so each step moves
+        // the hunk past one matched pair
+        if (n > 0) {
+            Hunk *p = &l->h[n - 1], s = h;
+            while (s.b0 > p->b1 && (del ? sent_eq(b, bh, s.b0 - 1, b, bh, s.b1 - 1)
+                                        : sent_eq(x, xh, s.x0 - 1, x, xh, s.x1 - 1))) {
+                s.b0--; s.b1--; s.x0--; s.x1--;
+            }
+            if (s.b0 == p->b1) { p->b1 = s.b1; p->x1 = s.x1; continue; }
+        }
+        if (i + 1 < l->count) {
+            Hunk *q = &l->h[i + 1], s = h;
+            while (s.b1 < q->b0 && (del ? sent_eq(b, bh, s.b0, b, bh, s.b1)
+                                        : sent_eq(x, xh, s.x0, x, xh, s.x1))) {
+                s.b0++; s.b1++; s.x0++; s.x1++;
+            }
+            if (s.b1 == q->b0) { q->b0 = s.b0; q->x0 = s.x0; continue; }
+        }
+        l->h[n++] = h;
+    }
+    l->count = n;
+}
+
+// Hunks for base [lo, lo+n) against x [lo, lo+m), from an alignment in
+// which rewriting a sentence in place costs one, against two for deleting
+// it and inserting another. With repeated sentences that keeps a rewrite
+// matched to the sentence it replaced, where a plain shortest edit script
+// may pair it with an equal sentence nearby. O(n*m), so small middles only.
+static int align_hunks(const Doc *base, const uint64_t *bh, const Doc *x, const uint64_t *xh, int lo, int n, int m, HunkList *out) {
+    size_t w = (size_t)m + 1;
+    unsigned char *dir = (unsigned char*)malloc(((size_t)n + 1) * w);
+    int *prev = (int*)malloc(sizeof(int) * w), *cur = (int*)malloc(sizeof(int) * w);
+    if (!dir || !prev || !cur) { free(dir); free(prev); free(cur); return -1; }
+    // dir: 0 diagonal, 1 base sentence deleted, 2 x sentence inserted;
+    // 4 marks a diagonal that matches
+    for (int j = 0; j <= m; j++) { prev[j] = j; dir[j] = 2; }
+    for (int i = 1; i <= n; i++) {
+        cur[0] = i;
+        dir[i * w] = 1;
+        for (int j = 1; j <= m; j++) {
+            int eq = sent_eq(base, bh, lo + i - 1, x, xh, lo + j - 1);
+            int best = prev[j - 1] + !eq, d = eq ? 4 : 0;
+            if (prev[j] + 1 < best) { best = prev[j] + 1; d = 1; }
+            if (cur[j - 1] + 1 < best) { best = cur[j - 1] + 1; d = 2; }
+            cur[j] = best;
+            dir[i * w + j] = (unsigned char)d;
+        }
+        int *t = prev; prev = cur; cur = t;
+    }
+    // Walk back; the gap between two matches is a hunk
+    int first = out->count, rc = 0;
+    int i = n, j = m, gi = n, gj = m;
+    while ((i > 0 || j > 0) && rc == 0) {
+        int d = dir[i * w + j];
+        if (d == 4) {
+            rc = hunk_add(out, lo + i, lo + gi, lo + j, lo + gj);
+            gi = --i; gj = --j;
+        } else if (d == 0) { i--; j--; }
+        else if (d == 1) i--;
+        else j--;
+    }
+    if (rc == 0) rc = hunk_add(out, lo, lo + gi, lo, lo + gj);
+    for (int a = first, b = out->count - 1; a < b; a++, b--) {
+        Hunk t = out->h[a]; out->h[a] = out->h[b]; out->h[b] = t;
+    }
+    free(dir); free(prev); free(cur);
+    return rc;
+}
+
+// Hunks taking base to x: common ends trimmed, then align_hunks() over a
+// small middle, else Myers' shortest edit script (traced so the matches
+// can be walked back)
+static int diff_hunks(const Doc *base, const uint64_t *bh, const Doc *x, const uint64_t *xh, HunkList *out) {
+    int lo = 0, bn = base->count, xn = x->count;
+    while (lo < bn && lo < xn && sent_eq(base, bh, lo, x, xh, lo)) lo++;
+    while (bn > lo && xn > lo && sent_eq(base, bh, bn - 1, x, xh, xn - 1)) { bn--; xn--; }
+    int n = bn - lo, m = xn - lo;
+    if (n == 0 || m == 0) return hunk_add(out, lo, bn, lo, xn);
+    if ((long long)n * m <= DIFF_ALIGN_CELLS) return align_hunks(base, bh, x, xh, lo, n, m, out);
+
+    int dmax = n + m < DIFF_MAX_EDITS ? n + m : DIFF_MAX_EDITS;
+    int off = dmax + 1;
+    int *v = (int*)calloc(2 * dmax + 3, sizeof(int));
+    // trace[d*d + (k+d)] = v[k] as it stood when step d began; grown as
+    // the search goes deeper, since most diffs end after a few steps
+    int *trace = NULL;
+    size_t trace_cap = 0;
+    if (!v) return -1;
+    int found = -1;
+    for (int d = 0; d <= dmax && found < 0; d++) {
+        size_t need = (size_t)(d + 1) * (d + 1);
+        if (need > trace_cap) {
+            size_t cap = trace_cap ? trace_cap * 4 : 64;
+            while (cap < need) cap *= 4;
+            int *nt = (int*)realloc(trace, sizeof(int) * cap);
+            if (!nt) { free(v); free(trace); return -1; }
+            trace = nt;
+            trace_cap = cap;
+        }
+        for (int k = -d; k <= d; k++) trace[d*d + k + d] = v[k + off];
+        for (int k = -d; k <= d; k += 2) {
+            int i = (k == -d || (k != d && v[k - 1 + off] < v[k + 1 + off])) ? v[k + 1 + off] : v[k - 1 + off] + 1;
+            int j = i - k;
+            while (i < n && j < m && sent_eq(base, bh, lo + i, x, xh, lo + j)) { i++; j++; }
+            v[k + off] = i;
+            if (i >= n && j >= m) { found = d; break; }
+        }
+    }
+    int rc = 0;
+    if (found < 0) {
+        rc = hunk_add(out, lo, bn, lo, xn);
+    } else {
+        // Walk back from the end collecting hunks (last first), then flip
+        int first = out->count;
+        int i = n, j = m, gi = n, gj = m;
+        for (int d = found; d >= 0 && rc == 0; d--) {
+            const int *tv = trace + d*d + d;     // tv[k] for -d <= k <= d
+            int k = i - j;
+            int pk = (k == -d || (k != d && tv[k - 1] < tv[k + 1])) ? k + 1 : k - 1;
+            int pi = d > 0 ? tv[pk] : 0, pj = pi - pk;
+            if (d == 0) pj = 0;
+            if (i > pi && j > pj) {
+                // i-1, j-1 down to the snake start match: the gap after
+                // them up to (gi, gj) is a hunk
+                rc = hunk_add(out, lo + i, lo + gi, lo + j, lo + gj);
+                int s = (i - pi) < (j - pj) ? (i - pi) : (j - pj);
+                i -= s; j -= s;
+                gi = i; gj = j;
+            }
+            if (d > 0) { i = pi; j = pj; }
+        }
+        if (rc == 0) rc = hunk_add(out, lo, lo + gi, lo, lo + gj);
+        for (int a = first, b = out->count - 1; a < b; a++, b--) {
+            Hunk t = out->h[a]; out->h[a] = out->h[b]; out->h[b] = t;
+        }
+        hunks_compact(out, base, bh, x, xh);
+    }
+    free(v);
+    free(trace);
+    return rc;
+}
+
+static int overlap(const Hunk *a, const Hunk *b) {
+    if (a->b0 == a->b1 && b->b0 == b->b1) return a->b0 == b->b0;
+    return a->b0 < b->b1 && b->b0 < a->b1;
+}
+
+static int same_change(const Hunk *a, const Doc *ad, const uint64_t *ah, const Hunk *b, const Doc *bd, const uint64_t *bh) {
+    if (a->b0 != b->b0 || a->b1 != b->b1 || a->x1 - a->x0 != b->x1 - b->x0) return 0;
+    for (int k = 0; k < a->x1 - a->x0; k++) {
+        if (!sent_eq(ad, ah, a->x0 + k, bd, bh, b->x0 + k)) return 0;
+    }
+    return 1;
+}
+
+static int append_range(Doc *out, const Doc *d, int lo, int hi) {
+    for (int i = lo; i < hi; i++) {
+        if (doc_append(out, d->sents[i], d->lens[i]) != 0) return -1;
+    }
+    return 0;
+}
+
+int doc_merge(const char *base, int base_len, const char *ours, int ours_len,
+              const char *theirs, int theirs_len, char **out, int *out_len) {
+    return doc_merge_ex(base, base_len, ours, ours_len, theirs, theirs_len, 0, NULL, out, out_len);
+}
+
+int doc_merge_ex(const char *base, int base_len, const char *ours, int ours_len,
+                 const char *theirs, int theirs_len, int prefer_ours, int *conflicts,
+                 char **out, int *out_len) {
+    Doc *b = doc_parse(base, base_len);
+    Doc *o = doc_parse(ours, ours_len);
+    Doc *t = doc_parse(theirs, theirs_len);
+    uint64_t *bh = b ? sent_hashes(b) : NULL;
+    uint64_t *oh = o ? sent_hashes(o) : NULL;
+    uint64_t *th = t ? sent_hashes(t) : NULL;
+    HunkList ho = {0}, ht = {0};
+    Doc *m = (Doc*)calloc(1, sizeof(Doc));
+    int rc = -1;
+    if (!b || !o || !t || !bh || !oh || !th || !m) goto done;
+    m->unsplit = -1;
+    if (diff_hunks(b, bh, o, oh, &ho) != 0 || diff_hunks(b, bh, t, th, &ht) != 0) goto done;
+
+    // Walk both hunk lists in base order, copying untouched base sentences
+    // between them
+    int pos = 0, io = 0, it = 0, clashes = 0;
+    rc = 0;
+    while (rc == 0 && (io < ho.count || it < ht.count)) {
+        const Hunk *a = io < ho.count ? &ho.h[io] : NULL;
+        const Hunk *c = it < ht.count ? &ht.h[it] : NULL;
+        const Hunk *h; const Doc *src;
+        if (a && c && overlap(a, c) && !same_change(a, o, oh, c, t, th)) {
+            if (!prefer_ours) { rc = 1; break; }
+            // Grow the clash over every hunk of either side that touches
+            // it, then take ours' text for that whole stretch of base
+            Hunk span = { a->b0 < c->b0 ? a->b0 : c->b0, a->b1 > c->b1 ? a->b1 : c->b1, 0, 0 };
+            int io0 = io++;
+            it++;
+            while (1) {
+                const Hunk *nx = io < ho.count && overlap(&ho.h[io], &span) ? &ho.h[io++]
+                               : it < ht.count && overlap(&ht.h[it], &span) ? &ht.h[it++] : NULL;
+                if (!nx) break;
+                if (nx->b1 > span.b1) span.b1 = nx->b1;
+            }
+            for (int k = io0; k < io && rc == 0; k++) {
+                const Hunk *x = &ho.h[k];
+                if (append_range(m, b, pos, x->b0) != 0 || append_range(m, o, x->x0, x->x1) != 0) rc = -1;
+                pos = x->b1;
+            }
+            if (rc == 0 && append_range(m, b, pos, span.b1) != 0) rc = -1;
+            pos = span.b1;
+            clashes++;
+            continue;
+        }
+        if (a && c && overlap(a, c)) {
+            h = a; src = o; io++; it++;
+        } else if (a && (!c || a->b0 < c->b0 || (a->b0 == c->b0 && a->b0 == a->b1))) {
+            h = a; src = o; io++;
+        } else {
+            h = c; src = t; it++;
+        }
+        if (append_range(m, b, pos, h->b0) != 0 || append_range(m, src, h->x0, h->x1) != 0) rc = -1;
+        pos = h->b1;
+    }
+    if (rc == 0 && append_range(m, b, pos, b->count) != 0) rc = -1;
+    if (rc == 0 && m->count == 0 && doc_append(m, "", 0) != 0) rc = -1;
+    if (rc == 0 && doc_serialize(m, out, out_len) != 0) rc = -1;
+    if (conflicts) *conflicts = clashes;
+done:
+    free(ho.h); free(ht.h);
+    free(bh); free(oh); free(th);
+    doc_free(b); doc_free(o); doc_free(t); doc_free(m);
+    return rc;
+}
+
+int doc_sentence_map(const char *from, int from_len, const char *to, int to_len, int **map) {
+    Doc *f = doc_parse(from, from_len);
+    Doc *t = doc_parse(to, to_len);
+    uint64_t *fh = f ? sent_hashes(f) : NULL;
+    uint64_t *th = t ? sent_hashes(t) : NULL;
+    HunkList hl = {0};
+    int *m = NULL, n = -1;
+    if (!f || !t || !fh || !th || diff_hunks(f, fh, t, th, &hl) != 0) goto done;
+    m = (int*)malloc(sizeof(int) * (f->count + 1));
+    if (!m) goto done;
+    // Untouched sentences move by the hunks before them; in a hunk, a
+    // sentence keeps its place among what replaced it, or is gone
+    int pos = 0;
+    for (int k = 0; k < hl.count; k++) {
+        const Hunk *h = &hl.h[k];
+        for (; pos < h->b0; pos++) m[pos] = pos + h->x0 - h->b0;
+        for (; pos < h->b1; pos++) m[pos] = pos - h->b0 < h->x1 - h->x0 ? h->x0 + pos - h->b0 : -1;
+    }
+    for (; pos <= f->count; pos++) m[pos] = pos + t->count - f->count;
+    *map = m;
+    n = f->count + 1;
+done:
+    free(hl.h);
+    free(fh); free(th);
+    doc_free(f); doc_free(t);
+    return n;
+}
+
+typedef struct {
+    DocIndexSent *sents;
+    int count;
+    int cap;
+} IndexBuild;
+
+static int split_emit_index(void *arg, const char *text, int start, int len) {
+    IndexBuild *b = (IndexBuild*)arg;
+    if (b->count == b->cap) {
+        int cap = b->cap ? b->cap * 2 : 16;
+        DocIndexSent *n = (DocIndexSent*)realloc(b->sents, sizeof(DocIndexSent) * cap);
+        if (!n) return -1;
+        b->sents = n;
+        b->cap = cap;
+    }
+    uint32_t words = 0;
+    for (int i = start; i < start + len; i++) {
+        if (!is_space(text[i]) && (i == start || is_space(text[i-1]))) words++;
+    }
+    DocIndexSent *e = &b->sents[b->count++];
+    e->start = (uint32_t)start;
+    e->len = (uint32_t)len;
+    e->words = words;
+    return 0;
+}
+
+DocIndex* doc_index_build(const char *text, int len) {
+    DocIndex *ix = (DocIndex*)calloc(1, sizeof(DocIndex));
+    if (!ix) return NULL;
+    IndexBuild b = { NULL, 0, 0 };
+    if (split_walk(text, len, split_emit_index, &b) != 0) {
+        free(b.sents);
+        free(ix);
+        return NULL;
+    }
+    ix->sents = b.sents;
+    ix->count = b.count;
+    ix->size = len;
+    ix->chars = (uint32_t)len;
+    // Words are counted over the whole file: "a.b" is one word but two sentences
+    for (int i = 0; i < len; i++) {
+        if (!is_space(text[i]) && (i == 0 || is_space(text[i-1]))) ix->words++;
+    }
+    for (int i = len - 1; i >= 0; i--) {
+        if (is_space(text[i])) continue;
+        ix->last_delim = is_delim(text[i]);
+        break;
+    }
+    return ix;
+}
+
+void doc_index_free(DocIndex *ix) {
+    if (!ix) return;
+    free(ix->sents);
+    free(ix);
+}
+
+#define DOC_INDEX_MAGIC "DIX1"
+
+typedef struct {
+    char magic[4];
+    int32_t count;
+    int64_t size;
+    int64_t mtime_ns;
+    uint32_t words;
+    uint32_t chars;
+    int32_t last_delim;
+    int32_t pad;
+} DocIndexHeader;
+
+int doc_index_save(const DocIndex *ix, const char *path) {
+    DocIndexHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, DOC_INDEX_MAGIC, 4);
+    h.count = ix->count;
+    h.size = ix->size;
+    h.mtime_ns = ix->mtime_ns;
+    h.words = ix->words;
+    h.chars = ix->chars;
+    h.last_delim = ix->last_delim;
+
+    char dir[PATH_MAX];
+    if (strlen(path) >= sizeof(dir)) return -1;
+    strcpy(dir, path);
+    char *slash = strrchr(dir, '/');
+    if (slash) { *slash = '\0'; mkpath(dir); }
+
+    // Written beside the real name and renamed over it, so a reader never
+    // sees half an index and concurrent rebuilds don't interleave
+    static unsigned long seq = 0;
+    char tmp[PATH_MAX];
+    int n = snprintf(tmp, sizeof(tmp), "%s.tmp.%ld.%lu", path, (long)getpid(), __sync_fetch_and_add(&seq, 1));
+    if (n < 0 || n >= (int)sizeof(tmp)) return -1;
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return -1;
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+             (ix->count == 0 || fwrite(ix->sents, sizeof(DocIndexSent), ix->count, f) == (size_t)ix->count);
+    if (fclose(f) != 0) ok = 0;
+    if (!ok || rename(tmp, path) != 0) { remove(tmp); return -1; }
+    return 0;
+}
+
+DocIndex* doc_index_load(const char *path) {
+    char *buf = NULL; int len = 0;
+    if (read_file_all(path, &buf, &len) != 0) return NULL;
+    DocIndexHeader h;
+    if (len < (int)sizeof(h)) { free(buf); return NULL; }
+    memcpy(&h, buf, sizeof(h));
+    if (memcmp(h.magic, DOC_INDEX_MAGIC, 4) != 0 || h.count < 0 ||
+        (size_t)len != sizeof(h) + (size_t)h.count * sizeof(DocIndexSent)) {
+        free(buf);
+        return NULL;
+    }
+    DocIndex *ix = (DocIndex*)calloc(1, sizeof(DocIndex));
+    if (!ix) { free(buf); return NULL; }
+    ix->count = h.count;
+    ix->size = h.size;
+    ix->mtime_ns = h.mtime_ns;
+    ix->words = h.words;
+    ix->chars = h.chars;
+    ix->last_delim = h.last_delim;
+    if (h.count > 0) {
+        ix->sents = (DocIndexSent*)malloc(sizeof(DocIndexSent) * h.count);
+        if (!ix->sents) { free(buf); free(ix); return NULL; }
+        memcpy(ix->sents, buf + sizeof(h), sizeof(DocIndexSent) * h.count);
+    }
+    free(buf);
+    for (int i = 0; i < ix->count; i++) {
+        if ((int64_t)ix->sents[i].start + ix->sents[i].len > ix->size) { doc_index_free(ix); return NULL; }
+    }
+    return ix;
+}
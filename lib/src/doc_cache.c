@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../lib/include/doc_cache.h"
+#include "../../lib/include/hashmap.h"
+
+DocCache* doc_cache_create(long long budget) {
+    DocCache *c = (DocCache*)calloc(1, sizeof(DocCache));
+    if (!c) return NULL;
+    c->budget = budget > 0 ? budget : 0;
+    for (int i = 0; i < DOC_CACHE_SHARDS; i++) pthread_mutex_init(&c->shards[i].mutex, NULL);
+    pthread_mutex_init(&c->stats_mutex, NULL);
+    return c;
+}
+
+static void entry_free(DocCacheEntry *e) {
+    free(e->name);
+    mapped_file_release(e->file);
+    doc_index_free(e->ix);
+    free(e);
+}
+
+static DocCacheShard* shard_for(DocCache *c, const char *name, unsigned int *bucket) {
+    unsigned int h = hash_string(name);
+    *bucket = (h / DOC_CACHE_SHARDS) % DOC_CACHE_BUCKETS;
+    return &c->shards[h % DOC_CACHE_SHARDS];
+}
+
+static void lru_unlink(DocCacheShard *s, DocCacheEntry *e) {
+    if (e->prev) e->prev->next = e->next; else s->head = e->next;
+    if (e->next) e->next->prev = e->prev; else s->tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void lru_push_front(DocCacheShard *s, DocCacheEntry *e) {
+    e->prev = NULL;
+    e->next = s->head;
+    if (s->head) s->head->prev = e;
+    s->head = e;
+    if (!s->tail) s->tail = e;
+}
+
+// Take e out of the shard. Returns 1 if the caller should free it (no
+// reader holds it). Shard lock held.
+static int detach(DocCacheShard *s, unsigned int bucket, DocCacheEntry *e) {
+    DocCacheEntry **pp = &s->buckets[bucket];
+    while (*pp && *pp != e) pp = &(*pp)->hnext;
+    if (*pp) *pp = e->hnext;
+    lru_unlink(s, e);
+    s->bytes -= e->charge;
+    s->entries--;
+    e->cached = 0;
+    return e->refs == 0;
+}
+
+static DocCacheEntry* find(DocCacheShard *s, unsigned int bucket, const char *name) {
+    for (DocCacheEntry *e = s->buckets[bucket]; e; e = e->hnext) {
+        if (strcmp(e->name, name) == 0) return e;
+    }
+    return NULL;
+}
+
+static void count(DocCache *c, long long *field, long long n) {
+    pthread_mutex_lock(&c->stats_mutex);
+    *field += n;
+    pthread_mutex_unlock(&c->stats_mutex);
+}
+
+DocCacheEntry* doc_cache_get(DocCache *c, const char *name, int64_t size, int64_t mtime_ns) {
+    if (!c) return NULL;
+    unsigned int bucket;
+    DocCacheShard *s = shard_for(c, name, &bucket);
+    DocCacheEntry *dead = NULL;
+    pthread_mutex_lock(&s->mutex);
+    DocCacheEntry *e = find(s, bucket, name);
+    if (e && (e->ix->size != size || e->ix->mtime_ns != mtime_ns)) {
+        if (detach(s, bucket, e)) dead = e;
+        e = NULL;
+    }
+    if (e) {
+        e->refs++;
+        lru_unlink(s, e);
+        lru_push_front(s, e);
+    }
+    pthread_mutex_unlock(&s->mutex);
+    if (dead) entry_free(dead);
+    count(c, e ? &c->hits : &c->misses, 1);
+    return e;
+}
+
+DocCacheEntry* doc_cache_put(DocCache *c, const char *name, MappedFile *file, DocIndex *ix) {
+    DocCacheEntry *e = (DocCacheEntry*)calloc(1, sizeof(DocCacheEntry));
+    if (e) e->name = strdup(name);
+    if (!e || !e->name) {
+        free(e);
+        mapped_file_release(file);
+        doc_index_free(ix);
+        return NULL;
+    }
+    e->file = file;
+    e->data = file->data;
+    e->len = file->len;
+    e->ix = ix;
+    e->refs = 1;
+    e->charge = (long long)sizeof(DocCacheEntry) + (long long)strlen(name) +
+                (long long)sizeof(DocIndex) + (long long)ix->count * (long long)sizeof(DocIndexSent);
+    if (!file->map) e->charge += file->len + 1;
+    if (!c) return e;
+    long long shard_budget = c->budget / DOC_CACHE_SHARDS;
+    if (e->charge > shard_budget) return e;
+
+    unsigned int bucket;
+    DocCacheShard *s = shard_for(c, name, &bucket);
+    DocCacheEntry *dead[64]; int ndead = 0;
+    long long evicted = 0;
+    pthread_mutex_lock(&s->mutex);
+    DocCacheEntry *old = find(s, bucket, name);
+    if (old && detach(s, bucket, old)) dead[ndead++] = old;
+    // Oldest first until the new entry fits
+    while (s->tail && s->bytes + e->charge > shard_budget && ndead < 64) {
+        DocCacheEntry *victim = s->tail;
+        unsigned int vb;
+        shard_for(c, victim->name, &vb);
+        if (detach(s, vb, victim)) dead[ndead++] = victim;
+        evicted++;
+    }
+    if (s->bytes + e->charge <= shard_budget) {
+        e->hnext = s->buckets[bucket];
+        s->buckets[bucket] = e;
+        lru_push_front(s, e);
+        s->bytes += e->charge;
+        s->entries++;
+        e->cached = 1;
+    }
+    pthread_mutex_unlock(&s->mutex);
+    for (int i = 0; i < ndead; i++) entry_free(dead[i]);
+    if (evicted) count(c, &c->evictions, evicted);
+    return e;
+}
+
+void doc_cache_release(DocCache *c, DocCacheEntry *e) {
+    if (!e) return;
+    if (!c) { entry_free(e); return; }
+    unsigned int bucket;
+    DocCacheShard *s = shard_for(c, e->name, &bucket);
+    pthread_mutex_lock(&s->mutex);
+    int last = --e->refs == 0 && !e->cached;
+    pthread_mutex_unlock(&s->mutex);
+    if (last) entry_free(e);
+}
+
+void doc_cache_invalidate(DocCache *c, const char *name) {
+    if (!c) return;
+    unsigned int bucket;
+    DocCacheShard *s = shard_for(c, name, &bucket);
+    DocCacheEntry *dead = NULL;
+    pthread_mutex_lock(&s->mutex);
+    DocCacheEntry *e = find(s, bucket, name);
+    if (e && detach(s, bucket, e)) dead = e;
+    pthread_mutex_unlock(&s->mutex);
+    if (dead) entry_free(dead);
+}
+
+void doc_cache_stats_format(DocCache *c, char *buf, int buflen) {
+    long long bytes = 0; int entries = 0;
+    for (int i = 0; c && i < DOC_CACHE_SHARDS; i++) {
+        pthread_mutex_lock(&c->shards[i].mutex);
+        bytes += c->shards[i].bytes;
+        entries += c->shards[i].entries;
+        pthread_mutex_unlock(&c->shards[i].mutex);
+    }
+    long long hits = 0, misses = 0, evictions = 0;
+    if (c) {
+        pthread_mutex_lock(&c->stats_mutex);
+        hits = c->hits; misses = c->misses; evictions = c->evictions;
+        pthread_mutex_unlock(&c->stats_mutex);
+    }
+    double ratio = hits + misses ? (double)hits / (double)(hits + misses) : 0.0;
+    snprintf(buf, buflen, "cache_hits=%lld cache_misses=%lld cache_hit_ratio=%.2f cache_bytes=%lld cache_entries=%d cache_evictions=%lld",
+             hits, misses, ratio, bytes, entries, evictions);
+}
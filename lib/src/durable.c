@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "../../lib/include/durable.h"
+#include "../../lib/include/util.h"
+
+typedef struct SyncReq {
+    int fd;
+    int rc;
+    int synced;             // flusher-private while the batch is in flight
+    int done;               // set under durable_mutex; the waiter may then leave
+    struct SyncReq *next;
+} SyncReq;
+
+static DurableMode durable_mode = DURABLE_NONE;
+static int group_window_ms = DURABLE_DEFAULT_WINDOW_MS;
+static pthread_mutex_t durable_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t durable_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t durable_done = PTHREAD_COND_INITIALIZER;
+static SyncReq *sync_queue = NULL;
+static int flusher_started = 0;
+static unsigned long stat_syncs = 0;      // durable_sync() calls that had to sync
+static unsigned long stat_flushes = 0;    // fsync() calls actually issued
+
+static int fsync_fd(int fd) {
+    int rc;
+    do { rc = fsync(fd); } while (rc != 0 && errno == EINTR);
+    __sync_fetch_and_add(&stat_flushes, 1);
+    return rc;
+}
+
+// Sync one batch: each distinct file once, however many callers asked
+static void flush_batch(SyncReq *batch) {
+    for (SyncReq *r = batch; r; r = r->next) {
+        if (r->synced) continue;
+        struct stat st;
+        int have = fstat(r->fd, &st) == 0;
+        r->rc = fsync_fd(r->fd) == 0 ? 0 : -1;
+        r->synced = 1;
+        if (!have) continue;
+        for (SyncReq *o = r->next; o; o = o->next) {
+            struct stat ost;
+            if (!o->synced && fstat(o->fd, &ost) == 0 && ost.st_dev == st.st_dev && ost.st_ino == st.st_ino) {
+                o->rc = r->rc;
+                o->synced = 1;
+            }
+        }
+    }
+}
+
+static void* flusher_main(void *arg) {
+    (void)arg;
+    int last_batch = 0;
+    pthread_mutex_lock(&durable_mutex);
+    while (1) {
+        while (!sync_queue) pthread_cond_wait(&durable_work, &durable_mutex);
+        // Callers that arrive while a batch is being synced form the next
+        // one. If the last batch had company, also hold the door open for
+        // the window so one fsync covers everyone; a lone writer never waits.
+        if (group_window_ms > 0 && last_batch > 1) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += (long)group_window_ms * 1000000L;
+            ts.tv_sec += ts.tv_nsec / 1000000000L;
+            ts.tv_nsec %= 1000000000L;
+            while (pthread_cond_timedwait(&durable_work, &durable_mutex, &ts) != ETIMEDOUT) {}
+        }
+        SyncReq *batch = sync_queue;
+        sync_queue = NULL;
+        last_batch = 0;
+        for (SyncReq *r = batch; r; r = r->next) last_batch++;
+        pthread_mutex_unlock(&durable_mutex);
+        flush_batch(batch);
+        pthread_mutex_lock(&durable_mutex);
+        // Only now may the waiters return (and their requests go away)
+        for (SyncReq *r = batch, *next; r; r = next) {
+            next = r->next;
+            r->done = 1;
+        }
+        pthread_cond_broadcast(&durable_done);
+    }
+    return NULL;
+}
+
+int durable_init(DurableMode mode, int window_ms) {
+    pthread_mutex_lock(&durable_mutex);
+    durable_mode = mode;
+    if (window_ms >= 0) group_window_ms = window_ms;
+    int rc = 0;
+    if (mode == DURABLE_GROUP && !flusher_started) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, flusher_main, NULL) == 0) {
+            pthread_detach(t);
+            flusher_started = 1;
+        } else {
+            durable_mode = DURABLE_FSYNC;
+            rc = -1;
+        }
+    }
+    pthread_mutex_unlock(&durable_mutex);
+    return rc;
+}
+
+DurableMode durable_get_mode(void) {
+    return durable_mode;
+}
+
+int durable_parse_mode(const char *s, DurableMode *mode) {
+    if (strcmp(s, "none") == 0) *mode = DURABLE_NONE;
+    else if (strcmp(s, "fsync") == 0) *mode = DURABLE_FSYNC;
+    else if (strcmp(s, "group") == 0) *mode = DURABLE_GROUP;
+    else return -1;
+    return 0;
+}
+
+const char* durable_mode_name(DurableMode mode) {
+    switch (mode) {
+        case DURABLE_FSYNC: return "fsync";
+        case DURABLE_GROUP: return "group";
+        default: return "none";
+    }
+}
+
+int durable_sync(int fd) {
+    if (durable_mode == DURABLE_NONE) return 0;
+    __sync_fetch_and_add(&stat_syncs, 1);
+    if (durable_mode == DURABLE_FSYNC) return fsync_fd(fd) == 0 ? 0 : -1;
+    SyncReq req = { fd, 0, 0, 0, NULL };
+    pthread_mutex_lock(&durable_mutex);
+    req.next = sync_queue;
+    sync_queue = &req;
+    pthread_cond_signal(&durable_work);
+    while (!req.done) pthread_cond_wait(&durable_done, &durable_mutex);
+    pthread_mutex_unlock(&durable_mutex);
+    return req.rc;
+}
+
+static int sync_path(const char *path, int flags) {
+    if (durable_mode == DURABLE_NONE) return 0;
+    int fd = open(path, flags);
+    if (fd < 0) return -1;
+    int rc = durable_sync(fd);
+    close(fd);
+    return rc;
+}
+
+int durable_publish(const char *tmp_path, const char *path) {
+    if (sync_path(tmp_path, O_RDONLY) != 0) return -1;
+    if (rename(tmp_path, path) != 0) return -1;
+    // The rename itself only survives a crash once the directory is synced
+    char dir[PATH_MAX];
+    if (strlen(path) >= sizeof(dir)) return -1;
+    strcpy(dir, path);
+    char *slash = strrchr(dir, '/');
+    if (slash) *slash = '\0';
+    else strcpy(dir, ".");
+    return sync_path(dir, O_RDONLY | O_DIRECTORY);
+}
+
+int durable_write_file(const char *path, const char *buf, int len) {
+    static unsigned long seq = 0;
+    char tmp[PATH_MAX];
+    int n = snprintf(tmp, sizeof(tmp), "%s.tmp.%ld.%lu", path, (long)getpid(), __sync_fetch_and_add(&seq, 1));
+    if (n < 0 || n >= (int)sizeof(tmp)) return -1;
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return -1;
+    int ok = fwrite(buf, 1, len, f) == (size_t)len;
+    if (fclose(f) != 0) ok = 0;
+    if (!ok || durable_publish(tmp, path) != 0) { remove(tmp); return -1; }
+    return 0;
+}
+
+void durable_stats_format(char *buf, int buflen) {
+    snprintf(buf, buflen, "durable=%s syncs=%lu flushes=%lu",
+             durable_mode_name(durable_mode), stat_syncs, stat_flushes);
+}
@@ -18,6 +18,7 @@ const char* errcode_to_string(int code) {
         case ERR_ONLY_OWNER: return "ERR only owner can perform this operation";
         case ERR_UNKNOWN_COMMAND: return "ERR unknown command";
         case ERR_SYSTEM_ERROR: return "ERR system error";
+        case ERR_FILE_TOO_LARGE: return "ERR file too large";
         default: return "ERR unknown error";
     }
 }
@@ -0,0 +1,412 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../lib/include/fiber.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "../../lib/include/thread_pool.h"
+
+#define FIBER_STACK_CACHE 64
+#define FIBER_EPOLL_BATCH 256
+
+typedef struct FiberThread FiberThread;
+
+typedef struct Fiber {
+    ucontext_t ctx;
+    void *stack;                // NULL until the fiber first runs
+    FiberFn fn;
+    void *arg;
+    FiberThread *thr;
+    int done;
+    unsigned wait_seq;          // bumped on every wake; stale timers compare against it
+    int wake_reason;            // 1 fd ready, 0 timed out
+    int wait_fd;                // registered in epoll while parked on it, else -1
+    struct Fiber *next;         // ready queue / inbox link
+} Fiber;
+
+typedef struct {
+    long long when_ms;
+    Fiber *f;
+    unsigned seq;
+} FiberTimer;
+
+struct FiberThread {
+    FiberSched *sched;
+    pthread_t tid;
+    int epfd;
+    int wakefd;                 // eventfd: inbox has work
+    ucontext_t main_ctx;
+    Fiber *current;
+    Fiber *ready_head;
+    Fiber *ready_tail;
+    FiberTimer *timers;         // binary min-heap on when_ms
+    int ntimers;
+    int timers_cap;
+    pthread_mutex_t inbox_mutex;
+    Fiber *inbox;               // new fibers and fibers woken by helper threads
+    void *stack_cache[FIBER_STACK_CACHE];
+    int nstack_cache;
+};
+
+struct FiberSched {
+    FiberThread *threads;
+    int nthreads;
+    size_t stack_size;
+    ThreadPool *blocking;
+    unsigned next_thread;
+    int live;
+};
+
+static __thread FiberThread *tls_thread = NULL;
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void ready_push(FiberThread *t, Fiber *f) {
+    f->next = NULL;
+    if (t->ready_tail) t->ready_tail->next = f; else t->ready_head = f;
+    t->ready_tail = f;
+}
+
+static void inbox_push(FiberThread *t, Fiber *f) {
+    pthread_mutex_lock(&t->inbox_mutex);
+    f->next = t->inbox;
+    t->inbox = f;
+    pthread_mutex_unlock(&t->inbox_mutex);
+    uint64_t one = 1;
+    if (write(t->wakefd, &one, sizeof(one)) < 0) { /* counter saturated: already signalled */ }
+}
+
+static void inbox_drain(FiberThread *t) {
+    pthread_mutex_lock(&t->inbox_mutex);
+    Fiber *list = t->inbox;
+    t->inbox = NULL;
+    pthread_mutex_unlock(&t->inbox_mutex);
+    // Pushed LIFO; reverse so fibers start in spawn order
+    Fiber *rev = NULL;
+    while (list) { Fiber *n = list->next; list->next = rev; rev = list; list = n; }
+    while (rev) { Fiber *n = rev->next; ready_push(t, rev); rev = n; }
+}
+
+static void timer_push(FiberThread *t, long long when, Fiber *f) {
+    if (t->ntimers == t->timers_cap) {
+        int ncap = t->timers_cap ? t->timers_cap * 2 : 64;
+        FiberTimer *nt = (FiberTimer*)realloc(t->timers, ncap * sizeof(FiberTimer));
+        if (!nt) return;
+        t->timers = nt;
+        t->timers_cap = ncap;
+    }
+    int i = t->ntimers++;
+    FiberTimer tm = { when, f, f->wait_seq };
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (t->timers[parent].when_ms <= when) break;
+        t->timers[i] = t->timers[parent];
+        i = parent;
+    }
+    t->timers[i] = tm;
+}
+
+static void timer_pop(FiberThread *t) {
+    FiberTimer last = t->timers[--t->ntimers];
+    int i = 0;
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= t->ntimers) break;
+        if (child + 1 < t->ntimers && t->timers[child + 1].when_ms < t->timers[child].when_ms) child++;
+        if (t->timers[child].when_ms >= last.when_ms) break;
+        t->timers[i] = t->timers[child];
+        i = child;
+    }
+    if (t->ntimers > 0) t->timers[i] = last;
+}
+
+// Make a parked fiber runnable again, cancelling whatever else it waited on
+static void wake(FiberThread *t, Fiber *f, int reason) {
+    if (f->wait_fd >= 0) {
+        epoll_ctl(t->epfd, EPOLL_CTL_DEL, f->wait_fd, NULL);
+        f->wait_fd = -1;
+    }
+    f->wait_seq++;
+    f->wake_reason = reason;
+    ready_push(t, f);
+}
+
+static void timers_fire(FiberThread *t, long long now) {
+    while (t->ntimers > 0 && t->timers[0].when_ms <= now) {
+        FiberTimer tm = t->timers[0];
+        timer_pop(t);
+        if (tm.f->wait_seq == tm.seq) wake(t, tm.f, 0);
+    }
+}
+
+static void* stack_get(FiberThread *t) {
+    if (t->nstack_cache > 0) return t->stack_cache[--t->nstack_cache];
+    // No guard page: mprotect() would split every stack into two mappings
+    // and tens of thousands of fibers would exhaust vm.max_map_count.
+    // Handlers keep large buffers on the heap instead.
+    void *p = mmap(NULL, t->sched->stack_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+static void stack_put(FiberThread *t, void *stack) {
+    if (t->nstack_cache < FIBER_STACK_CACHE) t->stack_cache[t->nstack_cache++] = stack;
+    else munmap(stack, t->sched->stack_size);
+}
+
+static void fiber_entry(void) {
+    Fiber *f = tls_thread->current;
+    f->fn(f->arg);
+    f->done = 1;
+    // Returning resumes uc_link, the scheduler loop
+}
+
+static void fiber_park(void) {
+    FiberThread *t = tls_thread;
+    swapcontext(&t->current->ctx, &t->main_ctx);
+}
+
+static void run_fiber(FiberThread *t, Fiber *f) {
+    if (!f->stack) {
+        f->stack = stack_get(t);
+        if (!f->stack || getcontext(&f->ctx) != 0) {
+            fprintf(stderr, "fiber: cannot allocate stack, running inline\n");
+            if (f->stack) stack_put(t, f->stack);
+            f->stack = NULL;
+            f->fn(f->arg);
+            __sync_fetch_and_sub(&t->sched->live, 1);
+            free(f);
+            return;
+        }
+        f->ctx.uc_stack.ss_sp = f->stack;
+        f->ctx.uc_stack.ss_size = t->sched->stack_size;
+        f->ctx.uc_link = &t->main_ctx;
+        makecontext(&f->ctx, fiber_entry, 0);
+    }
+    t->current = f;
+    swapcontext(&t->main_ctx, &f->ctx);
+    t->current = NULL;
+    if (f->done) {
+        stack_put(t, f->stack);
+        __sync_fetch_and_sub(&t->sched->live, 1);
+        free(f);
+    }
+}
+
+static void* sched_thread_main(void *arg) {
+    FiberThread *t = (FiberThread*)arg;
+    tls_thread = t;
+    struct epoll_event events[FIBER_EPOLL_BATCH];
+    while (1) {
+        inbox_drain(t);
+        timers_fire(t, now_ms());
+        // Run only what is ready now so a yielding fiber cannot starve I/O
+        Fiber *batch = t->ready_head;
+        t->ready_head = t->ready_tail = NULL;
+        while (batch) {
+            Fiber *next = batch->next;
+            run_fiber(t, batch);
+            batch = next;
+        }
+        int timeout = -1;
+        if (t->ready_head) timeout = 0;
+        else if (t->ntimers > 0) {
+            long long d = t->timers[0].when_ms - now_ms();
+            timeout = d < 0 ? 0 : (int)d;
+        }
+        int n = epoll_wait(t->epfd, events, FIBER_EPOLL_BATCH, timeout);
+        for (int i = 0; i < n; i++) {
+            Fiber *f = (Fiber*)events[i].data.ptr;
+            if (!f) {
+                uint64_t v;
+                if (read(t->wakefd, &v, sizeof(v)) < 0) { /* spurious */ }
+                continue;
+            }
+            if (f->wait_fd >= 0) wake(t, f, 1);
+        }
+    }
+    return NULL;
+}
+
+FiberSched* fiber_sched_create(int nthreads, int blocking_threads, size_t stack_size) {
+    if (nthreads < 1) nthreads = 1;
+    FiberSched *s = (FiberSched*)calloc(1, sizeof(FiberSched));
+    if (!s) return NULL;
+    s->stack_size = stack_size ? stack_size : FIBER_DEFAULT_STACK;
+    s->threads = (FiberThread*)calloc(nthreads, sizeof(FiberThread));
+    s->blocking = thread_pool_create(blocking_threads > 0 ? blocking_threads : 4, 0);
+    if (!s->threads || !s->blocking) goto fail;
+    for (int i = 0; i < nthreads; i++) {
+        FiberThread *t = &s->threads[i];
+        t->sched = s;
+        pthread_mutex_init(&t->inbox_mutex, NULL);
+        t->epfd = epoll_create1(EPOLL_CLOEXEC);
+        t->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (t->epfd < 0 || t->wakefd < 0) goto fail;
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL;
+        if (epoll_ctl(t->epfd, EPOLL_CTL_ADD, t->wakefd, &ev) != 0) goto fail;
+        if (pthread_create(&t->tid, NULL, sched_thread_main, t) != 0) goto fail;
+        pthread_detach(t->tid);
+        s->nthreads++;
+    }
+    return s;
+fail:
+    // Only reached before any scheduler thread could pick up work
+    if (s->nthreads > 0) return s;
+    if (s->blocking) thread_pool_free(s->blocking);
+    free(s->threads);
+    free(s);
+    return NULL;
+}
+
+int fiber_spawn(FiberSched *sched, FiberFn fn, void *arg) {
+    if (!sched || !fn || sched->nthreads == 0) return -1;
+    Fiber *f = (Fiber*)calloc(1, sizeof(Fiber));
+    if (!f) return -1;
+    f->fn = fn;
+    f->arg = arg;
+    f->wait_fd = -1;
+    unsigned idx = __sync_fetch_and_add(&sched->next_thread, 1) % (unsigned)sched->nthreads;
+    f->thr = &sched->threads[idx];
+    __sync_fetch_and_add(&sched->live, 1);
+    inbox_push(f->thr, f);
+    return 0;
+}
+
+int fiber_count(FiberSched *sched) {
+    return sched ? __sync_fetch_and_add(&sched->live, 0) : 0;
+}
+
+int fiber_current(void) {
+    return tls_thread != NULL && tls_thread->current != NULL;
+}
+
+int fiber_wait_fd(int fd, int for_write, int timeout_ms) {
+    if (!fiber_current()) {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = for_write ? POLLOUT : POLLIN;
+        pfd.revents = 0;
+        int rc = poll(&pfd, 1, timeout_ms);
+        return rc > 0 ? 1 : rc;
+    }
+    FiberThread *t = tls_thread;
+    Fiber *f = t->current;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = (for_write ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT;
+    ev.data.ptr = f;
+    if (epoll_ctl(t->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        if (errno == EPERM) return 1;  // regular file: always ready
+        return -1;
+    }
+    f->wait_fd = fd;
+    if (timeout_ms >= 0) timer_push(t, now_ms() + timeout_ms, f);
+    fiber_park();
+    return f->wake_reason;
+}
+
+void fiber_sleep_ms(int ms) {
+    if (!fiber_current()) {
+        usleep((useconds_t)ms * 1000);
+        return;
+    }
+    FiberThread *t = tls_thread;
+    timer_push(t, now_ms() + ms, t->current);
+    fiber_park();
+}
+
+void fiber_yield(void) {
+    if (!fiber_current()) return;
+    ready_push(tls_thread, tls_thread->current);
+    fiber_park();
+}
+
+typedef struct {
+    FiberFn fn;
+    void *arg;
+    Fiber *f;
+} BlockingCall;
+
+static void blocking_call_run(void *arg) {
+    BlockingCall *bc = (BlockingCall*)arg;
+    Fiber *f = bc->f;
+    bc->fn(bc->arg);
+    // The fiber parked before its scheduler thread could look at the inbox
+    inbox_push(f->thr, f);
+}
+
+void fiber_call_blocking(FiberFn fn, void *arg) {
+    if (!fiber_current()) { fn(arg); return; }
+    FiberThread *t = tls_thread;
+    BlockingCall bc = { fn, arg, t->current };
+    if (thread_pool_submit(t->sched->blocking, blocking_call_run, &bc) != 0) {
+        fn(arg);
+        return;
+    }
+    fiber_park();
+}
+
+int fiber_net_wait(int fd, int for_write) {
+    return fiber_wait_fd(fd, for_write, -1);
+}
+
+#else  // !__linux__: no scheduler, everything runs on plain threads
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+FiberSched* fiber_sched_create(int nthreads, int blocking_threads, size_t stack_size) {
+    (void)nthreads; (void)blocking_threads; (void)stack_size;
+    return NULL;
+}
+
+int fiber_spawn(FiberSched *sched, FiberFn fn, void *arg) {
+    (void)sched; (void)fn; (void)arg;
+    return -1;
+}
+
+int fiber_count(FiberSched *sched) { (void)sched; return 0; }
+
+int fiber_current(void) { return 0; }
+
+int fiber_wait_fd(int fd, int for_write, int timeout_ms) {
+    (void)fd; (void)for_write; (void)timeout_ms;
+    return 1;
+}
+
+void fiber_sleep_ms(int ms) {
+#ifdef _WIN32
+    Sleep(ms);
+#else
+    usleep((useconds_t)ms * 1000);
+#endif
+}
+
+void fiber_yield(void) {}
+
+void fiber_call_blocking(FiberFn fn, void *arg) { fn(arg); }
+
+int fiber_net_wait(int fd, int for_write) { return fiber_wait_fd(fd, for_write, -1); }
+
+#endif
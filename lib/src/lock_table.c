@@ -0,0 +1,504 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "../../lib/include/lock_table.h"
+#include "../../lib/include/hashmap.h"
+
+LockTable* lock_table_create(int lease_ms) {
+    LockTable *lt = (LockTable*)calloc(1, sizeof(LockTable));
+    if (!lt) return NULL;
+    lt->lease_ms = lease_ms > 0 ? lease_ms : 0;
+    for (int i = 0; i < LOCK_TABLE_SHARDS; i++) pthread_mutex_init(&lt->shards[i].mutex, NULL);
+    return lt;
+}
+
+void lock_table_on_expire(LockTable *lt, LockExpiredFn fn, void *arg) {
+    if (!lt) return;
+    lt->on_expire = fn;
+    lt->on_expire_arg = arg;
+}
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static LockShard* shard_for(LockTable *lt, const char *name, FileLocks ***bucket) {
+    unsigned int h = hash_string(name);
+    LockShard *s = &lt->shards[h % LOCK_TABLE_SHARDS];
+    *bucket = &s->buckets[(h / LOCK_TABLE_SHARDS) % LOCK_TABLE_BUCKETS];
+    return s;
+}
+
+static FileLocks* find(FileLocks **bucket, const char *name) {
+    for (FileLocks *f = *bucket; f; f = f->next) {
+        if (strcmp(f->name, name) == 0) return f;
+    }
+    return NULL;
+}
+
+static FileLocks* create(LockShard *s, FileLocks **bucket, const char *name) {
+    FileLocks *f = (FileLocks*)calloc(1, sizeof(FileLocks));
+    if (f) f->name = strdup(name);
+    if (!f || !f->name) { free(f); return NULL; }
+    f->next = *bucket;
+    *bucket = f;
+    s->files++;
+    return f;
+}
+
+// The file's last lock is gone: drop its record, or just its sentence
+// map if it has contention counters worth keeping
+static void retire(LockShard *s, FileLocks **bucket, FileLocks *f) {
+    free(f->slots);
+    f->slots = NULL;
+    f->cap = 0;
+    if (f->stats.waits > 0 || f->stats.expired > 0) return;
+    FileLocks **pp = bucket;
+    while (*pp && *pp != f) pp = &(*pp)->next;
+    if (*pp) *pp = f->next;
+    free(f->name);
+    free(f);
+    s->files--;
+}
+
+static unsigned int slot_hash(int sidx) {
+    return (unsigned int)sidx * 2654435761u;
+}
+
+// Slot holding sidx, or the empty slot where it would go
+static int probe(const FileLocks *f, int sidx) {
+    unsigned int mask = (unsigned int)f->cap - 1;
+    unsigned int i = slot_hash(sidx) & mask;
+    while (f->slots[i].sidx != -1 && f->slots[i].sidx != sidx) i = (i + 1) & mask;
+    return (int)i;
+}
+
+static SentenceLock* lookup(const FileLocks *f, int sidx) {
+    if (!f || f->cap == 0 || sidx < 0) return NULL;
+    SentenceLock *sl = &f->slots[probe(f, sidx)];
+    return sl->sidx == sidx ? sl : NULL;
+}
+
+static long long lease_end(const LockTable *lt, long long now) {
+    return lt->lease_ms ? now + lt->lease_ms : 0;
+}
+
+static int lapsed(const SentenceLock *sl, long long now) {
+    return sl->expires_ms != 0 && sl->expires_ms <= now;
+}
+
+// owner holds sl and its lease hasn't run out
+static int live(const SentenceLock *sl, long owner, long long now) {
+    return sl->owner == owner && !lapsed(sl, now);
+}
+
+// The lock owner holds as sidx, wherever a remap has moved it since
+static SentenceLock* held_as(const FileLocks *f, int sidx, long owner, long long now) {
+    SentenceLock *sl = lookup(f, sidx);
+    if (sl && sl->as == sidx && live(sl, owner, now)) return sl;
+    for (int i = 0; f && i < f->cap; i++) {
+        sl = &f->slots[i];
+        if (sl->sidx != -1 && sl->as == sidx && live(sl, owner, now)) return sl;
+    }
+    return NULL;
+}
+
+static int grow(FileLocks *f) {
+    int ncap = f->cap ? f->cap * 2 : 8;
+    SentenceLock *old = f->slots;
+    int ocap = f->cap;
+    f->slots = (SentenceLock*)malloc(ncap * sizeof(SentenceLock));
+    if (!f->slots) { f->slots = old; return -1; }
+    for (int i = 0; i < ncap; i++) f->slots[i].sidx = -1;
+    f->cap = ncap;
+    for (int i = 0; i < ocap; i++) {
+        if (old[i].sidx != -1) f->slots[probe(f, old[i].sidx)] = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+// Empty slot i, shifting later entries of its probe run back so lookups
+// never need tombstones
+static void erase(FileLocks *f, int i) {
+    unsigned int mask = (unsigned int)f->cap - 1;
+    unsigned int hole = (unsigned int)i, j = (unsigned int)i;
+    f->slots[hole].sidx = -1;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (f->slots[j].sidx == -1) break;
+        unsigned int home = slot_hash(f->slots[j].sidx) & mask;
+        // Move j into the hole unless its home lies cyclically in (hole, j]
+        int stays = hole <= j ? (home > hole && home <= j) : (home > hole || home <= j);
+        if (stays) continue;
+        f->slots[hole] = f->slots[j];
+        f->slots[j].sidx = -1;
+        hole = j;
+    }
+    f->stats.held--;
+}
+
+// Lock sidx of f (not held) for owner. Shard lock held.
+static int take(LockTable *lt, LockShard *s, FileLocks **bucket, FileLocks *f, int sidx, long owner) {
+    // Keep the map at most half full
+    if ((f->stats.held + 1) * 2 > f->cap && grow(f) != 0) {
+        if (f->stats.held == 0) retire(s, bucket, f);
+        return -1;
+    }
+    SentenceLock *sl = &f->slots[probe(f, sidx)];
+    sl->sidx = sl->as = sl->at = sidx;
+    sl->owner = owner;
+    sl->expires_ms = lease_end(lt, now_ms());
+    sl->head = sl->tail = NULL;
+    f->stats.held++;
+    return 0;
+}
+
+// w has stopped waiting after ms: count it against f
+static void count_wait(FileLocks *f, long long ms) {
+    f->stats.waiting--;
+    f->stats.wait_ms += ms;
+    if (ms > f->stats.wait_ms_max) f->stats.wait_ms_max = ms;
+}
+
+// Unlock sl, handing it straight to the oldest waiter if there is one.
+// Returns 1 if that retired f. Shard lock held.
+static int unlock(LockTable *lt, LockShard *s, FileLocks **bucket, FileLocks *f, SentenceLock *sl) {
+    LockWaiter *w = sl->head;
+    if (w) {
+        long long now = now_ms();
+        sl->head = w->next;
+        if (!sl->head) sl->tail = NULL;
+        sl->owner = w->owner;
+        sl->as = w->as;
+        sl->at = sl->sidx;
+        sl->expires_ms = lease_end(lt, now);
+        w->granted = 1;
+        count_wait(f, now - w->since_ms);
+        uint64_t one = 1;
+        if (write(w->wake_fd, &one, sizeof(one)) < 0) { /* it finds out when its wait ends */ }
+        return 0;
+    }
+    erase(f, (int)(sl - f->slots));
+    if (f->stats.held > 0) return 0;
+    retire(s, bucket, f);
+    return 1;
+}
+
+// sl's lease has run out: release it, handing it to its oldest waiter if
+// there is one, and count it. Returns 1 if that retired f. Shard lock held.
+static int expire(LockTable *lt, LockShard *s, FileLocks **bucket, FileLocks *f, SentenceLock *sl,
+                  LockExpiredFn fn, void *arg) {
+    if (fn) fn(f->name, sl->sidx, sl->owner, arg);
+    f->stats.expired++;
+    return unlock(lt, s, bucket, f, sl);
+}
+
+// The lock on sidx of name's record *f, after reaping it if its lease ran
+// out before the reaper got to it (NULL if that left the sentence free).
+// *f is looked up again: the reap may have retired it. Shard lock held.
+static SentenceLock* lookup_live(LockTable *lt, LockShard *s, FileLocks **bucket, const char *name,
+                                 FileLocks **f, int sidx, long long now) {
+    SentenceLock *sl = lookup(*f, sidx);
+    if (!sl || !lapsed(sl, now)) return sl;
+    expire(lt, s, bucket, *f, sl, lt->on_expire, lt->on_expire_arg);
+    *f = find(bucket, name);
+    // Erasing may have moved another sentence into its slot
+    return lookup(*f, sidx);
+}
+
+int lock_table_acquire(LockTable *lt, const char *name, int sidx, long owner) {
+    if (!lt || sidx < 0) return -1;
+    FileLocks **bucket;
+    LockShard *s = shard_for(lt, name, &bucket);
+    pthread_mutex_lock(&s->mutex);
+    FileLocks *f = find(bucket, name);
+    long long now = now_ms();
+    int rc;
+    if (f && (lookup_live(lt, s, bucket, name, &f, sidx, now) || (f && held_as(f, sidx, owner, now)))) rc = 1;
+    else if (!f && !(f = create(s, bucket, name))) rc = -1;
+    else rc = take(lt, s, bucket, f, sidx, owner);
+    pthread_mutex_unlock(&s->mutex);
+    return rc;
+}
+
+int lock_table_acquire_wait(LockTable *lt, const char *name, int sidx, long owner, LockWaiter *w) {
+    if (!lt || sidx < 0) return -1;
+    FileLocks **bucket;
+    LockShard *s = shard_for(lt, name, &bucket);
+    pthread_mutex_lock(&s->mutex);
+    FileLocks *f = find(bucket, name);
+    long long now = now_ms();
+    SentenceLock *sl = f ? lookup_live(lt, s, bucket, name, &f, sidx, now) : NULL;
+    int rc;
+    // Held by owner already: at sidx, or asked for as sidx and moved since
+    if ((sl && live(sl, owner, now)) || (f && held_as(f, sidx, owner, now))) {
+        rc = 1;
+    } else if (!sl) {
+        if (!f && !(f = create(s, bucket, name))) rc = -1;
+        else rc = take(lt, s, bucket, f, sidx, owner);
+    } else {
+        w->owner = owner;
+        w->sidx = w->as = sidx;
+        w->granted = 0;
+        w->since_ms = now_ms();
+        w->next = NULL;
+        if (sl->tail) sl->tail->next = w; else sl->head = w;
+        sl->tail = w;
+        f->stats.waiting++;
+        f->stats.waits++;
+        rc = 2;
+    }
+    pthread_mutex_unlock(&s->mutex);
+    return rc;
+}
+
+int lock_table_wait_end(LockTable *lt, const char *name, LockWaiter *w) {
+    FileLocks **bucket;
+    LockShard *s = shard_for(lt, name, &bucket);
+    pthread_mutex_lock(&s->mutex);
+    int rc = 0;
+    if (!w->granted) {
+        // A sentence with waiters is never unlocked, so its slot is there
+        FileLocks *f = find(bucket, name);
+        SentenceLock *sl = lookup(f, w->sidx);
+        if (sl) {
+            LockWaiter **pp = &sl->head, *prev = NULL;
+            while (*pp && *pp != w) { prev = *pp; pp = &(*pp)->next; }
+            if (*pp) {
+                *pp = w->next;
+                if (sl->tail == w) sl->tail = prev;
+            }
+            count_wait(f, now_ms() - w->since_ms);
+            f->stats.timeouts++;
+        }
+        rc = 1;
+    }
+    pthread_mutex_unlock(&s->mutex);
+    return rc;
+}
+
+int lock_table_release(LockTable *lt, const char *name, int sidx, long owner) {
+    if (!lt) return 1;
+    FileLocks **bucket;
+    LockShard *s = shard_for(lt, name, &bucket);
+    pthread_mutex_lock(&s->mutex);
+    FileLocks *f = find(bucket, name);
+    SentenceLock *sl = held_as(f, sidx, owner, now_ms());
+    int rc = 1;
+    if (sl) {
+        unlock(lt, s, bucket, f, sl);
+        rc = 0;
+    }
+    pthread_mutex_unlock(&s->mutex);
+    return rc;
+}
+
+int lock_table_renew(LockTable *lt, const char *name, long owner) {
+    if (!lt) return 0;
+    FileLocks **bucket;
+    LockShard *s = shard_for(lt, name, &bucket);
+    long long now = now_ms();
+    pthread_mutex_lock(&s->mutex);
+    FileLocks *f = find(bucket, name);
+    int n = 0;
+    for (int i = 0; f && i < f->cap; i++) {
+        SentenceLock *sl = &f->slots[i];
+        if (sl->sidx == -1 || !live(sl, owner, now)) continue;
+        sl->expires_ms = lease_end(lt, now);
+        n++;
+    }
+    pthread_mutex_unlock(&s->mutex);
+    return n;
+}
+
+int lock_table_release_owner(LockTable *lt, const char *name, long owner) {
+    if (!lt) return 0;
+    FileLocks **bucket;
+    LockShard *s = shard_for(lt, name, &bucket);
+    long long now = now_ms();
+    pthread_mutex_lock(&s->mutex);
+    FileLocks *f = find(bucket, name);
+    int n = 0;
+    // Erasing shifts later slots back into i, so look at i again
+    for (int i = 0; f && i < f->cap; ) {
+        SentenceLock *sl = &f->slots[i];
+        if (sl->sidx == -1 || !live(sl, owner, now)) { i++; continue; }
+        n++;
+        int handed = sl->head != NULL;
+        if (unlock(lt, s, bucket, f, sl)) break;
+        if (handed) i++;
+    }
+    pthread_mutex_unlock(&s->mutex);
+    return n;
+}
+
+int lock_table_expire(LockTable *lt, LockExpiredFn fn, void *arg) {
+    if (!lt || !lt->lease_ms) return 0;
+    int n = 0;
+    for (int k = 0; k < LOCK_TABLE_SHARDS; k++) {
+        LockShard *s = &lt->shards[k];
+        pthread_mutex_lock(&s->mutex);
+        long long now = now_ms();
+        for (int b = 0; b < LOCK_TABLE_BUCKETS; b++) {
+            FileLocks *next;
+            for (FileLocks *f = s->buckets[b]; f; f = next) {
+                next = f->next;
+                for (int i = 0; i < f->cap; ) {
+                    SentenceLock *sl = &f->slots[i];
+                    if (sl->sidx == -1 || !lapsed(sl, now)) { i++; continue; }
+                    n++;
+                    // Handed on, the sentence gets a fresh lease and stays
+                    int handed = sl->head != NULL;
+                    if (expire(lt, s, &s->buckets[b], f, sl, fn, arg)) break;
+                    if (handed) i++;
+                }
+            }
+        }
+        pthread_mutex_unlock(&s->mutex);
+    }
+    return n;
+}
+
+int lock_table_holds(LockTable *lt, const char *name, int sidx, long owner) {
+    return lock_table_locate(lt, name, sidx, owner) >= 0;
+}
+
+int lock_table_locate(LockTable *lt, const char *name, int sidx, long owner) {
+    if (!lt) return -1;
+    FileLocks **bucket;
+    LockShard *s = shard_for(lt, name, &bucket);
+    pthread_mutex_lock(&s->mutex);
+    SentenceLock *sl = held_as(find(bucket, name), sidx, owner, now_ms());
+    int at = sl ? sl->at : -1;
+    pthread_mutex_unlock(&s->mutex);
+    return at;
+}
+
+int lock_table_remap(LockTable *lt, const char *name, const int *map, int n) {
+    if (!lt || n <= 0) return 0;
+    FileLocks **bucket;
+    LockShard *s = shard_for(lt, name, &bucket);
+    pthread_mutex_lock(&s->mutex);
+    FileLocks *f = find(bucket, name);
+    if (!f || f->stats.held == 0) { pthread_mutex_unlock(&s->mutex); return 0; }
+    // Remapped keys hash elsewhere: move every lock into a fresh map
+    SentenceLock *old = f->slots;
+    int cap = f->cap, dropped = 0;
+    f->slots = (SentenceLock*)malloc(cap * sizeof(SentenceLock));
+    if (!f->slots) { f->slots = old; pthread_mutex_unlock(&s->mutex); return -1; }
+    for (int i = 0; i < cap; i++) f->slots[i].sidx = -1;
+    long long now = now_ms();
+    for (int i = 0; i < cap; i++) {
+        SentenceLock *sl = &old[i];
+        if (sl->sidx == -1) continue;
+        int to = sl->sidx < n ? map[sl->sidx] : sl->sidx + map[n - 1] - (n - 1);
+        int k = to < 0 ? -1 : probe(f, to);
+        if (k < 0 || f->slots[k].sidx == to) {
+            // Its sentence is gone: nobody can be handed it
+            for (LockWaiter *w = sl->head, *next; w; w = next) {
+                next = w->next;
+                w->sidx = -1;
+                count_wait(f, now - w->since_ms);
+                f->stats.timeouts++;
+                uint64_t one = 1;
+                if (write(w->wake_fd, &one, sizeof(one)) < 0) { /* it times out instead */ }
+            }
+            f->stats.held--;
+            dropped++;
+            continue;
+        }
+        for (LockWaiter *w = sl->head; w; w = w->next) w->sidx = to;
+        sl->sidx = to;
+        f->slots[k] = *sl;
+    }
+    free(old);
+    if (f->stats.held == 0) retire(s, bucket, f);
+    pthread_mutex_unlock(&s->mutex);
+    return dropped;
+}
+
+int lock_table_rebase(LockTable *lt, const char *name, long owner) {
+    if (!lt) return 0;
+    FileLocks **bucket;
+    LockShard *s = shard_for(lt, name, &bucket);
+    long long now = now_ms();
+    pthread_mutex_lock(&s->mutex);
+    FileLocks *f = find(bucket, name);
+    int n = 0;
+    for (int i = 0; f && i < f->cap; i++) {
+        SentenceLock *sl = &f->slots[i];
+        if (sl->sidx == -1 || !live(sl, owner, now)) continue;
+        sl->at = sl->sidx;
+        n++;
+    }
+    pthread_mutex_unlock(&s->mutex);
+    return n;
+}
+
+int lock_table_owned(LockTable *lt, const char *name, long owner) {
+    if (!lt) return 0;
+    FileLocks **bucket;
+    LockShard *s = shard_for(lt, name, &bucket);
+    pthread_mutex_lock(&s->mutex);
+    FileLocks *f = find(bucket, name);
+    long long now = now_ms();
+    int n = 0;
+    for (int i = 0; f && i < f->cap; i++) {
+        if (f->slots[i].sidx != -1 && live(&f->slots[i], owner, now)) n++;
+    }
+    pthread_mutex_unlock(&s->mutex);
+    return n;
+}
+
+int lock_table_held(LockTable *lt, const char *name) {
+    if (!lt) return 0;
+    FileLocks **bucket;
+    LockShard *s = shard_for(lt, name, &bucket);
+    pthread_mutex_lock(&s->mutex);
+    FileLocks *f = find(bucket, name);
+    int n = f ? f->stats.held : 0;
+    pthread_mutex_unlock(&s->mutex);
+    return n;
+}
+
+void lock_table_file_stats(LockTable *lt, const char *name, LockStats *out) {
+    memset(out, 0, sizeof(*out));
+    if (!lt) return;
+    FileLocks **bucket;
+    LockShard *s = shard_for(lt, name, &bucket);
+    pthread_mutex_lock(&s->mutex);
+    FileLocks *f = find(bucket, name);
+    if (f) *out = f->stats;
+    pthread_mutex_unlock(&s->mutex);
+}
+
+void lock_table_stats_format(LockTable *lt, char *buf, int buflen) {
+    LockStats sum;
+    memset(&sum, 0, sizeof(sum));
+    int files = 0;
+    for (int i = 0; lt && i < LOCK_TABLE_SHARDS; i++) {
+        LockShard *s = &lt->shards[i];
+        pthread_mutex_lock(&s->mutex);
+        files += s->files;
+        for (int b = 0; b < LOCK_TABLE_BUCKETS; b++) {
+            for (FileLocks *f = s->buckets[b]; f; f = f->next) {
+                sum.held += f->stats.held;
+                sum.waiting += f->stats.waiting;
+                sum.waits += f->stats.waits;
+                sum.timeouts += f->stats.timeouts;
+                sum.wait_ms += f->stats.wait_ms;
+                if (f->stats.wait_ms_max > sum.wait_ms_max) sum.wait_ms_max = f->stats.wait_ms_max;
+                sum.expired += f->stats.expired;
+            }
+        }
+        pthread_mutex_unlock(&s->mutex);
+    }
+    snprintf(buf, buflen, "lock_files=%d lock_held=%d lock_waiting=%d lock_waits=%lld lock_timeouts=%lld lock_wait_ms=%lld lock_wait_ms_max=%lld lock_expired=%lld",
+             files, sum.held, sum.waiting, sum.waits, sum.timeouts, sum.wait_ms, sum.wait_ms_max, sum.expired);
+}
@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../../lib/include/mapped_file.h"
+
+static int read_all(int fd, char *buf, int len) {
+    for (int off = 0; off < len; ) {
+        ssize_t n = pread(fd, buf + off, len - off, off);
+        if (n < 0) { if (errno == EINTR) continue; return -1; }
+        if (n == 0) return -1;              // shrank under us
+        off += (int)n;
+    }
+    return 0;
+}
+
+MappedFile* mapped_file_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size > 0x7fffffff) {
+        close(fd);
+        return NULL;
+    }
+    MappedFile *mf = (MappedFile*)calloc(1, sizeof(MappedFile));
+    if (!mf) { close(fd); return NULL; }
+    mf->len = (int)st.st_size;
+    mf->size = (int64_t)st.st_size;
+    mf->mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    mf->refs = 1;
+    if (mf->len >= MAPPED_FILE_MIN_MAP) {
+        void *p = mmap(NULL, (size_t)mf->len, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            // Handlers mostly walk a document front to back
+            madvise(p, (size_t)mf->len, MADV_SEQUENTIAL);
+            mf->map = p;
+            mf->map_len = (size_t)mf->len;
+            mf->data = (const char*)p;
+        }
+    }
+    if (!mf->map) {
+        char *buf = (char*)malloc(mf->len + 1);
+        if (!buf || read_all(fd, buf, mf->len) != 0) {
+            free(buf);
+            free(mf);
+            close(fd);
+            return NULL;
+        }
+        buf[mf->len] = '\0';
+        mf->data = buf;
+    }
+    // The mapping (or copy) outlives the descriptor
+    close(fd);
+    return mf;
+}
+
+MappedFile* mapped_file_retain(MappedFile *mf) {
+    if (mf) __sync_fetch_and_add(&mf->refs, 1);
+    return mf;
+}
+
+void mapped_file_release(MappedFile *mf) {
+    if (!mf || __sync_sub_and_fetch(&mf->refs, 1) != 0) return;
+    if (mf->map) munmap(mf->map, mf->map_len);
+    else free((void*)mf->data);
+    free(mf);
+}
@@ -1,3 +1,6 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE     // splice()
+#endif
 #ifdef _WIN32
 #define _WINSOCK_DEPRECATED_NO_WARNINGS
 #include <winsock2.h>
@@ -11,8 +14,17 @@ static void ensure_wsa() { if (!ws_inited) { WSADATA d; WSAStartup(MAKEWORD(2,2)
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 #include <unistd.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 #define SOCKET int
 #define INVALID_SOCKET (-1)
 #define CLOSESOCK close
@@ -144,7 +156,42 @@ int net_get_local_addr(int fd, char *ip_buf, int ip_buf_len, uint16_t *port_out)
     return 0;
 }
 
-int net_connect_ex(const char *remote_host, uint16_t remote_port, const char *local_host, uint16_t local_port) {
+// connect() that gives up after timeout_ms (0 = the kernel's own limit).
+// The socket is left blocking either way.
+static int connect_timed(SOCKET fd, const struct sockaddr *sa, int salen, int timeout_ms) {
+#ifdef _WIN32
+    (void)timeout_ms;
+    return connect(fd, sa, salen);
+#else
+    if (timeout_ms <= 0) return connect(fd, sa, (socklen_t)salen);
+    net_set_nonblocking(fd, 1);
+    int rc = connect(fd, sa, (socklen_t)salen);
+    if (rc != 0 && errno == EINPROGRESS) {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        do {
+            rc = poll(&pfd, 1, timeout_ms);
+        } while (rc < 0 && errno == EINTR);
+        if (rc == 0) {
+            errno = ETIMEDOUT;
+            rc = -1;
+        } else if (rc > 0) {
+            int err = 0;
+            socklen_t elen = sizeof(err);
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &elen);
+            if (err) { errno = err; rc = -1; } else rc = 0;
+        }
+    }
+    int saved = errno;
+    net_set_nonblocking(fd, 0);
+    errno = saved;
+    return rc;
+#endif
+}
+
+static int connect_ex_timed(const char *remote_host, uint16_t remote_port, const char *local_host, uint16_t local_port, int timeout_ms) {
     ensure_wsa();
     char port_str[16];
     snprintf(port_str, sizeof(port_str), "%u", (unsigned)remote_port);
@@ -174,7 +221,7 @@ int net_connect_ex(const char *remote_host, uint16_t remote_port, const char *lo
                 continue;
             }
         }
-        if (connect(fd, p->ai_addr, (int)p->ai_addrlen) == 0) {
+        if (connect_timed(fd, p->ai_addr, (int)p->ai_addrlen, timeout_ms) == 0) {
             char addrbuf[64] = "";
             if (p->ai_family == AF_INET) {
                 struct sockaddr_in *ipv4 = (struct sockaddr_in*)p->ai_addr;
@@ -193,30 +240,258 @@ int net_connect_ex(const char *remote_host, uint16_t remote_port, const char *lo
     return (int)fd;
 }
 
+int net_connect_ex(const char *remote_host, uint16_t remote_port, const char *local_host, uint16_t local_port) {
+    return connect_ex_timed(remote_host, remote_port, local_host, local_port, 0);
+}
+
 int net_connect(const char *ip, uint16_t port) {
-    return net_connect_ex(ip, port, NULL, 0);
+    return connect_ex_timed(ip, port, NULL, 0, 0);
 }
 
-int net_send_line(int fd, const char *line) {
-    if (net_verbose) {
-        net_logf("SEND", "fd=%d %s", fd, line);
+int net_connect_timeout(const char *ip, uint16_t port, int timeout_ms) {
+    return connect_ex_timed(ip, port, NULL, 0, timeout_ms);
+}
+
+int net_resolve(const char *host, uint16_t port, NetAddr *out) {
+    ensure_wsa();
+    char port_str[16];
+    snprintf(port_str, sizeof(port_str), "%u", (unsigned)port);
+    struct addrinfo hints; memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *res = NULL;
+    if (getaddrinfo(host, port_str, &hints, &res) != 0 || !res) return -1;
+    if (res->ai_addrlen > sizeof(out->addr)) { freeaddrinfo(res); return -1; }
+    out->family = res->ai_family;
+    out->len = (int)res->ai_addrlen;
+    memcpy(out->addr, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+    return 0;
+}
+
+int net_connect_addr(const NetAddr *addr) {
+    return net_connect_addr_timeout(addr, 0);
+}
+
+int net_connect_addr_timeout(const NetAddr *addr, int timeout_ms) {
+    ensure_wsa();
+    SOCKET fd = socket(addr->family, SOCK_STREAM, 0);
+    if (fd == INVALID_SOCKET) return -1;
+    if (connect_timed(fd, (const struct sockaddr*)addr->addr, addr->len, timeout_ms) != 0) {
+        CLOSESOCK(fd);
+        return -1;
     }
-    size_t n = strlen(line);
+    net_logf("CONNECT", "cached address (fd=%d)", (int)fd);
+    return (int)fd;
+}
+
+void net_set_nodelay(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+}
+
+void net_set_io_timeouts(int fd, int recv_ms, int send_ms) {
+#ifdef _WIN32
+    DWORD r = (DWORD)(recv_ms > 0 ? recv_ms : 0), w = (DWORD)(send_ms > 0 ? send_ms : 0);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&r, sizeof(r));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, (const char*)&w, sizeof(w));
+#else
+    struct timeval r, w;
+    if (recv_ms < 0) recv_ms = 0;
+    if (send_ms < 0) send_ms = 0;
+    r.tv_sec = recv_ms / 1000; r.tv_usec = (recv_ms % 1000) * 1000;
+    w.tv_sec = send_ms / 1000; w.tv_usec = (send_ms % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &r, sizeof(r));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &w, sizeof(w));
+#endif
+}
+
+void net_set_nonblocking(int fd, int enabled) {
+#ifdef _WIN32
+    u_long mode = enabled ? 1 : 0;
+    ioctlsocket(fd, FIONBIO, &mode);
+#else
+    int fl = fcntl(fd, F_GETFL, 0);
+    if (fl < 0) return;
+    fcntl(fd, F_SETFL, enabled ? (fl | O_NONBLOCK) : (fl & ~O_NONBLOCK));
+#endif
+}
+
+static NetWaitHook net_wait_hook = NULL;
+
+void net_set_wait_hook(NetWaitHook hook) {
+    net_wait_hook = hook;
+}
+
+// A socket call failed. If that was only a non-blocking fd with nothing to
+// do yet, wait until it is ready (parking the fiber when a hook is set)
+// and return 1 so the caller retries; otherwise 0.
+static int io_retry(int fd, int for_write) {
+#ifdef _WIN32
+    (void)fd; (void)for_write;
+    return 0;
+#else
+    if (errno == EINTR) return 1;
+    if (errno != EAGAIN && errno != EWOULDBLOCK) return 0;
+    // On a blocking socket EAGAIN means SO_RCVTIMEO/SO_SNDTIMEO ran out
+    int fl = fcntl(fd, F_GETFL, 0);
+    if (fl >= 0 && !(fl & O_NONBLOCK)) { errno = ETIMEDOUT; return 0; }
+    if (net_wait_hook) return net_wait_hook(fd, for_write) > 0;
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = for_write ? POLLOUT : POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, -1) > 0;
+#endif
+}
+
+static int send_all_flags(int fd, const char *buf, size_t n, int flags) {
     size_t sent = 0;
     while (sent < n) {
 #ifdef _WIN32
-        int rc = send(fd, line + sent, (int)(n - sent), 0);
+        int rc = send(fd, buf + sent, (int)(n - sent), flags);
 #else
-        int rc = (int)send(fd, line + sent, n - sent, 0);
+        int rc = (int)send(fd, buf + sent, n - sent, flags);
 #endif
+        if (rc < 0 && io_retry(fd, 1)) continue;
         if (rc <= 0) return -1;
         sent += rc;
     }
-    const char nl = '\n';
-    if (send(fd, &nl, 1, 0) != 1) return -1;
     return 0;
 }
 
+// Two buffers in one syscall (one TCP segment for short messages)
+static int send_pair(int fd, const char *a, size_t alen, const char *b, size_t blen) {
+#ifdef _WIN32
+    if (send_all_flags(fd, a, alen, 0) != 0) return -1;
+    return blen ? send_all_flags(fd, b, blen, 0) : 0;
+#else
+    struct iovec iov[2];
+    iov[0].iov_base = (void*)a; iov[0].iov_len = alen;
+    iov[1].iov_base = (void*)b; iov[1].iov_len = blen;
+    int idx = 0;
+    while (idx < 2) {
+        ssize_t rc = writev(fd, iov + idx, 2 - idx);
+        if (rc < 0 && io_retry(fd, 1)) continue;
+        if (rc <= 0) return -1;
+        while (idx < 2 && (size_t)rc >= iov[idx].iov_len) { rc -= iov[idx].iov_len; idx++; }
+        if (idx < 2) { iov[idx].iov_base = (char*)iov[idx].iov_base + rc; iov[idx].iov_len -= rc; }
+    }
+    return 0;
+#endif
+}
+
+// send_pair in one attempt; -1 unless both buffers went out whole
+static int send_pair_nowait(int fd, const char *a, size_t alen, const char *b, size_t blen) {
+#ifdef _WIN32
+    // No per-call non-blocking flag; the caller's socket decides
+    if (send(fd, a, (int)alen, 0) != (int)alen) return -1;
+    return blen && send(fd, b, (int)blen, 0) != (int)blen ? -1 : 0;
+#else
+    struct iovec iov[2];
+    iov[0].iov_base = (void*)a; iov[0].iov_len = alen;
+    iov[1].iov_base = (void*)b; iov[1].iov_len = blen;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    ssize_t rc;
+    do rc = sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL); while (rc < 0 && errno == EINTR);
+    return rc == (ssize_t)(alen + blen) ? 0 : -1;
+#endif
+}
+
+int net_send_line(int fd, const char *line) {
+    if (net_verbose) {
+        net_logf("SEND", "fd=%d %s", fd, line);
+    }
+    // Body and newline leave together instead of as two segments
+    return send_pair(fd, line, strlen(line), "\n", 1);
+}
+
+int net_send_line_nowait(int fd, const char *line) {
+    if (net_verbose) net_logf("SEND", "fd=%d %s (nowait)", fd, line);
+    return send_pair_nowait(fd, line, strlen(line), "\n", 1);
+}
+
+void net_sendbuf_init(NetSendBuf *b, int fd) {
+    b->fd = fd;
+    b->buf = NULL;
+    b->len = 0;
+    b->cap = 0;
+    b->err = 0;
+}
+
+// Push pending bytes; more_coming hints the kernel to hold a partial segment
+static int sendbuf_push(NetSendBuf *b, int more_coming) {
+    if (b->err) return -1;
+    if (b->fd < 0 || b->len == 0) return 0;
+    int flags = 0;
+#ifdef MSG_MORE
+    if (more_coming) flags |= MSG_MORE;
+#else
+    (void)more_coming;
+#endif
+    if (send_all_flags(b->fd, b->buf, b->len, flags) != 0) { b->err = 1; return -1; }
+    b->len = 0;
+    return 0;
+}
+
+static int sendbuf_put(NetSendBuf *b, const void *data, int len) {
+    if (b->err || len < 0) return -1;
+    if (b->len + len > b->cap) {
+        int ncap = b->cap ? b->cap : 4096;
+        while (ncap < b->len + len) ncap *= 2;
+        char *nb = (char*)realloc(b->buf, ncap);
+        if (!nb) { b->err = 1; return -1; }
+        b->buf = nb;
+        b->cap = ncap;
+    }
+    memcpy(b->buf + b->len, data, len);
+    b->len += len;
+    return 0;
+}
+
+int net_sendbuf_append(NetSendBuf *b, const void *data, int len) {
+    if (sendbuf_put(b, data, len) != 0) return -1;
+    if (b->fd >= 0 && b->len >= NET_SENDBUF_FLUSH) return sendbuf_push(b, 1);
+    return 0;
+}
+
+int net_sendbuf_line(NetSendBuf *b, const char *line) {
+    if (net_verbose) net_logf("SEND", "fd=%d %s", b->fd, line);
+    if (sendbuf_put(b, line, (int)strlen(line)) != 0) return -1;
+    return net_sendbuf_append(b, "\n", 1);
+}
+
+int net_sendbuf_linef(NetSendBuf *b, const char *fmt, ...) {
+    char tmp[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+    va_end(ap);
+    if (n < 0) return -1;
+    if (n < (int)sizeof(tmp)) return net_sendbuf_line(b, tmp);
+    char *big = (char*)malloc(n + 1);
+    if (!big) { b->err = 1; return -1; }
+    va_start(ap, fmt);
+    vsnprintf(big, n + 1, fmt, ap);
+    va_end(ap);
+    int rc = net_sendbuf_line(b, big);
+    free(big);
+    return rc;
+}
+
+int net_sendbuf_flush(NetSendBuf *b) {
+    return sendbuf_push(b, 0);
+}
+
+void net_sendbuf_free(NetSendBuf *b) {
+    free(b->buf);
+    b->buf = NULL;
+    b->len = b->cap = 0;
+}
+
 int net_recv_line(int fd, char *buf, int buflen) {
     int pos = 0;
     while (pos < buflen - 1) {
@@ -226,6 +501,7 @@ int net_recv_line(int fd, char *buf, int buflen) {
 #else
         int rc = (int)recv(fd, &c, 1, 0);
 #endif
+        if (rc < 0 && io_retry(fd, 0)) continue;
         if (rc <= 0) return -1;
         if (c == '\n') break;
         buf[pos++] = c;
@@ -244,3 +520,475 @@ void net_close(int fd) {
     CLOSESOCK(fd);
 }
 
+
+NetConn* net_conn_open(int fd) {
+    if (fd < 0) return NULL;
+    NetConn *c = (NetConn*)malloc(sizeof(NetConn));
+    if (!c) return NULL;
+    c->buf = (char*)malloc(NET_CONN_BUFSZ + 1);
+    if (!c->buf) { free(c); return NULL; }
+    c->fd = fd;
+    c->cap = NET_CONN_BUFSZ;
+    c->start = 0;
+    c->end = 0;
+    c->held_pos = -1;
+    c->held = 0;
+    return c;
+}
+
+// Put back the byte an over-long line's terminator overwrote
+static void conn_restore_held(NetConn *c) {
+    if (c->held_pos >= 0) {
+        c->buf[c->held_pos] = c->held;
+        c->held_pos = -1;
+    }
+}
+
+// Pull whatever the socket has (up to the free space) into the buffer.
+// Returns bytes read, 0 on EOF, -1 on error.
+static int conn_fill(NetConn *c, int flags) {
+    if (c->start == c->end) {
+        c->start = c->end = 0;
+    } else if (c->end == c->cap && c->start > 0) {
+        memmove(c->buf, c->buf + c->start, c->end - c->start);
+        c->end -= c->start;
+        c->start = 0;
+    }
+    if (c->end == c->cap) {
+        if (c->cap >= NET_CONN_MAX_LINE) return -1;
+        int ncap = c->cap * 2;
+        if (ncap > NET_CONN_MAX_LINE) ncap = NET_CONN_MAX_LINE;
+        char *nb = (char*)realloc(c->buf, ncap + 1);
+        if (!nb) return -1;
+        c->buf = nb;
+        c->cap = ncap;
+    }
+#ifdef _WIN32
+    int rc = recv(c->fd, c->buf + c->end, c->cap - c->end, flags);
+#else
+    int rc;
+    do {
+        rc = (int)recv(c->fd, c->buf + c->end, c->cap - c->end, flags);
+    } while (rc < 0 && flags == 0 && io_retry(c->fd, 0));
+#endif
+    if (rc > 0) c->end += rc;
+    return rc;
+}
+
+int net_conn_fill_nowait(NetConn *c) {
+    if (!c) return -1;
+    conn_restore_held(c);
+#ifdef MSG_DONTWAIT
+    int rc = conn_fill(c, MSG_DONTWAIT);
+    if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return -2;
+#else
+    int rc = conn_fill(c, 0);
+#endif
+    return rc;
+}
+
+int net_conn_has_line(NetConn *c, int maxlen) {
+    if (!c) return 0;
+    int avail = c->end - c->start;
+    if (avail <= 0) return 0;
+    if (avail >= maxlen - 1) return 1;
+    return memchr(c->buf + c->start, '\n', avail) != NULL;
+}
+
+static long long monotonic_ms(void) {
+#ifdef _WIN32
+    return (long long)GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+int net_conn_recv_line_timeout(NetConn *c, char *buf, int buflen, int timeout_ms) {
+    if (!c) return -1;
+#ifndef _WIN32
+    if (timeout_ms > 0) {
+        long long deadline = monotonic_ms() + timeout_ms;
+        while (!net_conn_has_line(c, buflen)) {
+            long long left = deadline - monotonic_ms();
+            if (left <= 0) { errno = ETIMEDOUT; return -2; }
+            struct pollfd pfd;
+            pfd.fd = c->fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            int prc = poll(&pfd, 1, (int)left);
+            if (prc < 0 && errno != EINTR) return -1;
+            if (prc <= 0) continue;
+            int rc = net_conn_fill_nowait(c);
+            if (rc == 0) break;     // EOF: net_conn_recv_line reports it
+            if (rc == -1) return -1;
+        }
+    }
+#else
+    (void)timeout_ms;
+#endif
+    return net_conn_recv_line(c, buf, buflen);
+}
+
+int net_conn_next_line(NetConn *c, char **line) {
+    if (!c) return -1;
+    conn_restore_held(c);
+    int scanned = c->start;
+    while (1) {
+        char *nl = (char*)memchr(c->buf + scanned, '\n', c->end - scanned);
+        if (nl) {
+            *nl = '\0';
+            *line = c->buf + c->start;
+            int len = (int)(nl - *line);
+            c->start = (int)(nl - c->buf) + 1;
+            if (net_verbose) net_logf("RECV", "fd=%d %s", c->fd, *line);
+            return len;
+        }
+        if (c->end - c->start >= NET_CONN_MAX_LINE) {
+            // Over-long line: hand out what we have, the rest becomes the next line
+            *line = c->buf + c->start;
+            int len = c->end - c->start;
+            c->held_pos = c->end;
+            c->held = c->buf[c->end];
+            c->buf[c->end] = '\0';
+            c->start = c->end;
+            return len;
+        }
+        int rc = conn_fill(c, 0);
+        if (rc <= 0) return -1;
+        scanned = c->end - rc;  // only the new bytes still need scanning
+    }
+}
+
+int net_conn_recv_line(NetConn *c, char *buf, int buflen) {
+    if (!c || buflen <= 0) return -1;
+    conn_restore_held(c);
+    int scanned = c->start;
+    while (1) {
+        char *nl = (char*)memchr(c->buf + scanned, '\n', c->end - scanned);
+        int avail = nl ? (int)(nl - (c->buf + c->start)) : c->end - c->start;
+        if (nl || avail >= buflen - 1) {
+            // Same contract as net_recv_line: an over-long line is split
+            int n = avail < buflen - 1 ? avail : buflen - 1;
+            memcpy(buf, c->buf + c->start, n);
+            buf[n] = '\0';
+            c->start += n;
+            if (nl && n == avail) c->start++;
+            if (net_verbose) net_logf("RECV", "fd=%d %s", c->fd, buf);
+            return n;
+        }
+        int rc = conn_fill(c, 0);
+        if (rc <= 0) return -1;
+        scanned = c->end - rc;  // only the new bytes still need scanning
+    }
+}
+
+int net_conn_read_exact(NetConn *c, void *buf, int len) {
+    if (!c || len < 0) return -1;
+    conn_restore_held(c);
+    char *out = (char*)buf;
+    int got = c->end - c->start;
+    if (got > len) got = len;
+    memcpy(out, c->buf + c->start, got);
+    c->start += got;
+    while (got < len) {
+        // Large remainders go straight to the caller's buffer
+#ifdef _WIN32
+        int rc = recv(c->fd, out + got, len - got, 0);
+#else
+        int rc = (int)recv(c->fd, out + got, len - got, 0);
+#endif
+        if (rc < 0 && io_retry(c->fd, 0)) continue;
+        if (rc <= 0) return -1;
+        got += rc;
+    }
+    return len;
+}
+
+int net_conn_pending(NetConn *c) {
+    return c ? c->end - c->start : 0;
+}
+
+void net_conn_free(NetConn *c) {
+    if (!c) return;
+    free(c->buf);
+    free(c);
+}
+
+void net_conn_close(NetConn *c) {
+    if (!c) return;
+    net_close(c->fd);
+    net_conn_free(c);
+}
+
+
+static void put_u32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24); p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);  p[3] = (unsigned char)v;
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+int net_conn_has_frame(NetConn *c) {
+    if (!c) return 0;
+    conn_restore_held(c);
+    int avail = c->end - c->start;
+    if (avail < NET_FRAME_HDR_LEN) return 0;
+    uint32_t len = get_u32((const unsigned char*)c->buf + c->start);
+    if (len > (uint32_t)(NET_CONN_MAX_LINE - NET_FRAME_HDR_LEN)) return -1;
+    return (uint32_t)avail >= NET_FRAME_HDR_LEN + len;
+}
+
+static void put_frame_hdr(unsigned char *hdr, uint16_t op, uint16_t flags, uint32_t req_id, uint32_t len) {
+    put_u32(hdr, len);
+    hdr[4] = (unsigned char)(op >> 8); hdr[5] = (unsigned char)op;
+    hdr[6] = (unsigned char)(flags >> 8); hdr[7] = (unsigned char)flags;
+    put_u32(hdr + 8, req_id);
+}
+
+int net_send_frame(int fd, uint16_t op, uint16_t flags, uint32_t req_id, const void *payload, uint32_t len) {
+    if (len > NET_FRAME_MAX) return -1;
+    unsigned char hdr[NET_FRAME_HDR_LEN];
+    put_frame_hdr(hdr, op, flags, req_id, len);
+    if (net_verbose) net_logf("SEND", "fd=%d frame op=%u flags=%u id=%u len=%u", fd, op, flags, req_id, len);
+    return send_pair(fd, (const char*)hdr, sizeof(hdr), (const char*)payload, len);
+}
+
+int net_send_frame_nowait(int fd, uint16_t op, uint16_t flags, uint32_t req_id, const void *payload, uint32_t len) {
+    if (len > NET_FRAME_MAX) return -1;
+    unsigned char hdr[NET_FRAME_HDR_LEN];
+    put_frame_hdr(hdr, op, flags, req_id, len);
+    if (net_verbose) net_logf("SEND", "fd=%d frame op=%u flags=%u id=%u len=%u (nowait)", fd, op, flags, req_id, len);
+    return send_pair_nowait(fd, (const char*)hdr, sizeof(hdr), (const char*)payload, len);
+}
+
+static int conn_recv_frame_hdr(NetConn *c, NetFrameHdr *h) {
+    unsigned char hdr[NET_FRAME_HDR_LEN];
+    if (net_conn_read_exact(c, hdr, sizeof(hdr)) < 0) return -1;
+    h->len = get_u32(hdr);
+    h->op = (uint16_t)((hdr[4] << 8) | hdr[5]);
+    h->flags = (uint16_t)((hdr[6] << 8) | hdr[7]);
+    h->req_id = get_u32(hdr + 8);
+    return h->len > NET_FRAME_MAX ? -1 : 0;
+}
+
+int net_conn_recv_frame(NetConn *c, NetFrameHdr *h, char **payload) {
+    if (conn_recv_frame_hdr(c, h) < 0) return -1;
+    char *p = (char*)malloc(h->len + 1);
+    if (!p) return -1;
+    if (net_conn_read_exact(c, p, (int)h->len) < 0) { free(p); return -1; }
+    p[h->len] = '\0';
+    if (net_verbose) net_logf("RECV", "fd=%d frame op=%u flags=%u id=%u len=%u", c->fd, h->op, h->flags, h->req_id, h->len);
+    *payload = p;
+    return (int)h->len;
+}
+
+int net_conn_recv_payload(NetConn *c, char **out, int *out_len) {
+    char *buf = NULL;
+    size_t len = 0, cap = 0;
+    while (1) {
+        NetFrameHdr h;
+        if (conn_recv_frame_hdr(c, &h) < 0 || h.op != NET_OP_DATA || len + h.len > NET_PAYLOAD_MAX) { free(buf); return -1; }
+        // Frames land straight in the joined buffer, which doubles as it
+        // fills so a long payload is copied a bounded number of times
+        if (len + h.len + 1 > cap) {
+            size_t ncap = cap ? cap : h.len + 1;
+            while (ncap < len + h.len + 1) ncap *= 2;
+            if (ncap > (size_t)NET_PAYLOAD_MAX + 1) ncap = (size_t)NET_PAYLOAD_MAX + 1;
+            char *nb = (char*)realloc(buf, ncap);
+            if (!nb) { free(buf); return -1; }
+            buf = nb;
+            cap = ncap;
+        }
+        if (net_conn_read_exact(c, buf + len, (int)h.len) < 0) { free(buf); return -1; }
+        if (net_verbose) net_logf("RECV", "fd=%d frame op=%u flags=%u id=%u len=%u", c->fd, h.op, h.flags, h.req_id, h.len);
+        len += h.len;
+        buf[len] = '\0';
+        if (!(h.flags & NET_FRAME_MORE)) break;
+    }
+    *out = buf;
+    *out_len = (int)len;
+    return 0;
+}
+
+int net_send_payload(int fd, uint32_t req_id, const void *buf, long long len) {
+    const char *p = (const char*)buf;
+    if (len < 0) return -1;
+    do {
+        uint32_t part = len > NET_FRAME_MAX ? NET_FRAME_MAX : (uint32_t)len;
+        uint16_t flags = len > NET_FRAME_MAX ? NET_FRAME_MORE : 0;
+        if (net_send_frame(fd, NET_OP_DATA, flags, req_id, p, part) != 0) return -1;
+        p += part;
+        len -= part;
+    } while (len > 0);
+    return 0;
+}
+
+#define NET_CHUNK 65536
+
+int net_send_file(int fd, uint32_t req_id, int file_fd, long long offset, long long len) {
+    if (len < 0) return -1;
+    do {
+        uint32_t part = len > NET_FRAME_MAX ? NET_FRAME_MAX : (uint32_t)len;
+        uint16_t flags = len > NET_FRAME_MAX ? NET_FRAME_MORE : 0;
+        unsigned char hdr[NET_FRAME_HDR_LEN];
+        put_frame_hdr(hdr, NET_OP_DATA, flags, req_id, part);
+        if (net_verbose) net_logf("SEND", "fd=%d file frame id=%u len=%u", fd, req_id, part);
+        int hflags = 0;
+#ifdef MSG_MORE
+        if (part > 0) hflags |= MSG_MORE;
+#endif
+        if (send_all_flags(fd, (const char*)hdr, sizeof(hdr), hflags) != 0) return -1;
+        uint32_t sent = 0;
+        while (sent < part) {
+#ifdef __linux__
+            off_t off = (off_t)offset;
+            ssize_t rc = sendfile(fd, file_fd, &off, part - sent);
+            if (rc < 0 && io_retry(fd, 1)) continue;
+            if (rc <= 0) return -1;  // error, or the file shrank underneath us
+#else
+            char chunk[NET_CHUNK];
+            uint32_t want = part - sent < sizeof(chunk) ? part - sent : (uint32_t)sizeof(chunk);
+#ifdef _WIN32
+            if (_lseeki64(file_fd, offset, SEEK_SET) < 0) return -1;
+            int rc = _read(file_fd, chunk, want);
+#else
+            ssize_t rc = pread(file_fd, chunk, want, (off_t)offset);
+#endif
+            if (rc <= 0) return -1;
+            if (send_all_flags(fd, chunk, (size_t)rc, 0) != 0) return -1;
+#endif
+            sent += (uint32_t)rc;
+            offset += rc;
+        }
+        len -= part;
+    } while (len > 0);
+    return 0;
+}
+
+// Read n bytes of frame body, handing them out in chunks: first whatever
+// the NetConn already buffered (no copy), then straight from the socket
+static int conn_body_stream(NetConn *c, uint32_t n, NetChunkSink sink, void *ctx, char **scratch) {
+    conn_restore_held(c);
+    int have = c->end - c->start;
+    if (have > 0) {
+        int take = (uint32_t)have < n ? have : (int)n;
+        if (sink(ctx, c->buf + c->start, take) != 0) return -1;
+        c->start += take;
+        n -= take;
+    }
+    if (n > 0 && !*scratch) {
+        *scratch = (char*)malloc(NET_CHUNK);
+        if (!*scratch) return -1;
+    }
+    while (n > 0) {
+        int want = n < NET_CHUNK ? (int)n : NET_CHUNK;
+#ifdef _WIN32
+        int rc = recv(c->fd, *scratch, want, 0);
+#else
+        int rc = (int)recv(c->fd, *scratch, want, 0);
+#endif
+        if (rc < 0 && io_retry(c->fd, 0)) continue;
+        if (rc <= 0) return -1;
+        if (sink(ctx, *scratch, rc) != 0) return -1;
+        n -= rc;
+    }
+    return 0;
+}
+
+int net_conn_recv_payload_stream(NetConn *c, NetChunkSink sink, void *ctx, long long *total) {
+    char *scratch = NULL;
+    long long got = 0;
+    int rc = 0;
+    while (1) {
+        NetFrameHdr h;
+        if (conn_recv_frame_hdr(c, &h) < 0 || h.op != NET_OP_DATA) { rc = -1; break; }
+        if (net_verbose) net_logf("RECV", "fd=%d frame op=%u flags=%u id=%u len=%u", c->fd, h.op, h.flags, h.req_id, h.len);
+        if (conn_body_stream(c, h.len, sink, ctx, &scratch) != 0) { rc = -1; break; }
+        got += h.len;
+        if (!(h.flags & NET_FRAME_MORE)) break;
+    }
+    free(scratch);
+    if (total) *total = got;
+    return rc;
+}
+
+static int relay_sink(void *ctx, const char *data, int len) {
+    return send_all_flags(*(int*)ctx, data, (size_t)len, 0);
+}
+
+int net_conn_relay_payload(NetConn *c, int out_fd, long long *total) {
+    char *scratch = NULL;
+    long long got = 0;
+    int rc = 0;
+#ifdef __linux__
+    int pipefd[2] = { -1, -1 };
+#endif
+    while (1) {
+        NetFrameHdr h;
+        if (conn_recv_frame_hdr(c, &h) < 0 || h.op != NET_OP_DATA) { rc = -1; break; }
+        unsigned char hdr[NET_FRAME_HDR_LEN];
+        put_frame_hdr(hdr, h.op, h.flags, h.req_id, h.len);
+        if (net_verbose) net_logf("SEND", "fd=%d relay frame from fd=%d len=%u", out_fd, c->fd, h.len);
+        int hflags = 0;
+#ifdef MSG_MORE
+        if (h.len > 0) hflags |= MSG_MORE;
+#endif
+        if (send_all_flags(out_fd, (const char*)hdr, sizeof(hdr), hflags) != 0) { rc = -1; break; }
+        uint32_t n = h.len;
+        // Bytes the reader already pulled in go out first
+        conn_restore_held(c);
+        int have = c->end - c->start;
+        if (have > 0) {
+            int take = (uint32_t)have < n ? have : (int)n;
+            if (send_all_flags(out_fd, c->buf + c->start, (size_t)take, 0) != 0) { rc = -1; break; }
+            c->start += take;
+            n -= take;
+        }
+#ifdef __linux__
+        // The rest moves socket -> pipe -> socket inside the kernel
+        if (n > 0 && pipefd[0] < 0 && pipe(pipefd) != 0) pipefd[0] = pipefd[1] = -1;
+        while (n > 0 && pipefd[0] >= 0) {
+            ssize_t in = splice(c->fd, NULL, pipefd[1], NULL, n, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (in < 0 && io_retry(c->fd, 0)) continue;
+            if (in <= 0) { rc = -1; break; }
+            ssize_t left = in;
+            while (left > 0) {
+                ssize_t out = splice(pipefd[0], NULL, out_fd, NULL, left, SPLICE_F_MOVE | SPLICE_F_MORE);
+                if (out < 0 && io_retry(out_fd, 1)) continue;
+                if (out <= 0) { rc = -1; break; }
+                left -= out;
+            }
+            if (rc != 0) break;
+            n -= (uint32_t)in;
+        }
+        if (rc != 0) break;
+#endif
+        if (n > 0 && conn_body_stream(c, n, relay_sink, &out_fd, &scratch) != 0) { rc = -1; break; }
+        got += h.len;
+        if (!(h.flags & NET_FRAME_MORE)) break;
+    }
+#ifdef __linux__
+    if (pipefd[0] >= 0) { close(pipefd[0]); close(pipefd[1]); }
+#endif
+    free(scratch);
+    if (total) *total = got;
+    return rc;
+}
+
+int net_hello(NetConn *c, int want_frames) {
+    if (net_send_line(c->fd, want_frames ? "HELLO FRAMES" : "HELLO LINES") != 0) return -1;
+    char resp[256];
+    if (net_conn_recv_line(c, resp, sizeof(resp)) <= 0) return -1;
+    if (strncmp(resp, "OK HELLO", 8) != 0) return -1;
+    return strstr(resp + 8, "FRAMES") != NULL;
+}
+
+int net_hello_reply(int fd, const char *line, int frames_enabled) {
+    int frames = frames_enabled && strstr(line, "FRAMES") != NULL;
+    net_send_line(fd, frames ? "OK HELLO FRAMES" : "OK HELLO LINES");
+    return frames;
+}
@@ -8,11 +8,7 @@
 
 // Simple JSON-like persistence for file metadata
 int persist_save_metadata(const char *path, void *data, int size) {
-    FILE *f = fopen(path, "wb");
-    if (!f) return -1;
-    int written = fwrite(data, 1, size, f);
-    fclose(f);
-    return (written == size) ? 0 : -1;
+    return write_file_all(path, (const char*)data, size);
 }
 
 int persist_load_metadata(const char *path, void *data, int max_size) {
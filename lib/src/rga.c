@@ -0,0 +1,347 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "../../lib/include/rga.h"
+
+// Items per D line, so a large delete stays well under the line limit
+#define RGA_DELETE_ITEMS 256
+
+static int id_eq(RgaId a, RgaId b) { return a.clock == b.clock && a.site == b.site; }
+
+// Order among concurrent inserts after the same origin: larger goes first
+static int id_gt(RgaId a, RgaId b) {
+    return a.clock != b.clock ? a.clock > b.clock : a.site > b.site;
+}
+
+static unsigned int id_hash(RgaId id) {
+    uint64_t h = id.clock * 0x9E3779B97F4A7C15ULL ^ (uint64_t)id.site * 0xC2B2AE3D27D4EB4FULL;
+    return (unsigned int)(h ^ (h >> 29));
+}
+
+static int find(const Rga *r, RgaId id) {
+    unsigned int mask = (unsigned int)r->nslots - 1;
+    for (unsigned int i = id_hash(id) & mask; r->slots[i] >= 0; i = (i + 1) & mask) {
+        if (id_eq(r->elems[r->slots[i]].id, id)) return r->slots[i];
+    }
+    return -1;
+}
+
+static void slot_put(int *slots, int nslots, const RgaElem *elems, int ix) {
+    unsigned int mask = (unsigned int)nslots - 1;
+    unsigned int i = id_hash(elems[ix].id) & mask;
+    while (slots[i] >= 0) i = (i + 1) & mask;
+    slots[i] = ix;
+}
+
+// Room for one more element (and its slot)
+static int reserve(Rga *r) {
+    if (r->count == r->cap) {
+        int cap = r->cap ? r->cap * 2 : 64;
+        RgaElem *e = (RgaElem*)realloc(r->elems, sizeof(RgaElem) * cap);
+        if (!e) return -2;
+        r->elems = e;
+        r->cap = cap;
+    }
+    if ((r->count + 1) * 2 > r->nslots) {
+        int nslots = r->nslots ? r->nslots * 2 : 128;
+        int *slots = (int*)malloc(sizeof(int) * nslots);
+        if (!slots) return -2;
+        memset(slots, 0xff, sizeof(int) * nslots);
+        for (int i = 0; i < r->count; i++) slot_put(slots, nslots, r->elems, i);
+        free(r->slots);
+        r->slots = slots;
+        r->nslots = nslots;
+    }
+    return 0;
+}
+
+// Place a new character after element origin, past any concurrent insert
+// there with a larger id (and whatever follows those, which is larger
+// still). Returns its index, or -2.
+static int integrate(Rga *r, RgaId id, int origin, char ch) {
+    if (reserve(r) != 0) return -2;
+    int prev = origin, cur = r->elems[origin].next;
+    while (cur >= 0 && id_gt(r->elems[cur].id, id)) {
+        prev = cur;
+        cur = r->elems[cur].next;
+    }
+    int ix = r->count++;
+    RgaElem *e = &r->elems[ix];
+    e->id = id;
+    e->next = cur;
+    e->ch = ch;
+    e->deleted = 0;
+    r->elems[prev].next = ix;
+    slot_put(r->slots, r->nslots, r->elems, ix);
+    r->visible++;
+    if (id.clock > r->clock) r->clock = id.clock;
+    return ix;
+}
+
+Rga* rga_create(const char *text, int len) {
+    Rga *r = (Rga*)calloc(1, sizeof(Rga));
+    if (!r || reserve(r) != 0) { rga_free(r); return NULL; }
+    r->elems[0].id.clock = 0;
+    r->elems[0].id.site = 0;
+    r->elems[0].next = -1;
+    r->elems[0].deleted = 1;
+    slot_put(r->slots, r->nslots, r->elems, 0);
+    r->count = 1;
+    int prev = 0;
+    for (int i = 0; text && i < len; i++) {
+        RgaId id = { (uint64_t)i + 1, 0 };
+        if ((prev = integrate(r, id, prev, text[i])) < 0) { rga_free(r); return NULL; }
+    }
+    return r;
+}
+
+void rga_free(Rga *r) {
+    if (!r) return;
+    free(r->elems);
+    free(r->slots);
+    free(r);
+}
+
+char* rga_text(const Rga *r, int *len) {
+    char *buf = (char*)malloc(r->visible + 1);
+    if (!buf) return NULL;
+    int n = 0;
+    for (int i = r->elems[0].next; i >= 0; i = r->elems[i].next) {
+        if (!r->elems[i].deleted) buf[n++] = r->elems[i].ch;
+    }
+    buf[n] = '\0';
+    if (len) *len = n;
+    return buf;
+}
+
+RgaId* rga_visible_ids(const Rga *r, int *n) {
+    *n = r->visible;
+    if (r->visible == 0) return NULL;
+    RgaId *ids = (RgaId*)malloc(sizeof(RgaId) * r->visible);
+    if (!ids) return NULL;
+    int k = 0;
+    for (int i = r->elems[0].next; i >= 0; i = r->elems[i].next) {
+        if (!r->elems[i].deleted) ids[k++] = r->elems[i].id;
+    }
+    return ids;
+}
+
+int rga_id_at(const Rga *r, int pos, RgaId *out) {
+    if (pos == -1) { *out = r->elems[0].id; return 0; }
+    if (pos < 0 || pos >= r->visible) return -1;
+    for (int i = r->elems[0].next; i >= 0; i = r->elems[i].next) {
+        if (r->elems[i].deleted) continue;
+        if (pos-- == 0) { *out = r->elems[i].id; return 0; }
+    }
+    return -1;
+}
+
+// --- operations -------------------------------------------------------
+
+static int escape(char *out, const char *text, int len) {
+    int n = 0;
+    for (int i = 0; i < len; i++) {
+        char c = text[i];
+        if (c == '\\' || c == '\n' || c == '\r' || c == '\0') {
+            out[n++] = '\\';
+            out[n++] = c == '\n' ? 'n' : c == '\r' ? 'r' : c == '\0' ? '0' : '\\';
+        } else {
+            out[n++] = c;
+        }
+    }
+    out[n] = '\0';
+    return n;
+}
+
+// Decodes in place; returns the length, or -1 on a bad escape
+static int unescape(char *s) {
+    int n = 0;
+    for (int i = 0; s[i]; i++) {
+        if (s[i] != '\\') { s[n++] = s[i]; continue; }
+        switch (s[++i]) {
+            case '\\': s[n++] = '\\'; break;
+            case 'n': s[n++] = '\n'; break;
+            case 'r': s[n++] = '\r'; break;
+            case '0': s[n++] = '\0'; break;
+            default: return -1;
+        }
+    }
+    return n;
+}
+
+static int emit_insert(RgaEmit emit, void *arg, RgaId id, RgaId origin, const char *text, int len) {
+    if (!emit) return 0;
+    char *line = (char*)malloc(96 + 2 * (size_t)len);
+    if (!line) return -2;
+    int n = snprintf(line, 96, "I %" PRIu64 ".%" PRIu32 " %" PRIu64 ".%" PRIu32 " ",
+                     id.clock, id.site, origin.clock, origin.site);
+    escape(line + n, text, len);
+    int rc = emit(arg, line);
+    free(line);
+    return rc;
+}
+
+int rga_insert_after(Rga *r, uint32_t site, RgaId origin, const char *text, int len, RgaEmit emit, void *arg) {
+    int prev = find(r, origin);
+    if (prev < 0) return -1;
+    for (int off = 0; off < len; off += RGA_OP_MAX_TEXT) {
+        int chunk = len - off < RGA_OP_MAX_TEXT ? len - off : RGA_OP_MAX_TEXT;
+        RgaId first = { r->clock + 1, site };
+        RgaId chunk_origin = r->elems[prev].id;
+        for (int i = 0; i < chunk; i++) {
+            RgaId id = { r->clock + 1, site };
+            if ((prev = integrate(r, id, prev, text[off + i])) < 0) return -2;
+        }
+        int rc = emit_insert(emit, arg, first, chunk_origin, text + off, chunk);
+        if (rc != 0) return rc;
+    }
+    return 0;
+}
+
+int rga_insert(Rga *r, uint32_t site, int pos, const char *text, int len, RgaEmit emit, void *arg) {
+    RgaId origin;
+    if (pos < 0 || pos > r->visible || rga_id_at(r, pos - 1, &origin) != 0) return -1;
+    return rga_insert_after(r, site, origin, text, len, emit, arg);
+}
+
+// D lines for ids, runs of consecutive clocks of one site written as one item
+static int emit_delete(RgaEmit emit, void *arg, const RgaId *ids, int n) {
+    if (!emit || n == 0) return 0;
+    char *line = (char*)malloc(2 + 48 * RGA_DELETE_ITEMS);
+    if (!line) return -2;
+    int rc = 0, len = 0, items = 0;
+    for (int i = 0; i < n && rc == 0; ) {
+        int run = 1;
+        while (i + run < n && ids[i + run].site == ids[i].site && ids[i + run].clock == ids[i].clock + (uint64_t)run) run++;
+        if (items == 0) len = snprintf(line, 3, "D");
+        len += run > 1 ? sprintf(line + len, " %" PRIu64 ".%" PRIu32 "+%d", ids[i].clock, ids[i].site, run)
+                       : sprintf(line + len, " %" PRIu64 ".%" PRIu32, ids[i].clock, ids[i].site);
+        i += run;
+        if (++items == RGA_DELETE_ITEMS || i == n) {
+            rc = emit(arg, line);
+            items = 0;
+        }
+    }
+    free(line);
+    return rc;
+}
+
+int rga_delete_ids(Rga *r, const RgaId *ids, int n, RgaEmit emit, void *arg) {
+    for (int i = 0; i < n; i++) {
+        if (find(r, ids[i]) <= 0) return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        RgaElem *e = &r->elems[find(r, ids[i])];
+        if (!e->deleted) { e->deleted = 1; r->visible--; }
+    }
+    return emit_delete(emit, arg, ids, n);
+}
+
+int rga_delete(Rga *r, int pos, int n, RgaEmit emit, void *arg) {
+    if (n == 0) return 0;
+    if (pos < 0 || n < 0 || pos + n > r->visible) return -1;
+    RgaId *ids = (RgaId*)malloc(sizeof(RgaId) * n);
+    if (!ids) return -2;
+    int k = 0;
+    for (int i = r->elems[0].next; i >= 0 && k < n; i = r->elems[i].next) {
+        if (r->elems[i].deleted) continue;
+        if (pos > 0) { pos--; continue; }
+        ids[k++] = r->elems[i].id;
+    }
+    int rc = rga_delete_ids(r, ids, n, emit, arg);
+    free(ids);
+    return rc;
+}
+
+static int parse_id(const char **p, RgaId *id) {
+    int used = 0;
+    if (sscanf(*p, "%" SCNu64 ".%" SCNu32 "%n", &id->clock, &id->site, &used) != 2) return -1;
+    *p += used;
+    return 0;
+}
+
+static int apply_insert(Rga *r, const char *p) {
+    RgaId id, origin;
+    if (parse_id(&p, &id) != 0 || *p++ != ' ' || parse_id(&p, &origin) != 0 || *p++ != ' ') return -1;
+    if (id.clock == 0) return -1;
+    char *text = strdup(p);
+    if (!text) return -2;
+    int len = unescape(text);
+    int prev = len < 0 ? -1 : find(r, origin);
+    int rc = prev < 0 ? -1 : 0;
+    for (int i = 0; rc == 0 && i < len; i++) {
+        RgaId cid = { id.clock + (uint64_t)i, id.site };
+        int ix = find(r, cid);
+        // Seen already: the rest of a resent run carries on after it
+        if (ix < 0) ix = integrate(r, cid, prev, text[i]);
+        if (ix < 0) rc = -2;
+        prev = ix;
+    }
+    free(text);
+    return rc;
+}
+
+static int apply_delete(Rga *r, const char *p) {
+    // Checked in full first, so a bad line changes nothing
+    for (int pass = 0; pass < 2; pass++) {
+        const char *q = p;
+        while (*q == ' ') {
+            q++;
+            RgaId id;
+            int run = 1, used = 0;
+            if (parse_id(&q, &id) != 0) return -1;
+            if (*q == '+') {
+                if (sscanf(q + 1, "%d%n", &run, &used) != 1 || run < 1) return -1;
+                q += 1 + used;
+            }
+            for (int i = 0; i < run; i++) {
+                RgaId cid = { id.clock + (uint64_t)i, id.site };
+                int ix = find(r, cid);
+                if (ix <= 0) return -1;
+                if (pass == 1 && !r->elems[ix].deleted) { r->elems[ix].deleted = 1; r->visible--; }
+            }
+        }
+        if (*q != '\0') return -1;
+    }
+    return 0;
+}
+
+int rga_apply(Rga *r, const char *op) {
+    if (op[0] == 'I' && op[1] == ' ') return apply_insert(r, op + 2);
+    if (op[0] == 'D' && op[1] == ' ') return apply_delete(r, op + 1);
+    return -1;
+}
+
+int rga_snapshot(const Rga *r, RgaEmit emit, void *arg) {
+    char *run = (char*)malloc(RGA_OP_MAX_TEXT);
+    if (!run) return -2;
+    int rc = 0, n = 0;
+    RgaId first = { 0, 0 }, origin = { 0, 0 }, last = { 0, 0 };
+    // Inserts in document order, each run after the character before it
+    for (int i = r->elems[0].next; i >= 0 && rc == 0; i = r->elems[i].next) {
+        RgaId id = r->elems[i].id;
+        if (n > 0 && (n == RGA_OP_MAX_TEXT || id.site != last.site || id.clock != last.clock + 1)) {
+            rc = emit_insert(emit, arg, first, origin, run, n);
+            origin = last;
+            n = 0;
+        }
+        if (n == 0) first = id;
+        run[n++] = r->elems[i].ch;
+        last = id;
+    }
+    if (rc == 0 && n > 0) rc = emit_insert(emit, arg, first, origin, run, n);
+    free(run);
+    if (rc != 0) return rc;
+
+    int ndel = r->count - 1 - r->visible, k = 0;
+    if (ndel == 0) return 0;
+    RgaId *ids = (RgaId*)malloc(sizeof(RgaId) * ndel);
+    if (!ids) return -2;
+    for (int i = r->elems[0].next; i >= 0; i = r->elems[i].next) {
+        if (r->elems[i].deleted) ids[k++] = r->elems[i].id;
+    }
+    rc = emit_delete(emit, arg, ids, k);
+    free(ids);
+    return rc;
+}
@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include "../../lib/include/rpc.h"
+
+struct RpcCall {
+    uint32_t id;
+    int done;                   // 0 waiting, 1 replied, -1 connection lost
+    char *reply;
+    int reply_len;
+    struct RpcCall *next;
+};
+
+struct RpcConn {
+    RpcClient *client;
+    NetConn *conn;
+    pthread_mutex_t send_mutex;
+    uint32_t next_id;
+    RpcCall *pending;           // calls waiting for a reply
+    int users;                  // callers holding it; the reader frees it at 0
+    int dead;
+};
+
+RpcClient* rpc_client_create(const NetTimeouts *t) {
+    RpcClient *rc = (RpcClient*)calloc(1, sizeof(RpcClient));
+    if (!rc) return NULL;
+    if (t) rc->timeouts = *t;
+    pthread_mutex_init(&rc->mutex, NULL);
+    pthread_cond_init(&rc->cond, NULL);
+    return rc;
+}
+
+// Caller holds rc->mutex. Returns -1 when the host table is full.
+static int find_host(RpcClient *rc, const char *host, uint16_t port) {
+    for (int i = 0; i < rc->host_count; i++) {
+        if (rc->hosts[i].port == port && strcmp(rc->hosts[i].host, host) == 0) return i;
+    }
+    if (rc->host_count >= RPC_MAX_HOSTS) return -1;
+    RpcHost *h = &rc->hosts[rc->host_count];
+    memset(h, 0, sizeof(*h));
+    strncpy(h->host, host, sizeof(h->host)-1);
+    h->port = port;
+    return rc->host_count++;
+}
+
+// Match reply frames to pending calls until the connection fails, then
+// fail whatever is still pending and free the connection once no caller
+// holds it.
+static void* rpc_reader(void *arg) {
+    RpcConn *c = (RpcConn*)arg;
+    RpcClient *rc = c->client;
+    while (1) {
+        NetFrameHdr h; char *payload = NULL;
+        if (net_conn_recv_frame(c->conn, &h, &payload) < 0) break;
+        pthread_mutex_lock(&rc->mutex);
+        RpcCall **pp = &c->pending;
+        while (*pp && (*pp)->id != h.req_id) pp = &(*pp)->next;
+        if (*pp && h.op == NET_OP_LINE) {
+            RpcCall *call = *pp;
+            *pp = call->next;
+            call->reply = payload;
+            call->reply_len = (int)h.len;
+            call->done = 1;
+            payload = NULL;
+            pthread_cond_broadcast(&rc->cond);
+        }
+        pthread_mutex_unlock(&rc->mutex);
+        free(payload);          // late reply to a call that gave up
+    }
+    pthread_mutex_lock(&rc->mutex);
+    c->dead = 1;
+    for (RpcCall *call = c->pending; call; call = call->next) call->done = -1;
+    c->pending = NULL;
+    for (int i = 0; i < rc->host_count; i++) {
+        if (rc->hosts[i].conn == c) rc->hosts[i].conn = NULL;
+    }
+    pthread_cond_broadcast(&rc->cond);
+    while (c->users > 0) pthread_cond_wait(&rc->cond, &rc->mutex);
+    pthread_mutex_unlock(&rc->mutex);
+    net_conn_close(c->conn);
+    pthread_mutex_destroy(&c->send_mutex);
+    free(c);
+    return NULL;
+}
+
+// Dial host and offer RPC. The new connection starts with one user (the
+// caller). On failure *status says why.
+static RpcConn* rpc_connect(RpcClient *rc, const char *host, uint16_t port, NetTimeouts t, int *status) {
+    int fd = net_connect_timeout(host, port, t.connect_ms);
+    if (fd < 0) { *status = errno == ETIMEDOUT ? RPC_NO_RESPONSE : RPC_UNREACHABLE; return NULL; }
+    net_set_nodelay(fd);
+    net_set_io_timeouts(fd, t.recv_ms, t.send_ms);
+    NetConn *nc = net_conn_open(fd);
+    if (!nc) { net_close(fd); *status = RPC_UNREACHABLE; return NULL; }
+    char resp[256];
+    if (net_send_line(fd, "HELLO FRAMES RPC") != 0 ||
+        net_conn_recv_line_timeout(nc, resp, sizeof(resp), t.recv_ms) <= 0) {
+        *status = errno == ETIMEDOUT ? RPC_NO_RESPONSE : RPC_UNSUPPORTED;
+        net_conn_close(nc);
+        return NULL;
+    }
+    if (strcmp(resp, "OK HELLO FRAMES RPC") != 0) {
+        *status = RPC_UNSUPPORTED;
+        net_conn_close(nc);
+        return NULL;
+    }
+    // The reader sits on this socket between calls; deadlines are per call
+    net_set_io_timeouts(fd, 0, t.send_ms);
+    RpcConn *c = (RpcConn*)calloc(1, sizeof(RpcConn));
+    if (!c) { net_conn_close(nc); *status = RPC_UNREACHABLE; return NULL; }
+    c->client = rc;
+    c->conn = nc;
+    c->users = 1;
+    pthread_mutex_init(&c->send_mutex, NULL);
+    pthread_t th;
+    if (pthread_create(&th, NULL, rpc_reader, c) != 0) {
+        pthread_mutex_destroy(&c->send_mutex);
+        net_conn_close(nc);
+        free(c);
+        *status = RPC_UNREACHABLE;
+        return NULL;
+    }
+    pthread_detach(th);
+    return c;
+}
+
+// Caller holds rc->mutex (dropped while dialling). Returns the host's live
+// connection with a user reference taken, or NULL with *status set.
+static RpcConn* rpc_conn_get(RpcClient *rc, const char *host, uint16_t port, int *status) {
+    int idx = find_host(rc, host, port);
+    if (idx < 0) { *status = RPC_UNSUPPORTED; return NULL; }
+    RpcHost *h = &rc->hosts[idx];
+    while (h->connecting) pthread_cond_wait(&rc->cond, &rc->mutex);
+    if (h->conn) { h->conn->users++; return h->conn; }
+    if (h->declined_at && time(NULL) - h->declined_at < RPC_RETRY_SEC) { *status = RPC_UNSUPPORTED; return NULL; }
+    h->connecting = 1;
+    NetTimeouts t = rc->timeouts;
+    pthread_mutex_unlock(&rc->mutex);
+    RpcConn *c = rpc_connect(rc, host, port, t, status);
+    pthread_mutex_lock(&rc->mutex);
+    h->connecting = 0;
+    if (!c && *status == RPC_UNSUPPORTED) h->declined_at = time(NULL);
+    if (c && !c->dead) h->conn = c;
+    pthread_cond_broadcast(&rc->cond);
+    return c;
+}
+
+// Caller holds rc->mutex
+static void unlink_call(RpcConn *c, RpcCall *call) {
+    for (RpcCall **pp = &c->pending; *pp; pp = &(*pp)->next) {
+        if (*pp == call) { *pp = call->next; return; }
+    }
+}
+
+void rpc_call_batch(RpcClient *rc, RpcRequest *reqs, int n, int timeout_ms) {
+    if (n <= 0) return;
+    RpcCall *calls = (RpcCall*)calloc(n, sizeof(RpcCall));
+    RpcConn **conns = (RpcConn**)calloc(n, sizeof(RpcConn*));
+    if (!rc || !calls || !conns) {
+        for (int i = 0; i < n; i++) { reqs[i].status = RPC_UNSUPPORTED; reqs[i].reply = NULL; reqs[i].reply_len = 0; }
+        free(calls); free(conns);
+        return;
+    }
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += timeout_ms / 1000;
+    until.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (until.tv_nsec >= 1000000000L) { until.tv_sec++; until.tv_nsec -= 1000000000L; }
+
+    // Everything goes out before anything is awaited
+    pthread_mutex_lock(&rc->mutex);
+    for (int i = 0; i < n; i++) {
+        reqs[i].reply = NULL;
+        reqs[i].reply_len = 0;
+        int status = RPC_UNREACHABLE;
+        RpcConn *c = rpc_conn_get(rc, reqs[i].host, reqs[i].port, &status);
+        if (!c) { reqs[i].status = status; continue; }
+        conns[i] = c;
+        if (c->dead) { calls[i].done = -1; continue; }
+        calls[i].id = ++c->next_id;
+        calls[i].next = c->pending;
+        c->pending = &calls[i];
+        pthread_mutex_unlock(&rc->mutex);
+        pthread_mutex_lock(&c->send_mutex);
+        int src = net_send_frame(c->conn->fd, NET_OP_LINE, 0, calls[i].id, reqs[i].cmd, (uint32_t)strlen(reqs[i].cmd));
+        pthread_mutex_unlock(&c->send_mutex);
+        pthread_mutex_lock(&rc->mutex);
+        if (src != 0 && calls[i].done == 0) {
+            unlink_call(c, &calls[i]);
+            calls[i].done = -1;
+        }
+    }
+
+    while (1) {
+        int waiting = 0;
+        for (int i = 0; i < n && !waiting; i++) waiting = conns[i] && calls[i].done == 0;
+        if (!waiting) break;
+        if (timeout_ms <= 0) pthread_cond_wait(&rc->cond, &rc->mutex);
+        else if (pthread_cond_timedwait(&rc->cond, &rc->mutex, &until) == ETIMEDOUT) break;
+    }
+
+    for (int i = 0; i < n; i++) {
+        RpcConn *c = conns[i];
+        if (!c) continue;
+        if (calls[i].done == 1) {
+            reqs[i].status = RPC_OK;
+            reqs[i].reply = calls[i].reply;
+            reqs[i].reply_len = calls[i].reply_len;
+        } else {
+            if (calls[i].done == 0) unlink_call(c, &calls[i]);
+            reqs[i].status = calls[i].done == 0 ? RPC_NO_RESPONSE : RPC_UNREACHABLE;
+        }
+        c->users--;
+    }
+    pthread_cond_broadcast(&rc->cond);
+    pthread_mutex_unlock(&rc->mutex);
+    free(calls);
+    free(conns);
+}
+
+int rpc_call(RpcClient *rc, const char *host, uint16_t port, const char *cmd, char *resp, int resplen, int timeout_ms) {
+    RpcRequest r;
+    memset(&r, 0, sizeof(r));
+    r.host = host;
+    r.port = port;
+    r.cmd = cmd;
+    rpc_call_batch(rc, &r, 1, timeout_ms);
+    if (r.status == RPC_OK) {
+        int len = (int)strcspn(r.reply, "\n");
+        if (len == 0) r.status = RPC_NO_RESPONSE;
+        if (len >= resplen) len = resplen - 1;
+        memcpy(resp, r.reply, len);
+        resp[len] = '\0';
+    }
+    free(r.reply);
+    return r.status;
+}
+
+void rpc_requests_free(RpcRequest *reqs, int n) {
+    for (int i = 0; i < n; i++) {
+        free(reqs[i].reply);
+        reqs[i].reply = NULL;
+        reqs[i].reply_len = 0;
+    }
+}
+
+void rpc_client_drop_host(RpcClient *rc, const char *host, uint16_t port) {
+    if (!rc || !host) return;
+    pthread_mutex_lock(&rc->mutex);
+    for (int i = 0; i < rc->host_count; i++) {
+        RpcHost *h = &rc->hosts[i];
+        if (h->port != port || strcmp(h->host, host) != 0) continue;
+        // The reader sees EOF, fails pending calls and frees the connection
+        if (h->conn) shutdown(h->conn->conn->fd, SHUT_RDWR);
+        h->conn = NULL;
+        h->declined_at = 0;
+    }
+    pthread_mutex_unlock(&rc->mutex);
+}
@@ -0,0 +1,96 @@
+#include <stdlib.h>
+#include "../../lib/include/thread_pool.h"
+
+static void* worker_main(void *arg) {
+    ThreadPool *pool = (ThreadPool*)arg;
+    pthread_mutex_lock(&pool->mutex);
+    while (1) {
+        while (!pool->head && !pool->shutdown) pthread_cond_wait(&pool->cond, &pool->mutex);
+        if (!pool->head) break;  // shutting down and drained
+        ThreadPoolJob *job = pool->head;
+        pool->head = job->next;
+        if (!pool->head) pool->tail = NULL;
+        pool->depth--;
+        pool->busy++;
+        pthread_mutex_unlock(&pool->mutex);
+        job->fn(job->arg);
+        free(job);
+        pthread_mutex_lock(&pool->mutex);
+        pool->busy--;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+ThreadPool* thread_pool_create(int nthreads, int max_queue) {
+    if (nthreads < 1) nthreads = 1;
+    ThreadPool *pool = (ThreadPool*)calloc(1, sizeof(ThreadPool));
+    if (!pool) return NULL;
+    pool->threads = (pthread_t*)calloc(nthreads, sizeof(pthread_t));
+    if (!pool->threads) { free(pool); return NULL; }
+    pool->max_queue = max_queue > 0 ? max_queue : 0;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    for (int i = 0; i < nthreads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) break;
+        pool->nthreads++;
+    }
+    if (pool->nthreads == 0) {
+        pthread_mutex_destroy(&pool->mutex);
+        pthread_cond_destroy(&pool->cond);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+int thread_pool_submit(ThreadPool *pool, ThreadPoolFn fn, void *arg) {
+    if (!pool || !fn) return -1;
+    ThreadPoolJob *job = (ThreadPoolJob*)malloc(sizeof(ThreadPoolJob));
+    if (!job) return -1;
+    job->fn = fn;
+    job->arg = arg;
+    job->next = NULL;
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->shutdown || (pool->max_queue > 0 && pool->depth >= pool->max_queue)) {
+        pthread_mutex_unlock(&pool->mutex);
+        free(job);
+        return -1;
+    }
+    if (pool->tail) pool->tail->next = job; else pool->head = job;
+    pool->tail = job;
+    pool->depth++;
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+    return 0;
+}
+
+int thread_pool_depth(ThreadPool *pool) {
+    if (!pool) return 0;
+    pthread_mutex_lock(&pool->mutex);
+    int d = pool->depth;
+    pthread_mutex_unlock(&pool->mutex);
+    return d;
+}
+
+int thread_pool_busy(ThreadPool *pool) {
+    if (!pool) return 0;
+    pthread_mutex_lock(&pool->mutex);
+    int b = pool->busy;
+    pthread_mutex_unlock(&pool->mutex);
+    return b;
+}
+
+void thread_pool_free(ThreadPool *pool) {
+    if (!pool) return;
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+    for (int i = 0; i < pool->nthreads; i++) pthread_join(pool->threads[i], NULL);
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->cond);
+    free(pool->threads);
+    free(pool);
+}
@@ -0,0 +1,287 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <limits.h>
+#include "../../lib/include/undo_log.h"
+#include "../../lib/include/util.h"
+
+// <root>/<name>.undo into out (PATH_MAX bytes); -1 if it doesn't fit
+static int journal_path(UndoLog *ul, const char *name, char *out) {
+    int n = snprintf(out, PATH_MAX, "%s/%s.undo", ul->root, name);
+    return n >= 0 && n < PATH_MAX ? 0 : -1;
+}
+
+static long record_size(UndoFile *uf, int i) {
+    long end = i + 1 < uf->nrecs ? uf->recs[i + 1].pos : uf->bytes;
+    return end - uf->recs[i].pos;
+}
+
+// Oldest record still within depth and budget (the newest always is)
+static int live_start(UndoLog *ul, UndoFile *uf) {
+    int i = uf->nrecs;
+    long total = 0;
+    while (i > 0 && uf->nrecs - i < ul->depth) {
+        long sz = record_size(uf, i - 1);
+        if (i < uf->nrecs && total + sz > ul->budget) break;
+        total += sz;
+        i--;
+    }
+    return i;
+}
+
+static int push_record(UndoFile *uf, const UndoRecord *r) {
+    if (uf->nrecs == uf->cap) {
+        int ncap = uf->cap ? uf->cap * 2 : 8;
+        UndoRecord *n = (UndoRecord*)realloc(uf->recs, ncap * sizeof(UndoRecord));
+        if (!n) return -1;
+        uf->recs = n;
+        uf->cap = ncap;
+    }
+    uf->recs[uf->nrecs++] = *r;
+    return 0;
+}
+
+static void forget(UndoLog *ul, UndoFile *uf) {
+    char path[PATH_MAX];
+    if (journal_path(ul, uf->name, path) == 0) remove(path);
+    uf->nrecs = 0;
+    uf->bytes = 0;
+}
+
+// Read the journal's records; a torn tail from a crash is cut off
+static void load(UndoLog *ul, UndoFile *uf) {
+    uf->loaded = 1;
+    uf->nrecs = 0;
+    uf->bytes = 0;
+    char path[PATH_MAX];
+    if (journal_path(ul, uf->name, path) != 0) return;
+    char *buf = NULL; int len = 0;
+    if (read_file_all(path, &buf, &len) != 0) return;
+    long pos = 0;
+    while (pos < len) {
+        char *nl = memchr(buf + pos, '\n', len - pos);
+        if (!nl) break;
+        UndoRecord r;
+        r.pos = pos;
+        r.hdr_len = (int)(nl - (buf + pos)) + 1;
+        if (sscanf(buf + pos, "D %" SCNx64 " %" SCNx64 " %d %d %d", &r.before, &r.after, &r.off, &r.del, &r.ins) != 5 ||
+            r.off < 0 || r.del < 0 || r.ins < 0) break;
+        long end = pos + r.hdr_len + r.ins + 1;
+        if (end > len || buf[end - 1] != '\n') break;
+        if (push_record(uf, &r) != 0) break;
+        pos = end;
+    }
+    free(buf);
+    uf->bytes = pos;
+    if (pos < len && truncate(path, pos) != 0) forget(ul, uf);
+}
+
+// Rewrite the journal without its dead records, once enough of them pile
+// up that the copy is worth it
+static void maybe_compact(UndoLog *ul, UndoFile *uf) {
+    int live = live_start(ul, uf);
+    if (live == 0) return;
+    long dead = uf->recs[live].pos;
+    if (live <= ul->depth / 2 && dead <= ul->budget / 2) return;
+    char path[PATH_MAX];
+    if (journal_path(ul, uf->name, path) != 0) return;
+    char *buf = NULL; int len = 0;
+    if (read_file_all(path, &buf, &len) != 0 || len != uf->bytes) { free(buf); forget(ul, uf); return; }
+    if (write_file_all(path, buf + dead, len - (int)dead) != 0) { free(buf); return; }
+    free(buf);
+    memmove(uf->recs, uf->recs + live, (uf->nrecs - live) * sizeof(UndoRecord));
+    uf->nrecs -= live;
+    for (int i = 0; i < uf->nrecs; i++) uf->recs[i].pos -= dead;
+    uf->bytes -= dead;
+}
+
+UndoLog* undo_log_open(const char *root, int depth, long budget) {
+    UndoLog *ul = (UndoLog*)calloc(1, sizeof(UndoLog));
+    if (!ul) return NULL;
+    strncpy(ul->root, root, sizeof(ul->root) - 1);
+    ul->depth = depth;
+    ul->budget = budget > 0 ? budget : UNDO_DEFAULT_BUDGET;
+    ul->index = hashmap_create();
+    if (!ul->index) { free(ul); return NULL; }
+    pthread_mutex_init(&ul->mutex, NULL);
+    mkpath(root);
+    return ul;
+}
+
+static UndoFile* file_get(UndoLog *ul, const char *fname) {
+    pthread_mutex_lock(&ul->mutex);
+    int slot = hashmap_get(ul->index, fname);
+    UndoFile *uf = slot >= 0 ? ul->files[slot] : NULL;
+    if (!uf) {
+        if (ul->nfiles == ul->cap_files) {
+            int ncap = ul->cap_files ? ul->cap_files * 2 : 16;
+            UndoFile **n = (UndoFile**)realloc(ul->files, ncap * sizeof(UndoFile*));
+            if (!n) { pthread_mutex_unlock(&ul->mutex); return NULL; }
+            ul->files = n;
+            ul->cap_files = ncap;
+        }
+        uf = (UndoFile*)calloc(1, sizeof(UndoFile));
+        if (!uf || hashmap_put(ul->index, fname, ul->nfiles) != 0) {
+            free(uf);
+            pthread_mutex_unlock(&ul->mutex);
+            return NULL;
+        }
+        strncpy(uf->name, fname, sizeof(uf->name) - 1);
+        pthread_mutex_init(&uf->mutex, NULL);
+        ul->files[ul->nfiles++] = uf;
+    }
+    pthread_mutex_unlock(&ul->mutex);
+    return uf;
+}
+
+UndoFile* undo_log_acquire(UndoLog *ul, const char *fname) {
+    if (!ul) return NULL;
+    UndoFile *uf = file_get(ul, fname);
+    if (!uf) return NULL;
+    pthread_mutex_lock(&uf->mutex);
+    if (!uf->loaded) load(ul, uf);
+    return uf;
+}
+
+void undo_log_release(UndoFile *uf) {
+    if (uf) pthread_mutex_unlock(&uf->mutex);
+}
+
+int undo_log_record(UndoLog *ul, UndoFile *uf, const char *prev, int prev_len, const char *cur, int cur_len) {
+    if (!ul || !uf || ul->depth <= 0) return 0;
+    // The changed range is what lies between the common prefix and suffix
+    int pre = 0, max = prev_len < cur_len ? prev_len : cur_len;
+    while (pre < max && prev[pre] == cur[pre]) pre++;
+    if (pre == prev_len && pre == cur_len) return 0;
+    int suf = 0;
+    while (suf < max - pre && prev[prev_len - 1 - suf] == cur[cur_len - 1 - suf]) suf++;
+
+    UndoRecord r;
+    r.pos = uf->bytes;
+    r.off = pre;
+    r.del = cur_len - pre - suf;
+    r.ins = prev_len - pre - suf;
+    r.before = hash_bytes(prev, prev_len);
+    r.after = hash_bytes(cur, cur_len);
+    char hdr[128];
+    r.hdr_len = snprintf(hdr, sizeof(hdr), "D %016" PRIx64 " %016" PRIx64 " %d %d %d\n", r.before, r.after, r.off, r.del, r.ins);
+
+    char path[PATH_MAX];
+    if (journal_path(ul, uf->name, path) != 0) return -1;
+    char dir[PATH_MAX]; strncpy(dir, path, sizeof(dir) - 1); dir[sizeof(dir) - 1] = '\0';
+    char *slash = strrchr(dir, '/');
+    if (slash) { *slash = '\0'; mkpath(dir); }
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) return -1;
+    const char *parts[3] = { hdr, prev + pre, "\n" };
+    int lens[3] = { r.hdr_len, r.ins, 1 };
+    int rc = 0;
+    for (int i = 0; i < 3 && rc == 0; i++) {
+        const char *p = parts[i]; int left = lens[i];
+        while (left > 0) {
+            ssize_t n = write(fd, p, left);
+            if (n < 0) { if (errno == EINTR) continue; rc = -1; break; }
+            p += n; left -= (int)n;
+        }
+    }
+    close(fd);
+    // A half-written record would poison everything after it
+    if (rc != 0 || push_record(uf, &r) != 0) { forget(ul, uf); return -1; }
+    uf->bytes += r.hdr_len + r.ins + 1;
+    maybe_compact(ul, uf);
+    return 0;
+}
+
+int undo_log_depth(UndoLog *ul, UndoFile *uf) {
+    if (!ul || !uf) return 0;
+    return uf->nrecs - live_start(ul, uf);
+}
+
+int undo_log_undo(UndoLog *ul, UndoFile *uf, const char *cur, int cur_len, int steps, char **out, int *out_len) {
+    if (!ul || !uf || steps < 1 || steps > undo_log_depth(ul, uf)) return -1;
+    if (hash_bytes(cur, cur_len) != uf->recs[uf->nrecs - 1].after) { forget(ul, uf); return -2; }
+    char path[PATH_MAX];
+    if (journal_path(ul, uf->name, path) != 0) return -1;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { forget(ul, uf); return -2; }
+    char *text = (char*)malloc(cur_len + 1);
+    int len = cur_len;
+    if (!text) { close(fd); return -1; }
+    memcpy(text, cur, cur_len);
+    int rc = 0;
+    for (int i = uf->nrecs - 1; i >= uf->nrecs - steps; i--) {
+        UndoRecord *r = &uf->recs[i];
+        if (r->off + r->del > len) { rc = -2; break; }
+        int nlen = len - r->del + r->ins;
+        char *next = (char*)malloc(nlen + 1);
+        if (!next) { rc = -1; break; }
+        memcpy(next, text, r->off);
+        if (pread(fd, next + r->off, r->ins, r->pos + r->hdr_len) != r->ins) { free(next); rc = -2; break; }
+        memcpy(next + r->off + r->ins, text + r->off + r->del, len - r->off - r->del);
+        next[nlen] = '\0';
+        free(text);
+        text = next;
+        len = nlen;
+        if (hash_bytes(text, len) != r->before) { rc = -2; break; }
+    }
+    close(fd);
+    if (rc != 0) {
+        free(text);
+        if (rc == -2) forget(ul, uf);
+        return rc;
+    }
+    *out = text;
+    *out_len = len;
+    return 0;
+}
+
+void undo_log_drop(UndoLog *ul, UndoFile *uf, int steps) {
+    if (!ul || !uf || steps < 1) return;
+    if (steps >= uf->nrecs) { forget(ul, uf); return; }
+    char path[PATH_MAX];
+    long pos = uf->recs[uf->nrecs - steps].pos;
+    if (journal_path(ul, uf->name, path) != 0 || truncate(path, pos) != 0) { forget(ul, uf); return; }
+    uf->nrecs -= steps;
+    uf->bytes = pos;
+}
+
+void undo_log_clear(UndoLog *ul, UndoFile *uf) {
+    if (ul && uf) forget(ul, uf);
+}
+
+void undo_log_move(UndoLog *ul, const char *oldname, const char *newname) {
+    if (!ul || strcmp(oldname, newname) == 0) return;
+    UndoFile *a = file_get(ul, oldname), *b = file_get(ul, newname);
+    if (!a || !b) return;
+    // Fixed lock order, so two opposite moves can't deadlock
+    UndoFile *first = strcmp(oldname, newname) < 0 ? a : b;
+    UndoFile *second = first == a ? b : a;
+    pthread_mutex_lock(&first->mutex);
+    pthread_mutex_lock(&second->mutex);
+    if (!a->loaded) load(ul, a);
+    if (!b->loaded) load(ul, b);
+    forget(ul, b);
+    char opath[PATH_MAX], npath[PATH_MAX];
+    int named = journal_path(ul, oldname, opath) == 0 && journal_path(ul, newname, npath) == 0;
+    if (a->nrecs > 0) {
+        if (named) {
+            char dir[PATH_MAX]; strncpy(dir, npath, sizeof(dir) - 1); dir[sizeof(dir) - 1] = '\0';
+            char *slash = strrchr(dir, '/');
+            if (slash) { *slash = '\0'; mkpath(dir); }
+        }
+        if (named && rename(opath, npath) == 0) {
+            UndoRecord *recs = b->recs; int cap = b->cap;
+            b->recs = a->recs; b->nrecs = a->nrecs; b->cap = a->cap; b->bytes = a->bytes;
+            a->recs = recs; a->cap = cap;
+            a->nrecs = 0; a->bytes = 0;
+        } else {
+            forget(ul, a);
+        }
+    }
+    pthread_mutex_unlock(&second->mutex);
+    pthread_mutex_unlock(&first->mutex);
+}
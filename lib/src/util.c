@@ -15,6 +15,7 @@
 #include <errno.h>
 #include <ctype.h>
 #include "../include/util.h"
+#include "../include/durable.h"
 
 static int mkdir_if_missing(const char *path) {
     int rc = MKDIR(path, 0755);
@@ -60,9 +61,17 @@ int write_file_all(const char *path, const char *buf, int len) {
         if (tmp[i] == '/' || tmp[i] == '\\') { tmp[i] = '\0'; break; }
     }
     if (strlen(tmp) > 0) mkpath(tmp);
-    FILE *f = fopen(path, "wb"); if (!f) return -1;
-    if (fwrite(buf, 1, len, f) != (size_t)len) { fclose(f); return -1; }
-    fclose(f); return 0;
+    // Temp file + rename, synced per the durability policy
+    return durable_write_file(path, buf, len);
+}
+
+uint64_t hash_bytes(const char *buf, int len) {
+    uint64_t h = 1469598103934665603ULL;
+    for (int i = 0; i < len; i++) {
+        h ^= (unsigned char)buf[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
 }
 
 static int load_config_buffer(char **out_buf) {
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../lib/include/rga.h"
+
+// In-process live-session simulation: CLIENTS client replicas edit at
+// random and a relay replica (the SS) applies what each one sends and
+// forwards it to the others, with sends and deliveries interleaved at
+// random. One more client joins halfway through from a snapshot. Once
+// everything is delivered every replica must hold the relay's text, and
+// must still hold it after some operations are delivered twice.
+//
+//   rga_sim [seed] [steps]
+//
+// Exits 0 if the replicas converged.
+
+#define CLIENTS 6
+
+typedef struct {
+    char **ops;
+    int head, tail, cap;
+} Queue;
+
+static Rga *replica[CLIENTS + 1];
+static Queue up[CLIENTS + 1], down[CLIENTS + 1];
+static int joined[CLIENTS + 1];
+
+static int push(void *arg, const char *op) {
+    Queue *q = (Queue*)arg;
+    if (q->tail == q->cap) {
+        int cap = q->cap ? q->cap * 2 : 1024;
+        char **ops = (char**)realloc(q->ops, cap * sizeof(char*));
+        if (!ops) return -2;
+        q->ops = ops;
+        q->cap = cap;
+    }
+    if (!(q->ops[q->tail] = strdup(op))) return -2;
+    q->tail++;
+    return 0;
+}
+
+// The relay takes client c's next operation and forwards it to the others
+static int relay_one(Rga *relay, int c) {
+    const char *op = up[c].ops[up[c].head++];
+    if (rga_apply(relay, op) != 0) {
+        printf("relay can't apply %s\n", op);
+        return -1;
+    }
+    for (int j = 0; j <= CLIENTS; j++) {
+        if (j != c && joined[j] && push(&down[j], op) != 0) return -1;
+    }
+    return 0;
+}
+
+static int deliver_one(int c) {
+    const char *op = down[c].ops[down[c].head++];
+    if (rga_apply(replica[c], op) != 0) {
+        printf("client %d can't apply %s\n", c, op);
+        return -1;
+    }
+    return 0;
+}
+
+static int local_edit(int c) {
+    Rga *r = replica[c];
+    int vis = r->visible;
+    if (vis > 0 && rand() % 3 == 0) {
+        int pos = rand() % vis;
+        int n = 1 + rand() % 3;
+        if (pos + n > vis) n = vis - pos;
+        return rga_delete(r, pos, n, push, &up[c]);
+    }
+    // Newlines and backslashes exercise the escaping in I lines
+    char text[8];
+    int n = 1 + rand() % 5;
+    for (int k = 0; k < n; k++) text[k] = k == 0 ? 'A' + c : "abc .\n\\"[rand() % 7];
+    return rga_insert(r, (uint32_t)c + 1, rand() % (vis + 1), text, n, push, &up[c]);
+}
+
+static int join(Rga *relay, int c) {
+    if (!(replica[c] = rga_create(NULL, 0))) return -1;
+    joined[c] = 1;
+    return rga_snapshot(relay, push, &down[c]);
+}
+
+static int same_text(const Rga *r, const char *text, int len) {
+    int n;
+    char *t = rga_text(r, &n);
+    int same = t && n == len && memcmp(t, text, len) == 0;
+    free(t);
+    return same;
+}
+
+int main(int argc, char **argv) {
+    unsigned int seed = argc > 1 ? (unsigned int)atoi(argv[1]) : 1;
+    int steps = argc > 2 ? atoi(argv[2]) : 20000;
+    srand(seed);
+
+    const char *base = "Hello world. This is base.";
+    Rga *relay = rga_create(base, (int)strlen(base));
+    if (!relay) return 1;
+    for (int c = 0; c < CLIENTS; c++) {
+        if (join(relay, c) != 0) return 1;
+    }
+
+    for (int s = 0; s < steps; s++) {
+        if (s == steps / 2 && join(relay, CLIENTS) != 0) return 1;
+        int c = rand() % (CLIENTS + 1);
+        if (!joined[c]) continue;
+        int rc = 0;
+        switch (rand() % 3) {
+        case 0:
+            rc = local_edit(c);
+            if (rc != 0) printf("client %d edit failed: %d\n", c, rc);
+            break;
+        case 1:
+            if (up[c].head < up[c].tail) rc = relay_one(relay, c);
+            break;
+        default:
+            if (down[c].head < down[c].tail) rc = deliver_one(c);
+            break;
+        }
+        if (rc != 0) return 1;
+    }
+
+    // Deliver everything still in flight
+    for (int moved = 1; moved; ) {
+        moved = 0;
+        for (int c = 0; c <= CLIENTS; c++) {
+            while (up[c].head < up[c].tail) {
+                if (relay_one(relay, c) != 0) return 1;
+                moved = 1;
+            }
+        }
+        for (int c = 0; c <= CLIENTS; c++) {
+            while (down[c].head < down[c].tail) {
+                if (deliver_one(c) != 0) return 1;
+                moved = 1;
+            }
+        }
+    }
+
+    int len;
+    char *text = rga_text(relay, &len);
+    if (!text) return 1;
+    int ok = 1;
+    for (int c = 0; c <= CLIENTS; c++) {
+        if (!same_text(replica[c], text, len)) { printf("client %d diverged\n", c); ok = 0; }
+    }
+    // A duplicate delivery must change nothing
+    for (int c = 0; c <= CLIENTS; c++) {
+        for (int k = 0; k < down[c].tail; k += 7) rga_apply(replica[c], down[c].ops[k]);
+        if (!same_text(replica[c], text, len)) { printf("client %d diverged after duplicates\n", c); ok = 0; }
+    }
+    printf("seed %u: %s, %d characters, %d elements\n", seed, ok ? "converged" : "DIVERGED", len, relay->count);
+
+    free(text);
+    for (int c = 0; c <= CLIENTS; c++) {
+        rga_free(replica[c]);
+        for (int k = 0; k < up[c].tail; k++) free(up[c].ops[k]);
+        for (int k = 0; k < down[c].tail; k++) free(down[c].ops[k]);
+        free(up[c].ops);
+        free(down[c].ops);
+    }
+    rga_free(relay);
+    return ok ? 0 : 1;
+}
@@ -2,20 +2,45 @@
 """
 Docs++ network helper utilities.
 
-Provides two primary commands:
+Provides these commands:
   * ping      - quick latency/connectivity check to NM/SS endpoints.
   * roundtrip - boots local NM/SS/client binaries and performs a CREATE/WRITE/READ cycle.
+  * scale     - boots local NM/SS binaries and times SYNC/READ/WRITE on documents
+                from 1 KB up to hundreds of MB.
+  * collab    - boots local NM/SS binaries, has several live clients edit one file
+                at random and checks that every replica and the file converge.
+  * stress    - boots local NM/SS binaries, commits from N writers on distinct
+                sentences of one file at once and checks the merged result.
+  * syscalls  - counts SS and client syscalls per MB of READ with strace -c.
+  * readlines - times READ of a 10k-line document, line by line and framed.
+  * updates   - times 1000 WRITE_UPDATEs in one session on small and 100k-word
+                documents and checks the result.
+  * durability - times WRITE_END commits under the none, fsync and group
+                durability modes.
+  * idle      - holds thousands of idle clients on the NM and reports its
+                threads and RSS, reactor against thread-per-connection.
+  * sessions  - holds thousands of concurrent STREAM sessions on one SS and
+                reports its threads, RSS and stream pace, fibers against
+                thread-per-connection.
 """
 
 from __future__ import annotations
 
 import argparse
+import os
+import random
+import resource
+import selectors
+import shutil
+import signal
 import socket
+import struct
 import subprocess
 import sys
+import threading
 import time
 from pathlib import Path
-from typing import Optional, Sequence, Tuple
+from typing import Callable, List, Optional, Sequence, Tuple
 
 
 def _tcp_ping(host: str, port: int, timeout: float) -> Tuple[bool, Optional[float], Optional[str]]:
@@ -64,11 +89,36 @@ def _start_process(cmd: Sequence[str], log_name: str) -> subprocess.Popen:
     return proc
 
 
+def _child_pids(pid: int) -> List[int]:
+    children = []
+    for entry in os.listdir("/proc"):
+        if not entry.isdigit():
+            continue
+        try:
+            with open(f"/proc/{entry}/stat", encoding="utf-8") as stat:
+                fields = stat.read().rsplit(")", 1)[1].split()
+        except OSError:
+            continue
+        if int(fields[1]) == pid:
+            children.append(int(entry))
+    return children
+
+
 def _stop_process(proc: Optional[subprocess.Popen]) -> None:
     if not proc:
         return
     if proc.poll() is not None:
         return
+    if os.path.basename(str(proc.args[0])) == "strace":
+        # strace -o FILE PROG ignores SIGTERM: stop the traced program and
+        # strace writes its summary and exits with it
+        for pid in _child_pids(proc.pid):
+            os.kill(pid, signal.SIGTERM)
+        try:
+            proc.wait(timeout=10)
+            return
+        except subprocess.TimeoutExpired:
+            pass
     proc.terminate()
     try:
         proc.wait(timeout=5)
@@ -212,6 +262,1045 @@ def cmd_roundtrip(args: argparse.Namespace) -> int:
             _stop_process(ss_proc)
             _stop_process(nm_proc)
 
+# Binary frame header (lib/include/net.h): u32 length, u16 opcode, u16 flags, u32 request id
+_FRAME_HDR = struct.Struct(">IHHI")
+_FRAME_MAX = 64 << 20
+_OP_DATA = 1
+_FRAME_MORE = 1
+
+
+class _Link:
+    """Line/frame protocol connection to an NM or SS port."""
+
+    def __init__(self, host: str, port: int, timeout: float) -> None:
+        self.sock = socket.create_connection((host, port), timeout=timeout)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.buf = bytearray()
+
+    def send_line(self, line: str) -> None:
+        self.sock.sendall(line.encode() + b"\n")
+
+    def _fill(self) -> None:
+        chunk = self.sock.recv(1 << 20)
+        if not chunk:
+            raise ConnectionError("connection closed")
+        self.buf += chunk
+
+    def line(self) -> str:
+        while b"\n" not in self.buf:
+            self._fill()
+        i = self.buf.index(b"\n")
+        out = bytes(self.buf[:i]).decode(errors="replace").rstrip("\r")
+        del self.buf[: i + 1]
+        return out
+
+    def exact(self, n: int) -> bytes:
+        while len(self.buf) < n:
+            self._fill()
+        out = bytes(self.buf[:n])
+        del self.buf[:n]
+        return out
+
+    def command(self, line: str) -> str:
+        self.send_line(line)
+        return self.line()
+
+    def hello_frames(self) -> None:
+        reply = self.command("HELLO FRAMES")
+        if not reply.startswith("OK HELLO FRAMES"):
+            raise RuntimeError(f"frames refused: {reply}")
+
+    def send_payload(self, data: bytes) -> None:
+        view = memoryview(data)
+        while True:
+            part = view[:_FRAME_MAX]
+            view = view[_FRAME_MAX:]
+            flags = _FRAME_MORE if len(view) else 0
+            self.sock.sendall(_FRAME_HDR.pack(len(part), _OP_DATA, flags, 0))
+            self.sock.sendall(part)
+            if not len(view):
+                return
+
+    def recv_payload(self, keep: bool = False) -> int:
+        """Drain a payload, returning its length and keeping its first bytes in self.head
+        (all of it in self.body if keep)."""
+        total = 0
+        self.head = b""
+        self.body = bytearray()
+        while True:
+            length, op, flags, _ = _FRAME_HDR.unpack(self.exact(_FRAME_HDR.size))
+            if op != _OP_DATA:
+                raise RuntimeError(f"unexpected frame op {op}")
+            left = length
+            while left:
+                if not self.buf:
+                    self._fill()
+                take = min(left, len(self.buf))
+                if len(self.head) < 64:
+                    self.head += bytes(self.buf[: min(take, 64 - len(self.head))])
+                if keep:
+                    self.body += self.buf[:take]
+                del self.buf[:take]
+                left -= take
+            total += length
+            if not flags & _FRAME_MORE:
+                return total
+
+    def close(self) -> None:
+        self.sock.close()
+
+
+def _parse_size(text: str) -> int:
+    units = {"K": 1 << 10, "M": 1 << 20, "G": 1 << 30}
+    text = text.strip().upper().rstrip("B")
+    if text and text[-1] in units:
+        return int(float(text[:-1]) * units[text[-1]])
+    return int(text)
+
+
+def _scale_document(size: int) -> bytes:
+    sentence = b"The quick brown fox jumps over the lazy dog. "
+    line = sentence * 4 + b"\n"
+    reps = size // len(line) + 1
+    return (line * reps)[:size - 1] + b"."
+
+
+def _locate(nm: _Link, command: str, timeout: float) -> _Link:
+    reply = nm.command(command)
+    if not reply.startswith("SS "):
+        raise RuntimeError(f"{command}: {reply}")
+    ip, port = reply.split()[1:3]
+    ss = _Link(ip, int(port), timeout)
+    ss.line()  # welcome
+    return ss
+
+
+def _start_cluster(args: argparse.Namespace, tag: str, procs: List[subprocess.Popen],
+                   ss_extra: Sequence[str] = (), ss_wrap: Sequence[str] = (),
+                   nm_extra: Sequence[str] = ()) -> None:
+    """Start an NM and one SS registered with it (run under ss_wrap, if given),
+    appending both to procs."""
+    nm_bin = _resolve_bin("nm")
+    ss_bin = _resolve_bin("ss")
+    nm_cmd = [nm_bin, "--port", str(args.nm_client_port), "--ss-port", str(args.nm_ss_port), *nm_extra]
+    ss_cmd = [
+        *ss_wrap,
+        ss_bin,
+        "--client-port",
+        str(args.ss_client_port),
+        "--admin-port",
+        str(args.ss_admin_port),
+        "--nm-ip",
+        args.nm_ip,
+        "--nm-port",
+        str(args.nm_ss_port),
+        "--ss-id",
+        f"{tag}-ss",
+        "--advertise-ip",
+        args.ss_ip,
+        *ss_extra,
+    ]
+    procs.append(_start_process(nm_cmd, f"{tag}-nm.log"))
+    if not _wait_for_port(args.nm_ip, args.nm_client_port, args.wait_timeout):
+        raise RuntimeError("NM port did not open in time")
+    procs.append(_start_process(ss_cmd, f"{tag}-ss.log"))
+    if not _wait_for_port(args.ss_ip, args.ss_client_port, args.wait_timeout):
+        raise RuntimeError("SS client port did not open in time")
+    time.sleep(1.0)
+
+
+def _run_on_cluster(args: argparse.Namespace, tag: str, body: Callable[[], int],
+                    ss_extra: Sequence[str] = (), ss_wrap: Sequence[str] = (),
+                    nm_extra: Sequence[str] = (), procs: Optional[List[subprocess.Popen]] = None) -> int:
+    """Run body against a fresh local NM + SS, stopping both afterwards.
+    The NM and SS are procs[0] and procs[1] while body runs."""
+    procs = [] if procs is None else procs
+    try:
+        _start_cluster(args, tag, procs, ss_extra, ss_wrap, nm_extra)
+        return body()
+    except FileNotFoundError as exc:
+        print(f"[{tag}] {exc}", file=sys.stderr)
+        print("Please run `make all` first.", file=sys.stderr)
+        return 1
+    except (OSError, RuntimeError, ConnectionError) as exc:
+        print(f"[{tag}] FAILED: {exc}", file=sys.stderr)
+        return 1
+    finally:
+        for proc in reversed(procs):
+            _stop_process(proc)
+
+
+def _login(args: argparse.Namespace, user: str) -> _Link:
+    nm = _Link(args.nm_ip, args.nm_client_port, args.io_timeout)
+    nm.line()  # welcome
+    nm.command(f"LOGIN {user} 0")
+    return nm
+
+
+def _sync_file(args: argparse.Namespace, name: str, data: bytes) -> None:
+    """Replace name's content through the admin SYNC path (what NM recovery uses);
+    as text lines up to END if the SS runs without frames."""
+    admin = _Link(args.ss_ip, args.ss_admin_port, args.io_timeout)
+    frames = admin.command("HELLO FRAMES").startswith("OK HELLO FRAMES")
+    reply = admin.command(f"SYNC {name}")
+    if reply != "OK":
+        raise RuntimeError(f"SYNC: {reply}")
+    if frames:
+        admin.send_payload(data)
+    else:
+        admin.sock.sendall(data + b"\nEND\n")
+    reply = admin.line()
+    admin.close()
+    if not reply.startswith("OK"):
+        raise RuntimeError(f"SYNC: {reply}")
+
+
+def _ss_stat(args: argparse.Namespace, key: str) -> int:
+    """One counter from the SS admin STATS line."""
+    admin = _Link(args.ss_ip, args.ss_admin_port, args.io_timeout)
+    reply = admin.command("STATS")
+    admin.close()
+    for field in reply.split():
+        if field.startswith(key + "="):
+            return int(field.split("=", 1)[1])
+    raise RuntimeError(f"STATS has no {key}: {reply}")
+
+
+def _read_file(args: argparse.Namespace, nm: _Link, name: str) -> bytes:
+    ss = _locate(nm, f"READ {name}", args.io_timeout)
+    ss.hello_frames()
+    reply = ss.command(f"READ {name}")
+    if not reply.startswith("OK"):
+        raise RuntimeError(f"READ: {reply}")
+    ss.recv_payload(keep=True)
+    ss.close()
+    return bytes(ss.body)
+
+
+def _scale_one(args: argparse.Namespace, nm: _Link, size: int) -> Tuple[float, float, float, float]:
+    name = f"scale_{int(time.time())}_{size}.txt"
+    reply = nm.command(f"CREATE {name}")
+    if not reply.startswith("OK"):
+        raise RuntimeError(f"CREATE: {reply}")
+    data = _scale_document(size)
+    start = time.perf_counter()
+    _sync_file(args, name, data)
+    sync_s = time.perf_counter() - start
+    del data
+
+    def read_back() -> Tuple[float, int, bytes]:
+        ss = _locate(nm, f"READ {name}", args.io_timeout)
+        ss.hello_frames()
+        begin = time.perf_counter()
+        reply = ss.command(f"READ {name}")
+        if not reply.startswith("OK"):
+            raise RuntimeError(f"READ: {reply}")
+        got = ss.recv_payload()
+        elapsed = time.perf_counter() - begin
+        ss.close()
+        return elapsed, got, ss.head
+
+    read_s, got, _ = read_back()
+    if got != size:
+        raise RuntimeError(f"READ returned {got} of {size} bytes")
+
+    # One word in the first sentence, committed through the edit path
+    ss = _locate(nm, f"WRITE {name} 0", args.io_timeout)
+    start = time.perf_counter()
+    for cmd in (f"WRITE_BEGIN {name} 0", f"WRITE_UPDATE {name} 0 0 Scaled", f"WRITE_END {name} 0"):
+        reply = ss.command(cmd)
+        if not reply.startswith("OK"):
+            raise RuntimeError(f"{cmd}: {reply}")
+    write_s = time.perf_counter() - start
+    ss.command("QUIT")
+    ss.close()
+
+    reread_s, got, head = read_back()
+    if not head.startswith(b"Scaled The quick"):
+        raise RuntimeError(f"edit missing after WRITE: {head[:40]!r}...")
+    nm.command(f"DELETE {name}")
+    return sync_s, read_s, write_s, reread_s
+
+
+def cmd_scale(args: argparse.Namespace) -> int:
+    sizes = [_parse_size(s) for s in args.sizes.split(",") if s.strip()]
+
+    def run() -> int:
+        failures = 0
+        nm = _login(args, "scale")
+        print(f"{'bytes':>10} {'SYNC ms':>10} {'READ ms':>10} {'WRITE ms':>10} {'re-READ ms':>11} {'READ MB/s':>10}")
+        for size in sizes:
+            mb = size / (1 << 20)
+            try:
+                sync_s, read_s, write_s, reread_s = _scale_one(args, nm, size)
+            except (OSError, RuntimeError, ConnectionError) as exc:
+                print(f"{size:>10} FAILED: {exc}")
+                failures += 1
+                if isinstance(exc, OSError):
+                    break
+                continue
+            print(f"{size:>10} {sync_s * 1000:>10.1f} {read_s * 1000:>10.1f} {write_s * 1000:>10.1f} {reread_s * 1000:>11.1f} {mb / read_s:>10.1f}")
+        nm.close()
+        return 1 if failures else 0
+
+    return _run_on_cluster(args, "scale", run)
+
+
+def _parse_rga_id(text: str) -> Tuple[int, int]:
+    clock, site = text.split(".")
+    return int(clock), int(site)
+
+
+_RGA_ESCAPES = {"\\": "\\", "n": "\n", "r": "\r", "0": "\0"}
+
+
+def _rga_unescape(text: str) -> str:
+    out = []
+    i = 0
+    while i < len(text):
+        if text[i] == "\\":
+            i += 1
+            out.append(_RGA_ESCAPES[text[i]])
+        else:
+            out.append(text[i])
+        i += 1
+    return "".join(out)
+
+
+class _Replica:
+    """A client's copy of a live document, merged the way lib/src/rga.c merges."""
+
+    def __init__(self) -> None:
+        # id -> [character, deleted, next id]; (0, 0) is the head
+        self.nodes = {(0, 0): ["", True, None]}
+        self.clock = 0
+
+    def apply(self, op: str) -> None:
+        if op.startswith("I "):
+            ident, origin, text = op[2:].split(" ", 2)
+            clock, site = _parse_rga_id(ident)
+            prev = _parse_rga_id(origin)
+            for i, ch in enumerate(_rga_unescape(text)):
+                cid = (clock + i, site)
+                if cid not in self.nodes:
+                    # After the origin, past any newer inserts there
+                    cur = self.nodes[prev][2]
+                    while cur is not None and cur > cid:
+                        prev, cur = cur, self.nodes[cur][2]
+                    self.nodes[cid] = [ch, False, cur]
+                    self.nodes[prev][2] = cid
+                    self.clock = max(self.clock, cid[0])
+                prev = cid
+        elif op.startswith("D "):
+            for item in op[2:].split():
+                ident, _, run = item.partition("+")
+                clock, site = _parse_rga_id(ident)
+                for i in range(int(run or 1)):
+                    self.nodes[(clock + i, site)][1] = True
+        else:
+            raise ValueError(f"bad operation {op!r}")
+
+    def visible(self) -> List[Tuple[Tuple[int, int], str]]:
+        out = []
+        cur = self.nodes[(0, 0)][2]
+        while cur is not None:
+            ch, deleted, nxt = self.nodes[cur]
+            if not deleted:
+                out.append((cur, ch))
+            cur = nxt
+        return out
+
+    def text(self) -> str:
+        return "".join(ch for _, ch in self.visible())
+
+
+class _LiveClient:
+    """One live session connection: OP lines go to its replica, everything else is a reply."""
+
+    def __init__(self, link: _Link, name: str, timeout: float) -> None:
+        self.link = link
+        self.name = name
+        self.timeout = timeout
+        self.replica = _Replica()
+        self.replies: List[str] = []
+        self.ops_in = 0
+        self.closed = False
+        self.cv = threading.Condition()
+        threading.Thread(target=self._reader, daemon=True).start()
+
+    def _reader(self) -> None:
+        try:
+            while True:
+                line = self.link.line()
+                with self.cv:
+                    if line.startswith("OP "):
+                        self.replica.apply(line.split(" ", 2)[2])
+                        self.ops_in += 1
+                    else:
+                        self.replies.append(line)
+                    self.cv.notify_all()
+        except (OSError, ConnectionError):
+            with self.cv:
+                self.closed = True
+                self.cv.notify_all()
+
+    def command(self, line: str, local_op: Optional[str] = None) -> str:
+        """Send line and wait for its reply; local_op is applied to the replica first."""
+        with self.cv:
+            if local_op:
+                self.replica.apply(local_op)
+            n = len(self.replies)
+            self.link.send_line(line)
+            self.cv.wait_for(lambda: len(self.replies) > n or self.closed, self.timeout)
+            if len(self.replies) <= n:
+                raise ConnectionError(f"no reply to {line[:40]!r}")
+            return self.replies[n]
+
+    def join(self) -> int:
+        reply = self.command(f"COLLAB_JOIN {self.name}")
+        if not reply.startswith("OK live"):
+            raise RuntimeError(f"COLLAB_JOIN: {reply}")
+        self.site = int(reply.split("site=")[1])
+        return self.site
+
+
+def _collab_client(client: _LiveClient, rng: random.Random, steps: int, jitter_ms: float,
+                   counts: dict, errors: List[str]) -> None:
+    """Random edits: server-side word inserts, and inserts and deletes made on the replica."""
+    try:
+        for step in range(steps):
+            roll = rng.random()
+            if roll < 0.4:
+                with client.cv:
+                    sentences = client.replica.text().count(".") + 1
+                word = f"u{client.site}n{step}" + ("." if rng.random() < 0.2 else "")
+                reply = client.command(f"COLLAB_UPDATE {client.name} {rng.randrange(sentences)} {rng.randrange(6)} {word}")
+                if reply == "OK updated":
+                    counts["updates"] += 1
+                elif "out of range" in reply:
+                    counts["refused"] += 1
+                else:
+                    errors.append(f"COLLAB_UPDATE: {reply}")
+            else:
+                with client.cv:
+                    chars = client.replica.visible()
+                    if roll < 0.8 or not chars:
+                        # Lamport clock: past everything this replica has seen
+                        pos = rng.randrange(len(chars) + 1)
+                        origin = chars[pos - 1][0] if pos else (0, 0)
+                        text = f" r{client.site}n{step}" + ("." if rng.random() < 0.2 else "")
+                        op = f"I {client.replica.clock + 1}.{client.site} {origin[0]}.{origin[1]} {text}"
+                        kind = "inserts"
+                    else:
+                        at = rng.randrange(len(chars))
+                        run = chars[at:at + rng.randint(1, 6)]
+                        op = "D " + " ".join(f"{c}.{s}" for (c, s), _ in run)
+                        kind = "deletes"
+                    reply = client.command(f"COLLAB_OP {client.name} {op}", local_op=op)
+                if reply == "OK op":
+                    counts[kind] += 1
+                else:
+                    errors.append(f"COLLAB_OP: {reply}")
+            if jitter_ms > 0:
+                time.sleep(rng.random() * jitter_ms / 1000.0)
+    except (OSError, ConnectionError, RuntimeError) as exc:
+        errors.append(str(exc))
+
+
+def cmd_collab(args: argparse.Namespace) -> int:
+    seed = args.seed if args.seed is not None else int(time.time())
+
+    def run() -> int:
+        nm = _login(args, "collab")
+        name = f"collab_{int(time.time())}.txt"
+        reply = nm.command(f"CREATE {name}")
+        if not reply.startswith("OK"):
+            raise RuntimeError(f"CREATE: {reply}")
+        clients = []
+        for _ in range(args.clients):
+            link = _locate(nm, f"LIVE {name}", args.io_timeout)
+            client = _LiveClient(link, name, args.io_timeout)
+            client.join()
+            clients.append(client)
+        print(f"[collab] {args.clients} clients x {args.steps} steps on {name}, seed {seed}")
+
+        per_client = [{"updates": 0, "refused": 0, "inserts": 0, "deletes": 0} for _ in clients]
+        errors: List[str] = []
+        threads = [
+            threading.Thread(target=_collab_client,
+                             args=(c, random.Random(seed * 1000 + i), args.steps, args.jitter_ms, per_client[i], errors))
+            for i, c in enumerate(clients)
+        ]
+        start = time.perf_counter()
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        elapsed = time.perf_counter() - start
+        counts = {k: sum(c[k] for c in per_client) for k in per_client[0]}
+
+        # Each reply follows every operation queued to that client before it,
+        # so after a save round every replica has seen everything
+        for _ in range(2):
+            for c in clients:
+                reply = c.command(f"COLLAB_SAVE {name}")
+                if reply != "OK saved":
+                    errors.append(f"COLLAB_SAVE: {reply}")
+        texts = []
+        for c in clients:
+            with c.cv:
+                texts.append(c.replica.text())
+        converged = all(t == texts[0] for t in texts)
+        for c in clients:
+            c.command(f"COLLAB_LEAVE {name}")
+            c.link.close()
+        saved = _read_file(args, nm, name).decode(errors="replace")
+        nm.command(f"DELETE {name}")
+        nm.close()
+
+        print(f"[collab] {elapsed:.2f} s: {counts['updates']} COLLAB_UPDATE ({counts['refused']} out of range), "
+              f"{counts['inserts']} inserts, {counts['deletes']} deletes; "
+              f"OP lines received {min(c.ops_in for c in clients)}..{max(c.ops_in for c in clients)} per client")
+        print(f"[collab] {len(texts[0])} chars; replicas converged: {converged}; file matches: {saved == texts[0]}")
+        for err in errors[:10]:
+            print(f"[collab] error: {err}")
+        return 0 if converged and saved == texts[0] and not errors else 1
+
+    return _run_on_cluster(args, "collab", run, ["--live-save-ms", str(args.live_save_ms)])
+
+
+
+def _percentile(samples: List[float], pct: float) -> float:
+    ordered = sorted(samples)
+    return ordered[min(len(ordered) - 1, int(len(ordered) * pct / 100.0))] if ordered else 0.0
+
+
+def _stress_writer(args: argparse.Namespace, nm: _Link, nm_lock: threading.Lock, name: str, sidx: int,
+                   stats: dict, errors: List[str]) -> None:
+    """args.rounds sentence-locked sessions on sentence sidx, each inserting one word."""
+    try:
+        with nm_lock:
+            ss = _locate(nm, f"WRITE {name} {sidx}", args.io_timeout)
+        for rnd in range(args.rounds):
+            for attempt in range(args.max_retries + 1):
+                if attempt:
+                    stats["retries"] += 1
+                reply = ss.command(f"WRITE_BEGIN {name} {sidx} WAIT {args.lock_wait_ms}")
+                if reply.startswith("ERR sentence locked"):
+                    continue
+                if not reply.startswith("OK"):
+                    raise RuntimeError(f"WRITE_BEGIN: {reply}")
+                reply = ss.command(f"WRITE_UPDATE {name} {sidx} 1 w{sidx}r{rnd}")
+                if reply != "OK updated":
+                    raise RuntimeError(f"WRITE_UPDATE: {reply}")
+                start = time.perf_counter()
+                reply = ss.command(f"WRITE_END {name} {sidx}")
+                stats["end_ms"].append((time.perf_counter() - start) * 1000.0)
+                if reply == "OK end":
+                    stats["commits"] += 1
+                    break
+                if reply.startswith("ERR merge conflict"):
+                    stats["conflicts"] += 1
+                    continue
+                raise RuntimeError(f"WRITE_END: {reply}")
+            else:
+                raise RuntimeError(f"round {rnd} gave up after {args.max_retries} retries")
+        ss.command("QUIT")
+        ss.close()
+    except (OSError, ConnectionError, RuntimeError) as exc:
+        errors.append(f"writer {sidx}: {exc}")
+
+
+def _stress_round(args: argparse.Namespace, tag: str) -> dict:
+    """Load a file with one sentence per writer, have every writer commit
+    args.rounds WRITE sessions on its own sentence at once, and read the merge back."""
+    nm = _login(args, tag)
+    name = f"{tag}_{int(time.time())}.txt"
+    reply = nm.command(f"CREATE {name}")
+    if not reply.startswith("OK"):
+        raise RuntimeError(f"CREATE: {reply}")
+    _sync_file(args, name, " ".join(f"S{i} base." for i in range(args.writers)).encode())
+    waits_before = _ss_stat(args, "lock_waits")
+
+    nm_lock = threading.Lock()
+    per_writer = [{"commits": 0, "conflicts": 0, "retries": 0, "end_ms": []} for _ in range(args.writers)]
+    errors: List[str] = []
+    threads = [
+        threading.Thread(target=_stress_writer, args=(args, nm, nm_lock, name, i, per_writer[i], errors))
+        for i in range(args.writers)
+    ]
+    start = time.perf_counter()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time.perf_counter() - start
+    waits = _ss_stat(args, "lock_waits") - waits_before
+
+    # Every writer's words, newest first, in its own sentence and nowhere else
+    text = _read_file(args, nm, name).decode(errors="replace")
+    expected = " ".join(
+        f"S{i} " + " ".join(f"w{i}r{r}" for r in reversed(range(args.rounds))) + " base."
+        for i in range(args.writers)
+    )
+    nm.command(f"DELETE {name}")
+    nm.close()
+    words = text.split()
+    return {
+        "commits": sum(w["commits"] for w in per_writer),
+        "conflicts": sum(w["conflicts"] for w in per_writer),
+        "retries": sum(w["retries"] for w in per_writer),
+        "end_ms": [ms for w in per_writer for ms in w["end_ms"]],
+        "elapsed": elapsed,
+        "waits": waits,
+        "errors": errors,
+        "text": text,
+        "expected": expected,
+        "lost": sum(1 for i in range(args.writers) for r in range(args.rounds) if f"w{i}r{r}" not in words),
+    }
+
+
+def _stress_ok(result: dict) -> bool:
+    # Distinct sentences never overlap, so nothing may conflict
+    return result["text"] == result["expected"] and not result["errors"] and result["conflicts"] == 0
+
+
+def _stress_report(label: str, args: argparse.Namespace, result: dict) -> None:
+    for err in result["errors"][:10]:
+        print(f"[{label}] error: {err}")
+    if result["text"] != result["expected"]:
+        print(f"[{label}] merged file is wrong: {result['lost']} of {args.writers * args.rounds} edits missing")
+        print(f"[{label}]   got      {result['text'][:120]!r}")
+        print(f"[{label}]   expected {result['expected'][:120]!r}")
+
+
+def cmd_stress(args: argparse.Namespace) -> int:
+    def run() -> int:
+        result = _stress_round(args, "stress")
+        commits, elapsed, end_ms = result["commits"], result["elapsed"], result["end_ms"]
+        print(f"[stress] {args.writers} writers x {args.rounds} rounds: {commits} commits in {elapsed:.2f} s "
+              f"({commits / elapsed:.0f}/s), WRITE_END p50 {_percentile(end_ms, 50):.2f} ms p99 {_percentile(end_ms, 99):.2f} ms")
+        print(f"[stress] conflicts {result['conflicts']}, retries {result['retries']}, lock waits {result['waits']}")
+        _stress_report("stress", args, result)
+        if result["text"] == result["expected"]:
+            print("[stress] merged file holds every writer's edits")
+        return 0 if _stress_ok(result) else 1
+
+    return _run_on_cluster(args, "stress", run)
+
+
+def cmd_durability(args: argparse.Namespace) -> int:
+    modes = [m.strip() for m in args.modes.split(",") if m.strip()]
+    bad = [m for m in modes if m not in ("none", "fsync", "group")]
+    if bad or not modes:
+        print(f"[durability] unknown modes: {','.join(bad) or args.modes}", file=sys.stderr)
+        return 2
+    print(f"[durability] {args.writers} writers x {args.rounds} rounds per mode, group-commit-ms={args.group_commit_ms}")
+    print(f"{'mode':<8} {'commits/s':>10} {'p50 ms':>9} {'p99 ms':>9} {'max ms':>9} {'syncs':>7} {'flushes':>8}")
+    failures = 0
+    for mode in modes:
+        row = {}
+
+        def run() -> int:
+            syncs_before = _ss_stat(args, "syncs")
+            flushes_before = _ss_stat(args, "flushes")
+            result = _stress_round(args, "durability")
+            row["syncs"] = _ss_stat(args, "syncs") - syncs_before
+            row["flushes"] = _ss_stat(args, "flushes") - flushes_before
+            row["result"] = result
+            _stress_report(f"durability {mode}", args, result)
+            return 0 if _stress_ok(result) else 1
+
+        ss_extra = ["--durability", mode, "--group-commit-ms", str(args.group_commit_ms)]
+        rc = _run_on_cluster(args, f"durability-{mode}", run, ss_extra)
+        if "result" not in row:
+            print(f"{mode:<8} FAILED")
+            failures += 1
+            continue
+        result = row["result"]
+        end_ms = result["end_ms"]
+        print(f"{mode:<8} {result['commits'] / result['elapsed']:>10.0f} {_percentile(end_ms, 50):>9.2f} "
+              f"{_percentile(end_ms, 99):>9.2f} {max(end_ms, default=0.0):>9.2f} {row['syncs']:>7} {row['flushes']:>8}")
+        if rc != 0:
+            failures += 1
+    return 1 if failures else 0
+
+
+def _strace_counts(path: Path) -> dict:
+    """Calls per syscall from an `strace -c` summary."""
+    counts = {}
+    with open(path, encoding="utf-8") as summary:
+        for row in summary:
+            fields = row.split()
+            # % time, seconds, usecs/call, calls, [errors,] syscall
+            if len(fields) < 5 or not fields[0][0].isdigit() or fields[-1] == "total":
+                continue
+            counts[fields[-1]] = counts.get(fields[-1], 0) + int(fields[3])
+    return counts
+
+
+def _read_text_reply(ss: _Link) -> bytes:
+    """A line-mode reply after its OK, up to its END line, as the raw text."""
+    scanned = 0
+    while True:
+        if ss.buf.startswith(b"END\n"):
+            del ss.buf[:4]
+            return b""
+        i = ss.buf.find(b"\nEND\n", scanned)
+        if i >= 0:
+            text = bytes(ss.buf[:i])
+            del ss.buf[: i + 5]
+            return text
+        scanned = max(0, len(ss.buf) - 4)
+        ss._fill()
+
+
+def cmd_syscalls(args: argparse.Namespace) -> int:
+    strace = shutil.which("strace")
+    if not strace:
+        print("[syscalls] strace not found; install it to count syscalls", file=sys.stderr)
+        return 1
+    size = _parse_size(args.size)
+    logs_dir = _repo_root() / "logs"
+    moved = size * args.repeat / (1 << 20)
+
+    def framed_reads(nm: _Link, name: str) -> None:
+        for _ in range(args.repeat):
+            ss = _locate(nm, f"READ {name}", args.io_timeout)
+            ss.hello_frames()
+            if not ss.command(f"READ {name}").startswith("OK"):
+                raise RuntimeError("READ failed")
+            if ss.recv_payload() != size:
+                raise RuntimeError("short READ")
+            ss.close()
+
+    def line_reads(nm: _Link, name: str) -> None:
+        for _ in range(args.repeat):
+            ss = _locate(nm, f"READ {name}", args.io_timeout)
+            if not ss.command(f"READ {name}").startswith("OK"):
+                raise RuntimeError("READ failed")
+            _read_text_reply(ss)
+            ss.close()
+
+    def measure(phase: str, ss_extra: Sequence[str], work: Optional[Callable[[_Link, str], None]],
+                client_reads: int = 0) -> Optional[dict]:
+        """Syscalls the SS makes over one phase, or the C client when it runs client_reads READs."""
+        path = logs_dir / f"syscalls-{phase}.txt"
+        traced = [strace, "-f", "-c", "-o", str(path)]
+
+        def run() -> int:
+            nm = _login(args, "syscalls")
+            name = f"syscalls_{int(time.time())}_{phase}.txt"
+            reply = nm.command(f"CREATE {name}")
+            if not reply.startswith("OK"):
+                raise RuntimeError(f"CREATE: {reply}")
+            _sync_file(args, name, _scale_document(size))
+            if work is not None:
+                work(nm, name)
+            else:
+                script = f"READ {name}\n" * client_reads + "QUIT\n"
+                cmd = traced + [_resolve_bin("client"), "--nm-ip", args.nm_ip,
+                                "--nm-port", str(args.nm_client_port), "--username", "syscalls"]
+                proc = subprocess.run(cmd, input=script.encode(), stdout=subprocess.DEVNULL,
+                                      stderr=subprocess.DEVNULL, timeout=args.io_timeout)
+                if proc.returncode != 0:
+                    raise RuntimeError(f"client exited with {proc.returncode}")
+            nm.command(f"DELETE {name}")
+            nm.close()
+            return 0
+
+        wrap = traced if work is not None else ()
+        if _run_on_cluster(args, f"syscalls-{phase}", run, ss_extra, wrap) != 0:
+            return None
+        return _strace_counts(path)
+
+    # The same start-up and load with nothing read, taken off every phase
+    idle = measure("ss-idle", (), lambda nm, name: None)
+    client_idle = measure("client-idle", (), None, 0)
+    if idle is None or client_idle is None:
+        return 1
+    print(f"[syscalls] {args.repeat} x {size} bytes = {moved:.1f} MB per phase; "
+          f"summaries in {logs_dir}/syscalls-*.txt")
+    print(f"{'phase':<24} {'syscalls':>10} {'per MB':>10}  top calls")
+    phases = [
+        ("ss-frames", "SS, framed READ", (), framed_reads),
+        ("ss-lines", "SS, line-mode READ", (), line_reads),
+        ("client-frames", "client, framed READ", (), None),
+        ("client-lines", "client, line-mode READ", ("--no-frames",), None),
+    ]
+    failures = 0
+    for phase, label, ss_extra, work in phases:
+        counts = measure(phase, ss_extra, work, args.repeat)
+        if counts is None:
+            print(f"{label:<24} FAILED")
+            failures += 1
+            continue
+        base = idle if work is not None else client_idle
+        extra = {k: v - base.get(k, 0) for k, v in counts.items() if v > base.get(k, 0)}
+        total = sum(extra.values())
+        top = ", ".join(f"{k} {v}" for k, v in sorted(extra.items(), key=lambda kv: -kv[1])[:4])
+        print(f"{label:<24} {total:>10} {total / moved:>10.1f}  {top}")
+    return 1 if failures else 0
+
+
+def cmd_readlines(args: argparse.Namespace) -> int:
+    body = "".join(f"Line {i:06d}: " + "lorem ipsum dolor sit amet. " * (args.line_bytes // 28) + "\n"
+                   for i in range(args.lines))
+    data = body.rstrip("\n").encode()
+
+    def run() -> int:
+        nm = _login(args, "readlines")
+        name = f"readlines_{int(time.time())}.txt"
+        reply = nm.command(f"CREATE {name}")
+        if not reply.startswith("OK"):
+            raise RuntimeError(f"CREATE: {reply}")
+        _sync_file(args, name, data)
+        print(f"[readlines] {args.lines} lines, {len(data)} bytes, {args.repeat} READs per mode")
+        print(f"{'mode':<8} {'p50 ms':>9} {'p99 ms':>9} {'min ms':>9} {'MB/s':>9}")
+        failures = 0
+        for mode in ("lines", "frames"):
+            ss = _locate(nm, f"READ {name}", args.io_timeout)
+            if mode == "frames":
+                ss.hello_frames()
+            samples = []
+            for _ in range(args.repeat):
+                start = time.perf_counter()
+                reply = ss.command(f"READ {name}")
+                if not reply.startswith("OK"):
+                    raise RuntimeError(f"READ: {reply}")
+                if mode == "frames":
+                    ss.recv_payload(keep=True)
+                    got = bytes(ss.body)
+                else:
+                    got = _read_text_reply(ss)
+                samples.append((time.perf_counter() - start) * 1000.0)
+                if got != data:
+                    print(f"{mode:<8} FAILED: {len(got)} of {len(data)} bytes back, or different")
+                    failures += 1
+                    break
+            else:
+                p50 = _percentile(samples, 50)
+                print(f"{mode:<8} {p50:>9.2f} {_percentile(samples, 99):>9.2f} {min(samples):>9.2f} "
+                      f"{len(data) / (1 << 20) / (p50 / 1000.0):>9.1f}")
+            ss.command("QUIT")
+            ss.close()
+        nm.command(f"DELETE {name}")
+        nm.close()
+        return 1 if failures else 0
+
+    return _run_on_cluster(args, "readlines", run)
+
+
+def _updates_one(args: argparse.Namespace, nm: _Link, words: int, rng: random.Random) -> Tuple[List[float], float]:
+    """args.updates WRITE_UPDATEs in one session on a document of `words` words,
+    checked against the same inserts made locally."""
+    sentence = "The quick brown fox jumps over the lazy dog again."
+    per = len(sentence.split())
+    sentences = [sentence] * max(1, words // per)
+    sidx = len(sentences) // 2
+    name = f"updates_{int(time.time())}_{words}.txt"
+    reply = nm.command(f"CREATE {name}")
+    if not reply.startswith("OK"):
+        raise RuntimeError(f"CREATE: {reply}")
+    _sync_file(args, name, " ".join(sentences).encode())
+
+    ss = _locate(nm, f"WRITE {name} {sidx}", args.io_timeout)
+    reply = ss.command(f"WRITE_BEGIN {name} {sidx}")
+    if not reply.startswith("OK"):
+        raise RuntimeError(f"WRITE_BEGIN: {reply}")
+    local = sentence.split()
+    samples = []
+    for k in range(args.updates):
+        # Before the last word, so the sentence keeps its delimiter
+        widx = rng.randrange(len(local))
+        start = time.perf_counter()
+        reply = ss.command(f"WRITE_UPDATE {name} {sidx} {widx} u{k}")
+        samples.append((time.perf_counter() - start) * 1000.0)
+        if reply != "OK updated":
+            raise RuntimeError(f"WRITE_UPDATE: {reply}")
+        local.insert(widx, f"u{k}")
+    start = time.perf_counter()
+    reply = ss.command(f"WRITE_END {name} {sidx}")
+    end_ms = (time.perf_counter() - start) * 1000.0
+    if reply != "OK end":
+        raise RuntimeError(f"WRITE_END: {reply}")
+    ss.command("QUIT")
+    ss.close()
+
+    sentences[sidx] = " ".join(local)
+    if _read_file(args, nm, name) != " ".join(sentences).encode():
+        raise RuntimeError("file read back differs from the updates made")
+    nm.command(f"DELETE {name}")
+    return samples, end_ms
+
+
+def cmd_updates(args: argparse.Namespace) -> int:
+    sizes = [int(w) for w in args.words.split(",") if w.strip()]
+    rng = random.Random(args.seed)
+
+    def run() -> int:
+        nm = _login(args, "updates")
+        print(f"[updates] {args.updates} WRITE_UPDATEs in one session on a middle sentence")
+        print(f"{'words':>8} {'total ms':>10} {'p50 ms':>8} {'p99 ms':>8} {'max ms':>8} {'WRITE_END ms':>13}")
+        failures = 0
+        for words in sizes:
+            try:
+                samples, end_ms = _updates_one(args, nm, words, rng)
+            except (RuntimeError, ConnectionError) as exc:
+                print(f"{words:>8} FAILED: {exc}")
+                failures += 1
+                continue
+            print(f"{words:>8} {sum(samples):>10.1f} {_percentile(samples, 50):>8.3f} "
+                  f"{_percentile(samples, 99):>8.3f} {max(samples):>8.3f} {end_ms:>13.2f}")
+        nm.close()
+        return 1 if failures else 0
+
+    return _run_on_cluster(args, "updates", run)
+
+
+def _proc_usage(pid: int) -> Tuple[int, float]:
+    """Threads and resident MB of a process, from /proc."""
+    threads, rss_kb = 0, 0
+    with open(f"/proc/{pid}/status", encoding="utf-8") as status:
+        for row in status:
+            if row.startswith("Threads:"):
+                threads = int(row.split()[1])
+            elif row.startswith("VmRSS:"):
+                rss_kb = int(row.split()[1])
+    return threads, rss_kb / 1024.0
+
+
+def _raise_fd_limit(need: int) -> None:
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    if soft != resource.RLIM_INFINITY and soft < need:
+        resource.setrlimit(resource.RLIMIT_NOFILE, (hard if hard == resource.RLIM_INFINITY else min(need, hard), hard))
+
+
+def cmd_idle(args: argparse.Namespace) -> int:
+    _raise_fd_limit(args.clients + 256)
+
+    def one(model: str, nm_extra: Sequence[str]) -> int:
+        procs: List[subprocess.Popen] = []
+
+        def run() -> int:
+            nm_pid = procs[0].pid
+            before = _proc_usage(nm_pid)
+            idle = []
+            try:
+                for i in range(args.clients):
+                    link = _Link(args.nm_ip, args.nm_client_port, args.io_timeout)
+                    idle.append(link)
+                    link.line()  # welcome
+                    link.command(f"LOGIN idle{i} 0")
+                time.sleep(1.0)
+                threads, rss = _proc_usage(nm_pid)
+                # An active client still gets answered promptly
+                nm = _login(args, "idle")
+                samples = []
+                for _ in range(args.repeat):
+                    start = time.perf_counter()
+                    nm.send_line("VIEW")
+                    while nm.line() != "END":
+                        pass
+                    samples.append((time.perf_counter() - start) * 1000.0)
+                nm.close()
+            finally:
+                for link in idle:
+                    link.close()
+            print(f"{model:<16} {len(idle):>8} {threads:>8} {threads - before[0]:>8} {rss:>8.1f} "
+                  f"{rss - before[1]:>8.1f} {_percentile(samples, 50):>10.3f}")
+            return 0
+
+        return _run_on_cluster(args, f"idle-{model}", run, nm_extra=nm_extra, procs=procs)
+
+    print(f"[idle] {args.clients} logged-in idle clients on the NM, then {args.repeat} VIEWs from one more")
+    print(f"{'NM model':<16} {'clients':>8} {'threads':>8} {'+thr':>8} {'RSS MB':>8} {'+MB':>8} {'VIEW p50 ms':>10}")
+    failures = 0
+    for model, nm_extra in (("reactor", ()), ("thread-per-conn", ("--thread-per-conn",))):
+        if one(model, nm_extra) != 0:
+            print(f"{model:<16} FAILED")
+            failures += 1
+    return 1 if failures else 0
+
+
+def cmd_sessions(args: argparse.Namespace) -> int:
+    _raise_fd_limit(args.sessions + 256)
+    # STREAM sends a word every 100 ms, so this outlasts the run
+    data = " ".join(f"w{i}" for i in range(args.words)).encode()
+
+    def one(model: str, ss_extra: Sequence[str]) -> int:
+        procs: List[subprocess.Popen] = []
+
+        def run() -> int:
+            ss_pid = procs[1].pid
+            nm = _login(args, "sessions")
+            name = f"sessions_{int(time.time())}.txt"
+            reply = nm.command(f"CREATE {name}")
+            if not reply.startswith("OK"):
+                raise RuntimeError(f"CREATE: {reply}")
+            _sync_file(args, name, data)
+            ss = _locate(nm, f"STREAM {name}", args.io_timeout)
+            ip, port = ss.sock.getpeername()[:2]
+            ss.close()
+            before = _proc_usage(ss_pid)
+            links = []
+            sel = selectors.DefaultSelector()
+            try:
+                for _ in range(args.sessions):
+                    link = _Link(ip, port, args.io_timeout)
+                    links.append(link)
+                    link.line()  # welcome
+                    reply = link.command(f"STREAM {name}")
+                    if reply != "OK":
+                        raise RuntimeError(f"STREAM: {reply}")
+                for link in links:
+                    link.line()  # first word: every session is streaming
+                    sel.register(link.sock, selectors.EVENT_READ, link)
+                # Keep draining so the SS is pacing words, not blocked on full sockets
+                threads, rss, words = 0, 0.0, 0
+                end = time.monotonic() + args.hold
+                while time.monotonic() < end:
+                    for key, _ in sel.select(0.2):
+                        chunk = key.data.sock.recv(1 << 16)
+                        if not chunk:
+                            raise ConnectionError("stream ended early")
+                        words += chunk.count(b"\n")
+                    t, m = _proc_usage(ss_pid)
+                    threads, rss = max(threads, t), max(rss, m)
+            finally:
+                sel.close()
+                for link in links:
+                    link.close()
+            nm.command(f"DELETE {name}")
+            nm.close()
+            print(f"{model:<16} {len(links):>8} {threads:>8} {threads - before[0]:>8} {rss:>8.1f} "
+                  f"{rss - before[1]:>8.1f} {words / args.hold / len(links):>12.2f}")
+            return 0
+
+        return _run_on_cluster(args, f"sessions-{model}", run, ss_extra, procs=procs)
+
+    print(f"[sessions] {args.sessions} concurrent STREAMs on one SS, measured over {args.hold:.1f} s "
+          f"(STREAM paces 10 words/s)")
+    print(f"{'SS model':<16} {'sessions':>8} {'threads':>8} {'+thr':>8} {'RSS MB':>8} {'+MB':>8} "
+          f"{'words/s each':>12}")
+    failures = 0
+    for model, ss_extra in (("fibers", ()), ("thread-per-conn", ("--thread-per-conn",))):
+        if one(model, ss_extra) != 0:
+            print(f"{model:<16} FAILED")
+            failures += 1
+    return 1 if failures else 0
+
+
+def _add_cluster_args(parser: argparse.ArgumentParser) -> None:
+    parser.add_argument("--nm-ip", default="127.0.0.1", help="IP the SS/benchmark use to reach the NM")
+    parser.add_argument("--nm-client-port", type=int, default=8000, help="NM client port")
+    parser.add_argument("--nm-ss-port", type=int, default=8001, help="NM storage registration port")
+    parser.add_argument("--ss-ip", default="127.0.0.1", help="IP the SS advertises and is probed on")
+    parser.add_argument("--ss-client-port", type=int, default=9000, help="SS client-facing port")
+    parser.add_argument("--ss-admin-port", type=int, default=9100, help="SS admin port")
+    parser.add_argument("--wait-timeout", type=float, default=15.0, help="Seconds to wait for server sockets")
+    parser.add_argument("--io-timeout", type=float, default=300.0, help="Seconds to wait on any one reply")
+
 
 def build_parser() -> argparse.ArgumentParser:
     parser = argparse.ArgumentParser(description="Docs++ network diagnostics")
@@ -260,6 +1349,102 @@ def build_parser() -> argparse.ArgumentParser:
     )
     roundtrip_parser.set_defaults(func=cmd_roundtrip)
 
+    scale_parser = subparsers.add_parser(
+        "scale",
+        help="Start local NM/SS binaries and time SYNC/READ/WRITE on growing documents",
+    )
+    scale_parser.add_argument(
+        "--sizes",
+        default="1K,64K,1M,16M,64M,128M,500M",
+        help="Comma-separated document sizes (K/M/G suffixes)",
+    )
+    _add_cluster_args(scale_parser)
+    scale_parser.set_defaults(func=cmd_scale)
+
+    collab_parser = subparsers.add_parser(
+        "collab",
+        help="Start local NM/SS binaries and check that live-session replicas converge under random edits",
+    )
+    collab_parser.add_argument("--clients", type=int, default=4, help="Live clients editing the file at once")
+    collab_parser.add_argument("--steps", type=int, default=300, help="Edits each client makes")
+    collab_parser.add_argument("--jitter-ms", type=float, default=2.0, help="Longest random pause between edits")
+    collab_parser.add_argument("--seed", type=int, help="Random seed (defaults to the time; printed either way)")
+    collab_parser.add_argument("--live-save-ms", type=int, default=100, help="SS autosave period during the run")
+    _add_cluster_args(collab_parser)
+    collab_parser.set_defaults(func=cmd_collab)
+
+    stress_parser = subparsers.add_parser(
+        "stress",
+        help="Start local NM/SS binaries and commit from N writers on distinct sentences of one file at once",
+    )
+    stress_parser.add_argument("--writers", type=int, default=8, help="Concurrent writers, one sentence each")
+    stress_parser.add_argument("--rounds", type=int, default=50, help="WRITE sessions each writer commits")
+    stress_parser.add_argument("--max-retries", type=int, default=5, help="Retries of one round before giving up")
+    stress_parser.add_argument("--lock-wait-ms", type=int, default=5000, help="WRITE_BEGIN ... WAIT for a busy sentence")
+    _add_cluster_args(stress_parser)
+    stress_parser.set_defaults(func=cmd_stress)
+
+    syscalls_parser = subparsers.add_parser(
+        "syscalls",
+        help="Count SS and client syscalls per MB of READ with strace -c",
+    )
+    syscalls_parser.add_argument("--size", default="8M", help="Document size (K/M/G suffixes)")
+    syscalls_parser.add_argument("--repeat", type=int, default=4, help="READs of the document per phase")
+    _add_cluster_args(syscalls_parser)
+    syscalls_parser.set_defaults(func=cmd_syscalls)
+
+    readlines_parser = subparsers.add_parser(
+        "readlines",
+        help="Start local NM/SS binaries and time READ of a 10k-line document, line-mode and framed",
+    )
+    readlines_parser.add_argument("--lines", type=int, default=10000, help="Lines in the document")
+    readlines_parser.add_argument("--line-bytes", type=int, default=80, help="Rough length of each line")
+    readlines_parser.add_argument("--repeat", type=int, default=20, help="READs per mode")
+    _add_cluster_args(readlines_parser)
+    readlines_parser.set_defaults(func=cmd_readlines)
+
+    updates_parser = subparsers.add_parser(
+        "updates",
+        help="Start local NM/SS binaries and time 1000 WRITE_UPDATEs on small and 100k-word documents",
+    )
+    updates_parser.add_argument("--words", default="1000,100000", help="Comma-separated document sizes in words")
+    updates_parser.add_argument("--updates", type=int, default=1000, help="WRITE_UPDATEs in the session")
+    updates_parser.add_argument("--seed", type=int, default=1, help="Random seed for the word positions")
+    _add_cluster_args(updates_parser)
+    updates_parser.set_defaults(func=cmd_updates)
+
+    durability_parser = subparsers.add_parser(
+        "durability",
+        help="Compare WRITE_END commit latency under the none, fsync and group durability modes",
+    )
+    durability_parser.add_argument("--modes", default="none,fsync,group", help="Comma-separated SS --durability modes")
+    durability_parser.add_argument("--group-commit-ms", type=int, default=0, help="SS --group-commit-ms for group mode")
+    durability_parser.add_argument("--writers", type=int, default=4, help="Concurrent writers, one sentence each")
+    durability_parser.add_argument("--rounds", type=int, default=50, help="WRITE sessions each writer commits")
+    durability_parser.add_argument("--max-retries", type=int, default=5, help="Retries of one round before giving up")
+    durability_parser.add_argument("--lock-wait-ms", type=int, default=5000, help="WRITE_BEGIN ... WAIT for a busy sentence")
+    _add_cluster_args(durability_parser)
+    durability_parser.set_defaults(func=cmd_durability)
+
+    idle_parser = subparsers.add_parser(
+        "idle",
+        help="Hold many idle clients on the NM and report its threads and RSS, reactor and thread-per-conn",
+    )
+    idle_parser.add_argument("--clients", type=int, default=2000, help="Idle clients to hold open")
+    idle_parser.add_argument("--repeat", type=int, default=20, help="VIEWs timed from one active client")
+    _add_cluster_args(idle_parser)
+    idle_parser.set_defaults(func=cmd_idle)
+
+    sessions_parser = subparsers.add_parser(
+        "sessions",
+        help="Hold many concurrent STREAM sessions on one SS and report its threads and RSS, fibers and thread-per-conn",
+    )
+    sessions_parser.add_argument("--sessions", type=int, default=4000, help="Concurrent STREAM sessions")
+    sessions_parser.add_argument("--words", type=int, default=600, help="Words in the streamed document")
+    sessions_parser.add_argument("--hold", type=float, default=5.0, help="Seconds to drain every stream while measuring")
+    _add_cluster_args(sessions_parser)
+    sessions_parser.set_defaults(func=cmd_sessions)
+
     return parser
 
 
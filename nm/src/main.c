@@ -5,8 +5,13 @@
 #include <time.h>
 #include <ctype.h>
 #include <pthread.h>
+#include <errno.h>
 #ifndef _WIN32
 #include <unistd.h>
+#include <signal.h>
+#endif
+#ifdef __linux__
+#include <sys/epoll.h>
 #endif
 #include "../../lib/include/net.h"
 #include "../../lib/include/util.h"
@@ -15,16 +20,29 @@
 #include "../../lib/include/persist.h"
 #include "../../lib/include/log.h"
 #include "../../lib/include/error_codes.h"
+#include "../../lib/include/conn_pool.h"
+#include "../../lib/include/thread_pool.h"
+#include "../../lib/include/rpc.h"
+#include "../../lib/include/durable.h"
 
 static char nm_bind_host[64] = "0.0.0.0";
 static uint16_t nm_client_port = 8000;
 static uint16_t nm_ss_port = 8001;
 static int nm_verbose = 0;
 static int nm_exec_allow_all = 0;
+static int ss_pool_max_idle = 8;        // idle admin connections kept per SS
+static int ss_pool_idle_timeout = 60;   // seconds before an idle one is closed
+static int nm_worker_count = 16;        // reactor mode: threads running client commands
+static int nm_thread_per_conn = 0;      // 1: legacy one-thread-per-client mode
+static int ss_connect_timeout_ms = 2000; // NM -> SS connect limit
+static int ss_timeout_ms = 10000;       // NM -> SS limit per reply / socket wait
+static int ss_rpc_enabled = 1;          // multiplexed admin calls (lib/rpc)
+static DurableMode nm_durability = DURABLE_GROUP; // metadata.dat sync policy
+static int nm_group_commit_ms = DURABLE_DEFAULT_WINDOW_MS;
 
 static void print_nm_usage(const char *prog) {
-    printf("Usage: %s [--host IP] [--port CLIENT_PORT] [--ss-port SS_REG_PORT] [--verbose] [--exec-allow]\n", prog);
-    printf("Defaults: host=0.0.0.0, port=8000, ss-port=8001\n");
+    printf("Usage: %s [--host IP] [--port CLIENT_PORT] [--ss-port SS_REG_PORT] [--ss-pool-size N] [--ss-pool-idle SECONDS] [--workers N] [--thread-per-conn] [--ss-connect-timeout MS] [--ss-timeout MS] [--no-ss-rpc] [--durability none|fsync|group] [--group-commit-ms N] [--verbose] [--exec-allow]\n", prog);
+    printf("Defaults: host=0.0.0.0, port=8000, ss-port=8001, ss-pool-size=8, ss-pool-idle=60, workers=16, ss-connect-timeout=2000, ss-timeout=10000, durability=group, group-commit-ms=0\n");
 }
 
 static void load_nm_config_defaults(void) {
@@ -40,6 +58,34 @@ static void load_nm_config_defaults(void) {
     if (config_get_uint16("nm.ss_port", &tmp) && tmp != 0) {
         nm_ss_port = tmp;
     }
+    if (config_get_uint16("nm.ss_pool_size", &tmp)) {
+        ss_pool_max_idle = tmp;
+    }
+    if (config_get_uint16("nm.ss_pool_idle", &tmp) && tmp != 0) {
+        ss_pool_idle_timeout = tmp;
+    }
+    if (config_get_uint16("nm.workers", &tmp) && tmp != 0) {
+        nm_worker_count = tmp;
+    }
+    if (config_get_uint16("nm.thread_per_conn", &tmp)) {
+        nm_thread_per_conn = tmp != 0;
+    }
+    if (config_get_uint16("nm.ss_connect_timeout", &tmp) && tmp != 0) {
+        ss_connect_timeout_ms = tmp;
+    }
+    if (config_get_uint16("nm.ss_timeout", &tmp) && tmp != 0) {
+        ss_timeout_ms = tmp;
+    }
+    if (config_get_uint16("nm.ss_rpc", &tmp)) {
+        ss_rpc_enabled = tmp != 0;
+    }
+    if (config_get_string("nm.durability", buf, sizeof(buf)) &&
+        durable_parse_mode(buf, &nm_durability) != 0) {
+        fprintf(stderr, "NM WARN: unknown nm.durability '%s'\n", buf);
+    }
+    if (config_get_uint16("nm.group_commit_ms", &tmp)) {
+        nm_group_commit_ms = tmp;
+    }
 }
 
 // Minimal NM: accepts client commands and SS registrations.
@@ -77,6 +123,8 @@ typedef struct {
     char replica_of[64];  // SS ID this is a replica of (empty if primary)
     time_t last_heartbeat;  // For failure detection
     int is_active;  // 1 if active, 0 if failed
+    int admin_queue;  // admin commands waiting on the SS (from heartbeat)
+    int admin_busy;   // admin workers busy on the SS (from heartbeat)
 } SSInfo;
 
 #define MAX_SS 32
@@ -227,30 +275,41 @@ static void remove_file_from_map(const char *filename) {
     }
 }
 
-// Save metadata to disk
+// Save metadata to disk: written beside the old copy and renamed over it,
+// so a crash mid-save leaves the previous metadata intact. Callers change
+// the tables under nm_mutex, drop it and then call this. Saves run one at
+// a time, each writing a snapshot taken under nm_mutex when its turn
+// comes, so an older snapshot never lands over a newer one; a caller whose
+// change a finished save already covered returns without writing.
+static pthread_mutex_t metadata_save_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long metadata_requested = 0;   // under nm_mutex
+static unsigned long metadata_published = 0;   // under metadata_save_mutex
+
 static void save_metadata(void) {
-    char path[512] = "nm/metadata.dat";
+    pthread_mutex_lock(&nm_mutex);
+    unsigned long ticket = ++metadata_requested;
+    pthread_mutex_unlock(&nm_mutex);
+    pthread_mutex_lock(&metadata_save_mutex);
+    if (metadata_published >= ticket) { pthread_mutex_unlock(&metadata_save_mutex); return; }
+    NetSendBuf snap; net_sendbuf_init(&snap, -1);
+    pthread_mutex_lock(&nm_mutex);
+    unsigned long covered = metadata_requested;
+    // files_count, the file entries, users, then access requests
+    net_sendbuf_append(&snap, &files_count, sizeof(int));
+    net_sendbuf_append(&snap, files, (int)(sizeof(FileEntry) * files_count));
+    net_sendbuf_append(&snap, &users_count, sizeof(int));
+    for (int i = 0; i < users_count; i++) net_sendbuf_append(&snap, users[i], 64);
+    net_sendbuf_append(&snap, &access_requests_count, sizeof(int));
+    net_sendbuf_append(&snap, access_requests, (int)(sizeof(AccessRequest) * access_requests_count));
+    pthread_mutex_unlock(&nm_mutex);
     mkpath("nm");
-    FILE *f = fopen(path, "wb");
-    if (f) {
-        // Write files_count
-        fwrite(&files_count, sizeof(int), 1, f);
-        // Write all file entries
-        for (int i = 0; i < files_count; i++) {
-            fwrite(&files[i], sizeof(FileEntry), 1, f);
-        }
-        // Write users
-        fwrite(&users_count, sizeof(int), 1, f);
-        for (int i = 0; i < users_count; i++) {
-            fwrite(users[i], 64, 1, f);
-        }
-        // Write access requests
-        fwrite(&access_requests_count, sizeof(int), 1, f);
-        for (int i = 0; i < access_requests_count; i++) {
-            fwrite(&access_requests[i], sizeof(AccessRequest), 1, f);
-        }
-        fclose(f);
+    if (!snap.err && durable_write_file("nm/metadata.dat", snap.buf, snap.len) == 0) {
+        metadata_published = covered;
+    } else {
+        printf("NM WARN: could not save metadata\n");
     }
+    net_sendbuf_free(&snap);
+    pthread_mutex_unlock(&metadata_save_mutex);
 }
 
 // Load metadata from disk
@@ -287,7 +346,7 @@ static void load_metadata(void) {
 }
 
 // Recursive function to display folder tree structure
-static void display_folder_tree(int cfd, const char *base_path, const char *prefix, int is_last, FileEntry *files, int files_count) {
+static void display_folder_tree(NetSendBuf *out, const char *base_path, const char *prefix, int is_last, FileEntry *files, int files_count) {
     int prefix_len = (int)strlen(base_path);
     
     // Collect all items under this folder (direct children only)
@@ -375,7 +434,7 @@ static void display_folder_tree(int cfd, const char *base_path, const char *pref
             strncat(buf, items[i].name, sizeof(buf) - strlen(buf) - 1);
         }
         
-        net_send_line(cfd, buf);
+        net_sendbuf_line(out, buf);
         
         // If it's a folder, recursively display its contents
         if (items[i].is_folder) {
@@ -385,32 +444,306 @@ static void display_folder_tree(int cfd, const char *base_path, const char *pref
             } else {
                 snprintf(new_prefix, sizeof(new_prefix), "%s│   ", tree_prefix);
             }
-            display_folder_tree(cfd, items[i].full_path, new_prefix, is_last_item, files, files_count);
+            display_folder_tree(out, items[i].full_path, new_prefix, is_last_item, files, files_count);
         }
     }
 }
 
-// Thread function to handle client connection
-static void* handle_client(void *arg) {
-    // arg now contains both socket and client info
-    typedef struct {
-        int cfd;
-        char client_ip[64];
-        uint16_t client_port;
-    } ClientContext;
-    
-    ClientContext *ctx = (ClientContext*)arg;
-    int cfd = ctx->cfd;
-    const char *client_ip = ctx->client_ip;
-    uint16_t client_port = ctx->client_port;
-    free(ctx);  // Free the allocated memory
-    
-    char user[64] = "";
-    char line[1024];
-    net_send_line(cfd, "WELCOME Docs++ NM. Please LOGIN <username>");
-    while (1) {
-        int n = net_recv_line(cfd, line, sizeof(line));
-        if (n <= 0) break;
+// Long-lived NM -> SS admin connections (see lib/conn_pool)
+static ConnPool *ss_pool = NULL;
+// Multiplexed NM -> SS admin calls (see lib/rpc); NULL with --no-ss-rpc
+static RpcClient *ss_rpc = NULL;
+
+static void ss_log_timeout(const char *ip, uint16_t port, const char *cmd) {
+    char detail[512];
+    snprintf(detail, sizeof(detail), "SS=%s:%u cmd=%.400s error=TIMEOUT", ip, port, cmd);
+    log_write("NM", "SS_CALL", "SYSTEM", detail, ERR_SS_NO_RESPONSE);
+}
+
+// ss_admin_call over a pooled request/response connection. A reused
+// connection that turns out to be dead is retried once on a fresh one; one
+// that timed out is not, so a hung SS costs at most ss_timeout_ms.
+static int ss_admin_call_plain(const char *ip, uint16_t port, const char *cmd, char *resp, int resplen) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        PooledConn *pc = conn_pool_acquire(ss_pool, ip, port);
+        if (!pc) return errno == ETIMEDOUT ? -2 : -1;
+        if (net_send_line(pc->conn->fd, cmd) == 0 && net_conn_recv_line_timeout(pc->conn, resp, resplen, ss_timeout_ms) > 0) {
+            conn_pool_release(ss_pool, pc, 1);
+            return 0;
+        }
+        int timed_out = errno == ETIMEDOUT;
+        int was_reused = pc->reused;
+        conn_pool_release(ss_pool, pc, 0);
+        if (timed_out) { ss_log_timeout(ip, port, cmd); break; }
+        if (!was_reused) break;
+    }
+    return -2;
+}
+
+// Send a one-line admin command and read its one-line reply, over the SS's
+// RPC channel when it has one, otherwise a pooled connection. Returns 0
+// with the reply in resp, -1 if the SS is unreachable, -2 if it did not
+// answer in time.
+static int ss_admin_call(const char *ip, uint16_t port, const char *cmd, char *resp, int resplen) {
+    if (ss_rpc) {
+        int rrc = rpc_call(ss_rpc, ip, port, cmd, resp, resplen, ss_timeout_ms);
+        if (rrc == RPC_NO_RESPONSE) ss_log_timeout(ip, port, cmd);
+        if (rrc != RPC_UNSUPPORTED) return rrc;
+    }
+    return ss_admin_call_plain(ip, port, cmd, resp, resplen);
+}
+
+// Several admin calls at once: they all go out over the RPC channels before
+// any reply is awaited, so N servers cost one round trip. Servers without
+// RPC are asked one by one on pooled connections. Each request's status
+// uses ss_admin_call's values; replies are '\n'-terminated lines (free
+// with rpc_requests_free).
+static void ss_admin_batch(RpcRequest *reqs, int n) {
+    if (ss_rpc) {
+        rpc_call_batch(ss_rpc, reqs, n, ss_timeout_ms);
+    } else {
+        for (int i = 0; i < n; i++) { reqs[i].status = RPC_UNSUPPORTED; reqs[i].reply = NULL; reqs[i].reply_len = 0; }
+    }
+    for (int i = 0; i < n; i++) {
+        if (reqs[i].status == RPC_NO_RESPONSE) ss_log_timeout(reqs[i].host, reqs[i].port, reqs[i].cmd);
+        if (reqs[i].status != RPC_UNSUPPORTED) continue;
+        char resp[1024];
+        reqs[i].status = ss_admin_call_plain(reqs[i].host, reqs[i].port, reqs[i].cmd, resp, sizeof(resp));
+        if (reqs[i].status == 0) {
+            int len = (int)strlen(resp);
+            reqs[i].reply = (char*)malloc(len + 2);
+            if (reqs[i].reply) { memcpy(reqs[i].reply, resp, len); reqs[i].reply[len] = '\n'; reqs[i].reply[len+1] = '\0'; reqs[i].reply_len = len + 1; }
+        } else {
+            // Don't wait on a dead SS once per request
+            for (int j = i + 1; j < n; j++) {
+                if (reqs[j].status == RPC_UNSUPPORTED && reqs[j].port == reqs[i].port && strcmp(reqs[j].host, reqs[i].host) == 0) reqs[j].status = reqs[i].status;
+            }
+        }
+    }
+}
+
+// Send the same command to every server in targets at once (replication)
+static void ss_admin_fanout(const SSInfo *targets, int n, const char *cmd) {
+    if (n <= 0) return;
+    RpcRequest *reqs = (RpcRequest*)calloc(n, sizeof(RpcRequest));
+    if (!reqs) return;
+    for (int i = 0; i < n; i++) {
+        reqs[i].host = targets[i].ip;
+        reqs[i].port = targets[i].admin_port;
+        reqs[i].cmd = cmd;
+    }
+    ss_admin_batch(reqs, n);
+    rpc_requests_free(reqs, n);
+    free(reqs);
+}
+
+// FETCH a whole file from an SS admin port into a malloc'd, NUL-terminated
+// buffer. Returns 0 on success, -1 if unreachable, -2 on no/short response,
+// 1 if the SS answered something other than BEGIN (copied into err).
+static int ss_fetch_file(const char *ip, uint16_t port, const char *fname, char **out, int *out_len, char *err, int errlen) {
+    PooledConn *pc = conn_pool_acquire(ss_pool, ip, port);
+    if (!pc) return -1;
+    NetConn *c = pc->conn;
+    char cmd[512]; snprintf(cmd, sizeof(cmd), "FETCH %s", fname);
+    net_send_line(c->fd, cmd);
+    char r[1024];
+    if (net_conn_recv_line_timeout(c, r, sizeof(r), ss_timeout_ms) <= 0) { conn_pool_release(ss_pool, pc, 0); return -2; }
+    if (strcmp(r, "BEGIN") != 0) {
+        if (err && errlen > 0) snprintf(err, errlen, "%s", r);
+        conn_pool_release(ss_pool, pc, 1);
+        return 1;
+    }
+    if (pc->frames) {
+        int rc = net_conn_recv_payload(c, out, out_len);
+        conn_pool_release(ss_pool, pc, rc == 0);
+        return rc == 0 ? 0 : -2;
+    }
+    // Line mode: "L <text>" per line until END, joined with newlines
+    int cap = 4096, len = 0, first = 1, complete = 0;
+    char *buf = (char*)malloc(cap);
+    if (!buf) { conn_pool_release(ss_pool, pc, 0); return -2; }
+    buf[0] = '\0';
+    char *ln;
+    while (net_conn_next_line(c, &ln) > 0) {
+        if (strcmp(ln, "END") == 0) { complete = 1; break; }
+        if (ln[0] != 'L' || ln[1] != ' ') continue;
+        int n = (int)strlen(ln + 2);
+        if (len + n + 2 > cap) {
+            while (len + n + 2 > cap) cap *= 2;
+            char *nb = (char*)realloc(buf, cap);
+            if (!nb) { free(buf); conn_pool_release(ss_pool, pc, 0); return -2; }
+            buf = nb;
+        }
+        if (!first) buf[len++] = '\n';
+        memcpy(buf + len, ln + 2, n);
+        len += n;
+        buf[len] = '\0';
+        first = 0;
+    }
+    conn_pool_release(ss_pool, pc, complete);
+    // Cut off before END: never hand back part of the file as the whole
+    if (!complete) { free(buf); return -2; }
+    *out = buf;
+    *out_len = len;
+    return 0;
+}
+
+// SYNC content to an SS admin port. Returns 0 once the SS confirms.
+static int ss_sync_file(const char *ip, uint16_t port, const char *fname, const char *buf, int len) {
+    PooledConn *pc = conn_pool_acquire(ss_pool, ip, port);
+    if (!pc) return -1;
+    NetConn *c = pc->conn;
+    char cmd[512]; snprintf(cmd, sizeof(cmd), "SYNC %s", fname);
+    char resp[256];
+    if (net_send_line(c->fd, cmd) != 0 ||
+        net_conn_recv_line_timeout(c, resp, sizeof(resp), ss_timeout_ms) <= 0) { conn_pool_release(ss_pool, pc, 0); return -1; }
+    if (strncmp(resp, "OK", 2) != 0) { conn_pool_release(ss_pool, pc, 1); return -1; }
+    int sent;
+    if (pc->frames) {
+        sent = net_send_payload(c->fd, 0, buf, len) == 0;
+    } else {
+        // Line mode: one line per newline-separated chunk, then END
+        NetSendBuf batch; net_sendbuf_init(&batch, c->fd);
+        const char *p = buf, *end = buf + len;
+        while (p < end) {
+            const char *nl = memchr(p, '\n', end - p);
+            int n = (int)((nl ? nl : end) - p);
+            if (n > 0) {
+                net_sendbuf_append(&batch, p, n);
+                net_sendbuf_append(&batch, "\n", 1);
+            }
+            if (!nl) break;
+            p = nl + 1;
+        }
+        net_sendbuf_line(&batch, "END");
+        sent = net_sendbuf_flush(&batch) == 0;
+        net_sendbuf_free(&batch);
+    }
+    // A half-sent file leaves the connection mid-payload: don't wait for a
+    // reply that won't come, and don't pool it
+    if (!sent) { conn_pool_release(ss_pool, pc, 0); return -1; }
+    int got = net_conn_recv_line(c, resp, sizeof(resp)) > 0;
+    conn_pool_release(ss_pool, pc, got);
+    return got && strncmp(resp, "OK", 2) == 0 ? 0 : -1;
+}
+
+// Copy fname from one SS to another without staging it in NM memory: the
+// FETCH payload frames are spliced straight into the SYNC connection.
+// Returns 0 on success, 1 if either link is in line mode (caller falls back
+// to ss_fetch_file + ss_sync_file), -1 on failure.
+static int ss_relay_file(const char *src_ip, uint16_t src_port, const char *dst_ip, uint16_t dst_port, const char *fname) {
+    PooledConn *dst = conn_pool_acquire(ss_pool, dst_ip, dst_port);
+    if (!dst) return -1;
+    PooledConn *src = dst->frames ? conn_pool_acquire(ss_pool, src_ip, src_port) : NULL;
+    if (!src || !src->frames) {
+        int fallback = !dst->frames || src != NULL;
+        if (src) conn_pool_release(ss_pool, src, 1);
+        conn_pool_release(ss_pool, dst, 1);
+        return fallback ? 1 : -1;
+    }
+    char cmd[512], resp[256];
+    snprintf(cmd, sizeof(cmd), "FETCH %s", fname);
+    if (net_send_line(src->conn->fd, cmd) != 0 || net_conn_recv_line_timeout(src->conn, resp, sizeof(resp), ss_timeout_ms) <= 0) {
+        conn_pool_release(ss_pool, src, 0);
+        conn_pool_release(ss_pool, dst, 1);
+        return -1;
+    }
+    if (strcmp(resp, "BEGIN") != 0) {
+        conn_pool_release(ss_pool, src, 1);
+        conn_pool_release(ss_pool, dst, 1);
+        return -1;
+    }
+    snprintf(cmd, sizeof(cmd), "SYNC %s", fname);
+    int answered = net_send_line(dst->conn->fd, cmd) == 0 && net_conn_recv_line_timeout(dst->conn, resp, sizeof(resp), ss_timeout_ms) > 0;
+    if (!answered || strncmp(resp, "OK", 2) != 0) {
+        // The FETCH payload is already on its way and nobody will read it
+        conn_pool_release(ss_pool, src, 0);
+        conn_pool_release(ss_pool, dst, answered);
+        return -1;
+    }
+    int rc = net_conn_relay_payload(src->conn, dst->conn->fd, NULL);
+    conn_pool_release(ss_pool, src, rc == 0);
+    if (rc != 0) { conn_pool_release(ss_pool, dst, 0); return -1; }
+    int got = net_conn_recv_line(dst->conn, resp, sizeof(resp)) > 0;
+    conn_pool_release(ss_pool, dst, got);
+    return got && strncmp(resp, "OK", 2) == 0 ? 0 : -1;
+}
+
+// Per-client state. Owned by exactly one thread at a time: the connection's
+// own thread in thread-per-connection mode, otherwise the worker that the
+// reactor handed it to.
+typedef struct {
+    int cfd;
+    NetConn *conn;
+    char client_ip[64];
+    uint16_t client_port;
+    char user[64];
+} ClientSession;
+
+#define NM_CLIENT_LINE_MAX 1024
+
+// Append a SEARCH hit unless it is already listed
+static void search_add_result(char results[][512], int *count, const char *name) {
+    for (int j = 0; j < *count; j++) {
+        if (strcmp(results[j], name) == 0) return;
+    }
+    strncpy(results[*count], name, 511);
+    results[*count][511] = '\0';
+    (*count)++;
+}
+
+static void search_log_timeout(const char *user, const char *ip, uint16_t port, const char *keyword) {
+    char detail[512];
+    snprintf(detail, sizeof(detail), "SS=%s:%u keyword=%.256s error=TIMEOUT", ip, port, keyword);
+    log_write("NM", "SEARCH", user, detail, ERR_SS_NO_RESPONSE);
+}
+
+// One VIEW -l row, copied out under nm_mutex and filled in from the SS after
+typedef struct {
+    char filename[256];
+    char owner[64];
+    time_t last_access_time;
+    char ss_ip[64];
+    uint16_t admin_port;
+    int found_ss;
+    char cmd[300];
+} ViewRow;
+
+static ClientSession* client_session_open(int cfd, const char *ip, uint16_t port) {
+    ClientSession *s = (ClientSession*)calloc(1, sizeof(ClientSession));
+    if (!s) return NULL;
+    s->conn = net_conn_open(cfd);
+    if (!s->conn) { free(s); return NULL; }
+    s->cfd = cfd;
+    // A client that stops reading replies must not hold a worker forever.
+    // Reads stay unlimited: between commands a session is idle, not stuck.
+    net_set_io_timeouts(cfd, 0, ss_timeout_ms);
+    // Ensure IP is valid, use "127.0.0.1" if empty
+    strncpy(s->client_ip, (ip && ip[0]) ? ip : "127.0.0.1", sizeof(s->client_ip)-1);
+    s->client_port = port;
+    // Log client registration
+    char reg_client_log[256];
+    snprintf(reg_client_log, sizeof(reg_client_log), "REGISTER_CLIENT IP=%s Port=%u", s->client_ip, s->client_port);
+    log_write("NM", "REGISTER_CLIENT", "SYSTEM", reg_client_log, 0);
+    return s;
+}
+
+static void client_session_close(ClientSession *s) {
+    net_conn_close(s->conn);
+    free(s);
+}
+
+// Execute one client command. Returns 1 when the session should end (QUIT
+// or a failed exchange), 0 to keep reading.
+static int handle_client_line(ClientSession *sess, char *line) {
+    int cfd = sess->cfd;
+    const char *client_ip = sess->client_ip;
+    uint16_t client_port = sess->client_port;
+    char *user = sess->user;
+    // Single pass: handlers `continue` when a command is done and `break`
+    // to end the session, as they did inside the old per-connection loop
+    int end_session = 1;
+    for (; end_session; end_session = 0) {
         trim(line);
         if (strncmp(line, "LOGIN ", 6) == 0) {
             char username_buf[64] = "";
@@ -420,10 +753,10 @@ static void* handle_client(void *arg) {
                 net_send_line(cfd, "ERR username required");
                 continue;
             }
-            strncpy(user, username_buf, sizeof(user)-1);
-            user[sizeof(user)-1] = '\0';
+            snprintf(user, sizeof(sess->user), "%.*s", (int)sizeof(sess->user) - 1, username_buf);
             if (matched >= 2 && advertised_port > 0 && advertised_port < 65535) {
                 client_port = (uint16_t)advertised_port;
+                sess->client_port = client_port;
             }
             char ok[256]; snprintf(ok, sizeof(ok), "OK LOGGED IN %s", user);
             net_send_line(cfd, ok);
@@ -438,6 +771,7 @@ static void* handle_client(void *arg) {
         } else if (strncmp(line, "VIEW REQUEST", 12)==0 || strncmp(line, "VIEWREQUEST", 11)==0) {
             // Handle "VIEW REQUEST" or "VIEWREQUEST" as alias for LISTREQUESTS
             if (user[0] == '\0') { net_send_line(cfd, "ERR please LOGIN first"); continue; }
+            NetSendBuf batch; net_sendbuf_init(&batch, cfd);
             char fname[256] = "";
             // Optional: VIEW REQUEST <filename> or just VIEW REQUEST for all
             int cmd_len = (strncmp(line, "VIEW REQUEST", 12)==0) ? 12 : 11;
@@ -455,7 +789,7 @@ static void* handle_client(void *arg) {
                 int idx = find_file_index(access_requests[i].filename);
                 if (idx >= 0 && strcasecmp_safe(files[idx].owner, user)==0) {
                     if (count == 0) {
-                        net_send_line(cfd, "PENDING ACCESS REQUESTS:");
+                        net_sendbuf_line(&batch, "PENDING ACCESS REQUESTS:");
                     }
                     char out[512];
                     char time_str[64];
@@ -463,19 +797,21 @@ static void* handle_client(void *arg) {
                     snprintf(out, sizeof(out), "--> File: %s | User: %s | Type: %s | Requested: %s", 
                             access_requests[i].filename, access_requests[i].requesting_user, 
                             access_requests[i].access_type, time_str);
-                    net_send_line(cfd, out);
+                    net_sendbuf_line(&batch, out);
                     count++;
                 }
             }
             pthread_mutex_unlock(&nm_mutex);
             if (count == 0) {
                 if (fname[0] != '\0') {
-                    net_send_line(cfd, "No pending requests for this file.");
+                    net_sendbuf_line(&batch, "No pending requests for this file.");
                 } else {
-                    net_send_line(cfd, "No pending access requests.");
+                    net_sendbuf_line(&batch, "No pending access requests.");
                 }
             }
-            net_send_line(cfd, "END");
+            net_sendbuf_line(&batch, "END");
+            net_sendbuf_flush(&batch);
+            net_sendbuf_free(&batch);
         } else if (strcmp(line, "VIEW") == 0 || (strncmp(line, "VIEW ", 5)==0 && line[5]=='-')) {
     // parse flags (case-insensitive)
     // Only match "VIEW" or "VIEW -" (with flags), not "VIEW REQUEST" etc.
@@ -493,15 +829,17 @@ static void* handle_client(void *arg) {
         }
     }
     
-    // Send appropriate header
+    // Send appropriate header; rows are batched and leave after the unlock
+    NetSendBuf batch; net_sendbuf_init(&batch, cfd);
     if (show_long) {
-        net_send_line(cfd, "-------------------------------------------------------------------");
-        net_send_line(cfd, "|  Filename      | Words | Chars | Last Access Time  | Owner   |");
-        net_send_line(cfd, "|----------------|-------|-------|-------------------|---------|");
+        net_sendbuf_line(&batch, "-------------------------------------------------------------------");
+        net_sendbuf_line(&batch, "|  Filename      | Words | Chars | Last Access Time  | Owner   |");
+        net_sendbuf_line(&batch, "|----------------|-------|-------|-------------------|---------|");
     } else {
-        net_send_line(cfd, "FILES:");
+        net_sendbuf_line(&batch, "FILES:");
     }
     
+    ViewRow *rows = NULL; int row_count = 0, row_cap = 0;
     pthread_mutex_lock(&nm_mutex);
     for (int i=0;i<files_count;i++) {
         if (files[i].is_folder) continue;
@@ -524,75 +862,98 @@ static void* handle_client(void *arg) {
         
         if (!show_long) {
             char buf[512]; 
-            snprintf(buf, sizeof(buf), "--> %s", files[i].filename); 
-            net_send_line(cfd, buf);
+            snprintf(buf, sizeof(buf), "--> %.*s", (int)sizeof(files[i].filename) - 1, files[i].filename);
+            net_sendbuf_line(&batch, buf);
         } else {
-            // Get stats from SS - find active SS for this file (primary or replica)
-            char ss_ip[64]; uint16_t admin_port = 0;
-            int found_ss = 0;
+            if (row_count == row_cap) {
+                int ncap = row_cap ? row_cap * 2 : 64;
+                ViewRow *nr = (ViewRow*)realloc(rows, sizeof(ViewRow) * ncap);
+                if (!nr) break;
+                rows = nr; row_cap = ncap;
+            }
+            ViewRow *row = &rows[row_count++];
+            memset(row, 0, sizeof(*row));
+            snprintf(row->filename, sizeof(row->filename), "%.*s", (int)sizeof(row->filename) - 1, files[i].filename);
+            snprintf(row->owner, sizeof(row->owner), "%.*s", (int)sizeof(row->owner) - 1, files[i].owner);
+            row->last_access_time = files[i].last_access_time;
+            // Find active SS for this file (primary or replica)
             for (int j = 0; j < ss_count; j++) {
                 if (sss[j].is_active && strcmp(sss[j].ip, files[i].ss_ip) == 0 && 
                     sss[j].client_port == files[i].ss_client_port) {
-                    strncpy(ss_ip, sss[j].ip, 63); ss_ip[63] = '\0';
-                    admin_port = sss[j].admin_port;
-                    found_ss = 1;
+                    strncpy(row->ss_ip, sss[j].ip, 63); row->ss_ip[63] = '\0';
+                    row->admin_port = sss[j].admin_port;
+                    row->found_ss = 1;
                     break;
                 }
             }
-            if (!found_ss) {
+            if (!row->found_ss) {
                 for (int j = 0; j < ss_count; j++) {
                     if (sss[j].is_active && !sss[j].is_primary && strcmp(sss[j].replica_of, "") != 0) {
                         for (int k = 0; k < ss_count; k++) {
                             if (strcmp(sss[k].ss_id, sss[j].replica_of) == 0 &&
                                 strcmp(sss[k].ip, files[i].ss_ip) == 0 &&
                                 sss[k].client_port == files[i].ss_client_port) {
-                                strncpy(ss_ip, sss[j].ip, 63); ss_ip[63] = '\0';
-                                admin_port = sss[j].admin_port;
-                                found_ss = 1;
+                                strncpy(row->ss_ip, sss[j].ip, 63); row->ss_ip[63] = '\0';
+                                row->admin_port = sss[j].admin_port;
+                                row->found_ss = 1;
                                 break;
                             }
                         }
-                        if (found_ss) break;
+                        if (row->found_ss) break;
                     }
                 }
             }
-            long size = 0;
-            int words = 0, chars = 0;
-            
-            if (found_ss) {
-                int sfd = net_connect(ss_ip, admin_port);
-                if (sfd >= 0) {
-                    char cmd[512];
-                    snprintf(cmd, sizeof(cmd), "INFO %s", files[i].filename);
-                    net_send_line(sfd, cmd);
-                    
-                    char resp[512];
-                    if (net_recv_line(sfd, resp, sizeof(resp)) > 0) {
-                        sscanf(resp, "SIZE %ld WORDS %d CHARS %d", &size, &words, &chars);
-                    }
-                    net_close(sfd);
-                }
-            }
-            
-            // Format time in IST (UTC + 5:30)
-            char time_str[64];
-            time_t ist_time = files[i].last_access_time + (5 * 3600 + 30 * 60);
-            struct tm *tm_info = gmtime(&ist_time);
-            strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M", tm_info);
-
-            
-            char row[512];
-            snprintf(row, sizeof(row), "| %-14s | %5d | %5d | %-17s | %-7s |",
-                     files[i].filename, words, chars, time_str, files[i].owner);
-            net_send_line(cfd, row);
         }
     }
     pthread_mutex_unlock(&nm_mutex);
+
+    // Stats come from the storage servers after the unlock, all requested
+    // at once, so a slow or hung SS delays only this listing and only once
+    RpcRequest *reqs = (RpcRequest*)calloc(row_count > 0 ? row_count : 1, sizeof(RpcRequest));
+    int *req_of_row = (int*)malloc(sizeof(int) * (row_count > 0 ? row_count : 1));
+    int req_count = 0;
+    for (int i = 0; i < row_count; i++) {
+        if (!reqs || !req_of_row) break;
+        req_of_row[i] = -1;
+        if (!rows[i].found_ss) continue;
+        snprintf(rows[i].cmd, sizeof(rows[i].cmd), "INFO %s", rows[i].filename);
+        reqs[req_count].host = rows[i].ss_ip;
+        reqs[req_count].port = rows[i].admin_port;
+        reqs[req_count].cmd = rows[i].cmd;
+        req_of_row[i] = req_count++;
+    }
+    ss_admin_batch(reqs, req_count);
+    for (int i = 0; i < row_count; i++) {
+        ViewRow *row = &rows[i];
+        long size = 0;
+        int words = 0, chars = 0;
+        int r = (reqs && req_of_row) ? req_of_row[i] : -1;
+        if (r >= 0 && reqs[r].status == 0 && reqs[r].reply) {
+            sscanf(reqs[r].reply, "SIZE %ld WORDS %d CHARS %d", &size, &words, &chars);
+        }
+
+        // Format time in IST (UTC + 5:30)
+        char time_str[64];
+        time_t ist_time = row->last_access_time + (5 * 3600 + 30 * 60);
+        struct tm *tm_info = gmtime(&ist_time);
+        strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M", tm_info);
+
+        char line_out[512];
+        snprintf(line_out, sizeof(line_out), "| %-14s | %5d | %5d | %-17s | %-7s |",
+                 row->filename, words, chars, time_str, row->owner);
+        net_sendbuf_line(&batch, line_out);
+    }
+    if (reqs) rpc_requests_free(reqs, req_count);
+    free(reqs);
+    free(req_of_row);
+    free(rows);
     
     if (show_long) {
-        net_send_line(cfd, "-------------------------------------------------------------------");
+        net_sendbuf_line(&batch, "-------------------------------------------------------------------");
     }
-    net_send_line(cfd, "END");
+    net_sendbuf_line(&batch, "END");
+    net_sendbuf_flush(&batch);
+    net_sendbuf_free(&batch);
 }else if (strncmp(line, "CREATE ", 7) == 0) {
             if (user[0] == '\0') { net_send_line(cfd, "ERR please LOGIN first"); continue; }
             char *fname = line+7; 
@@ -630,31 +991,26 @@ static void* handle_client(void *arg) {
             if (!found_ss) { pthread_mutex_unlock(&nm_mutex); net_send_line(cfd, "ERR no active storage server"); goto cont; }
             pthread_mutex_unlock(&nm_mutex);
             // ask SS admin to create file
-            int sfd = net_connect(ss_copy.ip, ss_copy.admin_port);
-            if (sfd < 0) { net_send_line(cfd, "ERR cannot reach storage server"); goto cont; }
             char cmd[512]; snprintf(cmd, sizeof(cmd), "CREATE %s", fname);
             log_write("NM", "SS_CREATE", ss_copy.ss_id, fname, 0);
-            net_send_line(sfd, cmd);
-            char resp[512]; if (net_recv_line(sfd, resp, sizeof(resp)) <= 0) { net_close(sfd); net_send_line(cfd, "ERR SS no response"); goto cont; }
-            net_close(sfd);
+            char resp[512]; int arc = ss_admin_call(ss_copy.ip, ss_copy.admin_port, cmd, resp, sizeof(resp));
+            if (arc == -1) { net_send_line(cfd, "ERR cannot reach storage server"); goto cont; }
+            if (arc != 0) { net_send_line(cfd, "ERR SS no response"); goto cont; }
             if (strncmp(resp, "OK", 2) != 0) { net_send_line(cfd, resp); goto cont; }
             
-            // Async replication to replicas (don't wait for response)
+            // Replicate to replicas; failures are repaired by recovery sync
+            SSInfo reps[MAX_SS]; int rep_count = 0;
             pthread_mutex_lock(&nm_mutex);
             for (int i = 0; i < ss_count; i++) {
-                if (!sss[i].is_primary && strcmp(sss[i].replica_of, ss_copy.ss_id) == 0) {
-                    // Send async replication request (non-blocking)
-                    int rep_fd = net_connect(sss[i].ip, sss[i].admin_port);
-                    if (rep_fd >= 0) {
-                        char rep_log[256];
-                        snprintf(rep_log, sizeof(rep_log), "REPLICATE_FILE %s target_ss=%s", fname, sss[i].ss_id);
-                        log_write("NM", "REPLICATE_FILE", ss_copy.ss_id, rep_log, 0);
-                        net_send_line(rep_fd, cmd);
-                        net_close(rep_fd);  // Don't wait for response
-                    }
-                }
+                if (!sss[i].is_primary && strcmp(sss[i].replica_of, ss_copy.ss_id) == 0) reps[rep_count++] = sss[i];
             }
             pthread_mutex_unlock(&nm_mutex);
+            for (int i = 0; i < rep_count; i++) {
+                char rep_log[256];
+                snprintf(rep_log, sizeof(rep_log), "REPLICATE_FILE %s target_ss=%s", fname, reps[i].ss_id);
+                log_write("NM", "REPLICATE_FILE", ss_copy.ss_id, rep_log, 0);
+            }
+            ss_admin_fanout(reps, rep_count, cmd);
             // record file
             pthread_mutex_lock(&nm_mutex);
             if (files_count < MAX_FILES) {
@@ -702,24 +1058,27 @@ static void* handle_client(void *arg) {
             if (!has_access) { char access_log[512]; snprintf(access_log, sizeof(access_log), "file=%s IP=%s Port=%u error=NO_ACCESS", fname, client_ip, client_port); log_write("NM", "READ", user, access_log, ERR_NO_ACCESS); net_send_line(cfd, errcode_to_string(ERR_NO_ACCESS)); continue; }
             char read_ok_log[512]; snprintf(read_ok_log, sizeof(read_ok_log), "file=%s IP=%s Port=%u SS=%s:%u", fname, client_ip, client_port, ss_ip, ss_port); log_write("NM", "READ", user, read_ok_log, 0);
             char file_loc_log[256]; snprintf(file_loc_log, sizeof(file_loc_log), "GET_FILE_LOCATION file=%s SS=%s:%u", fname, ss_ip, ss_port); log_write("NM", "GET_FILE_LOCATION", user, file_loc_log, 0);
-            // Update last access time
+            // Update last access time (in memory; it is saved with the
+            // next change that persists the metadata)
             pthread_mutex_lock(&nm_mutex);
             if (idx >= 0) {
                 files[idx].last_access_time = time(NULL);
-                save_metadata();
             }
             pthread_mutex_unlock(&nm_mutex);
 
             // Tell client how to reach SS (simple inline for now)
             char buf[256]; snprintf(buf, sizeof(buf), "SS %s %u", ss_ip, ss_port);
             net_send_line(cfd, buf);
-        } else if (strncmp(line, "WRITE ", 6) == 0) {
+        } else if (strncmp(line, "WRITE ", 6) == 0 || strncmp(line, "LIVE ", 5) == 0) {
+            // LIVE <file> (a live session) needs the same access as WRITE
             if (user[0] == '\0') { net_send_line(cfd, "ERR please LOGIN first"); continue; }
+            int live = line[0] == 'L';
+            const char *op = live ? "LIVE" : "WRITE";
             char fname[256]; int sidx=-1;
-            if (sscanf(line+6, "%255s %d", fname, &sidx) < 2) { net_send_line(cfd, "ERR bad args"); continue; }
+            if (live ? sscanf(line+5, "%255s", fname) < 1 : sscanf(line+6, "%255s %d", fname, &sidx) < 2) { net_send_line(cfd, "ERR bad args"); continue; }
             pthread_mutex_lock(&nm_mutex);
             int idx = find_file_index(fname);
-            if (idx<0){ pthread_mutex_unlock(&nm_mutex); char write_err_log[512]; snprintf(write_err_log, sizeof(write_err_log), "file=%s IP=%s Port=%u error=NOT_FOUND", fname, client_ip, client_port); log_write("NM", "WRITE", user, write_err_log, ERR_FILE_NOT_FOUND); net_send_line(cfd, errcode_to_string(ERR_FILE_NOT_FOUND)); continue; }
+            if (idx<0){ pthread_mutex_unlock(&nm_mutex); char write_err_log[512]; snprintf(write_err_log, sizeof(write_err_log), "file=%s IP=%s Port=%u error=NOT_FOUND", fname, client_ip, client_port); log_write("NM", op, user, write_err_log, ERR_FILE_NOT_FOUND); net_send_line(cfd, errcode_to_string(ERR_FILE_NOT_FOUND)); continue; }
             // write access: owner or writers list (case-insensitive)
             int has_write = 0;
             if (strcasecmp_safe(files[idx].owner, user)==0) {
@@ -734,7 +1093,7 @@ static void* handle_client(void *arg) {
             }
             if (!has_write) {
                 pthread_mutex_unlock(&nm_mutex);
-                char write_noaccess_log[512]; snprintf(write_noaccess_log, sizeof(write_noaccess_log), "file=%s IP=%s Port=%u error=NO_WRITE_ACCESS", fname, client_ip, client_port); log_write("NM", "WRITE", user, write_noaccess_log, ERR_NO_WRITE_ACCESS);
+                char write_noaccess_log[512]; snprintf(write_noaccess_log, sizeof(write_noaccess_log), "file=%s IP=%s Port=%u error=NO_WRITE_ACCESS", fname, client_ip, client_port); log_write("NM", op, user, write_noaccess_log, ERR_NO_WRITE_ACCESS);
                 net_send_line(cfd, errcode_to_string(ERR_NO_WRITE_ACCESS));
                 continue;
             }
@@ -744,7 +1103,7 @@ static void* handle_client(void *arg) {
             }
             pthread_mutex_unlock(&nm_mutex);
             save_metadata();  // Persist the updated timestamp
-            char write_ok_log[512]; snprintf(write_ok_log, sizeof(write_ok_log), "file=%s IP=%s Port=%u SS=%s:%u", fname, client_ip, client_port, ss_ip, ss_port); log_write("NM", "WRITE", user, write_ok_log, 0);
+            char write_ok_log[512]; snprintf(write_ok_log, sizeof(write_ok_log), "file=%s IP=%s Port=%u SS=%s:%u", fname, client_ip, client_port, ss_ip, ss_port); log_write("NM", op, user, write_ok_log, 0);
             char file_loc_log2[256]; snprintf(file_loc_log2, sizeof(file_loc_log2), "GET_FILE_LOCATION file=%s SS=%s:%u", fname, ss_ip, ss_port); log_write("NM", "GET_FILE_LOCATION", user, file_loc_log2, 0);
             char buf[256]; snprintf(buf, sizeof(buf), "SS %s %u", ss_ip, ss_port);
             net_send_line(cfd, buf);
@@ -813,40 +1172,46 @@ static void* handle_client(void *arg) {
             pthread_mutex_unlock(&nm_mutex);
             if (!found_ss) { net_send_line(cfd, "ERR storage server unavailable"); continue; }
             // fetch file content from SS admin
-            int sfd = net_connect(ss_ip, admin_port);
-            if (sfd<0){ net_send_line(cfd, "ERR SS not reachable"); continue; }
-            char cmd[512]; snprintf(cmd, sizeof(cmd), "FETCH %s", fname);
-            net_send_line(sfd, cmd);
-            char r[1024]; if (net_recv_line(sfd, r, sizeof(r))<=0) { net_close(sfd); net_send_line(cfd, "ERR SS no response"); continue; }
-            int used_admin = 1;
-            if (strcmp(r, "BEGIN")!=0) {
+            char *script = NULL; int script_len = 0;
+            char r[1024];
+            int frc = ss_fetch_file(ss_ip, admin_port, fname, &script, &script_len, r, sizeof(r));
+            if (frc == -1) { net_send_line(cfd, "ERR SS not reachable"); continue; }
+            if (frc == -2) { net_send_line(cfd, "ERR SS no response"); continue; }
+            if (frc == 1) {
                 // Fallback: use client READ if admin lacks FETCH
-                net_close(sfd); used_admin = 0;
-                int c2 = net_connect(ss_ip, client_port_ss);
+                int c2 = net_connect_timeout(ss_ip, client_port_ss, ss_connect_timeout_ms);
                 if (c2<0){ net_send_line(cfd, r); continue; }
-                char w[256]; net_recv_line(c2, w, sizeof(w)); // welcome (may or may not be sent)
+                net_set_io_timeouts(c2, ss_timeout_ms, ss_timeout_ms);
+                NetConn *c2conn = net_conn_open(c2);
+                if (!c2conn) { net_close(c2); net_send_line(cfd, "ERR system error"); continue; }
+                char w[256]; net_conn_recv_line(c2conn, w, sizeof(w)); // welcome (may or may not be sent)
                 char rcmd[512]; snprintf(rcmd, sizeof(rcmd), "READ %s", fname);
                 net_send_line(c2, rcmd);
-                if (net_recv_line(c2, r, sizeof(r))<=0) { net_close(c2); net_send_line(cfd, "ERR SS no response"); continue; }
-                if (strncmp(r, "OK", 2)!=0) { net_close(c2); net_send_line(cfd, r); continue; }
+                if (net_conn_recv_line(c2conn, r, sizeof(r))<=0) { net_conn_close(c2conn); net_send_line(cfd, "ERR SS no response"); continue; }
+                if (strncmp(r, "OK", 2)!=0) { net_conn_close(c2conn); net_send_line(cfd, r); continue; }
                 // receive content - treat whole file as bash script
-                char content[1<<16]; content[0]='\0';
                 // Read multiple lines until END or connection close
-                char linebuf[1024]; int first_line = 1;
-                while (net_recv_line(c2, linebuf, sizeof(linebuf)) > 0) {
+                NetSendBuf text; net_sendbuf_init(&text, -1);
+                char *linebuf; int first_line = 1;
+                while (net_conn_next_line(c2conn, &linebuf) > 0) {
                     if (strcmp(linebuf, "END") == 0) break;
                     // Some SS client implementations prefix lines with "L ". Strip it if present.
                     char *p = linebuf;
                     if (p[0] == 'L' && p[1] == ' ') p += 2;
-                    if (!first_line) {
-                        strncat(content, "\n", sizeof(content) - strlen(content) - 1);
-                    }
+                    if (!first_line) net_sendbuf_append(&text, "\n", 1);
                     first_line = 0;
-                    strncat(content, p, sizeof(content) - strlen(content) - 1);
+                    net_sendbuf_append(&text, p, (int)strlen(p));
+                }
+                net_conn_close(c2conn);
+                net_sendbuf_append(&text, "", 1);
+                if (text.err || text.len <= 1) {
+                    net_send_line(cfd, text.err ? "ERR system error" : "ERR empty");
+                    net_sendbuf_free(&text);
+                    continue;
                 }
-                net_close(c2);
-                if (content[0] == '\0') { net_send_line(cfd, "ERR empty"); continue; }
+                char *content = text.buf;
                 if (!exec_command_allowed(content)) {
+                    net_sendbuf_free(&text);
                     net_send_line(cfd, "ERR EXEC blocked; allowed commands: echo/ls/pwd (start NM with --exec-allow to override)");
                     continue;
                 }
@@ -876,22 +1241,13 @@ static void* handle_client(void *arg) {
                     }
                     remove(tmp_script);
                 }
+                net_sendbuf_free(&text);
                 net_send_line(cfd, "END");
                 continue;
             }
-            // assemble lines
-            char script[1<<16]; script[0]='\0'; int first = 1;
-            while (1) {
-                if (net_recv_line(sfd, r, sizeof(r))<=0) { break; }
-                if (strcmp(r, "END")==0) break;
-                if (r[0]=='L' && r[1]==' ') {
-                    if (!first) strncat(script, "\n", sizeof(script)-strlen(script)-1); first=0;
-                    strncat(script, r+2, sizeof(script)-strlen(script)-1);
-                }
-            }
-            net_close(sfd);
             // Treat whole script as bash script - write to temp file and execute
             if (!exec_command_allowed(script)) {
+                free(script);
                 net_send_line(cfd, "ERR EXEC blocked; allowed commands: echo/ls/pwd (start NM with --exec-allow to override)");
                 continue;
             }
@@ -899,7 +1255,7 @@ static void* handle_client(void *arg) {
             char tmp_script[512]; snprintf(tmp_script, sizeof(tmp_script), "nm_exec_tmp.sh");
             FILE *tf = fopen(tmp_script, "w");
             if (tf) {
-                fputs(script, tf);
+                fwrite(script, 1, script_len, tf);
                 fclose(tf);
 #ifdef _WIN32
                 FILE *pp = _popen("cmd /c nm_exec_tmp.sh", "r");
@@ -920,6 +1276,7 @@ static void* handle_client(void *arg) {
                 }
                 remove(tmp_script);
             }
+            free(script);
             net_send_line(cfd, "END");
         } else if (strncmp(line, "INFO ", 5) == 0) {
             char *fname = line+5; if (*fname=='\0'){ net_send_line(cfd, errcode_to_string(ERR_INVALID_ARGS)); continue; }
@@ -932,7 +1289,6 @@ static void* handle_client(void *arg) {
             pthread_mutex_unlock(&nm_mutex);
             if (idx<0){ char info_err_log[512]; snprintf(info_err_log, sizeof(info_err_log), "file=%s IP=%s Port=%u error=NOT_FOUND", fname, client_ip, client_port); log_write("NM", "INFO", user, info_err_log, ERR_FILE_NOT_FOUND); net_send_line(cfd, errcode_to_string(ERR_FILE_NOT_FOUND)); continue; }
             char info_ok_log[512]; snprintf(info_ok_log, sizeof(info_ok_log), "file=%s IP=%s Port=%u", fname, client_ip, client_port); log_write("NM", "INFO", user, info_ok_log, 0);
-            save_metadata();  // Persist the updated timestamp
             // Find active SS for this file (primary or replica)
             char ss_ip[64]; uint16_t admin_port = 0;
             pthread_mutex_lock(&nm_mutex);
@@ -966,12 +1322,10 @@ static void* handle_client(void *arg) {
             pthread_mutex_unlock(&nm_mutex);
             if (!found_ss) { net_send_line(cfd, "ERR storage server unavailable"); continue; }
             // ask SS for info
-            int sfd = net_connect(ss_ip, admin_port);
-            if (sfd<0){ net_send_line(cfd, "ERR SS not reachable"); continue; }
             char cmd[512]; snprintf(cmd, sizeof(cmd), "INFO %s", fname);
-            net_send_line(sfd, cmd);
-            char resp[512]; if (net_recv_line(sfd, resp, sizeof(resp)) <= 0) { net_close(sfd); net_send_line(cfd, "ERR SS no response"); continue; }
-            net_close(sfd);
+            char resp[512]; int arc = ss_admin_call(ss_ip, admin_port, cmd, resp, sizeof(resp));
+            if (arc == -1) { net_send_line(cfd, "ERR SS not reachable"); continue; }
+            if (arc != 0) { net_send_line(cfd, "ERR SS no response"); continue; }
             // resp: SIZE <bytes> WORDS <words> CHARS <chars>
             long size=0; int words=0, chars=0;
             sscanf(resp, "SIZE %ld WORDS %d CHARS %d", &size, &words, &chars);
@@ -1057,22 +1411,18 @@ static void* handle_client(void *arg) {
             
             if (!found_ss) { net_send_line(cfd, "ERR storage server for file not found or inactive"); continue; }
             
-            // Check if file is locked (WRITE in progress) - use separate connection
-            int check_fd = net_connect(ss_copy.ip, ss_copy.admin_port);
-            if (check_fd<0){ net_send_line(cfd, "ERR SS not reachable"); continue; }
+            // Check if file is locked (WRITE in progress)
             char check_cmd[512]; snprintf(check_cmd, sizeof(check_cmd), "CHECKLOCK %s", fname_copy);
-            net_send_line(check_fd, check_cmd);
-            char lock_resp[256]; if (net_recv_line(check_fd, lock_resp, sizeof(lock_resp)) <= 0) { net_close(check_fd); net_send_line(cfd, "ERR SS no response"); continue; }
-            net_close(check_fd);  // Close CHECKLOCK connection (SS closes after one command)
+            char lock_resp[256]; int lrc = ss_admin_call(ss_copy.ip, ss_copy.admin_port, check_cmd, lock_resp, sizeof(lock_resp));
+            if (lrc == -1) { net_send_line(cfd, "ERR SS not reachable"); continue; }
+            if (lrc != 0) { net_send_line(cfd, "ERR SS no response"); continue; }
             if (strncmp(lock_resp, "ERR", 3)==0) { net_send_line(cfd, "ERR file is locked for writing"); continue; }
-            // File is not locked, proceed with deletion - use new connection
-            int sfd = net_connect(ss_copy.ip, ss_copy.admin_port);
-            if (sfd<0){ net_send_line(cfd, "ERR SS not reachable"); continue; }
+            // File is not locked, proceed with deletion
             char cmd[512]; snprintf(cmd, sizeof(cmd), "DELETE %s", fname_copy);
             log_write("NM", "SS_DELETE", ss_copy.ss_id, fname_copy, 0);
-            net_send_line(sfd, cmd);
-            char resp[512]; if (net_recv_line(sfd, resp, sizeof(resp)) <= 0) { net_close(sfd); net_send_line(cfd, "ERR SS no response"); continue; }
-            net_close(sfd);
+            char resp[512]; int arc = ss_admin_call(ss_copy.ip, ss_copy.admin_port, cmd, resp, sizeof(resp));
+            if (arc == -1) { net_send_line(cfd, "ERR SS not reachable"); continue; }
+            if (arc != 0) { net_send_line(cfd, "ERR SS no response"); continue; }
             if (strncmp(resp, "OK", 2)!=0) { net_send_line(cfd, resp); continue; }
             
             // remove from table
@@ -1094,7 +1444,9 @@ static void* handle_client(void *arg) {
             char ok[256]; snprintf(ok, sizeof(ok), "OK File '%s' deleted successfully!", fname_copy); net_send_line(cfd, ok);
         } else if (strncmp(line, "UNDO ", 5) == 0) {
             if (user[0] == '\0') { net_send_line(cfd, "ERR please LOGIN first"); continue; }
-            char *fname = line+5;
+            // UNDO <file> [n]: step back n versions (default 1)
+            char fname[256]; int steps = 1;
+            if (sscanf(line+5, "%255s %d", fname, &steps) < 1 || steps < 1) { net_send_line(cfd, "ERR bad args"); continue; }
             pthread_mutex_lock(&nm_mutex);
             int idx = find_file_index(fname);
             if (idx<0){ pthread_mutex_unlock(&nm_mutex); log_write("NM", "UNDO", user, fname, ERR_FILE_NOT_FOUND); net_send_line(cfd, errcode_to_string(ERR_FILE_NOT_FOUND)); continue; }
@@ -1141,12 +1493,10 @@ static void* handle_client(void *arg) {
             }
             pthread_mutex_unlock(&nm_mutex);
             if (!found_ss) { net_send_line(cfd, "ERR storage server unavailable"); continue; }
-            int sfd = net_connect(ss_ip, admin_port);
-            if (sfd<0){ net_send_line(cfd, "ERR SS not reachable"); continue; }
-            char cmd[512]; snprintf(cmd, sizeof(cmd), "UNDO %s", fname);
-            net_send_line(sfd, cmd);
-            char resp[256]; if (net_recv_line(sfd, resp, sizeof(resp))<=0) { net_close(sfd); net_send_line(cfd, "ERR SS no response"); continue; }
-            net_close(sfd);
+            char cmd[512]; snprintf(cmd, sizeof(cmd), "UNDO %s %d", fname, steps);
+            char resp[256]; int arc = ss_admin_call(ss_ip, admin_port, cmd, resp, sizeof(resp));
+            if (arc == -1) { net_send_line(cfd, "ERR SS not reachable"); continue; }
+            if (arc != 0) { net_send_line(cfd, "ERR SS no response"); continue; }
             if (strncmp(resp, "OK", 2)==0) net_send_line(cfd, "OK Undo Successful!"); else net_send_line(cfd, resp);
         } else if (strncmp(line, "ADDACCESS ", 10)==0) {
             if (user[0] == '\0') { net_send_line(cfd, "ERR please LOGIN first"); continue; }
@@ -1236,12 +1586,10 @@ static void* handle_client(void *arg) {
             }
             pthread_mutex_unlock(&nm_mutex);
             if (!found_ss) { net_send_line(cfd, "ERR storage server unavailable"); continue; }
-            int sfd = net_connect(ss_ip, admin_port);
-            if (sfd<0){ net_send_line(cfd, "ERR SS not reachable"); continue; }
             char cmd[512]; snprintf(cmd, sizeof(cmd), "CHECKPOINT %s %s", fname, tag);
-            net_send_line(sfd, cmd);
-            char resp[256]; if (net_recv_line(sfd, resp, sizeof(resp))<=0) { net_close(sfd); net_send_line(cfd, "ERR SS no response"); continue; }
-            net_close(sfd);
+            char resp[256]; int arc = ss_admin_call(ss_ip, admin_port, cmd, resp, sizeof(resp));
+            if (arc == -1) { net_send_line(cfd, "ERR SS not reachable"); continue; }
+            if (arc != 0) { net_send_line(cfd, "ERR SS no response"); continue; }
             if (strncmp(resp, "OK", 2)==0) net_send_line(cfd, "OK Checkpoint created successfully!"); else net_send_line(cfd, resp);
         } else if (strncmp(line, "VIEWCHECKPOINT ", 15)==0) {
             char fname[256], tag[64];
@@ -1283,52 +1631,64 @@ static void* handle_client(void *arg) {
             }
             pthread_mutex_unlock(&nm_mutex);
             if (!found_ss) { net_send_line(cfd, "ERR storage server unavailable"); continue; }
-            int sfd = net_connect(ss_ip, admin_port);
-            if (sfd<0){ net_send_line(cfd, "ERR SS not reachable"); continue; }
+            PooledConn *spc = conn_pool_acquire(ss_pool, ss_ip, admin_port);
+            if (!spc){ net_send_line(cfd, "ERR SS not reachable"); continue; }
+            NetConn *sconn = spc->conn;
+            int frames = spc->frames, sconn_ok = 1;
             char cmd[512]; snprintf(cmd, sizeof(cmd), "VIEWCHECKPOINT %s %s", fname, tag);
-            net_send_line(sfd, cmd);
+            net_send_line(sconn->fd, cmd);
             char resp[4096]; 
-            if (net_recv_line(sfd, resp, sizeof(resp))<=0) { 
-                net_close(sfd); 
+            if (net_conn_recv_line_timeout(sconn, resp, sizeof(resp), ss_timeout_ms)<=0) { 
+                conn_pool_release(ss_pool, spc, 0); 
                 net_send_line(cfd, "ERR SS no response"); 
                 continue; 
             }
             if (strncmp(resp, "OK", 2)==0) {
-                // Read the content from SS (SS sends content as one line after "OK", but it may contain \n characters)
-                char content[8192];
-                if (net_recv_line(sfd, content, sizeof(content)) > 0) {
+                // Frame mode carries the whole checkpoint; line mode only gets
+                // the first line of it (SS sends the file as a single "line")
+                char line_content[8192];
+                char *content = NULL; int content_len = 0;
+                if (frames) {
+                    if (net_conn_recv_payload(sconn, &content, &content_len) != 0) { content = NULL; sconn_ok = 0; }
+                } else if (net_conn_recv_line(sconn, line_content, sizeof(line_content)) > 0) {
+                    content = line_content;
+                } else {
+                    sconn_ok = 0;
+                }
+                NetSendBuf batch; net_sendbuf_init(&batch, cfd);
+                if (content && content[0]) {
                     // Split content by newlines and send each line to client
                     char *p = content;
                     int has_content = 0;
                     while (*p) {
-                        char line[4096];
-                        int i = 0;
                         // Read until newline or end of string
-                        while (*p && *p != '\n' && *p != '\r' && i < sizeof(line) - 1) {
-                            line[i++] = *p++;
-                        }
-                        line[i] = '\0';
+                        int i = (int)strcspn(p, "\r\n");
                         if (i > 0) {
-                            net_send_line(cfd, line);
+                            net_sendbuf_append(&batch, p, i);
+                            net_sendbuf_append(&batch, "\n", 1);
                             has_content = 1;
                         }
+                        p += i;
                         // Skip newline characters
                         while (*p == '\n' || *p == '\r') p++;
                     }
                     if (!has_content) {
                         // Empty checkpoint
-                        net_send_line(cfd, "");
+                        net_sendbuf_line(&batch, "");
                     }
                 } else {
                     // Empty checkpoint
-                    net_send_line(cfd, "");
+                    net_sendbuf_line(&batch, "");
                 }
-                net_send_line(cfd, "END");
+                if (content != line_content) free(content);
+                net_sendbuf_line(&batch, "END");
+                net_sendbuf_flush(&batch);
+                net_sendbuf_free(&batch);
             } else {
                 // Error from SS
                 net_send_line(cfd, resp);
             }
-            net_close(sfd);
+            conn_pool_release(ss_pool, spc, sconn_ok);
         } else if (strncmp(line, "REVERT ", 7)==0) {
             char fname[256], tag[64];
             if (sscanf(line+7, "%255s %63s", fname, tag) != 2) { net_send_line(cfd, errcode_to_string(ERR_INVALID_ARGS)); continue; }
@@ -1369,16 +1729,16 @@ static void* handle_client(void *arg) {
             }
             pthread_mutex_unlock(&nm_mutex);
             if (!found_ss) { net_send_line(cfd, "ERR storage server unavailable"); continue; }
-            int sfd = net_connect(ss_ip, admin_port);
-            if (sfd<0){ net_send_line(cfd, "ERR SS not reachable"); continue; }
             char cmd[512]; snprintf(cmd, sizeof(cmd), "REVERT %s %s", fname, tag);
-            net_send_line(sfd, cmd);
-            char resp[256]; if (net_recv_line(sfd, resp, sizeof(resp))<=0) { net_close(sfd); net_send_line(cfd, "ERR SS no response"); continue; }
-            net_close(sfd);
+            char resp[256]; int arc = ss_admin_call(ss_ip, admin_port, cmd, resp, sizeof(resp));
+            if (arc == -1) { net_send_line(cfd, "ERR SS not reachable"); continue; }
+            if (arc != 0) { net_send_line(cfd, "ERR SS no response"); continue; }
             if (strncmp(resp, "OK", 2)==0) net_send_line(cfd, "OK File reverted successfully!"); else net_send_line(cfd, resp);
         } else if (strncmp(line, "LISTCHECKPOINTS ", 16)==0) {
-            char fname[256];
-            if (sscanf(line+16, "%255s", fname) != 1) { net_send_line(cfd, errcode_to_string(ERR_INVALID_ARGS)); continue; }
+            // LISTCHECKPOINTS <file> [SORT ...] [DESC] [OFFSET n] [LIMIT n]:
+            // the options go to the SS as they are
+            char fname[256]; int consumed = 0;
+            if (sscanf(line+16, "%255s%n", fname, &consumed) != 1) { net_send_line(cfd, errcode_to_string(ERR_INVALID_ARGS)); continue; }
             pthread_mutex_lock(&nm_mutex);
             int idx = find_file_index(fname);
             pthread_mutex_unlock(&nm_mutex);
@@ -1416,17 +1776,21 @@ static void* handle_client(void *arg) {
             }
             pthread_mutex_unlock(&nm_mutex);
             if (!found_ss) { net_send_line(cfd, "ERR storage server unavailable"); continue; }
-            int sfd = net_connect(ss_ip, admin_port);
-            if (sfd<0){ net_send_line(cfd, "ERR SS not reachable"); continue; }
-            char cmd[512]; snprintf(cmd, sizeof(cmd), "LISTCHECKPOINTS %s", fname);
-            net_send_line(sfd, cmd);
+            PooledConn *spc = conn_pool_acquire(ss_pool, ss_ip, admin_port);
+            if (!spc){ net_send_line(cfd, "ERR SS not reachable"); continue; }
+            char cmd[768]; snprintf(cmd, sizeof(cmd), "LISTCHECKPOINTS %s%.200s", fname, line+16+consumed);
+            net_send_line(spc->conn->fd, cmd);
             char resp[512];
+            int complete = 0;
+            NetSendBuf batch; net_sendbuf_init(&batch, cfd);
             while (1) {
-                if (net_recv_line(sfd, resp, sizeof(resp))<=0) break;
-                net_send_line(cfd, resp);
-                if (strcmp(resp, "END")==0) break;
+                if (net_conn_recv_line(spc->conn, resp, sizeof(resp))<=0) break;
+                net_sendbuf_line(&batch, resp);
+                if (strcmp(resp, "END")==0 || strncmp(resp, "ERR", 3)==0) { complete = 1; break; }
             }
-            net_close(sfd);
+            net_sendbuf_flush(&batch);
+            net_sendbuf_free(&batch);
+            conn_pool_release(ss_pool, spc, complete);
         } else if (strncmp(line, "CREATEFOLDER ", 13)==0) {
             if (user[0] == '\0') { net_send_line(cfd, "ERR please LOGIN first"); continue; }
             char *fname = line+13;
@@ -1462,27 +1826,20 @@ static void* handle_client(void *arg) {
             if (!found_ss) { pthread_mutex_unlock(&nm_mutex); net_send_line(cfd, "ERR no active storage server"); goto cont; }
             pthread_mutex_unlock(&nm_mutex);
             // ask SS admin to create folder
-            int sfd = net_connect(ss_copy.ip, ss_copy.admin_port);
-            if (sfd < 0) { net_send_line(cfd, "ERR cannot reach storage server"); goto cont; }
             char cmd[512]; snprintf(cmd, sizeof(cmd), "CREATEFOLDER %s", fname);
-            net_send_line(sfd, cmd);
-            char resp[512]; if (net_recv_line(sfd, resp, sizeof(resp)) <= 0) { net_close(sfd); net_send_line(cfd, "ERR SS no response"); goto cont; }
-            net_close(sfd);
+            char resp[512]; int arc = ss_admin_call(ss_copy.ip, ss_copy.admin_port, cmd, resp, sizeof(resp));
+            if (arc == -1) { net_send_line(cfd, "ERR cannot reach storage server"); goto cont; }
+            if (arc != 0) { net_send_line(cfd, "ERR SS no response"); goto cont; }
             if (strncmp(resp, "OK", 2) != 0) { net_send_line(cfd, resp); goto cont; }
             
-            // Async replication to replicas (don't wait for response)
+            // Replicate to replicas; failures are repaired by recovery sync
+            SSInfo reps[MAX_SS]; int rep_count = 0;
             pthread_mutex_lock(&nm_mutex);
             for (int i = 0; i < ss_count; i++) {
-                if (!sss[i].is_primary && strcmp(sss[i].replica_of, ss_copy.ss_id) == 0) {
-                    // Send async replication request (non-blocking)
-                    int rep_fd = net_connect(sss[i].ip, sss[i].admin_port);
-                    if (rep_fd >= 0) {
-                        net_send_line(rep_fd, cmd);
-                        net_close(rep_fd);  // Don't wait for response
-                    }
-                }
+                if (!sss[i].is_primary && strcmp(sss[i].replica_of, ss_copy.ss_id) == 0) reps[rep_count++] = sss[i];
             }
             pthread_mutex_unlock(&nm_mutex);
+            ss_admin_fanout(reps, rep_count, cmd);
             // record folder
             pthread_mutex_lock(&nm_mutex);
             if (files_count < MAX_FILES) {
@@ -1568,17 +1925,14 @@ static void* handle_client(void *arg) {
             pthread_mutex_unlock(&nm_mutex);
             if (target_exists) { net_send_line(cfd, "ERR target exists"); continue; }
             // Move file on SS
-            int sfd = net_connect(ss_copy.ip, ss_copy.admin_port);
-            if (sfd>=0) {
-                char cmd[512]; snprintf(cmd, sizeof(cmd), "MOVE %s %s", fname, newpath);
-                net_send_line(sfd, cmd);
-                char resp[256]; 
-                if (net_recv_line(sfd, resp, sizeof(resp)) <= 0) {
-                    net_close(sfd);
-                    net_send_line(cfd, "ERR SS no response");
-                    continue;
-                }
-                net_close(sfd);
+            char cmd[512]; snprintf(cmd, sizeof(cmd), "MOVE %s %s", fname, newpath);
+            char resp[256];
+            int arc = ss_admin_call(ss_copy.ip, ss_copy.admin_port, cmd, resp, sizeof(resp));
+            if (arc == -2) {
+                net_send_line(cfd, "ERR SS no response");
+                continue;
+            }
+            if (arc == 0) {
                 if (strncmp(resp, "OK", 2)==0) {
                     pthread_mutex_lock(&nm_mutex);
                     remove_file_from_map(fname);
@@ -1612,14 +1966,20 @@ static void* handle_client(void *arg) {
             pthread_mutex_unlock(&nm_mutex);
             if (foldidx<0){ net_send_line(cfd, "ERR folder not found"); continue; }
             
-            net_send_line(cfd, "Contents of folder:");
-            display_folder_tree(cfd, foldername, "", 1, files, files_count);
-            net_send_line(cfd, "END");
+            NetSendBuf batch; net_sendbuf_init(&batch, cfd);
+            net_sendbuf_line(&batch, "Contents of folder:");
+            display_folder_tree(&batch, foldername, "", 1, files, files_count);
+            net_sendbuf_line(&batch, "END");
+            net_sendbuf_flush(&batch);
+            net_sendbuf_free(&batch);
         } else if (strcmp(line, "LIST")==0) {
             log_write("NM", "LIST", user, "", 0);
-            net_send_line(cfd, "USERS:");
-            for (int i=0;i<users_count;i++) { char out[128]; snprintf(out, sizeof(out), "--> %s", users[i]); net_send_line(cfd, out); }
-            net_send_line(cfd, "END");
+            NetSendBuf batch; net_sendbuf_init(&batch, cfd);
+            net_sendbuf_line(&batch, "USERS:");
+            for (int i=0;i<users_count;i++) { net_sendbuf_linef(&batch, "--> %s", users[i]); }
+            net_sendbuf_line(&batch, "END");
+            net_sendbuf_flush(&batch);
+            net_sendbuf_free(&batch);
         } else if (strncmp(line, "REQUESTACCESS ", 14)==0) {
             if (user[0] == '\0') { net_send_line(cfd, "ERR please LOGIN first"); continue; }
             char fname[256];
@@ -1738,6 +2098,7 @@ static void* handle_client(void *arg) {
             net_send_line(cfd, "OK Access request approved successfully!");
         } else if (strncmp(line, "LISTREQUESTS", 12)==0 || strncmp(line, "VIEWREQUESTS", 12)==0) {
             if (user[0] == '\0') { net_send_line(cfd, "ERR please LOGIN first"); continue; }
+            NetSendBuf batch; net_sendbuf_init(&batch, cfd);
             char fname[256] = "";
             // Optional: LISTREQUESTS <filename> or just LISTREQUESTS for all
             // Also support VIEWREQUESTS as alias
@@ -1756,7 +2117,7 @@ static void* handle_client(void *arg) {
                 int idx = find_file_index(access_requests[i].filename);
                 if (idx >= 0 && strcasecmp_safe(files[idx].owner, user)==0) {
                     if (count == 0) {
-                        net_send_line(cfd, "PENDING ACCESS REQUESTS:");
+                        net_sendbuf_line(&batch, "PENDING ACCESS REQUESTS:");
                     }
                     char out[512];
                     char time_str[64];
@@ -1764,19 +2125,21 @@ static void* handle_client(void *arg) {
                     snprintf(out, sizeof(out), "--> File: %s | User: %s | Type: %s | Requested: %s", 
                             access_requests[i].filename, access_requests[i].requesting_user, 
                             access_requests[i].access_type, time_str);
-                    net_send_line(cfd, out);
+                    net_sendbuf_line(&batch, out);
                     count++;
                 }
             }
             pthread_mutex_unlock(&nm_mutex);
             if (count == 0) {
                 if (fname[0] != '\0') {
-                    net_send_line(cfd, "No pending requests for this file.");
+                    net_sendbuf_line(&batch, "No pending requests for this file.");
                 } else {
-                    net_send_line(cfd, "No pending access requests.");
+                    net_sendbuf_line(&batch, "No pending access requests.");
                 }
             }
-            net_send_line(cfd, "END");
+            net_sendbuf_line(&batch, "END");
+            net_sendbuf_flush(&batch);
+            net_sendbuf_free(&batch);
         } else if (strncmp(line, "SEARCH ", 7)==0) {
             if (user[0] == '\0') { net_send_line(cfd, "ERR please LOGIN first"); continue; }
             char keyword[256];
@@ -1791,85 +2154,117 @@ static void* handle_client(void *arg) {
             char all_results[2048][512];
             int total_matches = 0;
             
+            // Snapshot the active servers, then query them without nm_mutex
+            // so a slow SS holds up only this search
+            typedef struct { char ip[64]; uint16_t port; } SearchTarget;
+            SearchTarget targets[MAX_SS];
+            int target_count = 0;
             pthread_mutex_lock(&nm_mutex);
-            // Query all active storage servers
-            for (int i = 0; i < ss_count && total_matches < 2048; i++) {
+            for (int i = 0; i < ss_count && target_count < MAX_SS; i++) {
                 if (!sss[i].is_active) continue;
-                
-                int sfd = net_connect(sss[i].ip, sss[i].admin_port);
-                if (sfd >= 0) {
-                    char cmd[512];
-                    snprintf(cmd, sizeof(cmd), "SEARCH %s", keyword);
-                    net_send_line(sfd, cmd);
-                    
-                    char resp[512];
-                    if (net_recv_line(sfd, resp, sizeof(resp)) > 0 && strncmp(resp, "OK", 2) == 0) {
-                        // Read file results until END
-                        while (total_matches < 2048) {
-                            if (net_recv_line(sfd, resp, sizeof(resp)) <= 0) break;
-                            if (strcmp(resp, "END") == 0) break;
-                            
-                            // Check if file exists in our metadata and user has access
-                            int file_idx = find_file_index(resp);
-                            if (file_idx >= 0) {
-                                // Check access permissions
-                                int has_access = 0;
-                                if (strcasecmp_safe(files[file_idx].owner, user) == 0) {
-                                    has_access = 1;  // owner
-                                } else {
-                                    // Check readers
-                                    for (int r = 0; r < files[file_idx].readers_count; r++) {
-                                        if (strcasecmp_safe(files[file_idx].readers[r], user) == 0) {
-                                            has_access = 1;
-                                            break;
-                                        }
-                                    }
-                                    // Check writers
-                                    if (!has_access) {
-                                        for (int w = 0; w < files[file_idx].writers_count; w++) {
-                                            if (strcasecmp_safe(files[file_idx].writers[w], user) == 0) {
-                                                has_access = 1;
-                                                break;
-                                            }
-                                        }
-                                    }
-                                }
-                                
-                                if (has_access) {
-                                    // Check for duplicates
-                                    int is_duplicate = 0;
-                                    for (int j = 0; j < total_matches; j++) {
-                                        if (strcmp(all_results[j], resp) == 0) {
-                                            is_duplicate = 1;
-                                            break;
-                                        }
-                                    }
-                                    if (!is_duplicate) {
-                                        strncpy(all_results[total_matches], resp, sizeof(all_results[total_matches])-1);
-                                        all_results[total_matches][sizeof(all_results[total_matches])-1] = '\0';
-                                        total_matches++;
-                                    }
-                                }
+                strncpy(targets[target_count].ip, sss[i].ip, sizeof(targets[target_count].ip)-1);
+                targets[target_count].ip[sizeof(targets[target_count].ip)-1] = '\0';
+                targets[target_count].port = sss[i].admin_port;
+                target_count++;
+            }
+            pthread_mutex_unlock(&nm_mutex);
+
+            // Ask every server at once over RPC; the reply is "OK", one
+            // name per line, "END"
+            char search_cmd[512];
+            snprintf(search_cmd, sizeof(search_cmd), "SEARCH %s", keyword);
+            RpcRequest reqs[MAX_SS];
+            memset(reqs, 0, sizeof(reqs));
+            for (int i = 0; i < target_count; i++) {
+                reqs[i].host = targets[i].ip;
+                reqs[i].port = targets[i].port;
+                reqs[i].cmd = search_cmd;
+            }
+            if (ss_rpc) rpc_call_batch(ss_rpc, reqs, target_count, ss_timeout_ms);
+            else for (int i = 0; i < target_count; i++) reqs[i].status = RPC_UNSUPPORTED;
+
+            for (int i = 0; i < target_count && total_matches < 2048; i++) {
+                if (reqs[i].status == RPC_OK) {
+                    char *save = NULL;
+                    char *ln = strtok_r(reqs[i].reply, "\n", &save);
+                    if (!ln || strncmp(ln, "OK", 2) != 0) continue;
+                    while ((ln = strtok_r(NULL, "\n", &save)) != NULL && total_matches < 2048) {
+                        if (strcmp(ln, "END") == 0) break;
+                        search_add_result(all_results, &total_matches, ln);
+                    }
+                    continue;
+                }
+                if (reqs[i].status == RPC_NO_RESPONSE) search_log_timeout(user, targets[i].ip, targets[i].port, keyword);
+                if (reqs[i].status != RPC_UNSUPPORTED) continue;
+                // No RPC on this server: plain pooled connection
+                PooledConn *spc = conn_pool_acquire(ss_pool, targets[i].ip, targets[i].port);
+                if (!spc) continue;
+                NetConn *sconn = spc->conn;
+                int complete = 0;
+                errno = 0;
+                net_send_line(sconn->fd, search_cmd);
+
+                char resp[512];
+                if (net_conn_recv_line_timeout(sconn, resp, sizeof(resp), ss_timeout_ms) > 0 && strncmp(resp, "OK", 2) == 0) {
+                    // Read file results until END
+                    while (total_matches < 2048) {
+                        if (net_conn_recv_line(sconn, resp, sizeof(resp)) <= 0) break;
+                        if (strcmp(resp, "END") == 0) { complete = 1; break; }
+                        search_add_result(all_results, &total_matches, resp);
+                    }
+                }
+                if (!complete && errno == ETIMEDOUT) search_log_timeout(user, targets[i].ip, targets[i].port, keyword);
+                conn_pool_release(ss_pool, spc, complete);
+            }
+            rpc_requests_free(reqs, target_count);
+
+            // Keep only files we know about and the user may read
+            pthread_mutex_lock(&nm_mutex);
+            int kept = 0;
+            for (int m = 0; m < total_matches; m++) {
+                int file_idx = find_file_index(all_results[m]);
+                if (file_idx < 0) continue;
+                int has_access = 0;
+                if (strcasecmp_safe(files[file_idx].owner, user) == 0) {
+                    has_access = 1;  // owner
+                } else {
+                    // Check readers
+                    for (int r = 0; r < files[file_idx].readers_count; r++) {
+                        if (strcasecmp_safe(files[file_idx].readers[r], user) == 0) {
+                            has_access = 1;
+                            break;
+                        }
+                    }
+                    // Check writers
+                    if (!has_access) {
+                        for (int w = 0; w < files[file_idx].writers_count; w++) {
+                            if (strcasecmp_safe(files[file_idx].writers[w], user) == 0) {
+                                has_access = 1;
+                                break;
                             }
                         }
                     }
-                    net_close(sfd);
                 }
+                if (!has_access) continue;
+                if (kept != m) memcpy(all_results[kept], all_results[m], sizeof(all_results[kept]));
+                kept++;
             }
             pthread_mutex_unlock(&nm_mutex);
+            total_matches = kept;
             
             // Send results to client
+            NetSendBuf batch; net_sendbuf_init(&batch, cfd);
             if (total_matches > 0) {
-                net_send_line(cfd, "SEARCH RESULTS:");
+                net_sendbuf_line(&batch, "SEARCH RESULTS:");
                 for (int i = 0; i < total_matches; i++) {
-                    char out[512];
-                    snprintf(out, sizeof(out), "--> %s", all_results[i]);
-                    net_send_line(cfd, out);
+                    net_sendbuf_linef(&batch, "--> %s", all_results[i]);
                 }
             } else {
-                net_send_line(cfd, "No files found containing the keyword.");
+                net_sendbuf_line(&batch, "No files found containing the keyword.");
             }
-            net_send_line(cfd, "END");
+            net_sendbuf_line(&batch, "END");
+            net_sendbuf_flush(&batch);
+            net_sendbuf_free(&batch);
         } else if (strcmp(line, "QUIT")==0) {
             net_send_line(cfd, "BYE"); break;
         } else {
@@ -1877,7 +2272,20 @@ static void* handle_client(void *arg) {
         }
         cont: ;
     }
-    net_close(cfd);
+    return end_session;
+}
+
+// Thread-per-connection mode: one thread owns the client for its lifetime
+static void* handle_client(void *arg) {
+    ClientSession *sess = (ClientSession*)arg;
+    char line[NM_CLIENT_LINE_MAX];
+    net_send_line(sess->cfd, "WELCOME Docs++ NM. Please LOGIN <username>");
+    while (1) {
+        int n = net_conn_recv_line(sess->conn, line, sizeof(line));
+        if (n <= 0) break;
+        if (handle_client_line(sess, line)) break;
+    }
+    client_session_close(sess);
     return NULL;  // Thread function must return void*
 }
 
@@ -1897,13 +2305,122 @@ static void* check_ss_failures(void *arg) {
                          sss[i].ss_id, (long)(now - sss[i].last_heartbeat));
                 log_write("NM", "SS_FAILURE", sss[i].ss_id, log_msg, 0);
                 printf("[WARNING] SS %s marked as failed\n", sss[i].ss_id);
+                conn_pool_drop_host(ss_pool, sss[i].ip, sss[i].admin_port);
+                rpc_client_drop_host(ss_rpc, sss[i].ip, sss[i].admin_port);
+            }
+        }
+        pthread_mutex_unlock(&nm_mutex);
+        // Close admin connections that sat idle past the timeout
+        conn_pool_reap(ss_pool);
+    }
+    return NULL;
+}
+
+typedef struct {
+    int ss_idx;
+    char ss_id[64];
+} SSRecoveryJob;
+
+// Push every file the recovered SS should hold back to it from a live
+// replica. Runs on its own thread so registration is answered immediately
+// and the NM's event loop and workers are never held up by a bulk resync.
+static void* ss_recovery_thread(void *arg) {
+    SSRecoveryJob *job = (SSRecoveryJob*)arg;
+    int reconnect_idx = job->ss_idx;
+    char ssid[64];
+    strncpy(ssid, job->ss_id, sizeof(ssid)-1);
+    ssid[sizeof(ssid)-1] = '\0';
+    free(job);
+    // Find all files that should be on this SS and sync them from replicas
+    pthread_mutex_lock(&nm_mutex);
+    if (reconnect_idx < 0 || reconnect_idx >= ss_count) {
+        pthread_mutex_unlock(&nm_mutex);
+        return NULL;
+    }
+    SSInfo recovered_ss_copy = sss[reconnect_idx];  // Make a copy
+    char recovered_ss_ip[64];
+    uint16_t recovered_admin_port = recovered_ss_copy.admin_port;
+    uint16_t recovered_client_port = recovered_ss_copy.client_port;
+    strncpy(recovered_ss_ip, recovered_ss_copy.ip, sizeof(recovered_ss_ip)-1);
+    recovered_ss_ip[sizeof(recovered_ss_ip)-1] = '\0';
+    char recovered_ss_id[64];
+    strncpy(recovered_ss_id, recovered_ss_copy.ss_id, sizeof(recovered_ss_id)-1);
+    recovered_ss_id[sizeof(recovered_ss_id)-1] = '\0';
+
+    // Collect files that should be on this SS
+    int files_to_sync[1024];
+    int sync_count = 0;
+    for (int i = 0; i < files_count && sync_count < 1024; i++) {
+        // Check if this file should be on the recovered SS
+        if (strcmp(files[i].ss_ip, recovered_ss_ip) == 0 && 
+            files[i].ss_client_port == recovered_client_port) {
+            files_to_sync[sync_count++] = i;
+        }
+    }
+    pthread_mutex_unlock(&nm_mutex);
+
+    // Sync each file from a replica
+    for (int sync_idx = 0; sync_idx < sync_count; sync_idx++) {
+        int file_idx = files_to_sync[sync_idx];
+        char fname[256];
+        pthread_mutex_lock(&nm_mutex);
+        if (file_idx >= 0 && file_idx < files_count) {
+            strncpy(fname, files[file_idx].filename, sizeof(fname)-1);
+            fname[sizeof(fname)-1] = '\0';
+        } else {
+            pthread_mutex_unlock(&nm_mutex);
+            continue;
+        }
+        pthread_mutex_unlock(&nm_mutex);
+
+        // Find an active replica that has this file
+        pthread_mutex_lock(&nm_mutex);
+        SSInfo replica_ss_copy = {0};
+        int found_replica = 0;
+        for (int i = 0; i < ss_count; i++) {
+            if (sss[i].is_active && !sss[i].is_primary && 
+                strcmp(sss[i].replica_of, recovered_ss_id) == 0) {
+                replica_ss_copy = sss[i];
+                found_replica = 1;
+                break;
+            }
+        }
+        // If no direct replica, find any active SS that might have the file
+        if (!found_replica) {
+            for (int i = 0; i < ss_count; i++) {
+                if (sss[i].is_active && i != reconnect_idx) {
+                    replica_ss_copy = sss[i];
+                    found_replica = 1;
+                    break;
+                }
             }
         }
         pthread_mutex_unlock(&nm_mutex);
+
+        if (found_replica) {
+            // Stream the file from the replica into the recovered SS; line-mode
+            // peers still go through a fetch into memory and a sync
+            if (ss_relay_file(replica_ss_copy.ip, replica_ss_copy.admin_port, recovered_ss_ip, recovered_admin_port, fname) == 1) {
+                char *file_content = NULL; int file_len = 0;
+                if (ss_fetch_file(replica_ss_copy.ip, replica_ss_copy.admin_port, fname, &file_content, &file_len, NULL, 0) == 0) {
+                    ss_sync_file(recovered_ss_ip, recovered_admin_port, fname, file_content, file_len);
+                    free(file_content);
+                }
+            }
+        }
     }
+
+    char sync_log[512];
+    snprintf(sync_log, sizeof(sync_log), "SS %s recovered, synchronized %d files", ssid, sync_count);
+    log_write("NM", "SS_RECOVERY", ssid, sync_log, 0);
     return NULL;
 }
 
+typedef struct {
+    int fd;
+    char ip[64];
+} SSRegisterJob;
+
 static void handle_ss_register(int cfd, const char *peer_ip) {
     // Expected: REGISTER <ss_id> <client_port>
     char ip[64];
@@ -1913,6 +2430,9 @@ static void handle_ss_register(int cfd, const char *peer_ip) {
         strncpy(ip, "127.0.0.1", sizeof(ip)-1);
     }
     ip[sizeof(ip)-1] = '\0';
+    // Runs on a worker: a peer that connects and says nothing gives it up
+    // after ss_timeout_ms
+    net_set_io_timeouts(cfd, ss_timeout_ms, ss_timeout_ms);
     char line[512];
     if (net_recv_line(cfd, line, sizeof(line)) <= 0) { net_close(cfd); return; }
     if (strncmp(line, "REGISTER ", 9) != 0) { net_send_line(cfd, "ERR bad register"); net_close(cfd); return; }
@@ -1921,6 +2441,12 @@ static void handle_ss_register(int cfd, const char *peer_ip) {
     char tmp_ip[64]="127.0.0.1";
     int matched = sscanf(line+9, "%63s %u %u %63s", ssid, &cp, &ap, tmp_ip);
     if (matched < 3) { net_send_line(cfd, "ERR bad args"); net_close(cfd); return; }
+    // Heartbeats append the SS admin queue counters: queue=<n> ... busy=<n>
+    int admin_queue = 0, admin_busy = 0;
+    const char *qs = strstr(line, " queue=");
+    if (qs) sscanf(qs, " queue=%d", &admin_queue);
+    const char *bs = strstr(line, " busy=");
+    if (bs) sscanf(bs, " busy=%d", &admin_busy);
     if (matched == 4) {
         strncpy(ip, tmp_ip, sizeof(ip)-1);
         ip[sizeof(ip)-1] = '\0';
@@ -1945,11 +2471,13 @@ static void handle_ss_register(int cfd, const char *peer_ip) {
             sss[i].admin_port = (uint16_t)ap;
             sss[i].last_heartbeat = time(NULL);
             sss[i].is_active = 1;
+            sss[i].admin_queue = admin_queue;
+            sss[i].admin_busy = admin_busy;
             found = 1;
             reconnect_idx = i;
             // Log heartbeat
-            char hb_log[128];
-            snprintf(hb_log, sizeof(hb_log), "SS %s heartbeat", ssid);
+            char hb_log[160];
+            snprintf(hb_log, sizeof(hb_log), "SS %s heartbeat admin_queue=%d admin_busy=%d", ssid, admin_queue, admin_busy);
             log_write("NM", "HEARTBEAT", ssid, hb_log, 0);
             break;
         }
@@ -1964,140 +2492,17 @@ static void handle_ss_register(int cfd, const char *peer_ip) {
         
         // Only perform recovery if SS was previously inactive (recovering from failure)
         if (was_inactive) {
-            // Perform synchronization in background (don't block registration)
-            // Find all files that should be on this SS and sync them from replicas
-            pthread_mutex_lock(&nm_mutex);
-            if (reconnect_idx < 0 || reconnect_idx >= ss_count) {
-                pthread_mutex_unlock(&nm_mutex);
-                return;
-            }
-            SSInfo recovered_ss_copy = sss[reconnect_idx];  // Make a copy
-        char recovered_ss_ip[64];
-        uint16_t recovered_admin_port = recovered_ss_copy.admin_port;
-        uint16_t recovered_client_port = recovered_ss_copy.client_port;
-        strncpy(recovered_ss_ip, recovered_ss_copy.ip, sizeof(recovered_ss_ip)-1);
-        recovered_ss_ip[sizeof(recovered_ss_ip)-1] = '\0';
-        char recovered_ss_id[64];
-        strncpy(recovered_ss_id, recovered_ss_copy.ss_id, sizeof(recovered_ss_id)-1);
-        recovered_ss_id[sizeof(recovered_ss_id)-1] = '\0';
-        
-        // Collect files that should be on this SS
-        int files_to_sync[1024];
-        int sync_count = 0;
-        for (int i = 0; i < files_count && sync_count < 1024; i++) {
-            // Check if this file should be on the recovered SS
-            if (strcmp(files[i].ss_ip, recovered_ss_ip) == 0 && 
-                files[i].ss_client_port == recovered_client_port) {
-                files_to_sync[sync_count++] = i;
-            }
-        }
-        pthread_mutex_unlock(&nm_mutex);
-        
-        // Sync each file from a replica
-        for (int sync_idx = 0; sync_idx < sync_count; sync_idx++) {
-            int file_idx = files_to_sync[sync_idx];
-            char fname[256];
-            pthread_mutex_lock(&nm_mutex);
-            if (file_idx >= 0 && file_idx < files_count) {
-                strncpy(fname, files[file_idx].filename, sizeof(fname)-1);
-                fname[sizeof(fname)-1] = '\0';
-            } else {
-                pthread_mutex_unlock(&nm_mutex);
-                continue;
-            }
-            pthread_mutex_unlock(&nm_mutex);
-            
-            // Find an active replica that has this file
-            pthread_mutex_lock(&nm_mutex);
-            SSInfo replica_ss_copy = {0};
-            int found_replica = 0;
-            for (int i = 0; i < ss_count; i++) {
-                if (sss[i].is_active && !sss[i].is_primary && 
-                    strcmp(sss[i].replica_of, recovered_ss_id) == 0) {
-                    replica_ss_copy = sss[i];
-                    found_replica = 1;
-                    break;
-                }
-            }
-            // If no direct replica, find any active SS that might have the file
-            if (!found_replica) {
-                for (int i = 0; i < ss_count; i++) {
-                    if (sss[i].is_active && i != reconnect_idx) {
-                        replica_ss_copy = sss[i];
-                        found_replica = 1;
-                        break;
-                    }
-                }
-            }
-            pthread_mutex_unlock(&nm_mutex);
-            
-            if (found_replica) {
-                // Fetch file from replica
-                int rep_fd = net_connect(replica_ss_copy.ip, replica_ss_copy.admin_port);
-                if (rep_fd >= 0) {
-                    char fetch_cmd[512];
-                    snprintf(fetch_cmd, sizeof(fetch_cmd), "FETCH %s", fname);
-                    net_send_line(rep_fd, fetch_cmd);
-                    
-                    char resp[1024];
-                    if (net_recv_line(rep_fd, resp, sizeof(resp)) > 0 && 
-                        strcmp(resp, "BEGIN") == 0) {
-                        // Read file content
-                        char file_content[65536] = "";
-                        int first_line = 1;
-                        while (1) {
-                            if (net_recv_line(rep_fd, resp, sizeof(resp)) <= 0) break;
-                            if (strcmp(resp, "END") == 0) break;
-                            // Skip "L " prefix if present
-                            char *content_line = resp;
-                            if (resp[0] == 'L' && resp[1] == ' ') {
-                                content_line = resp + 2;
-                            }
-                            if (!first_line) {
-                                strncat(file_content, "\n", sizeof(file_content) - strlen(file_content) - 1);
-                            }
-                            first_line = 0;
-                            strncat(file_content, content_line, sizeof(file_content) - strlen(file_content) - 1);
-                        }
-                        
-                        // Sync to recovered SS
-                        int sync_fd = net_connect(recovered_ss_ip, recovered_admin_port);
-                        if (sync_fd >= 0) {
-                            char sync_cmd[512];
-                            snprintf(sync_cmd, sizeof(sync_cmd), "SYNC %s", fname);
-                            net_send_line(sync_fd, sync_cmd);
-                            
-                            char sync_resp[256];
-                            if (net_recv_line(sync_fd, sync_resp, sizeof(sync_resp)) > 0 && 
-                                strncmp(sync_resp, "OK", 2) == 0) {
-                                // Send content line by line
-                                char *p = file_content;
-                                while (*p) {
-                                    char line[4096];
-                                    int i = 0;
-                                    while (*p && *p != '\n' && i < sizeof(line) - 1) {
-                                        line[i++] = *p++;
-                                    }
-                                    line[i] = '\0';
-                                    if (i > 0) {
-                                        net_send_line(sync_fd, line);
-                                    }
-                                    if (*p == '\n') p++;
-                                }
-                                net_send_line(sync_fd, "END");
-                                net_recv_line(sync_fd, sync_resp, sizeof(sync_resp));
-                            }
-                            net_close(sync_fd);
-                        }
-                    }
-                    net_close(rep_fd);
+            SSRecoveryJob *job = (SSRecoveryJob*)calloc(1, sizeof(SSRecoveryJob));
+            pthread_t rt;
+            if (job) {
+                job->ss_idx = reconnect_idx;
+                snprintf(job->ss_id, sizeof(job->ss_id), "%.*s", (int)sizeof(job->ss_id) - 1, ssid);
+                if (pthread_create(&rt, NULL, ss_recovery_thread, job) == 0) {
+                    pthread_detach(rt);
+                } else {
+                    ss_recovery_thread(job);
                 }
             }
-            }
-            
-            char sync_log[512];
-            snprintf(sync_log, sizeof(sync_log), "SS %s recovered, synchronized %d files", ssid, sync_count);
-            log_write("NM", "SS_RECOVERY", ssid, sync_log, 0);
         }
         return;  // Return after handling reconnection
     }
@@ -2113,6 +2518,8 @@ static void handle_ss_register(int cfd, const char *peer_ip) {
         sss[ss_count].replica_of[0] = '\0';
         sss[ss_count].last_heartbeat = time(NULL);
         sss[ss_count].is_active = 1;
+        sss[ss_count].admin_queue = admin_queue;
+        sss[ss_count].admin_busy = admin_busy;
         ss_count++;
         
         // Assign replica if we have multiple SS
@@ -2131,6 +2538,164 @@ static void handle_ss_register(int cfd, const char *peer_ip) {
     net_close(cfd);
 }
 
+static void* ss_register_thread(void *arg) {
+    SSRegisterJob *job = (SSRegisterJob*)arg;
+    handle_ss_register(job->fd, job->ip);
+    free(job);
+    return NULL;
+}
+
+// Legacy mode: select() on both listeners and one detached thread per
+// client connection. Kept for comparison with the reactor.
+static void serve_thread_per_conn(int cfd, int sfd) {
+    while (1) {
+        fd_set rfds; FD_ZERO(&rfds);
+        int maxfd = (cfd>sfd?cfd:sfd);
+        FD_SET(cfd, &rfds); FD_SET(sfd, &rfds);
+        struct timeval tv; tv.tv_sec=1; tv.tv_usec=0;
+        int rc = select(maxfd+1, &rfds, NULL, NULL, &tv);
+        if (rc <= 0) continue;
+        if (FD_ISSET(cfd, &rfds)) {
+            char ip[64] = "";
+            uint16_t p; int cl = net_accept(cfd, ip, sizeof(ip), &p);
+            if (cl >= 0) {
+                ClientSession *sess = client_session_open(cl, ip, p);
+                if (!sess) { net_close(cl); continue; }
+                // All threads share the same files array, users array, and SS list
+                pthread_t thread;
+                if (pthread_create(&thread, NULL, handle_client, sess) != 0) {
+                    // Thread creation failed, handle in main thread (fallback)
+                    handle_client(sess);
+                } else {
+                    pthread_detach(thread);  // Don't wait for thread to finish
+                }
+            }
+        }
+        if (FD_ISSET(sfd, &rfds)) {
+            char ip[64] = ""; uint16_t p; int sl = net_accept(sfd, ip, sizeof(ip), &p);
+            SSRegisterJob *job = sl >= 0 ? (SSRegisterJob*)calloc(1, sizeof(SSRegisterJob)) : NULL;
+            if (job) {
+                job->fd = sl;
+                snprintf(job->ip, sizeof(job->ip), "%.*s", (int)sizeof(job->ip) - 1, ip);
+                pthread_t thread;
+                if (pthread_create(&thread, NULL, ss_register_thread, job) != 0) {
+                    ss_register_thread(job);
+                } else {
+                    pthread_detach(thread);
+                }
+            } else if (sl >= 0) {
+                handle_ss_register(sl, ip);
+            }
+        }
+    }
+}
+
+#ifdef __linux__
+// Reactor mode: one epoll loop owns every socket. It reads whatever a
+// client sends into the client's NetConn and, once a full command line is
+// buffered, hands the session to the worker pool. Client sockets are
+// registered EPOLLONESHOT, so a session is either waiting in epoll or being
+// run by exactly one worker, never both; the worker re-arms it when done.
+static int nm_epfd = -1;
+static ThreadPool *nm_workers = NULL;
+static int nm_client_listener_tag;   // epoll data.ptr for the listeners
+static int nm_ss_listener_tag;
+
+static void reactor_drop(ClientSession *sess) {
+    epoll_ctl(nm_epfd, EPOLL_CTL_DEL, sess->cfd, NULL);
+    client_session_close(sess);
+}
+
+static void reactor_arm(ClientSession *sess, int op) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.ptr = sess;
+    if (epoll_ctl(nm_epfd, op, sess->cfd, &ev) != 0) {
+        if (op == EPOLL_CTL_MOD) epoll_ctl(nm_epfd, EPOLL_CTL_DEL, sess->cfd, NULL);
+        client_session_close(sess);
+    }
+}
+
+// Worker job: run every complete command buffered for this client, then
+// give the socket back to the reactor
+static void client_session_job(void *arg) {
+    ClientSession *sess = (ClientSession*)arg;
+    char line[NM_CLIENT_LINE_MAX];
+    while (net_conn_has_line(sess->conn, sizeof(line))) {
+        if (net_conn_recv_line(sess->conn, line, sizeof(line)) <= 0 ||
+            handle_client_line(sess, line)) {
+            reactor_drop(sess);
+            return;
+        }
+    }
+    reactor_arm(sess, EPOLL_CTL_MOD);
+}
+
+static void ss_register_job(void *arg) {
+    ss_register_thread(arg);
+}
+
+static void reactor_accept_client(int lfd) {
+    char ip[64] = "";
+    uint16_t p; int cl = net_accept(lfd, ip, sizeof(ip), &p);
+    if (cl < 0) return;
+    ClientSession *sess = client_session_open(cl, ip, p);
+    if (!sess) { net_close(cl); return; }
+    net_send_line(cl, "WELCOME Docs++ NM. Please LOGIN <username>");
+    reactor_arm(sess, EPOLL_CTL_ADD);
+}
+
+static void reactor_accept_ss(int lfd) {
+    char ip[64] = ""; uint16_t p; int sl = net_accept(lfd, ip, sizeof(ip), &p);
+    if (sl < 0) return;
+    SSRegisterJob *job = (SSRegisterJob*)calloc(1, sizeof(SSRegisterJob));
+    if (!job) { net_close(sl); return; }
+    job->fd = sl;
+    snprintf(job->ip, sizeof(job->ip), "%.*s", (int)sizeof(job->ip) - 1, ip);
+    if (thread_pool_submit(nm_workers, ss_register_job, job) != 0) {
+        net_close(sl);
+        free(job);
+    }
+}
+
+static void reactor_client_readable(ClientSession *sess) {
+    int rc = net_conn_fill_nowait(sess->conn);
+    int ready = net_conn_has_line(sess->conn, NM_CLIENT_LINE_MAX);
+    if ((rc == 0 || rc == -1) && !ready) { reactor_drop(sess); return; }
+    if (!ready) { reactor_arm(sess, EPOLL_CTL_MOD); return; }
+    if (thread_pool_submit(nm_workers, client_session_job, sess) != 0) {
+        net_send_line(sess->cfd, "ERR server busy");
+        reactor_drop(sess);
+    }
+}
+
+static int serve_reactor(int cfd, int sfd) {
+    nm_workers = thread_pool_create(nm_worker_count, 0);
+    nm_epfd = epoll_create1(0);
+    if (!nm_workers || nm_epfd < 0) { fprintf(stderr, "Failed to start event loop\n"); return 1; }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = &nm_client_listener_tag;
+    epoll_ctl(nm_epfd, EPOLL_CTL_ADD, cfd, &ev);
+    ev.data.ptr = &nm_ss_listener_tag;
+    epoll_ctl(nm_epfd, EPOLL_CTL_ADD, sfd, &ev);
+    printf("Serving clients with an event loop and %d worker threads\n", nm_workers->nthreads);
+    struct epoll_event events[64];
+    while (1) {
+        int n = epoll_wait(nm_epfd, events, 64, -1);
+        for (int i = 0; i < n; i++) {
+            void *tag = events[i].data.ptr;
+            if (tag == &nm_client_listener_tag) reactor_accept_client(cfd);
+            else if (tag == &nm_ss_listener_tag) reactor_accept_ss(sfd);
+            else reactor_client_readable((ClientSession*)tag);
+        }
+    }
+    return 0;
+}
+#endif
+
 int main(int argc, char **argv) {
     // Initialize hashmap and cache for efficient lookups
     file_map = hashmap_create();
@@ -2159,6 +2724,28 @@ int main(int argc, char **argv) {
             nm_verbose = 1;
         } else if (strcmp(argv[i], "--exec-allow") == 0) {
             nm_exec_allow_all = 1;
+        } else if (strcmp(argv[i], "--ss-pool-size") == 0 && i + 1 < argc) {
+            ss_pool_max_idle = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ss-pool-idle") == 0 && i + 1 < argc) {
+            ss_pool_idle_timeout = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            nm_worker_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--thread-per-conn") == 0) {
+            nm_thread_per_conn = 1;
+        } else if (strcmp(argv[i], "--ss-connect-timeout") == 0 && i + 1 < argc) {
+            ss_connect_timeout_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ss-timeout") == 0 && i + 1 < argc) {
+            ss_timeout_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--no-ss-rpc") == 0) {
+            ss_rpc_enabled = 0;
+        } else if (strcmp(argv[i], "--durability") == 0 && i + 1 < argc) {
+            if (durable_parse_mode(argv[++i], &nm_durability) != 0) {
+                fprintf(stderr, "Unknown durability mode: %s\n", argv[i]);
+                print_nm_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--group-commit-ms") == 0 && i + 1 < argc) {
+            nm_group_commit_ms = atoi(argv[++i]);
         } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
             print_nm_usage(argv[0]);
             return 0;
@@ -2172,6 +2759,21 @@ int main(int argc, char **argv) {
         nm_ss_port = (uint16_t)(nm_client_port + 1);
     }
     net_set_verbose(nm_verbose);
+    if (durable_init(nm_durability, nm_group_commit_ms) != 0) {
+        printf("NM WARN: group commit unavailable, syncing each write\n");
+    }
+#ifndef _WIN32
+    // Writes to a peer that went away must fail with EPIPE, not kill the NM
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    ss_pool = conn_pool_create(ss_pool_max_idle, ss_pool_idle_timeout, 1);
+    if (!ss_pool) { fprintf(stderr, "Failed to initialize SS connection pool\n"); return 1; }
+    NetTimeouts ss_timeouts = { ss_connect_timeout_ms, ss_timeout_ms, ss_timeout_ms };
+    conn_pool_set_timeouts(ss_pool, &ss_timeouts);
+    if (ss_rpc_enabled) {
+        ss_rpc = rpc_client_create(&ss_timeouts);
+        if (!ss_rpc) { fprintf(stderr, "Failed to initialize SS RPC client\n"); return 1; }
+    }
     int cfd = net_listen_addr(nm_bind_host, nm_client_port);
     int sfd = net_listen_addr(nm_bind_host, nm_ss_port);
     if (cfd < 0 || sfd < 0) { fprintf(stderr, "Failed to listen on ports\n"); return 1; }
@@ -2189,56 +2791,11 @@ int main(int argc, char **argv) {
     pthread_create(&failure_thread, NULL, (void*(*)(void*))check_ss_failures, NULL);
     pthread_detach(failure_thread);
     
-    while (1) {
-        fd_set rfds; FD_ZERO(&rfds);
-        int maxfd = (cfd>sfd?cfd:sfd);
-#ifdef _WIN32
-        SOCKET scfd = cfd, ssfd = sfd;
-#endif
-        FD_SET(cfd, &rfds); FD_SET(sfd, &rfds);
-        struct timeval tv; tv.tv_sec=1; tv.tv_usec=0;
-        int rc = select(maxfd+1, &rfds, NULL, NULL, &tv);
-        if (rc > 0) {
-            if (FD_ISSET(cfd, &rfds)) {
-                char ip[64] = "";  // Initialize to empty string
-                uint16_t p; int cl = net_accept(cfd, ip, sizeof(ip), &p);
-                if (cl>=0) {
-                    // Handle each client in a separate thread for true concurrency
-                    // All threads share the same files array, users array, and SS list
-                    pthread_t thread;
-                    typedef struct {
-                        int cfd;
-                        char client_ip[64];
-                        uint16_t client_port;
-                    } ClientContext;
-                    ClientContext *ctx = (ClientContext*)malloc(sizeof(ClientContext));
-                    ctx->cfd = cl;
-                    // Ensure IP is valid, use "127.0.0.1" if empty (shouldn't happen with our fix)
-                    if (ip[0] == '\0') {
-                        strncpy(ctx->client_ip, "127.0.0.1", sizeof(ctx->client_ip)-1);
-                    } else {
-                        strncpy(ctx->client_ip, ip, sizeof(ctx->client_ip)-1);
-                    }
-                    ctx->client_ip[sizeof(ctx->client_ip)-1] = '\0';  // Ensure null termination
-                    ctx->client_port = p;
-                    // Log client registration
-                    char reg_client_log[256];
-                    snprintf(reg_client_log, sizeof(reg_client_log), "REGISTER_CLIENT IP=%s Port=%u", ctx->client_ip, ctx->client_port);
-                    log_write("NM", "REGISTER_CLIENT", "SYSTEM", reg_client_log, 0);
-                    if (pthread_create(&thread, NULL, handle_client, ctx) != 0) {
-                        // Thread creation failed, handle in main thread (fallback)
-                        handle_client(ctx);
-                    } else {
-                        pthread_detach(thread);  // Don't wait for thread to finish
-                    }
-                }
-            }
-            if (FD_ISSET(sfd, &rfds)) {
-                char ip[64]; uint16_t p; int sl = net_accept(sfd, ip, sizeof(ip), &p);
-                if (sl>=0) { handle_ss_register(sl, ip); }
-            }
-        }
+#ifdef __linux__
+    if (!nm_thread_per_conn) {
+        return serve_reactor(cfd, sfd);
     }
+#endif
+    serve_thread_per_conn(cfd, sfd);
+    return 0;
 }
-
-
@@ -1,16 +1,41 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE     // readahead()
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <stdint.h>
 #include <ctype.h>
+#include <time.h>
 #include <pthread.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #ifndef _WIN32
 #include <unistd.h>
+#include <poll.h>
 #include <sys/wait.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <dirent.h>
+#include <limits.h>
 #endif
 #include "../../lib/include/net.h"
 #include "../../lib/include/util.h"
 #include "../../lib/include/log.h"
+#include "../../lib/include/fiber.h"
+#include "../../lib/include/thread_pool.h"
+#include "../../lib/include/doc.h"
+#include "../../lib/include/edit_log.h"
+#include "../../lib/include/durable.h"
+#include "../../lib/include/undo_log.h"
+#include "../../lib/include/chunk_store.h"
+#include "../../lib/include/checkpoint_catalog.h"
+#include "../../lib/include/doc_cache.h"
+#include "../../lib/include/error_codes.h"
+#include "../../lib/include/mapped_file.h"
+#include "../../lib/include/lock_table.h"
+#include "../../lib/include/collab.h"
 
 typedef struct {
     char nm_ip[64];
@@ -23,55 +48,53 @@ typedef struct {
 
 static char data_root[256] = "ss/data";
 static char undo_root[256] = "ss/undo";
+// Reverse-delta history per file (UNDO <file> [n])
+static UndoLog *undo_log = NULL;
+static int undo_depth = UNDO_DEFAULT_DEPTH;
+static long undo_budget = UNDO_DEFAULT_BUDGET;
 static char checkpoint_root[256] = "ss/checkpoints";
+// Checkpoint contents live as deduplicated chunks; a checkpoint directory
+// holds only a manifest (older ones may still hold a full "file" copy)
+static char chunk_root[256] = "ss/chunks";
+static ChunkStore *chunk_store = NULL;
+// Tag, time, size and hash of every checkpoint, per file
+static CheckpointCatalog *checkpoint_catalog = NULL;
+static char index_root[256] = "ss/index";
+// Recently read documents with their sentence index (--doc-cache-mb 0 turns it off)
+static DocCache *doc_cache = NULL;
+static long long doc_cache_mb = DOC_CACHE_DEFAULT_MB;
+// Accept "HELLO FRAMES" from peers (--no-frames keeps every connection line-based)
+static int frames_enabled = 1;
+// Client connections run as fibers on a few scheduler threads unless
+// --thread-per-conn asks for the old one-thread-per-client model
+static FiberSched *client_sched = NULL;
+static int fiber_threads = 4;
+static int ss_thread_per_conn = 0;
+// Edits go to an append-only log and reach the data files in the
+// background (--no-edit-log writes each commit straight to the file)
+static EditLog *edit_log = NULL;
+static int edit_log_enabled = 1;
+static char edit_log_path[256] = "ss/wal/edits.log";
+// When writes count as on disk (--durability none|fsync|group)
+static DurableMode durability = DURABLE_GROUP;
+static int group_commit_ms = DURABLE_DEFAULT_WINDOW_MS;
 
-// Per-file, per-sentence locking for true concurrent access
-typedef struct {
-    char filename[256];
-    int locked_sentences[2048];  // -1 = unlocked, thread_id = locked
-    pthread_mutex_t file_mutex;
-    int ref_count;
-} FileLock;
-
-#define MAX_LOCKED_FILES 256
-static FileLock file_locks[MAX_LOCKED_FILES];
-static int file_locks_count = 0;
-static pthread_mutex_t locks_table_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-// Get or create file lock entry
-static FileLock* get_file_lock(const char *filename) {
-    pthread_mutex_lock(&locks_table_mutex);
-    FileLock *fl = NULL;
-    for (int i=0; i<file_locks_count; i++) {
-        if (strcmp(file_locks[i].filename, filename) == 0) {
-            fl = &file_locks[i];
-            fl->ref_count++;
-            pthread_mutex_unlock(&locks_table_mutex);
-            return fl;
-        }
-    }
-    if (file_locks_count < MAX_LOCKED_FILES) {
-        fl = &file_locks[file_locks_count++];
-        strncpy(fl->filename, filename, sizeof(fl->filename)-1);
-        pthread_mutex_init(&fl->file_mutex, NULL);
-        for (int i=0; i<2048; i++) fl->locked_sentences[i] = -1;
-        fl->ref_count = 1;
-    }
-    pthread_mutex_unlock(&locks_table_mutex);
-    return fl;
-}
-
-static void release_file_lock(FileLock *fl) {
-    if (!fl) return;
-    pthread_mutex_lock(&locks_table_mutex);
-    fl->ref_count--;
-    if (fl->ref_count <= 0) {
-        pthread_mutex_destroy(&fl->file_mutex);
-        // Remove from table (simplified - just mark as unused)
-        fl->filename[0] = '\0';
-    }
-    pthread_mutex_unlock(&locks_table_mutex);
-}
+// Sentence locks of every file being edited, owned by client session.
+// Each lock is leased: activity on the session renews it, and the reaper
+// releases it once it has gone lock_lease_sec without (0 = no leases).
+static LockTable *sentence_locks = NULL;
+static int lock_lease_sec = 120;
+// Client session ids, never reused (unlike the socket fd)
+static long next_session_id = 0;
+// Live (COLLAB_*) documents. Unsaved edits reach the file within
+// live_save_ms (0 = only on COLLAB_SAVE and when the last subscriber leaves).
+static CollabHub *collab_hub = NULL;
+static int live_save_ms = 1000;
+// Largest file a live session takes, and grows to (each live document
+// keeps every character it ever had, with an id, in memory)
+static int live_max_mb = 8;
+// Longest a WRITE_BEGIN ... WAIT may queue for a sentence
+#define LOCK_WAIT_MAX_MS 300000
 
 // Validate filename: alphanumeric, dots, dashes, underscores, slashes only
 // Must have extension (.txt, .md, etc.)
@@ -98,6 +121,8 @@ static int is_valid_filename(const char *fname) {
     return 1;  // Valid filename
 }
 
+static void admin_stats_format(char *buf, int buflen);
+
 // Heartbeat thread function
 static void* send_heartbeat(void *arg) {
     HeartbeatArgs *args = (HeartbeatArgs*)arg;
@@ -113,8 +138,10 @@ static void* send_heartbeat(void *arg) {
                 strncpy(hostip, "0.0.0.0", sizeof(hostip)-1);
                 hostip[sizeof(hostip)-1] = '\0';
             }
-            char reg[256]; snprintf(reg, sizeof(reg), "REGISTER %s %u %u %s", 
-                                    args->ss_id, args->client_port, args->admin_port, hostip);
+            // Admin queue counters ride along so the NM can see SS load
+            char stats[256]; admin_stats_format(stats, sizeof(stats));
+            char reg[512]; snprintf(reg, sizeof(reg), "REGISTER %s %u %u %s %s", 
+                                    args->ss_id, args->client_port, args->admin_port, hostip, stats);
             net_send_line(rfd, reg);
             char resp[256]; net_recv_line(rfd, resp, sizeof(resp));
             net_close(rfd);
@@ -124,143 +151,860 @@ static void* send_heartbeat(void *arg) {
     return NULL;
 }
 
+static void lock_expired(const char *name, int sidx, long owner, void *arg) {
+    (void)arg;
+    char exp_log[512]; snprintf(exp_log, sizeof(exp_log), "file=%s sentence=%d session=%ld reason=lease", name, sidx, owner);
+    log_write("SS", "LOCK_RELEASE", "SYSTEM", exp_log, 0);
+}
+
+// Releases sentence locks whose session has gone quiet for a whole lease
+static void* lock_reaper(void *arg) {
+    (void)arg;
+    while (1) {
+        sleep(1);
+        lock_table_expire(sentence_locks, lock_expired, NULL);
+    }
+    return NULL;
+}
+
+// Length of name[0..len) without a trailing ".<digits>", or -1 if there
+// is none
+static int strip_number(const char *name, int len) {
+    int i = len;
+    while (i > 0 && isdigit((unsigned char)name[i-1])) i--;
+    if (i == len || i == 0 || name[i-1] != '.') return -1;
+    return i - 1;
+}
+
+static int has_tag(const char *name, int len, const char *tag) {
+    int tl = (int)strlen(tag);
+    return len > tl && memcmp(name + len - tl, tag, tl) == 0;
+}
+
+// 1 if name is scratch space rather than a document: <file>.swap.<fd>,
+// where write sessions used to stage edits (nothing creates these any
+// more), or <file>.tmp.<pid>.<seq>, where durable_write_file and
+// doc_index_save write before renaming over <file>. *pid gets a temp
+// file's pid, 0 for a swap file.
+static int scratch_file_name(const char *name, long *pid) {
+    int len = strip_number(name, (int)strlen(name));
+    if (len < 0) return 0;
+    *pid = 0;
+    if (has_tag(name, len, ".swap")) return 1;
+    len = strip_number(name, len);
+    if (len < 0 || !has_tag(name, len, ".tmp")) return 0;
+    *pid = strtol(name + len + 1, NULL, 10);
+    return 1;
+}
+
+// Remove scratch files a crash or disconnect stranded under dir. Temp
+// files of this process are left alone: the applier may be writing them.
+static int sweep_scratch_files(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return 0;
+    int n = 0;
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        char path[PATH_MAX];
+        int plen = snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        if (plen < 0 || plen >= (int)sizeof(path)) continue;
+        struct stat st;
+        if (lstat(path, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) { n += sweep_scratch_files(path); continue; }
+        long pid;
+        if (scratch_file_name(e->d_name, &pid) && pid != (long)getpid() && remove(path) == 0) n++;
+    }
+    closedir(d);
+    return n;
+}
+
+// Sentence index sidecars (index_root/<file>.idx). A sidecar is trusted
+// only while the file's size and mtime match the ones it was built for;
+// anything else (a file written before indexing existed, a replica pushed
+// over FETCH) just gets re-indexed on first use.
+static int file_stamp(const char *path, int64_t *size, int64_t *mtime_ns) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) return -1;
+    *size = (int64_t)st.st_size;
+    *mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    return 0;
+}
+
+// fname's sidecar path into out (PATH_MAX bytes); -1 if it doesn't fit
+static int index_path(const char *fname, char *out) {
+    int n = snprintf(out, PATH_MAX, "%s/%s.idx", index_root, fname);
+    return n >= 0 && n < PATH_MAX ? 0 : -1;
+}
+
+// fname's contents and sentence index: the cached copy while the file
+// still has the size and mtime it was cached at, otherwise read from disk
+// (the index from its sidecar, or rebuilt if that is stale) and cached.
+// A reference the caller releases; NULL if the file doesn't exist.
+static DocCacheEntry* ss_doc_get(const char *fname) {
+    char path[512]; snprintf(path, sizeof(path), "%s/%s", data_root, fname);
+    int64_t size, mtime;
+    if (file_stamp(path, &size, &mtime) != 0) return NULL;
+    DocCacheEntry *e = doc_cache_get(doc_cache, fname, size, mtime);
+    if (e) return e;
+    // Mapped, not copied, if it's large; stamped from the open file, so
+    // the stamp always describes the contents cached with it
+    MappedFile *mf = mapped_file_open(path);
+    if (!mf) return NULL;
+    // Without a sidecar path the index is rebuilt on every load
+    char ipath[PATH_MAX];
+    int has_ipath = index_path(fname, ipath) == 0;
+    DocIndex *ix = has_ipath ? doc_index_load(ipath) : NULL;
+    if (!ix || ix->size != mf->size || ix->mtime_ns != mf->mtime_ns) {
+        doc_index_free(ix);
+        ix = doc_index_build(mf->data, mf->len);
+        if (!ix) { mapped_file_release(mf); return NULL; }
+        ix->mtime_ns = mf->mtime_ns;
+        if (has_ipath) doc_index_save(ix, ipath);
+    }
+    return doc_cache_put(doc_cache, fname, mf, ix);
+}
+
+// Re-index fname from the content just written to it
+static void ss_index_update(const char *fname, const char *buf, int len) {
+    char path[512]; snprintf(path, sizeof(path), "%s/%s", data_root, fname);
+    char ipath[PATH_MAX];
+    int has_ipath = index_path(fname, ipath) == 0;
+    DocIndex *ix = doc_index_build(buf, len);
+    // The version just written is the one the next reader wants
+    MappedFile *mf = ix ? mapped_file_open(path) : NULL;
+    if (mf && mf->size == len) {
+        ix->mtime_ns = mf->mtime_ns;
+        if (has_ipath) doc_index_save(ix, ipath);
+        doc_cache_release(doc_cache, doc_cache_put(doc_cache, fname, mf, ix));
+    } else {
+        mapped_file_release(mf);
+        if (has_ipath) remove(ipath);
+        doc_cache_invalidate(doc_cache, fname);
+        doc_index_free(ix);
+    }
+}
+
+static void ss_index_remove(const char *fname) {
+    char ipath[PATH_MAX];
+    if (index_path(fname, ipath) == 0) remove(ipath);
+    doc_cache_invalidate(doc_cache, fname);
+}
+
+static void ss_index_move(const char *oldname, const char *newname) {
+    char opath[PATH_MAX], npath[PATH_MAX];
+    if (index_path(oldname, opath) == 0) {
+        if (index_path(newname, npath) == 0) {
+            char dir[PATH_MAX]; memcpy(dir, npath, sizeof(dir));
+            char *slash = strrchr(dir, '/');
+            if (slash) { *slash = '\0'; mkpath(dir); }
+            if (rename(opath, npath) != 0) remove(opath);
+        } else {
+            remove(opath);
+        }
+    }
+    doc_cache_invalidate(doc_cache, oldname);
+    doc_cache_invalidate(doc_cache, newname);
+}
+
+typedef struct {
+    const char *fname;
+    DocCacheEntry *doc;
+} ClientDocJob;
+
+static void client_doc_get_job(void *arg) {
+    ClientDocJob *j = (ClientDocJob*)arg;
+    j->doc = ss_doc_get(j->fname);
+}
+
+// File access from client handlers. Inside a fiber the call runs on the
+// scheduler's helper pool so a slow disk parks only this session.
+static DocCacheEntry* client_doc_get(const char *fname) {
+    ClientDocJob j = { fname, NULL };
+    fiber_call_blocking(client_doc_get_job, &j);
+    return j.doc;
+}
+
+// The applier writes the data file for each commit
+static void edit_log_applied(const char *fname, const char *buf, int len, void *arg) {
+    (void)arg;
+    ss_index_update(fname, buf, len);
+}
+
+// fname went from prev to buf: move its sentence locks to where their
+// sentences are now, so a commit that adds or removes sentences leaves
+// every lock on the sentence it was taken for. Called with the file's
+// undo history held, which keeps the table in step with the file. skip
+// is a lock the caller is about to release (0 or 1): with none other
+// held there is nothing to move.
+static void ss_locks_follow(const char *fname, const char *prev, int prev_len, const char *buf, int len, int skip) {
+    if (lock_table_held(sentence_locks, fname) <= skip) return;
+    int *map = NULL;
+    int n = doc_sentence_map(prev, prev_len, buf, len, &map);
+    if (n < 0) return;
+    int dropped = lock_table_remap(sentence_locks, fname, map, n);
+    free(map);
+    if (dropped > 0) {
+        char drop_log[384]; snprintf(drop_log, sizeof(drop_log), "file=%s dropped=%d reason=sentence_removed", fname, dropped);
+        log_write("SS", "LOCK_REMAP", "SYSTEM", drop_log, -1);
+    }
+}
+
+// Replace fname's contents for an admin command (REVERT, SYNC), keeping
+// the version it replaces in the undo history
+static int ss_replace_file(const char *fname, const char *buf, int len) {
+    char path[512]; snprintf(path, sizeof(path), "%s/%s", data_root, fname);
+    UndoFile *uf = undo_log_acquire(undo_log, fname);
+    edit_log_settle(edit_log, fname);
+    char *prev = NULL; int prev_len = 0;
+    if (uf && read_file_all(path, &prev, &prev_len) != 0) { prev = NULL; prev_len = 0; }
+    int rc = write_file_all(path, buf, len);
+    if (rc == 0) {
+        ss_index_update(fname, buf, len);
+        undo_log_record(undo_log, uf, prev ? prev : "", prev_len, buf, len);
+        ss_locks_follow(fname, prev ? prev : "", prev_len, buf, len, 0);
+    }
+    edit_log_reset(edit_log, fname);
+    free(prev);
+    undo_log_release(uf);
+    return rc;
+}
+
+// A new or deleted file starts with no history
+static void ss_undo_clear(const char *fname) {
+    UndoFile *uf = undo_log_acquire(undo_log, fname);
+    undo_log_clear(undo_log, uf);
+    undo_log_release(uf);
+}
+
+static void client_settle_job(void *arg) {
+    edit_log_settle(edit_log, (const char*)arg);
+}
+
+// Bring fname's data file up to its latest commit before reading it
+static void client_settle(const char *fname) {
+    if (edit_log) fiber_call_blocking(client_settle_job, (void*)fname);
+}
+
+// Sentence sidx can be locked for writing: an existing sentence, or the
+// one after a complete last sentence. Otherwise fills err with the reply.
+static int client_sentence_check(const char *fname, int sidx, char *err, int errlen) {
+    client_settle(fname);
+    DocCacheEntry *doc = client_doc_get(fname);
+    int rc = 0;
+    if (doc && doc->ix->count > 0) {
+        // If last sentence is complete (has delimiter), can append new sentence
+        // If last sentence is incomplete, cannot append
+        int max_allowed = doc->ix->last_delim ? doc->ix->count : doc->ix->count - 1;
+        if (sidx > max_allowed) {
+            snprintf(err, errlen, "ERR: Sentence index out of range (max: %d)", max_allowed);
+            rc = -1;
+        }
+    } else if (sidx > 0) {
+        // File doesn't exist or is empty - only sentence 0 valid
+        snprintf(err, errlen, "ERR: Sentence index out of range (file is empty)");
+        rc = -1;
+    }
+    doc_cache_release(doc_cache, doc);
+    return rc;
+}
+
+// Lock a sentence, queueing up to wait_ms behind its holder. The fiber
+// parks on an eventfd the releasing session writes when it hands the lock
+// over. Returns 0 locked, 1 locked already (without a wait, by anyone;
+// with one, by owner itself), 2 waited out, -1 error.
+static int client_lock_wait(const char *fname, int sidx, long owner, int wait_ms) {
+    if (wait_ms <= 0) return lock_table_acquire(sentence_locks, fname, sidx, owner);
+    LockWaiter w;
+    memset(&w, 0, sizeof(w));
+    w.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (w.wake_fd < 0) return -1;
+    int rc = lock_table_acquire_wait(sentence_locks, fname, sidx, owner, &w);
+    if (rc == 2) {
+        fiber_wait_fd(w.wake_fd, 0, wait_ms);
+        // Handed over or not, this settles it (a late grant still counts)
+        rc = lock_table_wait_end(sentence_locks, fname, &w) == 0 ? 0 : 2;
+    }
+    close(w.wake_fd);
+    return rc;
+}
+
+typedef struct {
+    EditLogSession *session;
+    long owner;                 // the committing session, -1 for none
+    const char *fname;
+    const char *path;
+    const char *base;           // the version the session started from
+    int base_len;
+    const char *buf;            // the session's document
+    int len;
+    int prefer_ours;            // settle conflicts for buf instead of failing
+    int rc;                     // 0 committed, 1 merge conflict, -1 failed
+    int merged;                 // others' commits were merged in
+    int conflicts;              // clashes settled for buf (prefer_ours)
+    char *out;                  // committed if merged / current on a conflict
+    int out_len;
+} ClientCommitJob;
+
+// Orders commits to a file when there is no undo history to hold
+static pthread_mutex_t commit_fallback_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void client_commit_job(void *arg) {
+    ClientCommitJob *j = (ClientCommitJob*)arg;
+    // The version being replaced goes into the undo history as a delta;
+    // holding the history keeps commits to the file in record order
+    UndoFile *uf = undo_log_acquire(undo_log, j->fname);
+    if (!uf) pthread_mutex_lock(&commit_fallback_mutex);
+    edit_log_settle(edit_log, j->fname);
+    char *prev = NULL; int prev_len = 0;
+    if (read_file_all(j->path, &prev, &prev_len) != 0) { prev = NULL; prev_len = 0; }
+    const char *buf = j->buf; int len = j->len;
+    char *merged = NULL;
+    j->rc = 0;
+    // Someone else committed since this session began: replay its changes
+    // onto that version instead of overwriting it
+    if (prev_len != j->base_len || (prev_len > 0 && memcmp(prev, j->base, prev_len) != 0)) {
+        int merged_len = 0;
+        j->rc = doc_merge_ex(j->base, j->base_len, buf, len, prev ? prev : "", prev_len,
+                             j->prefer_ours, &j->conflicts, &merged, &merged_len);
+        if (j->rc == 0) { buf = merged; len = merged_len; j->merged = 1; }
+    }
+    if (j->rc == 0) {
+        int rc = edit_log_commit(edit_log, j->session, buf, len);
+        // Not logged: write the data file here instead
+        if (rc != 0 && (rc = write_file_all(j->path, buf, len)) == 0) {
+            ss_index_update(j->fname, buf, len);
+            edit_log_reset(edit_log, j->fname);
+        }
+        if (rc == 0) {
+            undo_log_record(undo_log, uf, prev ? prev : "", prev_len, buf, len);
+            ss_locks_follow(j->fname, prev ? prev : "", prev_len, buf, len, j->owner != -1);
+        } else {
+            j->rc = -1;
+        }
+    }
+    // The session carries on from the committed version, or after a
+    // conflict from the current one: its sentences are where the locks are
+    if (j->owner != -1 && j->rc >= 0) lock_table_rebase(sentence_locks, j->fname, j->owner);
+    if (j->rc == 0 && merged) { j->out = merged; j->out_len = len; merged = NULL; }
+    else if (j->rc == 1) { j->out = prev; j->out_len = prev_len; prev = NULL; }
+    free(merged);
+    free(prev);
+    if (uf) undo_log_release(uf);
+    else pthread_mutex_unlock(&commit_fallback_mutex);
+}
+
+// Commit a write session's document. Off the fiber thread, since the
+// commit waits for its log record to be synced under fsync/group.
+static void client_commit(ClientCommitJob *j) {
+    fiber_call_blocking(client_commit_job, j);
+}
+
+// Write a live document to its file with the same commit as WRITE_END,
+// merging in whatever other writers committed since its last save. Where
+// a commit and the live text changed the same sentences the live text
+// wins; the rest of that commit is kept. Off the fiber threads. Returns
+// 0, 1 if there was nothing to save, -1.
+static int live_save(CollabDoc *d) {
+    CollabSave s;
+    int rc = collab_save_begin(d, &s);
+    if (rc != 0) return rc;
+    char path[512]; snprintf(path, sizeof(path), "%s/%s", data_root, d->name);
+    ClientCommitJob j;
+    memset(&j, 0, sizeof(j));
+    j.owner = -1;
+    j.fname = d->name; j.path = path; j.buf = s.text; j.len = s.len;
+    j.base = d->base; j.base_len = d->base_len;
+    j.prefer_ours = 1;
+    client_commit_job(&j);
+    int merged = j.merged, conflicts = j.conflicts, len = s.len;
+    if (j.rc == 0 && j.out) {
+        len = j.out_len;
+        collab_save_end(d, &s, j.out, j.out_len);
+    } else {
+        collab_save_end(d, &s, j.rc == 0 ? s.text : NULL, s.len);
+    }
+    free(j.out);
+    char save_log[512]; snprintf(save_log, sizeof(save_log), "file=%s chars=%d merged=%d conflicts=%d", d->name, len, merged, conflicts);
+    log_write("SS", "LIVE_SAVE", "SYSTEM", save_log, j.rc == 0 ? 0 : -1);
+    return j.rc == 0 ? 0 : -1;
+}
+
+typedef struct {
+    CollabDoc *doc;
+    int rc;
+} LiveSaveJob;
+
+static void live_save_job(void *arg) {
+    LiveSaveJob *j = (LiveSaveJob*)arg;
+    j->rc = live_save(j->doc);
+}
+
+// Saves live documents with unsaved edits every live_save_ms
+static void* live_saver(void *arg) {
+    (void)arg;
+    while (1) {
+        usleep((useconds_t)live_save_ms * 1000);
+        CollabDoc **docs;
+        int n = collab_dirty(collab_hub, &docs);
+        for (int i = 0; i < n; i++) {
+            live_save(docs[i]);
+            collab_release(collab_hub, docs[i]);
+        }
+        free(docs);
+    }
+    return NULL;
+}
+
+// name's live document, loaded from its file if nobody has it open. The
+// text is split and joined the way a write session would write it back,
+// so later edits only change what they touch. NULL with *too_large set
+// if the file is over live_max_mb.
+static CollabDoc* live_open(const char *fname, int *too_large) {
+    *too_large = 0;
+    CollabDoc *d = collab_get(collab_hub, fname);
+    if (d) return d;
+    client_settle(fname);
+    DocCacheEntry *e = client_doc_get(fname);
+    int max_len = live_max_mb << 20;
+    if (e && e->len > max_len) {
+        *too_large = 1;
+        doc_cache_release(doc_cache, e);
+        return NULL;
+    }
+    Doc *doc = e ? doc_parse_indexed(e->data, e->len, e->ix) : doc_parse(NULL, 0);
+    char *text = NULL; int len = 0;
+    if (doc && doc_serialize(doc, &text, &len) == 0) {
+        d = collab_open(collab_hub, fname, e ? e->data : "", e ? e->len : 0, text, len, max_len);
+    }
+    free(text);
+    doc_free(doc);
+    doc_cache_release(doc_cache, e);
+    return d;
+}
+
+// Unsubscribe; the last one out saves the document
+static void live_leave(CollabDoc *d, CollabPeer *peer, long sid, const char *reason) {
+    int left = collab_leave(d, peer);
+    if (left == 0) {
+        LiveSaveJob j = { d, 0 };
+        fiber_call_blocking(live_save_job, &j);
+    }
+    char leave_log[512]; snprintf(leave_log, sizeof(leave_log), "file=%s session=%ld subscribers=%d reason=%s", d->name, sid, left, reason);
+    log_write("SS", "LIVE_LEAVE", "client", leave_log, 0);
+    collab_release(collab_hub, d);
+}
+
+#define MAX_LIVE_DOCS 16
+
+static int live_find(CollabDoc **docs, int n, const char *fname) {
+    for (int i = 0; i < n; i++) {
+        if (strcmp(docs[i]->name, fname) == 0) return i;
+    }
+    return -1;
+}
+
+// Live mode, from a COLLAB_JOIN until the connection has left every live
+// document. Replies and other subscribers' operations share the socket,
+// so everything to the client goes through its CollabPeer and only
+// COLLAB_* commands are served. Returns 0 back in normal mode, -1 when
+// the connection is finished.
+static int client_live(NetConn *conn, int cfd, long sid, char *line) {
+    CollabPeer *peer = collab_peer_open(cfd, (uint32_t)sid, client_sched);
+    if (!peer) { net_send_line(cfd, "ERR out of memory"); return 0; }
+    CollabDoc *docs[MAX_LIVE_DOCS];
+    int ndocs = 0, rc = 0;
+    while (1) {
+        char fname[256];
+        if (strncmp(line, "COLLAB_JOIN ", 12)==0 && sscanf(line+12, "%255s", fname) == 1) {
+            if (live_find(docs, ndocs, fname) >= 0) {
+                collab_peer_send(peer, "ERR already live on this file");
+            } else if (ndocs == MAX_LIVE_DOCS) {
+                collab_peer_send(peer, "ERR too many live files");
+            } else {
+                int too_large = 0;
+                CollabDoc *d = live_open(fname, &too_large);
+                if (too_large) {
+                    char err[128]; snprintf(err, sizeof(err), "%s for a live session (limit %d MB)", errcode_to_string(ERR_FILE_TOO_LARGE), live_max_mb);
+                    collab_peer_send(peer, err);
+                    char join_log[512]; snprintf(join_log, sizeof(join_log), "file=%s session=%ld error=TOO_LARGE", fname, sid);
+                    log_write("SS", "LIVE_JOIN", "client", join_log, ERR_FILE_TOO_LARGE);
+                } else if (!d || collab_join(d, peer) != 0) {
+                    collab_release(collab_hub, d);
+                    collab_peer_send(peer, "ERR out of memory");
+                } else {
+                    docs[ndocs++] = d;
+                    char ok[320]; snprintf(ok, sizeof(ok), "OK live %s site=%ld", fname, sid);
+                    collab_peer_send(peer, ok);
+                    char join_log[512]; snprintf(join_log, sizeof(join_log), "file=%s session=%ld", fname, sid);
+                    log_write("SS", "LIVE_JOIN", "client", join_log, 0);
+                }
+            }
+        } else if (strncmp(line, "COLLAB_UPDATE ", 14)==0) {
+            // COLLAB_UPDATE <filename> <sentence_index> <word_index> <content>
+            int sidx = -1, widx = -1; char content[768];
+            int i = -1;
+            if (sscanf(line+14, "%255s %d %d %767[^\n\r]", fname, &sidx, &widx, content) < 4) {
+                collab_peer_send(peer, "ERR bad args");
+            } else if ((i = live_find(docs, ndocs, fname)) < 0) {
+                collab_peer_send(peer, "ERR not live on this file");
+            } else if (widx < 0) {
+                collab_peer_send(peer, "ERR: Word index cannot be negative");
+            } else {
+                int max = 0;
+                int urc = collab_insert_words(docs[i], sidx, widx, content, &max);
+                char reply[256];
+                if (urc == -1) snprintf(reply, sizeof(reply), "ERR: Sentence index out of range (max: %d)", max);
+                else if (urc == -2) snprintf(reply, sizeof(reply), "ERR: Word index out of range (max: %d)", max);
+                else if (urc == -4) snprintf(reply, sizeof(reply), "%s for a live session (limit %d MB)", errcode_to_string(ERR_FILE_TOO_LARGE), live_max_mb);
+                else if (urc != 0) snprintf(reply, sizeof(reply), "ERR out of memory");
+                else snprintf(reply, sizeof(reply), "OK updated");
+                collab_peer_send(peer, reply);
+                char update_log[512]; snprintf(update_log, sizeof(update_log), "file=%s sentence=%d word=%d session=%ld", fname, sidx, widx, sid);
+                log_write("SS", "LIVE_UPDATE", "client", update_log, urc == 0 ? 0 : -1);
+            }
+        } else if (strncmp(line, "COLLAB_OP ", 10)==0) {
+            // COLLAB_OP <filename> <operation>, made on the client's replica
+            int n = 0, i = -1;
+            if (sscanf(line+10, "%255s %n", fname, &n) < 1 || n == 0) {
+                collab_peer_send(peer, "ERR bad args");
+            } else if ((i = live_find(docs, ndocs, fname)) < 0) {
+                collab_peer_send(peer, "ERR not live on this file");
+            } else {
+                int arc = collab_apply(docs[i], peer, line + 10 + n);
+                collab_peer_send(peer, arc == 0 ? "OK op" : arc == -2 ? "ERR out of memory" :
+                                       arc == -3 ? errcode_to_string(ERR_FILE_TOO_LARGE) : "ERR bad operation");
+            }
+        } else if (strncmp(line, "COLLAB_SAVE ", 12)==0 && sscanf(line+12, "%255s", fname) == 1) {
+            int i = live_find(docs, ndocs, fname);
+            if (i < 0) {
+                collab_peer_send(peer, "ERR not live on this file");
+            } else {
+                LiveSaveJob j = { docs[i], 0 };
+                fiber_call_blocking(live_save_job, &j);
+                collab_peer_send(peer, j.rc >= 0 ? "OK saved" : "ERR save failed");
+            }
+        } else if (strncmp(line, "COLLAB_LEAVE ", 13)==0 && sscanf(line+13, "%255s", fname) == 1) {
+            int i = live_find(docs, ndocs, fname);
+            if (i < 0) {
+                collab_peer_send(peer, "ERR not live on this file");
+            } else {
+                CollabDoc *d = docs[i];
+                docs[i] = docs[--ndocs];
+                live_leave(d, peer, sid, "leave");
+                collab_peer_send(peer, "OK left");
+            }
+        } else if (strcmp(line, "QUIT")==0) {
+            collab_peer_send(peer, "BYE");
+            rc = -1;
+            break;
+        } else {
+            collab_peer_send(peer, "ERR only COLLAB_* commands during a live session");
+        }
+        if (ndocs == 0) break;
+        if (net_conn_next_line(conn, &line) <= 0) { rc = -1; break; }
+    }
+    // Gone (or QUIT) while live: the subscriptions end with the connection
+    for (int i = 0; i < ndocs; i++) live_leave(docs[i], peer, sid, "disconnect");
+    collab_peer_close(peer, 1);
+    return rc;
+}
+
+// One STREAM word, then the pacing delay. Returns -1 if the client is gone.
+static int stream_word(int cfd, const char *word) {
+    if (net_send_line(cfd, word) != 0) return -1;
+    // Pacing parks the fiber; on a plain thread it just sleeps
+    fiber_sleep_ms(100);
+    return 0;
+}
+
+// Frame-mode bulk reply: ok_line, then the file as DATA frames sent with
+// sendfile (no userspace copy). Returns 0 when sent, 1 if the file can't
+// be opened (nothing was sent), -1 if the connection is no longer usable.
+typedef struct {
+    const char *path;
+    int fd;
+    long long size;
+} FileOpenJob;
+
+// Opens a file for send_file_reply and reads it into the page cache, so
+// the sendfile() that follows copies from memory instead of waiting on
+// the disk
+static void file_open_job(void *arg) {
+    FileOpenJob *j = (FileOpenJob*)arg;
+    j->fd = open(j->path, O_RDONLY);
+    if (j->fd < 0) return;
+    struct stat st;
+    if (fstat(j->fd, &st) != 0 || !S_ISREG(st.st_mode)) { close(j->fd); j->fd = -1; return; }
+    j->size = (long long)st.st_size;
+#ifdef __linux__
+    readahead(j->fd, 0, (size_t)st.st_size);
+#endif
+}
+
+static int send_file_reply(int fd, const char *path, const char *ok_line) {
+    // Disk work on the helper pool; only the socket waits stay on the fiber
+    FileOpenJob j = { path, -1, 0 };
+    fiber_call_blocking(file_open_job, &j);
+    if (j.fd < 0) return 1;
+    int rc = (net_send_line(fd, ok_line) == 0 && net_send_file(fd, 0, j.fd, 0, j.size) == 0) ? 0 : -1;
+    close(j.fd);
+    return rc;
+}
+
+// Line-mode bulk reply body: data in the pieces fgets() would read it in
+// (up to each newline, at most max-1 bytes), line endings stripped, each
+// sent as prefix + piece straight from data
+static void sendbuf_text_lines(NetSendBuf *b, const char *prefix, const char *data, int len, int max) {
+    int plen = (int)strlen(prefix);
+    for (const char *p = data, *end = data + len; p < end; ) {
+        int n = 0, keep = -1;
+        while (n < max - 1 && p + n < end) {
+            char c = p[n++];
+            if (keep < 0 && (c == '\r' || c == '\n' || c == '\0')) keep = n - 1;
+            if (c == '\n') break;
+        }
+        net_sendbuf_append(b, prefix, plen);
+        net_sendbuf_append(b, p, keep < 0 ? n : keep);
+        net_sendbuf_append(b, "\n", 1);
+        p += n;
+    }
+}
+
+// <checkpoint_root>/<fname>/<tag>/<leaf> into out (PATH_MAX bytes); -1 if
+// it doesn't fit
+static int checkpoint_path(char *out, const char *fname, const char *tag, const char *leaf) {
+    int n = snprintf(out, PATH_MAX, "%s/%s/%s/%s", checkpoint_root, fname, tag, leaf);
+    return n >= 0 && n < PATH_MAX ? 0 : -1;
+}
+
+// A checkpoint's contents: from its chunk manifest, or the full copy
+// checkpoints made before the chunk store
+static int checkpoint_load(const char *fname, const char *tag, char **buf, int *len) {
+    char cpath[PATH_MAX];
+    if (checkpoint_path(cpath, fname, tag, "manifest") != 0) return -1;
+    int rc = chunk_store ? chunk_store_load(chunk_store, cpath, buf, len) : 1;
+    if (rc != 1) return rc;
+    if (checkpoint_path(cpath, fname, tag, "file") != 0) return -1;
+    return read_file_all(cpath, buf, len);
+}
+
+static int send_chunk_frame(void *ctx, const char *data, int len, int last) {
+    return net_send_frame(*(int*)ctx, NET_OP_DATA, last ? 0 : NET_FRAME_MORE, 0, data, (uint32_t)len);
+}
+
+// Framed VIEWCHECKPOINT reply, one DATA frame per chunk. Same returns as
+// send_file_reply (a path too long to build is one that can't be opened).
+static int checkpoint_send(int fd, const char *fname, const char *tag) {
+    char cpath[PATH_MAX];
+    if (checkpoint_path(cpath, fname, tag, "manifest") != 0) return 1;
+    if (chunk_store && access(cpath, F_OK) == 0) {
+        if (net_send_line(fd, "OK") != 0) return -1;
+        return chunk_store_read(chunk_store, cpath, send_chunk_frame, &fd) == 0 ? 0 : -1;
+    }
+    if (checkpoint_path(cpath, fname, tag, "file") != 0) return 1;
+    return send_file_reply(fd, cpath, "OK");
+}
+
+// Write sessions open on one client connection. The document being edited
+// stays in memory from WRITE_BEGIN to WRITE_END, so an update costs the
+// sentence it touches and the file is written once, when the session ends.
+#define MAX_WRITE_SESSIONS 16
+typedef struct {
+    char fname[256];
+    Doc *doc;
+    int dirty;                  // updated since WRITE_BEGIN
+    EditLogSession *log;        // NULL without the edit log
+    // The version the edits apply to, merged against at WRITE_END: the
+    // cached document it was loaded from, then whatever it last committed
+    DocCacheEntry *base_entry;
+    char *base_buf;
+    const char *base;
+    int base_len;
+} WriteSession;
+
+static WriteSession* write_session_find(WriteSession *ws, const char *fname) {
+    for (int i = 0; i < MAX_WRITE_SESSIONS; i++) {
+        if (ws[i].doc && strcmp(ws[i].fname, fname) == 0) return &ws[i];
+    }
+    return NULL;
+}
+
+// doc (may be NULL: an empty file) is taken over if a session is opened
+static WriteSession* write_session_open(WriteSession *ws, const char *fname, DocCacheEntry *doc, EditLogSession *log) {
+    for (int i = 0; i < MAX_WRITE_SESSIONS; i++) {
+        if (ws[i].doc) continue;
+        ws[i].doc = doc ? doc_parse_indexed(doc->data, doc->len, doc->ix) : doc_parse(NULL, 0);
+        if (!ws[i].doc) return NULL;
+        strncpy(ws[i].fname, fname, sizeof(ws[i].fname)-1);
+        ws[i].fname[sizeof(ws[i].fname)-1] = '\0';
+        ws[i].dirty = 0;
+        ws[i].log = log;
+        ws[i].base_entry = doc;
+        ws[i].base_buf = NULL;
+        ws[i].base = doc ? doc->data : "";
+        ws[i].base_len = doc ? doc->len : 0;
+        return &ws[i];
+    }
+    return NULL;
+}
+
+// Make text (malloc'd, taken over) the session's base; with reparse, its
+// document too
+static void write_session_rebase(WriteSession *s, char *text, int len, int reparse) {
+    if (reparse) {
+        Doc *d = doc_parse(text, len);
+        if (d) { doc_free(s->doc); s->doc = d; }
+    }
+    doc_cache_release(doc_cache, s->base_entry);
+    s->base_entry = NULL;
+    free(s->base_buf);
+    s->base_buf = text;
+    s->base = text;
+    s->base_len = len;
+}
+
+static void write_session_close(WriteSession *s) {
+    edit_log_end(edit_log, s->log);
+    s->log = NULL;
+    doc_free(s->doc);
+    s->doc = NULL;
+    s->fname[0] = '\0';
+    doc_cache_release(doc_cache, s->base_entry);
+    s->base_entry = NULL;
+    free(s->base_buf);
+    s->base_buf = NULL;
+    s->base = NULL;
+    s->base_len = 0;
+}
+
+static void write_sessions_renew(WriteSession *ws, long sid) {
+    for (int i = 0; i < MAX_WRITE_SESSIONS; i++) {
+        if (ws[i].doc) lock_table_renew(sentence_locks, ws[i].fname, sid);
+    }
+}
+
 static void* handle_client_conn(void *arg) {
     int cfd = *(int*)arg;
     free(arg);  // Free the allocated memory
-    char line[1024];
-    if (net_send_line(cfd, "WELCOME SS CLIENT") != 0) { net_close(cfd); return NULL; }
+    NetConn *conn = net_conn_open(cfd);
+    if (!conn) { net_close(cfd); return NULL; }
+    char *line;
+    int frames = 0;
+    WriteSession sessions[MAX_WRITE_SESSIONS];
+    memset(sessions, 0, sizeof(sessions));
+    long sid = __sync_add_and_fetch(&next_session_id, 1);
+    if (net_send_line(cfd, "WELCOME SS CLIENT") != 0) { net_conn_close(conn); return NULL; }
     while (1) {
-        if (net_recv_line(cfd, line, sizeof(line)) <= 0) break;
+        // line points into the connection buffer; nothing below reads the
+        // connection again before the command is finished with it
+        if (net_conn_next_line(conn, &line) <= 0) break;
+        // Any command counts as activity on the session's locks
+        write_sessions_renew(sessions, sid);
+        if (strncmp(line, "HELLO", 5) == 0) {
+            frames = net_hello_reply(cfd, line, frames_enabled);
+            // A framed reply is a status line and then its payload; don't
+            // let Nagle hold a small payload back behind the line
+            if (frames) net_set_nodelay(cfd);
+        }
         // Handle READ command
-        if (strncmp(line, "READ ", 5) == 0) {
+        else if (strncmp(line, "READ ", 5) == 0) {
         char *fname = line + 5;
+            client_settle(fname);
     
             // Build file path
             char path[512];
             snprintf(path, sizeof(path), "%s/%s", data_root, fname);
     
-            // Open file
-            FILE *f = fopen(path, "r");
-            if (!f) {
+            if (frames) {
+                // Whole file as DATA frames, newlines and all, page cache -> socket
+                int src = send_file_reply(cfd, path, "OK");
+                if (src == 1) {
+                    log_write("SS", "READ", "client", fname, -1);
+                    net_send_line(cfd, "ERR file not found");
+                    continue;
+                }
+                log_write("SS", "READ", "client", fname, src);
+                if (src != 0) break;
+                continue;
+            }
+
+            // Hot files come from the document cache
+            DocCacheEntry *doc = client_doc_get(fname);
+            if (!doc) {
                 log_write("SS", "READ", "client", fname, -1);
                 net_send_line(cfd, "ERR file not found");
                 continue;
             }
     
-            // Send OK
-            net_send_line(cfd, "OK");
-    
-            // Send file content line by line
-            char line[4096];
-            while (fgets(line, sizeof(line), f)) {
-                // Remove trailing newline
-                line[strcspn(line, "\r\n")] = 0;
-                net_send_line(cfd, line);
-            }
-    
-            fclose(f);
+            // Send OK, the content line by line and END as one batch
+            NetSendBuf batch; net_sendbuf_init(&batch, cfd);
+            net_sendbuf_line(&batch, "OK");
+            sendbuf_text_lines(&batch, "", doc->data, doc->len, NET_CONN_MAX_LINE - 4);
+            doc_cache_release(doc_cache, doc);
     
             // ✅ CRITICAL: Send END marker
-            net_send_line(cfd, "END");
+            net_sendbuf_line(&batch, "END");
+            net_sendbuf_flush(&batch);
+            net_sendbuf_free(&batch);
             
             // Log successful READ
             log_write("SS", "READ", "client", fname, 0);
         }
         else if (strncmp(line, "WRITE_BEGIN ", 12)==0) {
-            char fname[256]; int sidx=-1;
-            if (sscanf(line+12, "%255s %d", fname, &sidx) < 2) { net_send_line(cfd, "ERR bad args"); continue; }
+            // WRITE_BEGIN <file> <sentence> [WAIT <ms>]
+            char fname[256]; int sidx=-1, wait_ms=0;
+            if (sscanf(line+12, "%255s %d WAIT %d", fname, &sidx, &wait_ms) < 2) { net_send_line(cfd, "ERR bad args"); continue; }
             if (sidx < 0) { net_send_line(cfd, "ERR invalid sentence index"); continue; }
+            if (wait_ms < 0) { net_send_line(cfd, "ERR bad args"); continue; }
+            if (wait_ms > LOCK_WAIT_MAX_MS) wait_ms = LOCK_WAIT_MAX_MS;
 
-    char vpath[512];
-    snprintf(vpath, sizeof(vpath), "%s/%s", data_root, fname);
-    char *vbuf = NULL;
-    int vlen = 0;
-    
-    int file_exists = (read_file_all(vpath, &vbuf, &vlen) == 0);
-    
-    if (file_exists && vbuf != NULL && vlen > 0) {
-        // File exists with content - count sentences
-        int sentence_count = 0;
-        int in_sentence = 0;
-        int last_has_delimiter = 0;
-        
-        for (int i = 0; i < vlen; i++) {
-            char ch = vbuf[i];
-            if (ch != ' ' && ch != '\t' && ch != '\n' && ch != '\r') {
-                in_sentence = 1;
-                last_has_delimiter = 0;
-            }
-            if (ch == '.' || ch == '!' || ch == '?') {
-                sentence_count++;
-                in_sentence = 0;
-                last_has_delimiter = 1;
-            }
-        }
-        
-        if (in_sentence) {
-            sentence_count++;
-            last_has_delimiter = 0;
-        }
-        
-        free(vbuf);
-        
-        // Determine max allowed sentence index
-        // If last sentence is complete (has delimiter), can append new sentence
-        // If last sentence is incomplete, cannot append
-        int max_allowed = last_has_delimiter ? sentence_count : sentence_count - 1;
-        
-        if (sidx > max_allowed) {
+            // Range check off the sentence index instead of scanning the file
             char err[256];
-            snprintf(err, sizeof(err), "ERR: Sentence index out of range (max: %d)", max_allowed);
-            net_send_line(cfd, err);
-            continue;
-        }
-    } else {
-        // File doesn't exist or is empty - only sentence 0 valid
-        if (sidx > 0) {
-            net_send_line(cfd, "ERR: Sentence index out of range (file is empty)");
-            continue;
-        }
-    }
-
+            if (client_sentence_check(fname, sidx, err, sizeof(err)) != 0) { net_send_line(cfd, err); continue; }
 
-            
-            FileLock *fl = get_file_lock(fname);
-            if (!fl) { net_send_line(cfd, "ERR too many locked files"); continue; }
-            
-            pthread_mutex_lock(&fl->file_mutex);
-            // Check if sentence is already locked
-            if (sidx < 2048 && fl->locked_sentences[sidx] != -1) {
-                pthread_mutex_unlock(&fl->file_mutex);
-                release_file_lock(fl);
-                net_send_line(cfd, "ERR sentence locked");
+            // Lock the sentence for this session
+            int lrc = client_lock_wait(fname, sidx, sid, wait_ms);
+            if (lrc == 1) { net_send_line(cfd, "ERR sentence locked"); continue; }
+            if (lrc == 2) { net_send_line(cfd, "ERR sentence locked (wait timed out)"); continue; }
+            if (lrc != 0) { net_send_line(cfd, "ERR out of memory"); continue; }
+            // The holder may have changed the file while we queued, and
+            // moved the sentence with it
+            if (wait_ms > 0 && client_sentence_check(fname, lock_table_locate(sentence_locks, fname, sidx, sid), err, sizeof(err)) != 0) {
+                lock_table_release(sentence_locks, fname, sidx, sid);
+                net_send_line(cfd, err);
                 continue;
             }
-            // Lock the sentence (use connection fd as identifier)
-            if (sidx < 2048) fl->locked_sentences[sidx] = cfd;
-            pthread_mutex_unlock(&fl->file_mutex);
             
-            // Create swap file for this write session (copy original to swap file)
-            // This ensures STREAM always reads original file while WRITE modifies swap
-            char path[512]; snprintf(path, sizeof(path), "%s/%s", data_root, fname);
-            char swappath[512]; snprintf(swappath, sizeof(swappath), "%s/%s.swap.%d", data_root, fname, cfd);
-            char *buf=NULL; int len=0;
-            if (read_file_all(path, &buf, &len) == 0) {
-                // File exists - copy to swap file and create undo snapshot
-                write_file_all(swappath, buf, len);
-                char upath[512]; snprintf(upath, sizeof(upath), "%s/%s.bak", undo_root, fname);
-                write_file_all(upath, buf, len);
-                free(buf);
-            } else {
-                // File doesn't exist - create empty swap file
-                write_file_all(swappath, "", 0);
+            // Load the document into this connection's session; edits stay
+            // in memory until WRITE_END, so STREAM keeps reading the original
+            WriteSession *ws = write_session_find(sessions, fname);
+            // The log session is opened before the file is read, so it
+            // records the version the document starts from
+            EditLogSession *els = ws ? NULL : edit_log_begin(edit_log, fname);
+            client_settle(fname);
+            DocCacheEntry *doc = ws ? NULL : client_doc_get(fname);
+            // Another sentence of a file this connection is already editing
+            // keeps the edits made so far
+            if (!ws) {
+                ws = write_session_open(sessions, fname, doc, els);
+                if (ws) doc = NULL;     // the session's base now
+                else edit_log_end(edit_log, els);
+                // Its copy is the current version
+                if (ws) lock_table_rebase(sentence_locks, fname, sid);
+            }
+            doc_cache_release(doc_cache, doc);
+            if (!ws) {
+                lock_table_release(sentence_locks, fname, sidx, sid);
+                net_send_line(cfd, "ERR too many write sessions");
+                continue;
             }
             // Send lock info: filename and sentence index (we'll track this per connection)
             char lock_info[512]; snprintf(lock_info, sizeof(lock_info), "OK lock %s %d", fname, sidx);
             net_send_line(cfd, lock_info);
             
             // Log WRITE_BEGIN
-            char write_begin_log[512]; snprintf(write_begin_log, sizeof(write_begin_log), "file=%s sentence=%d", fname, sidx);
+            char write_begin_log[512]; snprintf(write_begin_log, sizeof(write_begin_log), "file=%s sentence=%d session=%ld", fname, sidx, sid);
             log_write("SS", "WRITE_BEGIN", "client", write_begin_log, 0);
         } else if (strncmp(line, "WRITE_UPDATE ", 13)==0) {
             // Parse lock info from line: WRITE_UPDATE <filename> <sentence_index> <word_index> <content>
@@ -272,157 +1016,36 @@ static void* handle_client_conn(void *arg) {
                 continue;
             }
             
-            FileLock *fl = get_file_lock(fname);
-            if (!fl) { net_send_line(cfd, "ERR file not found"); continue; }
-            
-            pthread_mutex_lock(&fl->file_mutex);
-            // Verify this connection owns the lock
-            if (sidx >= 2048 || fl->locked_sentences[sidx] != cfd) {
-                pthread_mutex_unlock(&fl->file_mutex);
-                release_file_lock(fl);
+            // Verify this connection owns the lock, and find the sentence
+            // in the session's document (others' commits may have moved
+            // it in the file since)
+            WriteSession *ws = write_session_find(sessions, fname);
+            int at = ws ? lock_table_locate(sentence_locks, fname, sidx, sid) : -1;
+            if (at < 0) {
                 net_send_line(cfd, "ERR not locked by this session");
                 continue;
             }
-            pthread_mutex_unlock(&fl->file_mutex);
-            
-            // load from SWAP file (not the real file!)
-            // This ensures STREAM always reads the original file
-            char path[512]; snprintf(path, sizeof(path), "%s/%s", data_root, fname);
-            char swappath[512]; snprintf(swappath, sizeof(swappath), "%s/%s.swap.%d", data_root, fname, cfd);
-            char *buf=NULL; int len=0; if (read_file_all(swappath, &buf, &len)!=0) { buf=strdup(""); len=0; }
-            // split into sentences by .!? keeping delimiters as terminators
-            // build dynamic array
-            char *text = buf; int n_sent=0; char *sents[2048]; int slens[2048];
-            char *start = text;
-            // Skip leading whitespace
-            while (start < text+len && (*start==' ' || *start=='\t' || *start=='\n' || *start=='\r')) start++;
-            for (int i=(int)(start-text);i<len;i++) {
-                char ch = text[i];
-                if (ch=='.' || ch=='!' || ch=='?') {
-                    int seglen = (int)((text+i+1) - start);
-                    if (n_sent < 2048 && seglen > 0) { 
-                        sents[n_sent] = (char*)malloc(seglen+1); 
-                        memcpy(sents[n_sent], start, seglen); 
-                        sents[n_sent][seglen]='\0'; 
-                        slens[n_sent]=seglen; 
-                        n_sent++; 
-                    }
-                    start = text+i+1;
-                    // Skip whitespace after delimiter
-                    while (start < text+len && (*start==' ' || *start=='\t' || *start=='\n' || *start=='\r')) start++;
-                }
-            }
-            if (start < text+len) {
-                int seglen = (int)((text+len) - start);
-                // Trim trailing whitespace
-                while (seglen > 0 && (start[seglen-1]==' ' || start[seglen-1]=='\t' || start[seglen-1]=='\n' || start[seglen-1]=='\r')) seglen--;
-                if (n_sent < 2048 && seglen > 0) { 
-                    sents[n_sent] = (char*)malloc(seglen+1); 
-                    memcpy(sents[n_sent], start, seglen); 
-                    sents[n_sent][seglen]='\0'; 
-                    slens[n_sent]=seglen; 
-                    n_sent++; 
-                }
-            }
-            if (n_sent==0) { sents[n_sent]=strdup(""); slens[n_sent]=0; n_sent++; }
-
-// ✅ CORRECTED: Auto-create sentences if needed (don't validate!)
-// During a WRITE session, new sentences can be created via delimiters
-// So we need to allow dynamic sentence creation up to sidx
-while (sidx >= n_sent && n_sent < 2048) {
-    sents[n_sent] = strdup("");
-    slens[n_sent] = 0;
-    n_sent++;
-}
-if (sidx >= n_sent) {
-    // Shouldn't happen, but handle gracefully
-    sidx = n_sent - 1;
-}
-
-            // words split by spaces, insert content at widx
-            char *sent = sents[sidx];
-            // Make a copy of sentence to avoid modifying original
-            char sent_copy[4096]; strncpy(sent_copy, sent, sizeof(sent_copy)-1); sent_copy[sizeof(sent_copy)-1]='\0';
-            // build words array from copy
-            char *wp = sent_copy; char *words[4096]; int wc=0;
-            while (*wp) {
-                while (*wp==' ') wp++;
-                if (!*wp) break;
-                words[wc++] = wp;
-                while (*wp && *wp!=' ') wp++;
-                if (*wp) { *wp='\0'; wp++; }
-            }
-            
             if (widx < 0) {
-    net_send_line(cfd, "ERR: Word index cannot be negative");
-    for (int i=0;i<n_sent;i++) free(sents[i]);
-    free(buf);
-    release_file_lock(fl);
-    continue;
-}
-
-int max_word_index = wc + 1;
-if (widx > max_word_index) {
-    char err[256];
-    snprintf(err, sizeof(err), "ERR: Word index out of range (max: %d)", max_word_index);
-    net_send_line(cfd, err);
-    for (int i=0;i<n_sent;i++) free(sents[i]);
-    free(buf);
-    release_file_lock(fl);
-    continue;
-}
-
-int insert_pos = widx;
-if (insert_pos > wc) insert_pos = wc;
-
-            // build new sentence with inserted content tokens
-            char newsent[4096]; newsent[0]='\0';
-            // copy words before widx
-            for (int i=0;i<insert_pos;i++) {
-                if (i>0) strcat(newsent, " ");
-                strcat(newsent, words[i]);
+                net_send_line(cfd, "ERR: Word index cannot be negative");
+                continue;
             }
-            // Add space before content if there are words before it
-            if (insert_pos > 0) strcat(newsent, " ");
-            // Add the new content
-            strcat(newsent, content);
-            // Add space after content if there are words after it
-            if (wc > insert_pos) strcat(newsent, " ");
-            // Add words after insertion point
-            for (int i=insert_pos;i<wc;i++) {
-                strcat(newsent, words[i]);
-                if (i < wc-1) strcat(newsent, " ");
+            // Logged first: replay repeats the insert, failures included
+            if (edit_log_update(edit_log, ws->log, at, widx, content) != 0) {
+                net_send_line(cfd, "ERR edit log write failed");
+                continue;
             }
-            // Replace the sentence with the new content
-            // Note: If newsent contains delimiters, they will be preserved in the sentence
-            // The file will be rebuilt and when read back, it will be split naturally
-            free(sents[sidx]); 
-            sents[sidx] = strdup(newsent); 
-            slens[sidx] = (int)strlen(newsent);
-            // rebuild full text - sentences already contain their delimiters
-            // Need to ensure proper spacing between sentences
-            char rebuilt[1<<20]; rebuilt[0]='\0';
-            for (int i=0;i<n_sent;i++) {
-                if (strlen(sents[i]) == 0) continue; // Skip empty sentences
-                if (strlen(rebuilt) > 0) {
-                    // Check if we need to add space between sentences
-                    int prev_len = (int)strlen(rebuilt);
-                    // If previous doesn't end with space and current doesn't start with space, add one
-                    if (prev_len > 0 && rebuilt[prev_len-1] != ' ' && rebuilt[prev_len-1] != '\t' && 
-                        sents[i][0] != ' ' && sents[i][0] != '\t') {
-                        strcat(rebuilt, " ");
-                    }
-                }
-                strcat(rebuilt, sents[i]);
+            // Insert the content into the session's copy of the sentence;
+            // delimiters in it split the sentence the same way a re-read would
+            int max_word_index = 0;
+            int irc = doc_insert(ws->doc, at, widx, content, &max_word_index);
+            if (irc == -1) {
+                char err[256];
+                snprintf(err, sizeof(err), "ERR: Word index out of range (max: %d)", max_word_index);
+                net_send_line(cfd, err);
+                continue;
             }
-            // persist to SWAP file (not the real file!)
-            pthread_mutex_lock(&fl->file_mutex);
-            write_file_all(swappath, rebuilt, (int)strlen(rebuilt));
-            pthread_mutex_unlock(&fl->file_mutex);
-            
-            for (int i=0;i<n_sent;i++) free(sents[i]);
-            free(buf);
-            release_file_lock(fl);
+            if (irc != 0) { net_send_line(cfd, "ERR out of memory"); continue; }
+            ws->dirty = 1;
             char write_update_log[512]; snprintf(write_update_log, sizeof(write_update_log), "file=%s sentence=%d word=%d", fname, sidx, widx);
             log_write("SS", "WRITE_UPDATE", "client", write_update_log, 0);
             net_send_line(cfd, "OK updated");
@@ -430,74 +1053,146 @@ if (insert_pos > wc) insert_pos = wc;
             // Parse: WRITE_END <filename> <sentence_index>
             char fname[256]; int sidx=-1;
             if (sscanf(line+9, "%255s %d", fname, &sidx) >= 2) {
-                // Move swap file to real file (atomically commit the write)
                 char path[512]; snprintf(path, sizeof(path), "%s/%s", data_root, fname);
-                char swappath[512]; snprintf(swappath, sizeof(swappath), "%s/%s.swap.%d", data_root, fname, cfd);
-                
-                // Read swap file and write to real file
-                char *buf=NULL; int len=0;
-                if (read_file_all(swappath, &buf, &len) == 0) {
-                    write_file_all(path, buf, len);
-                    free(buf);
+                // Serialize the session's document and commit it: a log
+                // record now, the data file from the applier
+                WriteSession *ws = write_session_find(sessions, fname);
+                if (ws && !lock_table_holds(sentence_locks, fname, sidx, sid)) {
+                    // The lease ran out and the sentence may have been
+                    // edited since: these edits are dropped, not committed
+                    if (lock_table_owned(sentence_locks, fname, sid) == 0) write_session_close(ws);
+                    char exp_log[512]; snprintf(exp_log, sizeof(exp_log), "file=%s sentence=%d session=%ld error=LOCK_EXPIRED", fname, sidx, sid);
+                    log_write("SS", "WRITE_END", "client", exp_log, -1);
+                    net_send_line(cfd, "ERR lock expired, changes discarded");
+                    continue;
                 }
-                // Clean up swap file
-                remove(swappath);
-                
-                FileLock *fl = get_file_lock(fname);
-                if (fl) {
-                    pthread_mutex_lock(&fl->file_mutex);
-                    if (sidx >= 0 && sidx < 2048 && fl->locked_sentences[sidx] == cfd) {
-                        fl->locked_sentences[sidx] = -1;  // Release lock
+                // Edits go on top of whatever was committed since the
+                // session began; only overlapping changes conflict
+                int rc = 0, merged = 0;
+                char *committed = NULL; int committed_len = 0;
+                if (ws && ws->dirty) {
+                    char *buf=NULL; int len=0;
+                    if (doc_serialize(ws->doc, &buf, &len) == 0) {
+                        ClientCommitJob j;
+                        memset(&j, 0, sizeof(j));
+                        j.session = ws->log; j.owner = sid; j.fname = fname; j.path = path;
+                        j.base = ws->base; j.base_len = ws->base_len;
+                        j.buf = buf; j.len = len;
+                        client_commit(&j);
+                        rc = j.rc; merged = j.merged;
+                        // The session carries on from what was committed,
+                        // or after a conflict from the current version
+                        if (rc == 0 && !j.out) { committed = buf; committed_len = len; buf = NULL; }
+                        else { committed = j.out; committed_len = j.out_len; }
+                        free(buf);
+                        ws->dirty = 0;
+                    } else {
+                        rc = -1;
                     }
-                    pthread_mutex_unlock(&fl->file_mutex);
-                    release_file_lock(fl);
                 }
-                char write_end_log[512]; snprintf(write_end_log, sizeof(write_end_log), "file=%s sentence=%d", fname, sidx);
-                log_write("SS", "WRITE_END", "client", write_end_log, 0);
+
+                lock_table_release(sentence_locks, fname, sidx, sid);
+                int still_editing = lock_table_owned(sentence_locks, fname, sid) > 0;
+                // Other sentences of this file still locked by this connection
+                // keep editing the same document
+                if (ws && !still_editing) write_session_close(ws);
+                else if (ws && committed) { write_session_rebase(ws, committed, committed_len, merged || rc == 1); committed = NULL; }
+                free(committed);
+                char write_end_log[512]; snprintf(write_end_log, sizeof(write_end_log), "file=%s sentence=%d session=%ld merged=%d%s", fname, sidx, sid, merged,
+                                                  rc == 1 ? " error=MERGE_CONFLICT" : rc < 0 ? " error=COMMIT_FAILED" : "");
+                log_write("SS", "WRITE_END", "client", write_end_log, rc == 0 ? 0 : -1);
+                if (rc == 1) { net_send_line(cfd, "ERR merge conflict, changes discarded"); continue; }
+                if (rc < 0) { net_send_line(cfd, "ERR commit failed"); continue; }
             }
             net_send_line(cfd, "OK end");
         } else if (strncmp(line, "STREAM ", 7)==0) {
-            char *fname = line+7; char path[512]; snprintf(path, sizeof(path), "%s/%s", data_root, fname);
-            char *buf=NULL; int len=0;
-            if (read_file_all(path, &buf, &len) != 0) { 
+            char *fname = line+7;
+            client_settle(fname);
+            DocCacheEntry *doc = client_doc_get(fname);
+            if (!doc) { 
                 log_write("SS", "STREAM", "client", fname, -1);
                 net_send_line(cfd, "ERR not found"); 
             }
             else {
                 net_send_line(cfd, "OK");
-                // stream word by word (split by spaces)
-                char *p = buf; while (*p) {
-                    while (*p==' '||*p=='\t'||*p=='\n' || *p=='\r') p++;
-                    if (!*p) break;
-                    char word[256]; int wi=0; while (*p && *p!=' ' && *p!='\t' && *p!='\n' && *p!='\r' && wi<255) { word[wi++]=*p++; }
-                    word[wi]='\0';
-                    net_send_line(cfd, word);
-#ifdef _WIN32
-                    Sleep(100);
-#else
-                    usleep(100000);
-#endif
+                // stream word by word (split by whitespace), one sentence
+                // at a time off the index. A word can run across a
+                // sentence end ("a.b"), so the partial word carries over.
+                DocIndex *ix = doc->ix;
+                char word[256]; int wi=0; int gone=0;
+                for (int si=0; si<ix->count && !gone; si++) {
+                    uint32_t off = ix->sents[si].start;
+                    uint32_t end = si+1 < ix->count ? ix->sents[si+1].start : off + ix->sents[si].len;
+                    if (end > (uint32_t)doc->len) break;
+                    const char *chunk = doc->data + off;
+                    for (uint32_t k=0; k<end-off && !gone; k++) {
+                        char ch = chunk[k];
+                        if (ch==' '||ch=='\t'||ch=='\n'||ch=='\r') {
+                            if (wi > 0) { word[wi]='\0'; wi=0; gone = stream_word(cfd, word) != 0; }
+                            continue;
+                        }
+                        if (wi == 255) { word[wi]='\0'; wi=0; gone = stream_word(cfd, word) != 0; }
+                        word[wi++] = ch;
+                    }
                 }
+                if (!gone && wi > 0) { word[wi]='\0'; stream_word(cfd, word); }
                 net_send_line(cfd, "STOP");
-                free(buf);
+                doc_cache_release(doc_cache, doc);
                 
                 // Log successful STREAM
                 log_write("SS", "STREAM", "client", fname, 0);
             }
+        } else if (strncmp(line, "COLLAB_JOIN ", 12)==0) {
+            // Live edits bypass the sentence locks this connection holds
+            int editing = 0;
+            for (int i = 0; i < MAX_WRITE_SESSIONS; i++) editing |= sessions[i].doc != NULL;
+            if (editing) { net_send_line(cfd, "ERR finish WRITE sessions before going live"); continue; }
+            if (client_live(conn, cfd, sid, line) != 0) break;
         } else if (strcmp(line, "QUIT")==0) { net_send_line(cfd, "BYE"); break; }
         else { net_send_line(cfd, "ERR unknown"); }
     }
-    net_close(cfd);
+    // Gone mid-edit: uncommitted edits are dropped and the locks go to
+    // whoever is waiting
+    for (int i=0; i<MAX_WRITE_SESSIONS; i++) {
+        if (!sessions[i].doc) continue;
+        int n = lock_table_release_owner(sentence_locks, sessions[i].fname, sid);
+        if (n > 0) {
+            char rel_log[512]; snprintf(rel_log, sizeof(rel_log), "file=%.255s session=%ld sentences=%d reason=disconnect", sessions[i].fname, sid, n);
+            log_write("SS", "LOCK_RELEASE", "client", rel_log, 0);
+        }
+        write_session_close(&sessions[i]);
+    }
+    net_conn_close(conn);
     return NULL;
 }
 
-static int handle_admin_conn(int afd) {
-    char line[1024];
-    if (net_recv_line(afd, line, sizeof(line)) <= 0) { net_close(afd); return -1; }
+static void client_conn_fiber(void *arg) {
+    handle_client_conn(arg);
+}
+
+// Case-insensitive search for a NUL-terminated keyword in len bytes
+static int contains_nocase(const char *data, int len, const char *keyword) {
+    int klen = (int)strlen(keyword);
+    if (klen == 0) return 1;
+    int first = tolower((unsigned char)keyword[0]);
+    for (int i = 0; i + klen <= len; i++) {
+        if (tolower((unsigned char)data[i]) != first) continue;
+        int k = 1;
+        while (k < klen && tolower((unsigned char)data[i+k]) == tolower((unsigned char)keyword[k])) k++;
+        if (k == klen) return 1;
+    }
+    return 0;
+}
+
+// Run one admin command. Reply lines go to out (the caller flushes it);
+// bulk FETCH/VIEWCHECKPOINT replies and the SYNC upload use the connection
+// directly. Returns -1 if the connection can't be used any more.
+static int handle_admin_command(NetConn *conn, NetSendBuf *out, char *line, int frames) {
+    int afd = conn->fd;
     if (strncmp(line, "CREATE ", 7)==0) {
         char *fname = line+7; 
         // Validate filename
-        if (!is_valid_filename(fname)) { net_send_line(afd, "ERR invalid filename (must be alphanumeric with extension, no spaces)"); }
+        if (!is_valid_filename(fname)) { net_sendbuf_line(out, "ERR invalid filename (must be alphanumeric with extension, no spaces)"); }
         else {
             char path[512]; snprintf(path, sizeof(path), "%s/%s", data_root, fname);
             // Create directory structure if path has folders
@@ -511,43 +1206,40 @@ static int handle_admin_conn(int afd) {
                 p++;
             }
             const char *empty = "";
+            edit_log_settle(edit_log, fname);
             if (write_file_all(path, empty, 0) != 0) { 
                 log_write("SS", "CREATE", "admin", fname, -1);
-                net_send_line(afd, "ERR create"); 
+                net_sendbuf_line(out, "ERR create"); 
             }
             else { 
+                ss_index_update(fname, empty, 0);
+                edit_log_reset(edit_log, fname);
+                ss_undo_clear(fname);
                 log_write("SS", "CREATE", "admin", fname, 0);
-                net_send_line(afd, "OK created"); 
+                net_sendbuf_line(out, "OK created"); 
             }
         }
     } else if (strncmp(line, "CHECKLOCK ", 10)==0) {
         char *fname = line+10;
-        pthread_mutex_lock(&locks_table_mutex);
-        int has_lock = 0;
-        for (int i=0; i<file_locks_count; i++) {
-            if (strcmp(file_locks[i].filename, fname) == 0) {
-                pthread_mutex_lock(&file_locks[i].file_mutex);
-                for (int j=0; j<2048; j++) {
-                    if (file_locks[i].locked_sentences[j] != -1) {
-                        has_lock = 1;
-                        break;
-                    }
-                }
-                pthread_mutex_unlock(&file_locks[i].file_mutex);
-                break;
-            }
-        }
-        pthread_mutex_unlock(&locks_table_mutex);
-        if (has_lock) net_send_line(afd, "ERR file locked");
-        else net_send_line(afd, "OK not locked");
+        if (lock_table_held(sentence_locks, fname) > 0) net_sendbuf_line(out, "ERR file locked");
+        else net_sendbuf_line(out, "OK not locked");
+    } else if (strncmp(line, "LOCKSTATS ", 10)==0) {
+        // Sentence lock contention on one file
+        LockStats ls; lock_table_file_stats(sentence_locks, line+10, &ls);
+        net_sendbuf_linef(out, "OK LOCKSTATS held=%d waiting=%d waits=%lld timeouts=%lld wait_ms=%lld wait_ms_max=%lld expired=%lld",
+                          ls.held, ls.waiting, ls.waits, ls.timeouts, ls.wait_ms, ls.wait_ms_max, ls.expired);
     } else if (strncmp(line, "DELETE ", 7)==0) {
         char *fname = line+7; char path[512]; snprintf(path, sizeof(path), "%s/%s", data_root, fname);
+        edit_log_settle(edit_log, fname);
         if (remove(path)==0) { 
+            ss_index_remove(fname);
+            edit_log_reset(edit_log, fname);
+            ss_undo_clear(fname);
             log_write("SS", "DELETE", "admin", fname, 0);
-            net_send_line(afd, "OK deleted"); 
+            net_sendbuf_line(out, "OK deleted"); 
         } else { 
             log_write("SS", "DELETE", "admin", fname, -1);
-            net_send_line(afd, "ERR delete");
+            net_sendbuf_line(out, "ERR delete");
         }
     } else if (strncmp(line, "CREATEFOLDER ", 13)==0) {
         char *fname = line+13;
@@ -556,7 +1248,7 @@ static int handle_admin_conn(int afd) {
         char *end = fname + strlen(fname) - 1;
         while (end > fname && (*end == ' ' || *end == '\t')) *end-- = '\0';
         if (*fname == '\0') {
-            net_send_line(afd, "ERR folder name required");
+            net_sendbuf_line(out, "ERR folder name required");
         } else {
             char path[512]; snprintf(path, sizeof(path), "%s/%s", data_root, fname);
             // Create directory structure if path has folders
@@ -572,169 +1264,202 @@ static int handle_admin_conn(int afd) {
             // Create the folder directory itself
             if (mkpath(path) == 0) {
                 log_write("SS", "CREATEFOLDER", "admin", fname, 0);
-                net_send_line(afd, "OK created");
+                net_sendbuf_line(out, "OK created");
             } else {
                 log_write("SS", "CREATEFOLDER", "admin", fname, -1);
-                net_send_line(afd, "ERR create");
+                net_sendbuf_line(out, "ERR create");
             }
         }
     } else if (strncmp(line, "INFO ", 5)==0) {
-        char *fname = line+5; char path[512]; snprintf(path, sizeof(path), "%s/%s", data_root, fname);
-        FILE *f = fopen(path, "rb");
-        if (!f) { 
+        char *fname = line+5;
+        // Counts come from the sentence index, not a scan of the file
+        edit_log_settle(edit_log, fname);
+        DocCacheEntry *doc = ss_doc_get(fname);
+        if (!doc) { 
             log_write("SS", "INFO", "admin", fname, -1);
-            net_send_line(afd, "SIZE 0 WORDS 0 CHARS 0");
+            net_sendbuf_line(out, "SIZE 0 WORDS 0 CHARS 0");
         } else {
-            fseek(f,0,SEEK_END); long sz = ftell(f); fseek(f,0,SEEK_SET);
-            char *content = (char*)malloc(sz+1);
-            if (content) {
-                fread(content, 1, sz, f);
-                content[sz] = '\0';
-                // Count words and chars
-                int words = 0, chars = (int)sz;
-                const char *p = content;
-                int in_word = 0;
-                while (*p) {
-                    if (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
-                        if (in_word) { words++; in_word = 0; }
-                    } else {
-                        in_word = 1;
-                    }
-                    p++;
-                }
-                if (in_word) words++;
-                char resp[128]; snprintf(resp, sizeof(resp), "SIZE %ld WORDS %d CHARS %d", sz, words, chars);
-                log_write("SS", "INFO", "admin", fname, 0);
-                net_send_line(afd, resp);
-                free(content);
-            } else {
-                char resp[64]; snprintf(resp, sizeof(resp), "SIZE %ld WORDS 0 CHARS 0", sz);
-                log_write("SS", "INFO", "admin", fname, 0);
-                net_send_line(afd, resp);
-            }
-            fclose(f);
+            DocIndex *ix = doc->ix;
+            char resp[128]; snprintf(resp, sizeof(resp), "SIZE %lld WORDS %u CHARS %u", (long long)ix->size, ix->words, ix->chars);
+            log_write("SS", "INFO", "admin", fname, 0);
+            net_sendbuf_line(out, resp);
+            doc_cache_release(doc_cache, doc);
         }
-    } else if (strncmp(line, "FETCH ", 7)==0) {
-        char *fname = line+7; char path[512]; snprintf(path, sizeof(path), "%s/%s", data_root, fname);
-        FILE *f = fopen(path, "rb");
-        if (!f) { 
+    } else if (strncmp(line, "FETCH ", 6)==0 && frames) {
+        char *fname = line+6; char path[512]; snprintf(path, sizeof(path), "%s/%s", data_root, fname);
+        edit_log_settle(edit_log, fname);
+        int src = send_file_reply(afd, path, "BEGIN");
+        if (src == 1) {
+            log_write("SS", "FETCH", "admin", fname, -1);
+            net_sendbuf_line(out, "ERR not found");
+        } else {
+            log_write("SS", "FETCH", "admin", fname, src);
+            if (src != 0) return -1;
+        }
+    } else if (strncmp(line, "FETCH ", 6)==0) {
+        char *fname = line+6;
+        edit_log_settle(edit_log, fname);
+        DocCacheEntry *doc = ss_doc_get(fname);
+        if (!doc) { 
             log_write("SS", "FETCH", "admin", fname, -1);
-            net_send_line(afd, "ERR not found"); 
+            net_sendbuf_line(out, "ERR not found"); 
         } else {
             log_write("SS", "FETCH", "admin", fname, 0);
-            net_send_line(afd, "BEGIN");
-            char lbuf[900];
-            while (fgets(lbuf, sizeof(lbuf), f)) {
-                // strip trailing newlines to keep protocol line-based
-                lbuf[strcspn(lbuf, "\r\n")] = 0;
-                char out[1024]; snprintf(out, sizeof(out), "L %s", lbuf);
-                net_send_line(afd, out);
-            }
-            fclose(f);
-            net_send_line(afd, "END");
+            net_sendbuf_line(out, "BEGIN");
+            // newlines stripped to keep the protocol line-based; a line
+            // travels whole as long as the reader can buffer it
+            sendbuf_text_lines(out, "L ", doc->data, doc->len, NET_CONN_MAX_LINE - 4);
+            doc_cache_release(doc_cache, doc);
+            net_sendbuf_line(out, "END");
         }
     } else if (strncmp(line, "UNDO ", 5)==0) {
-        char *fname = line+5; char upath[512]; snprintf(upath, sizeof(upath), "%s/%s.bak", undo_root, fname);
-        char *buf=NULL; int len=0; 
-        if (read_file_all(upath, &buf, &len)!=0) { 
-            log_write("SS", "UNDO", "admin", fname, -1);
-            net_send_line(afd, "ERR undo"); 
-        } else { 
-            char path[512]; snprintf(path, sizeof(path), "%s/%s", data_root, fname); 
-            write_file_all(path, buf, len); 
-            free(buf); 
-            remove(upath); 
-            log_write("SS", "UNDO", "admin", fname, 0);
-            net_send_line(afd, "OK undo"); 
+        // UNDO <file> [n]: apply the newest n reverse deltas
+        char fname[256]; int steps = 1;
+        if (sscanf(line+5, "%255s %d", fname, &steps) < 1 || steps < 1) {
+            log_write("SS", "UNDO", "admin", "", -1);
+            net_sendbuf_line(out, "ERR bad args");
+        } else {
+            char path[512]; snprintf(path, sizeof(path), "%s/%s", data_root, fname);
+            UndoFile *uf = undo_log_acquire(undo_log, fname);
+            edit_log_settle(edit_log, fname);
+            char *cur=NULL; int cur_len=0; char *buf=NULL; int len=0;
+            int rc = -1;
+            if (uf && read_file_all(path, &cur, &cur_len) == 0) {
+                rc = undo_log_undo(undo_log, uf, cur, cur_len, steps, &buf, &len);
+            }
+            if (rc == 0 && write_file_all(path, buf, len) != 0) rc = -3;
+            if (rc == 0) {
+                ss_index_update(fname, buf, len);
+                edit_log_reset(edit_log, fname);
+                undo_log_drop(undo_log, uf, steps);
+                ss_locks_follow(fname, cur, cur_len, buf, len, 0);
+                log_write("SS", "UNDO", "admin", fname, 0);
+                net_sendbuf_line(out, "OK undo");
+            } else {
+                log_write("SS", "UNDO", "admin", fname, -1);
+                if (rc == -2) net_sendbuf_line(out, "ERR undo: file changed outside its history");
+                else if (rc == -1) net_sendbuf_linef(out, "ERR undo: %d level(s) of history", undo_log_depth(undo_log, uf));
+                else net_sendbuf_line(out, "ERR undo");
+            }
+            undo_log_release(uf);
+            free(cur); free(buf);
         }
     } else if (strncmp(line, "CHECKPOINT ", 11)==0) {
         char fname[256], tag[64];
-        if (sscanf(line+11, "%255s %63s", fname, tag) != 2) { 
+        // Tags name directories: no hidden names (the catalog is .catalog), no paths
+        if (sscanf(line+11, "%255s %63s", fname, tag) != 2 || tag[0] == '.' || strchr(tag, '/')) { 
             log_write("SS", "CHECKPOINT", "admin", fname, -1);
-            net_send_line(afd, "ERR bad args"); 
+            net_sendbuf_line(out, "ERR bad args"); 
         } else {
             char path[512]; snprintf(path, sizeof(path), "%s/%s", data_root, fname);
             char *buf=NULL; int len=0;
+            edit_log_settle(edit_log, fname);
             if (read_file_all(path, &buf, &len) != 0) { 
                 log_write("SS", "CHECKPOINT", "admin", fname, -1);
-                net_send_line(afd, "ERR not found"); 
+                net_sendbuf_line(out, "ERR not found"); 
             } else {
-                char cpath[512]; snprintf(cpath, sizeof(cpath), "%s/%s/%s", checkpoint_root, fname, tag);
-                mkpath(cpath);
-                snprintf(cpath, sizeof(cpath), "%s/%s/%s/file", checkpoint_root, fname, tag);
-                write_file_all(cpath, buf, len);
+                char cpath[PATH_MAX];
+                int crc = chunk_store && checkpoint_path(cpath, fname, tag, "manifest") == 0
+                              ? chunk_store_save(chunk_store, cpath, buf, len) : -1;
+                if (crc == 0) {
+                    // A full copy left from before the chunk store is stale now
+                    if (checkpoint_path(cpath, fname, tag, "file") == 0) remove(cpath);
+                    catalog_add(checkpoint_catalog, fname, tag, buf, len);
+                }
                 free(buf);
-                log_write("SS", "CHECKPOINT", "admin", fname, 0);
-                net_send_line(afd, "OK checkpoint created");
+                log_write("SS", "CHECKPOINT", "admin", fname, crc);
+                if (crc == 0) net_sendbuf_line(out, "OK checkpoint created");
+                else net_sendbuf_line(out, "ERR checkpoint failed");
             }
         }
     } else if (strncmp(line, "VIEWCHECKPOINT ", 15)==0) {
         char fname[256], tag[64];
-        if (sscanf(line+15, "%255s %63s", fname, tag) != 2) { net_send_line(afd, "ERR bad args"); }
+        CheckpointEntry ce;
+        if (sscanf(line+15, "%255s %63s", fname, tag) != 2) { net_sendbuf_line(out, "ERR bad args"); }
+        else if (catalog_find(checkpoint_catalog, fname, tag, &ce) != 0) { net_sendbuf_line(out, "ERR not found"); }
         else {
-            char cpath[512]; snprintf(cpath, sizeof(cpath), "%s/%s/%s/file", checkpoint_root, fname, tag);
             char *buf=NULL; int len=0;
-            if (read_file_all(cpath, &buf, &len) != 0) { net_send_line(afd, "ERR not found"); }
-            else { net_send_line(afd, "OK"); net_send_line(afd, buf); free(buf); }
+            if (frames) {
+                int src = checkpoint_send(afd, fname, tag);
+                if (src == 1) net_sendbuf_line(out, "ERR not found");
+                else if (src != 0) return -1;
+            }
+            else if (checkpoint_load(fname, tag, &buf, &len) != 0) { net_sendbuf_line(out, "ERR not found"); }
+            else { net_sendbuf_line(out, "OK"); net_sendbuf_line(out, buf); free(buf); }
         }
     } else if (strncmp(line, "REVERT ", 7)==0) {
         char fname[256], tag[64];
         if (sscanf(line+7, "%255s %63s", fname, tag) != 2) { 
             log_write("SS", "REVERT", "admin", fname, -1);
-            net_send_line(afd, "ERR bad args"); 
+            net_sendbuf_line(out, "ERR bad args"); 
         } else {
-            char cpath[512]; snprintf(cpath, sizeof(cpath), "%s/%s/%s/file", checkpoint_root, fname, tag);
             char *buf=NULL; int len=0;
-            if (read_file_all(cpath, &buf, &len) != 0) { 
+            CheckpointEntry ce;
+            if (catalog_find(checkpoint_catalog, fname, tag, &ce) != 0 || checkpoint_load(fname, tag, &buf, &len) != 0) { 
                 log_write("SS", "REVERT", "admin", fname, -1);
-                net_send_line(afd, "ERR not found"); 
+                net_sendbuf_line(out, "ERR not found"); 
+            } else if (hash_bytes(buf, len) != ce.hash) {
+                free(buf);
+                log_write("SS", "REVERT", "admin", fname, -1);
+                net_sendbuf_line(out, "ERR checkpoint damaged");
             } else {
-                char path[512]; snprintf(path, sizeof(path), "%s/%s", data_root, fname);
-                write_file_all(path, buf, len);
+                ss_replace_file(fname, buf, len);
                 free(buf);
                 log_write("SS", "REVERT", "admin", fname, 0);
-                net_send_line(afd, "OK reverted");
+                net_sendbuf_line(out, "OK reverted");
             }
         }
     } else if (strncmp(line, "LISTCHECKPOINTS ", 16)==0) {
-        char fname[256];
-        if (sscanf(line+16, "%255s", fname) != 1) { 
+        // LISTCHECKPOINTS <file> [SORT time|tag|size] [DESC] [OFFSET n] [LIMIT n]
+        char fname[256] = ""; int consumed = 0;
+        CatalogSort sort = CATALOG_SORT_TIME; int desc = 0, offset = 0, limit = 0, bad = 0;
+        if (sscanf(line+16, "%255s%n", fname, &consumed) != 1) bad = 1;
+        char opts[512] = "";
+        if (!bad) { strncpy(opts, line+16+consumed, sizeof(opts)-1); }
+        char *save = NULL;
+        for (char *tok = strtok_r(opts, " ", &save); tok && !bad; tok = strtok_r(NULL, " ", &save)) {
+            char *arg = NULL;
+            if (strcasecmp(tok, "DESC") == 0) desc = 1;
+            else if (strcasecmp(tok, "ASC") == 0) desc = 0;
+            else if (!(arg = strtok_r(NULL, " ", &save))) bad = 1;
+            else if (strcasecmp(tok, "SORT") == 0) bad = catalog_parse_sort(arg, &sort) != 0;
+            else if (strcasecmp(tok, "OFFSET") == 0) offset = atoi(arg);
+            else if (strcasecmp(tok, "LIMIT") == 0) limit = atoi(arg);
+            else bad = 1;
+        }
+        CheckpointEntry *list = NULL; int count = 0, total = 0;
+        if (bad || offset < 0 || limit < 0) {
+            log_write("SS", "LISTCHECKPOINTS", "admin", fname, -1);
+            net_sendbuf_line(out, "ERR bad args"); 
+        } else if (catalog_list(checkpoint_catalog, fname, sort, desc, offset, limit, &list, &count, &total) != 0) {
             log_write("SS", "LISTCHECKPOINTS", "admin", fname, -1);
-            net_send_line(afd, "ERR bad args"); 
+            net_sendbuf_line(out, "ERR list failed");
         } else {
-            char dir[512]; snprintf(dir, sizeof(dir), "%s/%s", checkpoint_root, fname);
             log_write("SS", "LISTCHECKPOINTS", "admin", fname, 0);
-            net_send_line(afd, "CHECKPOINTS:");
-            // Simple: list directory entries (platform-specific, simplified)
-            char cmd[1024];
-#ifdef _WIN32
-            snprintf(cmd, sizeof(cmd), "dir /b \"%s\" 2>nul", dir);
-#else
-            snprintf(cmd, sizeof(cmd), "ls \"%s\" 2>/dev/null", dir);
-#endif
-            FILE *fp = popen(cmd, "r");
-            if (fp) {
-                char tag[256];
-                while (fgets(tag, sizeof(tag), fp)) {
-                    tag[strcspn(tag, "\r\n")] = 0;
-                    if (strlen(tag) > 0) {
-                        char out[512]; snprintf(out, sizeof(out), "--> %s", tag);
-                        net_send_line(afd, out);
-                    }
-                }
-                pclose(fp);
+            net_sendbuf_linef(out, "CHECKPOINTS: %d of %d", count, total);
+            for (int i = 0; i < count; i++) {
+                time_t t = (time_t)list[i].created; struct tm tmv; char when[32];
+                localtime_r(&t, &tmv);
+                strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tmv);
+                net_sendbuf_linef(out, "--> %s  %s  %lld bytes", list[i].tag, when, list[i].size);
             }
-            net_send_line(afd, "END");
+            net_sendbuf_line(out, "END");
+            free(list);
         }
     } else if (strncmp(line, "MOVE ", 5)==0) {
         char oldpath[512], newpath[512];
         if (sscanf(line+5, "%511s %511s", oldpath, newpath) != 2) { 
             log_write("SS", "MOVE", "admin", oldpath, -1);
-            net_send_line(afd, "ERR bad args"); 
+            net_sendbuf_line(out, "ERR bad args"); 
         } else {
-            char opath[512], npath[512];
-            snprintf(opath, sizeof(opath), "%s/%s", data_root, oldpath);
-            snprintf(npath, sizeof(npath), "%s/%s", data_root, newpath);
+            char opath[PATH_MAX], npath[PATH_MAX];
+            int on = snprintf(opath, sizeof(opath), "%s/%s", data_root, oldpath);
+            int nn = snprintf(npath, sizeof(npath), "%s/%s", data_root, newpath);
+            if (on < 0 || on >= (int)sizeof(opath) || nn < 0 || nn >= (int)sizeof(npath)) {
+                log_write("SS", "MOVE", "admin", oldpath, -1);
+                net_sendbuf_line(out, "ERR path too long");
+                return 0;
+            }
             // Create directory for new path
             char *p = npath;
             while (*p) {
@@ -746,12 +1471,18 @@ static int handle_admin_conn(int afd) {
                 p++;
             }
             // Rename/move file
+            edit_log_settle(edit_log, oldpath);
+            edit_log_settle(edit_log, newpath);
             if (rename(opath, npath) == 0) {
+                ss_index_move(oldpath, newpath);
+                edit_log_reset(edit_log, oldpath);
+                edit_log_reset(edit_log, newpath);
+                undo_log_move(undo_log, oldpath, newpath);
                 log_write("SS", "MOVE", "admin", oldpath, 0);
-                net_send_line(afd, "OK moved");
+                net_sendbuf_line(out, "OK moved");
             } else {
                 log_write("SS", "MOVE", "admin", oldpath, -1);
-                net_send_line(afd, "ERR move failed");
+                net_sendbuf_line(out, "ERR move failed");
             }
         }
     } else if (strncmp(line, "SYNC ", 5)==0) {
@@ -761,22 +1492,25 @@ static int handle_admin_conn(int afd) {
         char fname[256];
         if (sscanf(line+5, "%255s", fname) != 1) {
             log_write("SS", "SYNC", "admin", "", -1);
-            net_send_line(afd, "ERR bad args");
+            net_sendbuf_line(out, "ERR bad args");
         } else {
             log_write("SS", "SYNC", "admin", fname, 0);
-            net_send_line(afd, "OK");
+            net_sendbuf_line(out, "OK");
+            if (net_sendbuf_flush(out) != 0) return -1;
+            char *payload = NULL; int payload_len = 0;
+            if (frames && net_conn_recv_payload(conn, &payload, &payload_len) != 0) {
+                return -1;
+            }
             // Read content until END
-            char content[65536] = "";
+            NetSendBuf content; net_sendbuf_init(&content, -1);
             int first_line = 1;
-            while (1) {
-                char line_buf[4096];
-                if (net_recv_line(afd, line_buf, sizeof(line_buf)) <= 0) break;
+            while (!frames) {
+                char *line_buf;
+                if (net_conn_next_line(conn, &line_buf) <= 0) break;
                 if (strcmp(line_buf, "END") == 0) break;
-                if (!first_line) {
-                    strncat(content, "\n", sizeof(content) - strlen(content) - 1);
-                }
+                if (!first_line) net_sendbuf_append(&content, "\n", 1);
                 first_line = 0;
-                strncat(content, line_buf, sizeof(content) - strlen(content) - 1);
+                net_sendbuf_append(&content, line_buf, (int)strlen(line_buf));
             }
             // Write file
             char path[512];
@@ -791,19 +1525,24 @@ static int handle_admin_conn(int afd) {
                 }
                 p++;
             }
-            if (write_file_all(path, content, (int)strlen(content)) == 0) {
-                net_send_line(afd, "OK synced");
+            int wrc = frames ? ss_replace_file(fname, payload, payload_len)
+                    : content.err ? -1 : ss_replace_file(fname, content.buf ? content.buf : "", content.len);
+            free(payload);
+            net_sendbuf_free(&content);
+            if (wrc == 0) {
+                net_sendbuf_line(out, "OK synced");
             } else {
-                net_send_line(afd, "ERR sync failed");
+                net_sendbuf_line(out, "ERR sync failed");
             }
         }
     } else if (strncmp(line, "SEARCH ", 7)==0) {
         char keyword[256];
         if (sscanf(line+7, "%255s", keyword) != 1) {
             log_write("SS", "SEARCH", "admin", "", -1);
-            net_send_line(afd, "ERR bad args");
+            net_sendbuf_line(out, "ERR bad args");
         } else {
             log_write("SS", "SEARCH", "admin", keyword, 0);
+            edit_log_settle_all(edit_log);
             // Search through all files in data_root
             // List all files and search their contents
             int match_count = 0;
@@ -824,67 +1563,463 @@ static int handle_admin_conn(int afd) {
                     // Remove trailing newline
                     filepath[strcspn(filepath, "\r\n")] = 0;
                     if (strlen(filepath) == 0) continue;
+                    // A commit or index write in flight is not a document
+                    const char *base = strrchr(filepath, '/');
+                    long pid;
+                    if (scratch_file_name(base ? base + 1 : filepath, &pid)) continue;
                     
-                    // Read file and search for keyword
-                    char *buf = NULL;
-                    int len = 0;
-                    if (read_file_all(filepath, &buf, &len) == 0 && buf != NULL) {
-                        // Case-insensitive search
-                        char *content_lower = (char*)malloc(len + 1);
-                        char *keyword_lower = (char*)malloc(strlen(keyword) + 1);
-                        if (content_lower && keyword_lower) {
-                            // Convert to lowercase for case-insensitive search
-                            for (int i = 0; i < len; i++) {
-                                content_lower[i] = (char)tolower((unsigned char)buf[i]);
-                            }
-                            content_lower[len] = '\0';
-                            for (int i = 0; keyword[i]; i++) {
-                                keyword_lower[i] = (char)tolower((unsigned char)keyword[i]);
+                    // Scan the file where it lies (mapped if large)
+                    MappedFile *mf = mapped_file_open(filepath);
+                    if (mf) {
+                        if (contains_nocase(mf->data, mf->len, keyword)) {
+                            // Extract relative path from data_root
+                            const char *rel_path = filepath;
+                            int data_root_len = (int)strlen(data_root);
+                            if (strncmp(filepath, data_root, data_root_len) == 0) {
+                                rel_path = filepath + data_root_len;
+                                if (*rel_path == '/' || *rel_path == '\\') rel_path++;
                             }
-                            keyword_lower[strlen(keyword)] = '\0';
-                            
-                            // Search for keyword
-                            if (strstr(content_lower, keyword_lower) != NULL) {
-                                // Extract relative path from data_root
-                                const char *rel_path = filepath;
-                                int data_root_len = (int)strlen(data_root);
-                                if (strncmp(filepath, data_root, data_root_len) == 0) {
-                                    rel_path = filepath + data_root_len;
-                                    if (*rel_path == '/' || *rel_path == '\\') rel_path++;
-                                }
-                                strncpy(results[match_count], rel_path, sizeof(results[match_count])-1);
-                                results[match_count][sizeof(results[match_count])-1] = '\0';
-                                match_count++;
-                            }
-                            free(content_lower);
-                            free(keyword_lower);
+                            // A suffix of filepath, so it always fits
+                            snprintf(results[match_count], sizeof(results[match_count]), "%s", rel_path);
+                            match_count++;
                         }
-                        free(buf);
+                        mapped_file_release(mf);
                     }
                 }
                 pclose(fp);
             }
             
             // Send results
-            if (match_count > 0) {
-                net_send_line(afd, "OK");
-                for (int i = 0; i < match_count; i++) {
-                    net_send_line(afd, results[i]);
-                }
-            } else {
-                net_send_line(afd, "OK");
+            net_sendbuf_line(out, "OK");
+            for (int i = 0; i < match_count; i++) {
+                net_sendbuf_line(out, results[i]);
             }
-            net_send_line(afd, "END");
+            net_sendbuf_line(out, "END");
         }
     } else {
-        net_send_line(afd, "ERR unknown");
+        net_sendbuf_line(out, "ERR unknown");
     }
-    net_close(afd); return 0;
+    return 0;
+}
+
+// The NM keeps admin connections open in a pool, so each connection gets
+// its own thread and serves commands until the NM closes it or sends QUIT.
+// Admin dispatch: one poll loop owns the admin listener and every idle
+// admin connection. Each complete command line is queued on a bounded
+// worker pool, so a long SEARCH or a bulk SYNC/FETCH never holds up
+// accepts or other admin traffic. A connection is either polled or owned
+// by one worker (busy), never both. When the queue is full the command is
+// answered "ERR SS busy" on the loop thread, without waiting: a peer that
+// can't take the reply at once is disconnected.
+//
+// SEARCH and the bulk commands also share per-class slots (AdminLimit). A
+// command whose class is full is parked on admin_held instead of holding
+// a worker, and queued again when a slot frees up; one that waited
+// ADMIN_LIMIT_WAIT_SEC is answered "ERR SS busy".
+//
+// A connection that opened with "HELLO FRAMES RPC" is multiplexed instead:
+// every request is a LINE frame tagged with a request id, the loop keeps
+// polling it and queues each request as its own job, and each job answers
+// with one LINE frame (the reply lines, newline-terminated) carrying the
+// same id, in whatever order the jobs finish. Bulk transfers (FETCH, SYNC,
+// VIEWCHECKPOINT) stream on the connection itself and stay on plain
+// connections.
+typedef struct {
+    const char *name;
+    int max;            // concurrent commands of this class
+    int active;
+} AdminLimit;
+
+// A job parked until its command's class has a free slot
+typedef struct AdminHeld {
+    ThreadPoolFn fn;
+    void *arg;
+    AdminLimit *limit;
+    time_t until;           // refused after this; 0 = not waiting
+    struct AdminHeld *next;
+} AdminHeld;
+
+typedef struct AdminConn {
+    NetConn *conn;
+    int frames;
+    int rpc;
+    int busy;
+    int inflight;           // RPC jobs queued or running
+    int closing;
+    pthread_mutex_t send_mutex;     // RPC replies from concurrent jobs
+    char line[1024];        // command being run, kept while it is held
+    AdminHeld held;
+    struct AdminConn *next;
+} AdminConn;
+
+typedef struct {
+    AdminConn *ac;
+    uint32_t req_id;
+    char *line;
+    AdminHeld held;
+} AdminRpcJob;
+
+#define ADMIN_LIMIT_SEARCH 0
+#define ADMIN_LIMIT_BULK 1
+#define ADMIN_LIMIT_WAIT_SEC 5
+#define ADMIN_HELD 2        // admin_dispatch_line: parked, will run again
+
+static ThreadPool *admin_pool = NULL;
+static int admin_workers = 8;
+static int admin_queue_max = 64;
+static pthread_mutex_t admin_mutex = PTHREAD_MUTEX_INITIALIZER;
+static AdminConn *admin_conns = NULL;
+static AdminHeld *admin_held = NULL;    // oldest first
+static int admin_wake_pipe[2] = { -1, -1 };
+static AdminLimit admin_limits[] = {
+    { "search", 2, 0 },     // SEARCH: find + read every file
+    { "bulk", 4, 0 },       // FETCH / SYNC / VIEWCHECKPOINT: whole-file transfers
+};
+
+static AdminLimit* admin_limit_for(const char *line) {
+    if (strncmp(line, "SEARCH ", 7)==0) return &admin_limits[ADMIN_LIMIT_SEARCH];
+    if (strncmp(line, "FETCH ", 6)==0 || strncmp(line, "SYNC ", 5)==0 ||
+        strncmp(line, "VIEWCHECKPOINT ", 15)==0) return &admin_limits[ADMIN_LIMIT_BULK];
+    return NULL;
+}
+
+static void admin_wake_loop(void) {
+    char c = 1;
+    if (write(admin_wake_pipe[1], &c, 1) < 0) { /* loop is already awake */ }
+}
+
+// Caller holds admin_mutex
+static void admin_hold(AdminHeld *h) {
+    AdminHeld **link = &admin_held;
+    while (*link) link = &(*link)->next;
+    h->next = NULL;
+    *link = h;
+}
+
+// Queue a held job again. Returns -1 if the queue is full: it stays held
+// then, for the loop to retry.
+static int admin_resubmit(AdminHeld *h) {
+    if (thread_pool_submit(admin_pool, h->fn, h->arg) == 0) return 0;
+    pthread_mutex_lock(&admin_mutex);
+    admin_hold(h);
+    pthread_mutex_unlock(&admin_mutex);
+    return -1;
+}
+
+// Take a slot in the command's class for h's job. Returns 0 with the slot
+// taken, -1 once the job has waited ADMIN_LIMIT_WAIT_SEC, or ADMIN_HELD if
+// it was parked: then it belongs to admin_held, and the caller must return
+// without touching it.
+static int admin_limit_enter(AdminLimit *l, AdminHeld *h) {
+    time_t now = time(NULL);
+    pthread_mutex_lock(&admin_mutex);
+    if (l->active < l->max) {
+        l->active++;
+        pthread_mutex_unlock(&admin_mutex);
+        h->until = 0;
+        return 0;
+    }
+    if (!h->until) h->until = now + ADMIN_LIMIT_WAIT_SEC;
+    if (now >= h->until) {
+        pthread_mutex_unlock(&admin_mutex);
+        h->until = 0;
+        return -1;
+    }
+    h->limit = l;
+    admin_hold(h);
+    pthread_mutex_unlock(&admin_mutex);
+    admin_wake_loop();      // so it times the wait out
+    return ADMIN_HELD;
+}
+
+// Free the slot and give it to the oldest job held for this class
+static void admin_limit_leave(AdminLimit *l) {
+    AdminHeld *h = NULL;
+    pthread_mutex_lock(&admin_mutex);
+    l->active--;
+    for (AdminHeld **link = &admin_held; *link; link = &(*link)->next) {
+        if ((*link)->limit == l) { h = *link; *link = h->next; break; }
+    }
+    pthread_mutex_unlock(&admin_mutex);
+    if (h && admin_resubmit(h) != 0) admin_wake_loop();
+}
+
+// Queue and limit counters as one line, for STATS and the NM heartbeat
+static void admin_stats_format(char *buf, int buflen) {
+    int depth = thread_pool_depth(admin_pool);
+    int busy = thread_pool_busy(admin_pool);
+    pthread_mutex_lock(&admin_mutex);
+    snprintf(buf, buflen, "queue=%d queue_max=%d workers=%d busy=%d search=%d/%d bulk=%d/%d",
+             depth, admin_queue_max, admin_pool ? admin_pool->nthreads : 0, busy,
+             admin_limits[ADMIN_LIMIT_SEARCH].active, admin_limits[ADMIN_LIMIT_SEARCH].max,
+             admin_limits[ADMIN_LIMIT_BULK].active, admin_limits[ADMIN_LIMIT_BULK].max);
+    pthread_mutex_unlock(&admin_mutex);
+}
+
+// Run one line from an admin connection, replying into out. Returns 0 when
+// the connection should be closed, ADMIN_HELD if the job was parked on
+// held (see admin_limit_enter).
+static int admin_dispatch_line(AdminConn *ac, NetSendBuf *out, char *line, AdminHeld *held) {
+    if (strncmp(line, "HELLO", 5)==0) {
+        // Capability exchange; applies to the rest of this connection
+        if (frames_enabled && strstr(line, "RPC") != NULL) {
+            net_sendbuf_line(out, "OK HELLO FRAMES RPC");
+            // Replies leave as separate small frames; don't let Nagle hold them
+            net_set_nodelay(ac->conn->fd);
+            pthread_mutex_lock(&admin_mutex);
+            ac->frames = ac->rpc = 1;
+            pthread_mutex_unlock(&admin_mutex);
+        } else {
+            ac->frames = net_hello_reply(ac->conn->fd, line, frames_enabled);
+        }
+        return 1;
+    }
+    if (strcmp(line, "QUIT")==0) { net_sendbuf_line(out, "BYE"); return 0; }
+    if (strcmp(line, "STATS")==0) {
+        char stats[256]; admin_stats_format(stats, sizeof(stats));
+        char dstats[128]; durable_stats_format(dstats, sizeof(dstats));
+        char cstats[160] = "";
+        if (chunk_store) chunk_store_stats_format(chunk_store, cstats, sizeof(cstats));
+        char kstats[192]; doc_cache_stats_format(doc_cache, kstats, sizeof(kstats));
+        char lstats[224]; lock_table_stats_format(sentence_locks, lstats, sizeof(lstats));
+        char vstats[96]; collab_stats_format(collab_hub, vstats, sizeof(vstats));
+        net_sendbuf_linef(out, "OK STATS %s %s %s %s %s %s", stats, dstats, cstats, kstats, lstats, vstats);
+        return 1;
+    }
+    AdminLimit *limit = admin_limit_for(line);
+    int entered = limit ? admin_limit_enter(limit, held) : 0;
+    if (entered == ADMIN_HELD) return ADMIN_HELD;
+    if (entered != 0) {
+        log_write("SS", "ADMIN_BUSY", "admin", line, -1);
+        net_sendbuf_line(out, "ERR SS busy");
+        return 1;
+    }
+    int rc = handle_admin_command(ac->conn, out, line, ac->frames);
+    if (limit) admin_limit_leave(limit);
+    return rc == 0;
+}
+
+// One RPC reply frame; concurrent jobs share the socket
+static void admin_rpc_reply(AdminConn *ac, uint32_t req_id, const char *data, int len) {
+    pthread_mutex_lock(&ac->send_mutex);
+    net_send_frame(ac->conn->fd, NET_OP_LINE, 0, req_id, data, (uint32_t)len);
+    pthread_mutex_unlock(&ac->send_mutex);
+}
+
+// Worker job: every complete command buffered on the connection, then hand
+// it back to the poll loop. A held command runs again before newer ones;
+// while it is held the connection stays busy.
+static void admin_conn_job(void *arg) {
+    AdminConn *ac = (AdminConn*)arg;
+    int keep = 1;
+    while (keep && !ac->rpc) {
+        if (!ac->held.until) {
+            if (!net_conn_has_line(ac->conn, sizeof(ac->line))) break;
+            if (net_conn_recv_line(ac->conn, ac->line, sizeof(ac->line)) <= 0) { keep = 0; break; }
+        }
+        NetSendBuf out; net_sendbuf_init(&out, ac->conn->fd);
+        keep = admin_dispatch_line(ac, &out, ac->line, &ac->held);
+        if (keep == ADMIN_HELD) { net_sendbuf_free(&out); return; }
+        if (net_sendbuf_flush(&out) != 0) keep = 0;
+        net_sendbuf_free(&out);
+    }
+    pthread_mutex_lock(&admin_mutex);
+    ac->busy = 0;
+    if (!keep) ac->closing = 1;
+    pthread_mutex_unlock(&admin_mutex);
+    admin_wake_loop();
+}
+
+// Worker job for one RPC request
+static void admin_rpc_job(void *arg) {
+    AdminRpcJob *job = (AdminRpcJob*)arg;
+    AdminConn *ac = job->ac;
+    NetSendBuf out; net_sendbuf_init(&out, -1);
+    if (strncmp(job->line, "FETCH ", 6)==0 || strncmp(job->line, "SYNC ", 5)==0 ||
+        strncmp(job->line, "VIEWCHECKPOINT ", 15)==0 || strncmp(job->line, "HELLO", 5)==0 ||
+        strcmp(job->line, "QUIT")==0) {
+        net_sendbuf_line(&out, "ERR not supported over RPC");
+    } else if (admin_dispatch_line(ac, &out, job->line, &job->held) == ADMIN_HELD) {
+        net_sendbuf_free(&out);
+        return;
+    }
+    admin_rpc_reply(ac, job->req_id, out.buf ? out.buf : "", out.len);
+    net_sendbuf_free(&out);
+    free(job->line);
+    free(job);
+    pthread_mutex_lock(&admin_mutex);
+    ac->inflight--;
+    pthread_mutex_unlock(&admin_mutex);
+    admin_wake_loop();
+}
+
+// Loop thread: queue every whole request frame buffered on an RPC
+// connection. Returns -1 if the stream is broken.
+static int admin_rpc_queue(AdminConn *ac) {
+    int ready;
+    while ((ready = net_conn_has_frame(ac->conn)) == 1) {
+        NetFrameHdr h; char *payload = NULL;
+        if (net_conn_recv_frame(ac->conn, &h, &payload) < 0) return -1;
+        if (h.op != NET_OP_LINE) { free(payload); return -1; }
+        AdminRpcJob *job = (AdminRpcJob*)calloc(1, sizeof(AdminRpcJob));
+        if (!job) { free(payload); return -1; }
+        job->ac = ac;
+        job->req_id = h.req_id;
+        job->line = payload;
+        job->held.fn = admin_rpc_job;
+        job->held.arg = job;
+        pthread_mutex_lock(&admin_mutex);
+        ac->inflight++;
+        pthread_mutex_unlock(&admin_mutex);
+        if (thread_pool_submit(admin_pool, admin_rpc_job, job) != 0) {
+            log_write("SS", "ADMIN_BUSY", "admin", payload, -1);
+            // A reply job may be mid-send on this socket; don't wait for it
+            int sent = pthread_mutex_trylock(&ac->send_mutex) == 0;
+            if (sent) {
+                sent = net_send_frame_nowait(ac->conn->fd, NET_OP_LINE, 0, h.req_id, "ERR SS busy\n", 12) == 0;
+                pthread_mutex_unlock(&ac->send_mutex);
+            }
+            free(payload);
+            free(job);
+            pthread_mutex_lock(&admin_mutex);
+            ac->inflight--;
+            pthread_mutex_unlock(&admin_mutex);
+            if (!sent) return -1;
+        }
+    }
+    return ready < 0 ? -1 : 0;
+}
+
+static void* admin_loop(void *arg) {
+    int lfd = *(int*)arg;
+    free(arg);
+    struct pollfd *pfds = NULL;
+    AdminConn **owners = NULL;
+    int cap = 0;
+    while (1) {
+        // Snapshot the idle connections, reaping closed ones
+        pthread_mutex_lock(&admin_mutex);
+        int n = 2;
+        for (AdminConn *ac = admin_conns; ac; ac = ac->next) n++;
+        if (n > cap) {
+            cap = n * 2;
+            pfds = (struct pollfd*)realloc(pfds, cap * sizeof(struct pollfd));
+            owners = (AdminConn**)realloc(owners, cap * sizeof(AdminConn*));
+        }
+        pfds[0].fd = lfd; pfds[0].events = POLLIN; pfds[0].revents = 0;
+        pfds[1].fd = admin_wake_pipe[0]; pfds[1].events = POLLIN; pfds[1].revents = 0;
+        n = 2;
+        AdminConn **link = &admin_conns;
+        while (*link) {
+            AdminConn *ac = *link;
+            if (ac->closing && ac->inflight == 0) {
+                *link = ac->next;
+                net_conn_close(ac->conn);
+                pthread_mutex_destroy(&ac->send_mutex);
+                free(ac);
+                continue;
+            }
+            if (ac->closing) { link = &ac->next; continue; }
+            if (!ac->busy) {
+                pfds[n].fd = ac->conn->fd; pfds[n].events = POLLIN; pfds[n].revents = 0;
+                owners[n++] = ac;
+            }
+            link = &ac->next;
+        }
+        int timeout = admin_held ? 1000 : -1;
+        pthread_mutex_unlock(&admin_mutex);
+
+        int ready_fds = poll(pfds, n, timeout);
+        // Held jobs that waited too long run again to be refused; ones whose
+        // class has room (their first resubmit hit a full queue) just run
+        AdminHeld *due = NULL, **due_tail = &due;
+        time_t now = time(NULL);
+        pthread_mutex_lock(&admin_mutex);
+        for (AdminHeld **link = &admin_held; *link; ) {
+            AdminHeld *h = *link;
+            if (now >= h->until || h->limit->active < h->limit->max) {
+                *link = h->next;
+                h->next = NULL;
+                *due_tail = h;
+                due_tail = &h->next;
+            } else {
+                link = &h->next;
+            }
+        }
+        pthread_mutex_unlock(&admin_mutex);
+        while (due) {
+            AdminHeld *h = due;
+            due = h->next;
+            admin_resubmit(h);
+        }
+        if (ready_fds <= 0) continue;
+        if (pfds[1].revents) {
+            char drain[64];
+            if (read(admin_wake_pipe[0], drain, sizeof(drain)) < 0) { /* nothing queued */ }
+        }
+        if (pfds[0].revents & POLLIN) {
+            char ip[64]; uint16_t p; int al = net_accept(lfd, ip, sizeof(ip), &p);
+            AdminConn *ac = al >= 0 ? (AdminConn*)calloc(1, sizeof(AdminConn)) : NULL;
+            if (ac) ac->conn = net_conn_open(al);
+            if (ac && ac->conn) {
+                pthread_mutex_init(&ac->send_mutex, NULL);
+                ac->held.fn = admin_conn_job;
+                ac->held.arg = ac;
+                pthread_mutex_lock(&admin_mutex);
+                ac->next = admin_conns;
+                admin_conns = ac;
+                pthread_mutex_unlock(&admin_mutex);
+            } else {
+                free(ac);
+                if (al >= 0) net_close(al);
+            }
+        }
+        for (int i = 2; i < n; i++) {
+            if (!pfds[i].revents) continue;
+            AdminConn *ac = owners[i];
+            int rc = net_conn_fill_nowait(ac->conn);
+            if (ac->rpc) {
+                if (admin_rpc_queue(ac) != 0 || rc == 0 || rc == -1) {
+                    pthread_mutex_lock(&admin_mutex);
+                    ac->closing = 1;
+                    pthread_mutex_unlock(&admin_mutex);
+                }
+                continue;
+            }
+            int ready = net_conn_has_line(ac->conn, 1024);
+            if ((rc == 0 || rc == -1) && !ready) {
+                pthread_mutex_lock(&admin_mutex);
+                ac->closing = 1;
+                pthread_mutex_unlock(&admin_mutex);
+                continue;
+            }
+            if (!ready) continue;
+            pthread_mutex_lock(&admin_mutex);
+            ac->busy = 1;
+            pthread_mutex_unlock(&admin_mutex);
+            if (thread_pool_submit(admin_pool, admin_conn_job, ac) != 0) {
+                // Queue full: refuse what is buffered here and keep the
+                // connection, unless the peer can't take the refusal now
+                char line[1024];
+                int sent = 1;
+                while (sent && net_conn_has_line(ac->conn, sizeof(line)) &&
+                       net_conn_recv_line(ac->conn, line, sizeof(line)) > 0) {
+                    log_write("SS", "ADMIN_BUSY", "admin", line, -1);
+                    sent = net_send_line_nowait(ac->conn->fd, "ERR SS busy") == 0;
+                }
+                pthread_mutex_lock(&admin_mutex);
+                ac->busy = 0;
+                if (!sent) ac->closing = 1;
+                pthread_mutex_unlock(&admin_mutex);
+            }
+        }
+    }
+    return NULL;
 }
 
 static void print_ss_usage(const char *prog) {
-    printf("Usage: %s [--host IP] [--client-port PORT] [--admin-port PORT] [--nm-ip IP] [--nm-port PORT] [--ss-id NAME] [--advertise-ip IP] [--verbose]\n", prog);
-    printf("Defaults: host=0.0.0.0, client-port=9000, admin-port=9100, nm-ip=127.0.0.1, nm-port=8000\n");
+    printf("Usage: %s [--host IP] [--client-port PORT] [--admin-port PORT] [--nm-ip IP] [--nm-port PORT] [--ss-id NAME] [--advertise-ip IP] [--fiber-threads N] [--thread-per-conn] [--admin-workers N] [--admin-queue N] [--max-search N] [--max-bulk N] [--no-edit-log] [--undo-depth N] [--undo-budget-kb N] [--doc-cache-mb N] [--lock-lease-sec N] [--live-save-ms N] [--live-max-mb N] [--durability none|fsync|group] [--group-commit-ms N] [--no-frames] [--verbose]\n", prog);
+    printf("Defaults: host=0.0.0.0, client-port=9000, admin-port=9100, nm-ip=127.0.0.1, nm-port=8000, fiber-threads=4, admin-workers=8, admin-queue=64, max-search=2, max-bulk=4, undo-depth=16, undo-budget-kb=1024, doc-cache-mb=64, lock-lease-sec=120, live-save-ms=1000, live-max-mb=8, durability=group, group-commit-ms=0\n");
 }
 
 int main(int argc, char **argv) {
@@ -915,6 +2050,54 @@ int main(int argc, char **argv) {
     if (config_get_uint16("nm.port", &cfg_nm_port) && cfg_nm_port != 0) {
         nm_reg_port = cfg_nm_port;
     }
+    uint16_t cfg_val;
+    if (config_get_uint16("ss.fiber_threads", &cfg_val) && cfg_val != 0) {
+        fiber_threads = cfg_val;
+    }
+    if (config_get_uint16("ss.edit_log", &cfg_val)) {
+        edit_log_enabled = cfg_val != 0;
+    }
+    if (config_get_uint16("ss.undo_depth", &cfg_val)) {
+        undo_depth = cfg_val;
+    }
+    if (config_get_uint16("ss.undo_budget_kb", &cfg_val) && cfg_val != 0) {
+        undo_budget = (long)cfg_val * 1024;
+    }
+    if (config_get_uint16("ss.doc_cache_mb", &cfg_val)) {
+        doc_cache_mb = cfg_val;
+    }
+    if (config_get_uint16("ss.lock_lease_sec", &cfg_val)) {
+        lock_lease_sec = cfg_val;
+    }
+    if (config_get_uint16("ss.live_save_ms", &cfg_val)) {
+        live_save_ms = cfg_val;
+    }
+    if (config_get_uint16("ss.live_max_mb", &cfg_val)) {
+        live_max_mb = cfg_val;
+    }
+    char cfg_durability[16];
+    if (config_get_string("ss.durability", cfg_durability, sizeof(cfg_durability)) &&
+        durable_parse_mode(cfg_durability, &durability) != 0) {
+        fprintf(stderr, "SS WARN: unknown ss.durability '%s'\n", cfg_durability);
+    }
+    if (config_get_uint16("ss.group_commit_ms", &cfg_val)) {
+        group_commit_ms = cfg_val;
+    }
+    if (config_get_uint16("ss.thread_per_conn", &cfg_val)) {
+        ss_thread_per_conn = cfg_val != 0;
+    }
+    if (config_get_uint16("ss.admin_workers", &cfg_val) && cfg_val != 0) {
+        admin_workers = cfg_val;
+    }
+    if (config_get_uint16("ss.admin_queue", &cfg_val) && cfg_val != 0) {
+        admin_queue_max = cfg_val;
+    }
+    if (config_get_uint16("ss.max_search", &cfg_val) && cfg_val != 0) {
+        admin_limits[ADMIN_LIMIT_SEARCH].max = cfg_val;
+    }
+    if (config_get_uint16("ss.max_bulk", &cfg_val) && cfg_val != 0) {
+        admin_limits[ADMIN_LIMIT_BULK].max = cfg_val;
+    }
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--host") == 0 && i + 1 < argc) {
@@ -937,6 +2120,42 @@ int main(int argc, char **argv) {
             advertise_ip[sizeof(advertise_ip)-1] = '\0';
         } else if (strcmp(argv[i], "--verbose") == 0) {
             verbose = 1;
+        } else if (strcmp(argv[i], "--no-frames") == 0) {
+            frames_enabled = 0;
+        } else if (strcmp(argv[i], "--fiber-threads") == 0 && i + 1 < argc) {
+            fiber_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--thread-per-conn") == 0) {
+            ss_thread_per_conn = 1;
+        } else if (strcmp(argv[i], "--no-edit-log") == 0) {
+            edit_log_enabled = 0;
+        } else if (strcmp(argv[i], "--undo-depth") == 0 && i + 1 < argc) {
+            undo_depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--undo-budget-kb") == 0 && i + 1 < argc) {
+            undo_budget = atol(argv[++i]) * 1024;
+        } else if (strcmp(argv[i], "--doc-cache-mb") == 0 && i + 1 < argc) {
+            doc_cache_mb = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--lock-lease-sec") == 0 && i + 1 < argc) {
+            lock_lease_sec = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--live-save-ms") == 0 && i + 1 < argc) {
+            live_save_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--live-max-mb") == 0 && i + 1 < argc) {
+            live_max_mb = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--durability") == 0 && i + 1 < argc) {
+            if (durable_parse_mode(argv[++i], &durability) != 0) {
+                fprintf(stderr, "Unknown durability mode: %s\n", argv[i]);
+                print_ss_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--group-commit-ms") == 0 && i + 1 < argc) {
+            group_commit_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--admin-workers") == 0 && i + 1 < argc) {
+            admin_workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--admin-queue") == 0 && i + 1 < argc) {
+            admin_queue_max = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-search") == 0 && i + 1 < argc) {
+            admin_limits[ADMIN_LIMIT_SEARCH].max = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-bulk") == 0 && i + 1 < argc) {
+            admin_limits[ADMIN_LIMIT_BULK].max = atoi(argv[++i]);
         } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
             print_ss_usage(argv[0]);
             return 0;
@@ -950,22 +2169,87 @@ int main(int argc, char **argv) {
     if (admin_port == 0) {
         admin_port = client_port + 100;
     }
+    // Offsets into a live document are ints
+    if (live_max_mb < 1 || live_max_mb > 1024) live_max_mb = 8;
 
     net_set_verbose(verbose);
+#ifndef _WIN32
+    // A client or NM that hangs up mid-response must not kill the SS
+    signal(SIGPIPE, SIG_IGN);
+#endif
     mkpath(data_root);
     mkpath(undo_root);
     mkpath(checkpoint_root);
+    mkpath(index_root);
+    if (durable_init(durability, group_commit_ms) != 0) {
+        printf("SS WARN: group commit unavailable, syncing each write\n");
+    }
+    // Before the edit log: replayed commits refresh the cache too
+    doc_cache = doc_cache_create(doc_cache_mb * 1024 * 1024);
+    // Counts chunk references from every checkpoint (and drops orphans)
+    chunk_store = chunk_store_open(chunk_root, checkpoint_root);
+    if (!chunk_store) printf("SS WARN: chunk store unavailable, checkpoints disabled\n");
+    checkpoint_catalog = catalog_open(checkpoint_root, checkpoint_load);
+    undo_log = undo_log_open(undo_root, undo_depth, undo_budget);
+    if (!undo_log) printf("SS WARN: undo history unavailable\n");
+    if (edit_log_enabled) {
+        // Replays commits a crash kept from reaching the data files
+        edit_log = edit_log_open(edit_log_path, data_root, edit_log_applied, NULL);
+        if (!edit_log) printf("SS WARN: edit log unavailable, writing commits directly\n");
+    }
     
     // Initialize logging
     log_init("logs/ss.log");
     log_write("SS", "STARTUP", "SYSTEM", "Storage Server started", 0);
     
-    // Initialize locks table mutex for thread-safe concurrent access
-    pthread_mutex_init(&locks_table_mutex, NULL);
+    sentence_locks = lock_table_create(lock_lease_sec * 1000);
+    lock_table_on_expire(sentence_locks, lock_expired, NULL);
+    if (lock_lease_sec > 0) {
+        pthread_t reaper_thread;
+        if (pthread_create(&reaper_thread, NULL, lock_reaper, NULL) == 0) pthread_detach(reaper_thread);
+        else printf("SS WARN: lock reaper unavailable, leases won't expire\n");
+    }
+    collab_hub = collab_hub_create();
+    if (!collab_hub) { fprintf(stderr, "SS out of memory\n"); return 1; }
+    if (live_save_ms > 0) {
+        pthread_t saver_thread;
+        if (pthread_create(&saver_thread, NULL, live_saver, NULL) == 0) pthread_detach(saver_thread);
+        else printf("SS WARN: live saver unavailable, live edits are saved when their session ends\n");
+    }
+    const char *scratch_roots[] = { data_root, index_root, undo_root, checkpoint_root, chunk_root };
+    int swept = 0;
+    for (size_t i = 0; i < sizeof(scratch_roots) / sizeof(scratch_roots[0]); i++) swept += sweep_scratch_files(scratch_roots[i]);
+    if (swept > 0) {
+        char sweep_log[128]; snprintf(sweep_log, sizeof(sweep_log), "removed=%d", swept);
+        log_write("SS", "SCRATCH_SWEEP", "SYSTEM", sweep_log, 0);
+    }
+
+    if (!ss_thread_per_conn) {
+        client_sched = fiber_sched_create(fiber_threads, 4, 0);
+        if (client_sched) {
+            // Sockets owned by fibers are non-blocking; EAGAIN parks the fiber
+            net_set_wait_hook(fiber_net_wait);
+            printf("Serving clients as fibers on %d scheduler threads\n", fiber_threads);
+        } else {
+            printf("SS WARN: fiber scheduler unavailable, using a thread per client\n");
+        }
+    }
     
     int cfd = net_listen_addr(bind_host, client_port);
     int afd = net_listen_addr(bind_host, admin_port);
     if (cfd<0||afd<0){ fprintf(stderr, "SS failed to listen\n"); return 1; }
+
+    // Admin commands: own poll loop + bounded worker pool
+    for (int i = 0; i < (int)(sizeof(admin_limits)/sizeof(admin_limits[0])); i++) {
+        if (admin_limits[i].max < 1) admin_limits[i].max = 1;
+    }
+    admin_pool = thread_pool_create(admin_workers, admin_queue_max);
+    if (!admin_pool || pipe(admin_wake_pipe) != 0) { fprintf(stderr, "SS failed to start admin workers\n"); return 1; }
+    int *admin_listen_fd = (int*)malloc(sizeof(int));
+    *admin_listen_fd = afd;
+    pthread_t admin_thread;
+    if (pthread_create(&admin_thread, NULL, admin_loop, admin_listen_fd) != 0) { fprintf(stderr, "SS failed to start admin loop\n"); return 1; }
+    pthread_detach(admin_thread);
     printf("Storage Server registering to NM at %s:%u and listening for clients on %s:%u (admin %s:%u)\n",
            nm_ip, nm_reg_port, bind_host, client_port, bind_host, admin_port);
     // register with NM
@@ -1009,17 +2293,25 @@ int main(int argc, char **argv) {
     
     while (1) {
         fd_set rfds; FD_ZERO(&rfds);
-        int maxfd = (cfd>afd?cfd:afd);
-        FD_SET(cfd, &rfds); FD_SET(afd, &rfds);
+        int maxfd = cfd;
+        FD_SET(cfd, &rfds);
         struct timeval tv; tv.tv_sec=1; tv.tv_usec=0;
         int rc = select(maxfd+1, &rfds, NULL, NULL, &tv);
         if (rc > 0) {
             if (FD_ISSET(cfd, &rfds)) { 
                 char ip[64]; uint16_t p; int cl = net_accept(cfd, ip, sizeof(ip), &p); 
-                if (cl>=0) {
+                if (cl>=0 && client_sched) {
+                    int *client_fd = (int*)malloc(sizeof(int));
+                    *client_fd = cl;
+                    net_set_nonblocking(cl, 1);
+                    if (fiber_spawn(client_sched, client_conn_fiber, client_fd) != 0) {
+                        free(client_fd);
+                        net_close(cl);
+                    }
+                } else if (cl>=0) {
                     // Handle each client in a separate thread for true concurrency
                     // This allows multiple clients to edit different sentences simultaneously
-                    // All threads share the same lock table (file_locks array)
+                    // All threads share the same lock table (sentence_locks)
                     pthread_t thread;
                     int *client_fd = (int*)malloc(sizeof(int));
                     *client_fd = cl;
@@ -1033,10 +2325,6 @@ int main(int argc, char **argv) {
                     }
                 }
             }
-            if (FD_ISSET(afd, &rfds)) { 
-                char ip[64]; uint16_t p; int al = net_accept(afd, ip, sizeof(ip), &p); 
-                if (al>=0) handle_admin_conn(al); 
-            }
         }
     }
 }